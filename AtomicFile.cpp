@@ -0,0 +1,137 @@
+#include "AtomicFile.h"
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const int TEMP_ATTEMPTS = 16;   // Names taken by temp files left behind by a crash are skipped
+
+    std::atomic<unsigned long> nextTempId(0);
+
+    std::string MakeTempPath(const std::string& path) {
+#ifdef _WIN32
+        unsigned long pid = (unsigned long)GetCurrentProcessId();
+#else
+        unsigned long pid = (unsigned long)getpid();
+#endif
+        return path + "." + std::to_string(pid) + "." + std::to_string(nextTempId++) + ".tmp";
+    }
+
+#ifdef _WIN32
+    std::wstring ToWide(const std::string& text) {
+        int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), (int)text.size(), NULL, 0);
+        std::wstring wide(length, L'\0');
+        if (length > 0) {
+            MultiByteToWideChar(CP_UTF8, 0, text.data(), (int)text.size(), &wide[0], length);
+        }
+        return wide;
+    }
+
+    // Fails with ERROR_FILE_EXISTS if the temp file exists already
+    bool WriteTempFile(const std::wstring& path, const std::string& data, bool sync) {
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        bool ok = true;
+        size_t written = 0;
+        while (ok && written < data.size()) {
+            DWORD chunk = (DWORD)(data.size() - written < 0x40000000 ? data.size() - written : 0x40000000);
+            DWORD count = 0;
+            ok = WriteFile(file, data.data() + written, chunk, &count, NULL) && count > 0;
+            written += count;
+        }
+        if (ok && sync) {
+            ok = FlushFileBuffers(file) != 0;
+        }
+        return CloseHandle(file) && ok;
+    }
+#else
+    // Fails with EEXIST if the temp file exists already
+    bool WriteTempFile(const std::string& path, const std::string& data, bool sync) {
+        // The history may hold private data, so it is only readable by the user
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = true;
+        size_t written = 0;
+        while (ok && written < data.size()) {
+            ssize_t count = write(fd, data.data() + written, data.size() - written);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            ok = count > 0;
+            written += ok ? (size_t)count : 0;
+        }
+        if (ok && sync) {
+            ok = fsync(fd) == 0;
+        }
+        return close(fd) == 0 && ok;
+    }
+
+    // Makes the rename itself durable
+    bool SyncDirectory(const std::string& path) {
+        size_t separator = path.find_last_of('/');
+        std::string directory = separator == std::string::npos ? "." : separator == 0 ? "/" : path.substr(0, separator);
+        int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = fsync(fd) == 0;
+        close(fd);
+        return ok;
+    }
+#endif
+}
+
+bool WriteFileAtomically(const std::string& path, const std::string& data, bool sync) {
+#ifdef _WIN32
+    std::wstring widePath = ToWide(path);
+    std::wstring wideTempPath;
+    bool written = false;
+    for (int attempt = 0; attempt < TEMP_ATTEMPTS && !written; ++attempt) {
+        wideTempPath = ToWide(MakeTempPath(path));
+        written = WriteTempFile(wideTempPath, data, sync);
+        if (!written && GetLastError() != ERROR_FILE_EXISTS) {
+            DeleteFileW(wideTempPath.c_str());
+            return false;
+        }
+    }
+    if (!written) {
+        return false;
+    }
+    DWORD flags = MOVEFILE_REPLACE_EXISTING | (sync ? MOVEFILE_WRITE_THROUGH : 0);
+    if (!MoveFileExW(wideTempPath.c_str(), widePath.c_str(), flags)) {
+        DeleteFileW(wideTempPath.c_str());
+        return false;
+    }
+    return true;
+#else
+    std::string tempPath;
+    bool written = false;
+    for (int attempt = 0; attempt < TEMP_ATTEMPTS && !written; ++attempt) {
+        tempPath = MakeTempPath(path);
+        written = WriteTempFile(tempPath, data, sync);
+        if (!written && errno != EEXIST) {
+            unlink(tempPath.c_str());
+            return false;
+        }
+    }
+    if (!written) {
+        return false;
+    }
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        unlink(tempPath.c_str());
+        return false;
+    }
+    return !sync || SyncDirectory(path);
+#endif
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+// Replaces the contents of a file atomically: the data is written to a new
+// <path>.<pid>.<n>.tmp, which is then renamed over the file. A crash at any
+// point leaves either the complete old or the complete new contents (and
+// possibly the temp file). With sync, the data and the rename are flushed to
+// the disk before returning, so the same holds after a power loss. The temp
+// name is unique, so processes writing the same file at once (the manager
+// and clipboard_fsck --repair) never write into each other's temp file; the
+// last rename wins.
+// The path is UTF-8.
+bool WriteFileAtomically(const std::string& path, const std::string& data, bool sync);
@@ -0,0 +1,168 @@
+#include "CaptureScheduler.h"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+
+namespace {
+    // Fast checks after a copy shortcut, in ms after the key press
+    const int BURST_OFFSETS_MS[] = { 10, 50, 150 };
+    const size_t MAX_LATENCY_SAMPLES = 256;
+
+    double ElapsedMs(CaptureScheduler::Clock::time_point from, CaptureScheduler::Clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    double Average(const std::vector<double>& latencies) {
+        if (latencies.empty()) {
+            return 0.0;
+        }
+        double total = 0.0;
+        for (double ms : latencies) {
+            total += ms;
+        }
+        return total / latencies.size();
+    }
+}
+
+CaptureScheduler::CaptureScheduler()
+    : m_startTime(Clock::now()),
+      m_hintPending(false),
+      m_notificationPending(false),
+      m_idleInterval(MIN_IDLE_INTERVAL_MS),
+      m_wakeups(0),
+      m_hints(0),
+      m_hintedCaptures(0),
+      m_polledCaptures(0),
+      m_notifications(0),
+      m_notifiedCaptures(0),
+      m_latencyPos(0),
+      m_notificationLatencyPos(0) {
+}
+
+int CaptureScheduler::OnPoll(bool captured) {
+    m_wakeups++;
+    Clock::time_point now = Clock::now();
+    // A notification is followed by one check, right away
+    bool notified = m_notificationPending;
+    m_notificationPending = false;
+
+    if (m_hintPending && ElapsedMs(m_hintTime, now) > HINT_TIMEOUT_MS) {
+        m_hintPending = false;
+        m_burst.clear();
+    }
+
+    if (captured) {
+        if (notified) {
+            m_notifiedCaptures++;
+            RecordLatency(m_notificationLatencies, m_notificationLatencyPos, ElapsedMs(m_notificationTime, now));
+        }
+        if (m_hintPending) {
+            m_hintedCaptures++;
+            RecordLatency(m_latencies, m_latencyPos, ElapsedMs(m_hintTime, now));
+        } else if (!notified) {
+            m_polledCaptures++;
+        }
+        m_hintPending = false;
+        m_burst.clear();
+        m_idleInterval = MIN_IDLE_INTERVAL_MS;
+        return m_idleInterval;
+    }
+
+    if (!m_burst.empty()) {
+        return NextBurstDelay();
+    }
+
+    if (m_hintPending) {
+        // Burst finished without a change; keep checking at the fast idle rate
+        m_idleInterval = MIN_IDLE_INTERVAL_MS;
+        return m_idleInterval;
+    }
+
+    // Nothing happened: back off exponentially
+    int delay = m_idleInterval;
+    m_idleInterval = std::min(m_idleInterval * 2, (int)MAX_IDLE_INTERVAL_MS);
+    return delay;
+}
+
+int CaptureScheduler::OnCopyHint() {
+    m_hints++;
+    m_hintTime = Clock::now();
+    m_hintPending = true;
+    m_burst.assign(std::begin(BURST_OFFSETS_MS), std::end(BURST_OFFSETS_MS));
+    return NextBurstDelay();
+}
+
+void CaptureScheduler::OnChangeNotification() {
+    m_notifications++;
+    m_notificationTime = Clock::now();
+    m_notificationPending = true;
+}
+
+int CaptureScheduler::NextBurstDelay() {
+    double elapsed = ElapsedMs(m_hintTime, Clock::now());
+    while (!m_burst.empty()) {
+        int offset = m_burst.front();
+        m_burst.pop_front();
+        if (offset > elapsed) {
+            return std::max(1, (int)(offset - elapsed));
+        }
+    }
+    return 1;
+}
+
+void CaptureScheduler::RecordLatency(std::vector<double>& latencies, size_t& pos, double ms) {
+    if (latencies.size() < MAX_LATENCY_SAMPLES) {
+        latencies.push_back(ms);
+    } else {
+        latencies[pos] = ms;
+        pos = (pos + 1) % MAX_LATENCY_SAMPLES;
+    }
+}
+
+double CaptureScheduler::GetWakeupsPerHour() const {
+    double hours = ElapsedMs(m_startTime, Clock::now()) / 3600000.0;
+    if (hours <= 0.0) {
+        return 0.0;
+    }
+    return m_wakeups / hours;
+}
+
+double CaptureScheduler::GetAverageLatencyMs() const {
+    return Average(m_latencies);
+}
+
+double CaptureScheduler::GetAverageNotificationLatencyMs() const {
+    return Average(m_notificationLatencies);
+}
+
+double CaptureScheduler::GetLatencyPercentileMs(double percentile) const {
+    if (m_latencies.empty()) {
+        return 0.0;
+    }
+    std::vector<double> sorted(m_latencies);
+    std::sort(sorted.begin(), sorted.end());
+    size_t index = (size_t)(percentile / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+std::string CaptureScheduler::FormatStats() const {
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer),
+             "Wakeups: %zu (%.0f/hour)\n"
+             "Idle interval: %d ms\n"
+             "Copy shortcuts seen: %zu\n"
+             "Captures after shortcut: %zu\n"
+             "Captures by polling: %zu\n"
+             "Capture latency after shortcut: avg %.1f ms, p95 %.1f ms\n"
+             "Change notifications: %zu\n"
+             "Captures after notification: %zu (avg %.1f ms)",
+             m_wakeups, GetWakeupsPerHour(),
+             m_idleInterval,
+             m_hints,
+             m_hintedCaptures,
+             m_polledCaptures,
+             GetAverageLatencyMs(), GetLatencyPercentileMs(95.0),
+             m_notifications,
+             m_notifiedCaptures, GetAverageNotificationLatencyMs());
+    return buffer;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Decides when the clipboard should be checked next.
+// Idle polling backs off exponentially; a copy shortcut schedules a short
+// burst of fast checks so the change is captured with minimal latency.
+class CaptureScheduler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    CaptureScheduler();
+
+    // Called after every clipboard check, returns the delay (ms) until the next one
+    int OnPoll(bool captured);
+    // Called when a copy shortcut is seen, returns the delay (ms) until the first burst check
+    int OnCopyHint();
+    // Called when the system reports a clipboard change, before it is checked.
+    // Counted apart from copy shortcuts, with its own latency to the capture
+    void OnChangeNotification();
+
+    double GetWakeupsPerHour() const;
+    double GetAverageLatencyMs() const;
+    double GetLatencyPercentileMs(double percentile) const;
+    size_t GetWakeupCount() const { return m_wakeups; }
+    size_t GetHintCount() const { return m_hints; }
+    size_t GetHintedCaptureCount() const { return m_hintedCaptures; }
+    size_t GetPolledCaptureCount() const { return m_polledCaptures; }
+    size_t GetNotificationCount() const { return m_notifications; }
+    size_t GetNotifiedCaptureCount() const { return m_notifiedCaptures; }
+    double GetAverageNotificationLatencyMs() const;
+    int GetCurrentIdleInterval() const { return m_idleInterval; }
+
+    std::string FormatStats() const;
+
+    static const int MIN_IDLE_INTERVAL_MS = 500;    // Interval right after activity
+    static const int MAX_IDLE_INTERVAL_MS = 4000;   // Ceiling for the idle back-off
+    static const int HINT_TIMEOUT_MS = 1000;        // Captures later than this are not attributed to a hint
+
+private:
+    int NextBurstDelay();
+    static void RecordLatency(std::vector<double>& latencies, size_t& pos, double ms);
+
+    Clock::time_point m_startTime;
+    Clock::time_point m_hintTime;
+    bool m_hintPending;
+    Clock::time_point m_notificationTime;
+    bool m_notificationPending;
+    std::deque<int> m_burst;          // Remaining burst offsets (ms after the hint)
+    int m_idleInterval;
+
+    size_t m_wakeups;
+    size_t m_hints;
+    size_t m_hintedCaptures;
+    size_t m_polledCaptures;
+    size_t m_notifications;
+    size_t m_notifiedCaptures;
+    std::vector<double> m_latencies;  // Ring buffer of recent hint-to-capture latencies
+    size_t m_latencyPos;
+    std::vector<double> m_notificationLatencies;  // Ring buffer of recent notification-to-capture latencies
+    size_t m_notificationLatencyPos;
+};
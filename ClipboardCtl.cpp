@@ -0,0 +1,236 @@
+// clipboard_ctl: command line client for the control endpoint of a running
+// Clipboard Manager (see ControlServer.h).
+//
+//     clipboard_ctl [--endpoint <path>] list [count]
+//     clipboard_ctl [--endpoint <path>] search [-n <count>] <query...>
+//     clipboard_ctl [--endpoint <path>] get <id>
+//     clipboard_ctl [--endpoint <path>] restore <id>
+//     clipboard_ctl [--endpoint <path>] range <from> <to>
+//     clipboard_ctl [--endpoint <path>] export [--from <time>] [--to <time>] <file>
+//     clipboard_ctl [--endpoint <path>] import <file>
+//     clipboard_ctl [--endpoint <path>] stats
+//     clipboard_ctl [--endpoint <path>] bench [--clients <n>] [--requests <n>] [request...]
+
+#include "ControlServer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#define getcwd _getcwd
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+    const char* USAGE =
+        "usage: clipboard_ctl [--endpoint <path>] <command>\n"
+        "  list [count]                   newest entries\n"
+        "  search [-n <count>] <query>    fuzzy search, best first\n"
+        "  get <id>                       print the full content of an entry\n"
+        "  restore <id>                   put an entry back on the clipboard\n"
+        "  range <from> <to>              entries captured in a time range, oldest first\n"
+        "  export [--from <time>] [--to <time>] <file>\n"
+        "                                 write the history (or a time range) as JSON Lines\n"
+        "  import <file>                  add the entries of a JSON Lines file\n"
+        "  stats                          history, server and memory statistics\n"
+        "  bench [--clients <n>] [--requests <n>] [request]\n"
+        "                                 concurrent throughput (default request: search 20 e)\n"
+        "times: YYYY-MM-DD[THH:MM[:SS]] (local), @<unix time> or - for an open end\n";
+
+    int Usage() {
+        fputs(USAGE, stderr);
+        return 2;
+    }
+
+    // The manager may run in another directory
+    std::string AbsolutePath(const std::string& path) {
+#ifdef _WIN32
+        bool absolute = path.size() > 1 && (path[1] == ':' || (path[0] == '\\' && path[1] == '\\'));
+        const char* separator = "\\";
+#else
+        bool absolute = !path.empty() && path[0] == '/';
+        const char* separator = "/";
+#endif
+        char directory[4096];
+        if (absolute || !getcwd(directory, sizeof(directory))) {
+            return path;
+        }
+        return std::string(directory) + separator + path;
+    }
+
+    // Times contain no spaces on the wire
+    std::string TimeArgument(std::string time) {
+        std::replace(time.begin(), time.end(), ' ', 'T');
+        return time;
+    }
+
+    std::string Join(const std::vector<std::string>& words, size_t first) {
+        std::string joined;
+        for (size_t i = first; i < words.size(); ++i) {
+            joined += (i > first ? " " : "") + words[i];
+        }
+        return joined;
+    }
+
+    int RunRequest(const std::string& endpoint, const std::string& request, bool contentOnly) {
+        ControlClient client;
+        if (!client.Connect(endpoint)) {
+            fprintf(stderr, "clipboard_ctl: cannot connect to %s (is Clipboard Manager running?)\n", endpoint.c_str());
+            return 1;
+        }
+        std::string status;
+        std::vector<std::string> lines;
+        if (!client.Request(request, status, lines)) {
+            fprintf(stderr, "clipboard_ctl: connection lost\n");
+            return 1;
+        }
+        if (status.compare(0, 3, "OK ") != 0) {
+            fprintf(stderr, "clipboard_ctl: %s\n", status.c_str());
+            return 1;
+        }
+        for (const auto& line : lines) {
+            if (contentOnly) {
+                // id|timestamp|type|content
+                size_t separator = 0;
+                for (int field = 0; field < 3 && separator != std::string::npos; ++field) {
+                    separator = line.find('|', separator == 0 ? 0 : separator + 1);
+                }
+                std::string content = separator == std::string::npos ? line : line.substr(separator + 1);
+                fputs(ControlServer::UnescapeContent(content).c_str(), stdout);
+            } else {
+                puts(line.c_str());
+            }
+        }
+        return 0;
+    }
+
+    int RunBenchmark(const std::string& endpoint, size_t clientCount, size_t requestCount, const std::string& request) {
+        std::vector<std::vector<double> > latencies(clientCount);
+        std::vector<int> failures(clientCount, 0);
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t c = 0; c < clientCount; ++c) {
+            threads.push_back(std::thread([&, c]() {
+                ControlClient client;
+                if (!client.Connect(endpoint)) {
+                    failures[c] = (int)requestCount;
+                    return;
+                }
+                std::string status;
+                std::vector<std::string> lines;
+                latencies[c].reserve(requestCount);
+                for (size_t i = 0; i < requestCount; ++i) {
+                    auto begin = std::chrono::steady_clock::now();
+                    if (!client.Request(request, status, lines) || status.compare(0, 3, "OK ") != 0) {
+                        failures[c]++;
+                        continue;
+                    }
+                    latencies[c].push_back(std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - begin).count());
+                }
+            }));
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> all;
+        int failed = 0;
+        for (size_t c = 0; c < clientCount; ++c) {
+            all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+            failed += failures[c];
+        }
+        if (all.empty()) {
+            fprintf(stderr, "clipboard_ctl: no request succeeded\n");
+            return 1;
+        }
+        std::sort(all.begin(), all.end());
+        auto percentile = [&all](double p) { return all[std::min(all.size() - 1, (size_t)(p * all.size()))]; };
+        printf("request:     %s\n", request.c_str());
+        printf("clients:     %lu\n", (unsigned long)clientCount);
+        printf("requests:    %lu ok, %d failed in %.2f s\n", (unsigned long)all.size(), failed, elapsedSeconds);
+        printf("throughput:  %.0f requests/s\n", all.size() / elapsedSeconds);
+        printf("latency ms:  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+               percentile(0.50), percentile(0.95), percentile(0.99), all.back());
+        return failed ? 1 : 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    std::string endpoint = ControlServer::GetDefaultEndpoint();
+    if (args.size() >= 2 && args[0] == "--endpoint") {
+        endpoint = args[1];
+        args.erase(args.begin(), args.begin() + 2);
+    }
+    if (args.empty()) {
+        return Usage();
+    }
+
+    const std::string& command = args[0];
+    if (command == "list" && args.size() <= 2) {
+        return RunRequest(endpoint, Join(args, 0), false);
+    }
+    if (command == "search" && args.size() >= 2) {
+        std::string count = "20";
+        size_t first = 1;
+        if (args[1] == "-n" && args.size() >= 4) {
+            count = args[2];
+            first = 3;
+        }
+        return RunRequest(endpoint, "search " + count + " " + Join(args, first), false);
+    }
+    if ((command == "get" || command == "restore") && args.size() == 2) {
+        return RunRequest(endpoint, command + " " + args[1], command == "get");
+    }
+    if (command == "range" && args.size() == 3) {
+        return RunRequest(endpoint, "range " + TimeArgument(args[1]) + " " + TimeArgument(args[2]), false);
+    }
+    if (command == "export" && args.size() >= 2) {
+        std::string from = "-";
+        std::string to = "-";
+        size_t i = 1;
+        for (; i + 1 < args.size(); i += 2) {
+            if (args[i] == "--from") {
+                from = TimeArgument(args[i + 1]);
+            } else if (args[i] == "--to") {
+                to = TimeArgument(args[i + 1]);
+            } else {
+                break;
+            }
+        }
+        if (i + 1 != args.size()) {
+            return Usage();
+        }
+        return RunRequest(endpoint, "export " + from + " " + to + " " + AbsolutePath(args[i]), false);
+    }
+    if (command == "import" && args.size() == 2) {
+        return RunRequest(endpoint, "import " + AbsolutePath(args[1]), false);
+    }
+    if (command == "stats" && args.size() == 1) {
+        return RunRequest(endpoint, command, false);
+    }
+    if (command == "bench") {
+        size_t clients = 8;
+        size_t requests = 1000;
+        size_t i = 1;
+        for (; i + 1 < args.size() && args[i].compare(0, 2, "--") == 0; i += 2) {
+            if (args[i] == "--clients") {
+                clients = (size_t)std::max(atoi(args[i + 1].c_str()), 1);
+            } else if (args[i] == "--requests") {
+                requests = (size_t)std::max(atoi(args[i + 1].c_str()), 1);
+            } else {
+                return Usage();
+            }
+        }
+        std::string request = i < args.size() ? Join(args, i) : "search 20 e";
+        return RunBenchmark(endpoint, clients, requests, request);
+    }
+    return Usage();
+}
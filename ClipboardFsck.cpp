@@ -0,0 +1,895 @@
+// clipboard_fsck: checks the history file and the images and captured
+// formats it refers to, and optionally repairs them. Runs without the
+// manager, e.g. from a nightly maintenance job.
+//
+//     clipboard_fsck [--dir <directory>] [--threads <n>] [--repair] [--quiet]
+//
+// The history file is memory-mapped and split into chunks at line breaks
+// that the worker threads take in turn; every record is parsed, its
+// compressed content fully decoded and, with the key, its sealed part
+// opened. The files in clipboard_images/ and clipboard_payloads/ and every
+// file a record names are then checked in parallel: PNG files must have a
+// valid chunk structure (CRCs, IHDR first, IDAT with a zlib header, IEND
+// last) and sealed files must open.
+//
+// --repair (refused while the manager runs):
+//   - records that can't be parsed, have a bad time, corrupt compressed
+//     content or a missing or undecodable image are moved to
+//     clipboard_history.txt.rejected
+//   - captured formats whose file is missing or corrupt are removed from
+//     their record
+//   - files no record refers to are moved to clipboard_orphans/
+// Sealed records that don't open are kept, as the manager keeps them.
+//
+// Exit status, as fsck: 0 no problems, 1 problems repaired, 4 problems
+// left, 8 operational error, 16 usage error.
+
+#include "AtomicFile.h"
+#include "ControlServer.h"
+#include "HistoryRecord.h"
+#include "StorageCipher.h"
+#include "TextCompressor.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    const char* USAGE =
+        "usage: clipboard_fsck [--dir <directory>] [--threads <n>] [--repair] [--quiet]\n"
+        "  --dir <directory>   where the history is (default: current directory)\n"
+        "  --threads <n>       worker threads (default: all cores)\n"
+        "  --repair            drop broken records, remove broken references, move orphaned files\n"
+        "  --quiet             only print the summary\n"
+        "sealed records and files are checked with the key in clipboard_history.key; a passphrase\n"
+        "is taken from CLIPBOARD_MANAGER_PASSPHRASE\n";
+
+    const char* HISTORY_FILE = "clipboard_history.txt";
+    const char* REJECTED_FILE = "clipboard_history.txt.rejected";
+    const char* KEY_FILE = "clipboard_history.key";
+    const char* IMAGE_DIR = "clipboard_images";
+    const char* PAYLOAD_DIR = "clipboard_payloads";
+    const char* ORPHAN_DIR = "clipboard_orphans";
+    const char* SEALED_FILE_SUFFIX = ".enc";
+
+    const int EXIT_CLEAN = 0;
+    const int EXIT_REPAIRED = 1;
+    const int EXIT_PROBLEMS_LEFT = 4;
+    const int EXIT_FAILED = 8;
+    const int EXIT_USAGE = 16;
+
+    const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+    enum Action {
+        ACTION_NONE,        // Reported only
+        ACTION_DROP,        // Record moved to the rejected file
+        ACTION_REWRITE      // Record written back with the changes in its RecordRepair
+    };
+
+    // A line of the history file with a problem
+    struct Finding {
+        uint64_t line;      // Within the chunk during the scan, in the file afterwards
+        uint64_t offset;    // Of the line in the file
+        size_t length;      // Without the line break
+        std::string message;
+        Action action;
+    };
+
+    // A file named by a record
+    struct Reference {
+        std::string path;
+        bool image;         // img attribute; otherwise a captured format
+        int width;          // Images only, 0 if not recorded
+        int height;
+        std::string size;   // Captured formats: size the record gives
+        uint64_t line;
+        uint64_t offset;
+        size_t length;
+    };
+
+    struct Chunk {
+        uint64_t begin;
+        uint64_t end;
+        uint64_t lines;
+        uint64_t records;
+        uint64_t sealedUnverified;   // Sealed records that could not be opened for lack of a key
+        std::vector<Finding> findings;
+        std::vector<Reference> references;
+    };
+
+    // Changes to a record that is kept
+    struct RecordRepair {
+        std::set<std::string> brokenFormats;   // Paths of captured formats to remove
+        int width;                             // Image size to record, 0 to keep it
+        int height;
+    };
+
+    struct FileCheck {
+        std::string path;   // Relative, with '/', as records name it
+        bool exists;
+        bool listed;        // Found in one of the directories
+        bool verified;      // False for sealed files without a key
+        std::string problem;
+        uint64_t size;      // Of the contents, opened for sealed files; known if verified
+        int width;          // PNG files
+        int height;
+    };
+
+    // Read-only view of a whole file
+    class MappedFile {
+    public:
+        MappedFile() : m_data(nullptr), m_size(0) {
+#ifdef _WIN32
+            m_file = INVALID_HANDLE_VALUE;
+            m_mapping = NULL;
+#else
+            m_fd = -1;
+#endif
+        }
+
+        ~MappedFile() {
+            Close();
+        }
+
+        void Close() {
+#ifdef _WIN32
+            if (m_data) {
+                UnmapViewOfFile(m_data);
+            }
+            if (m_mapping) {
+                CloseHandle(m_mapping);
+            }
+            if (m_file != INVALID_HANDLE_VALUE) {
+                CloseHandle(m_file);
+            }
+            m_mapping = NULL;
+            m_file = INVALID_HANDLE_VALUE;
+#else
+            if (m_data) {
+                munmap((void*)m_data, m_size);
+            }
+            if (m_fd >= 0) {
+                close(m_fd);
+            }
+            m_fd = -1;
+#endif
+            m_data = nullptr;
+            m_size = 0;
+        }
+
+        bool Open(const fs::path& path) {
+#ifdef _WIN32
+            m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                 FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            LARGE_INTEGER size;
+            if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size)) {
+                return false;
+            }
+            m_size = (size_t)size.QuadPart;
+            if (m_size == 0) {
+                return true;
+            }
+            m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+            m_data = m_mapping ? (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+            m_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat info;
+            if (m_fd < 0 || fstat(m_fd, &info) != 0) {
+                return false;
+            }
+            m_size = (size_t)info.st_size;
+            if (m_size == 0) {
+                return true;
+            }
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+            m_data = data != MAP_FAILED ? (const char*)data : nullptr;
+            if (m_data) {
+                // Every page is read once, front to back within each chunk
+                madvise(data, m_size, MADV_SEQUENTIAL);
+            }
+#endif
+            return m_data != nullptr;
+        }
+
+        const char* GetData() const { return m_data; }
+        size_t GetSize() const { return m_size; }
+
+    private:
+        const char* m_data;
+        size_t m_size;
+#ifdef _WIN32
+        HANDLE m_file;
+        HANDLE m_mapping;
+#else
+        int m_fd;
+#endif
+    };
+
+    int Usage() {
+        fputs(USAGE, stderr);
+        return EXIT_USAGE;
+    }
+
+    bool EndsWith(const std::string& text, const std::string& suffix) {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    bool ReadWholeFile(const std::string& path, std::string& data) {
+        std::ifstream file(fs::u8path(path), std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return !file.bad();
+    }
+
+    int ReadDigits(const std::string& text, size_t position, size_t count) {
+        int value = 0;
+        for (size_t i = position; i < position + count; ++i) {
+            if (text[i] < '0' || text[i] > '9') {
+                return -1;
+            }
+            value = value * 10 + (text[i] - '0');
+        }
+        return value;
+    }
+
+    // "%Y-%m-%d %H:%M:%S", as the manager writes it. Checked field by field:
+    // TimeIndex::ParseTime goes through mktime, which takes a process-wide
+    // lock and would serialize the workers.
+    bool IsValidTimestamp(const std::string& timestamp) {
+        static const int DAYS[12] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+        if (timestamp.size() != 19 || timestamp[4] != '-' || timestamp[7] != '-' || timestamp[10] != ' ' ||
+            timestamp[13] != ':' || timestamp[16] != ':') {
+            return false;
+        }
+        int year = ReadDigits(timestamp, 0, 4);
+        int month = ReadDigits(timestamp, 5, 2);
+        int day = ReadDigits(timestamp, 8, 2);
+        int hour = ReadDigits(timestamp, 11, 2);
+        int minute = ReadDigits(timestamp, 14, 2);
+        int second = ReadDigits(timestamp, 17, 2);
+        if (year < 1970 || month < 1 || month > 12 || day < 1 || day > DAYS[month - 1] || hour < 0 || hour > 23 ||
+            minute < 0 || minute > 59 || second < 0 || second > 60) {
+            return false;
+        }
+        bool leapYear = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+        return month != 2 || day < 29 || leapYear;
+    }
+
+    uint32_t Crc32(const unsigned char* data, size_t size) {
+        static const std::vector<uint32_t> table = []() {
+            std::vector<uint32_t> entries(256);
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit) {
+                    crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+                }
+                entries[i] = crc;
+            }
+            return entries;
+        }();
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; ++i) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    uint32_t ReadBigEndian32(const unsigned char* data) {
+        return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+    }
+
+    // Chunk structure of a PNG file; the image data itself is not inflated
+    bool CheckPng(const std::string& file, int& width, int& height, std::string& problem) {
+        static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        const unsigned char* data = (const unsigned char*)file.data();
+        if (file.size() < sizeof(SIGNATURE) || memcmp(data, SIGNATURE, sizeof(SIGNATURE)) != 0) {
+            problem = "not a PNG file";
+            return false;
+        }
+        size_t position = sizeof(SIGNATURE);
+        bool first = true;
+        bool hasData = false;
+        while (position + 12 <= file.size()) {
+            uint32_t length = ReadBigEndian32(data + position);
+            if (length > file.size() - position - 12) {
+                break;
+            }
+            const unsigned char* type = data + position + 4;
+            const unsigned char* body = type + 4;
+            if (Crc32(type, length + 4) != ReadBigEndian32(body + length)) {
+                problem = "PNG chunk " + std::string((const char*)type, 4) + " fails its CRC";
+                return false;
+            }
+            if (first) {
+                if (memcmp(type, "IHDR", 4) != 0 || length != 13) {
+                    problem = "PNG file does not start with IHDR";
+                    return false;
+                }
+                width = (int)ReadBigEndian32(body);
+                height = (int)ReadBigEndian32(body + 4);
+                first = false;
+            } else if (memcmp(type, "IDAT", 4) == 0 && !hasData) {
+                // zlib stream: deflate, and the header check bits
+                if (length < 2 || (body[0] & 0x0F) != 8 || ((body[0] << 8) | body[1]) % 31 != 0) {
+                    problem = "PNG image data has no valid zlib header";
+                    return false;
+                }
+                hasData = true;
+            } else if (memcmp(type, "IEND", 4) == 0) {
+                if (!hasData) {
+                    problem = "PNG file has no image data";
+                    return false;
+                }
+                return true;
+            }
+            position += 12 + (size_t)length;
+        }
+        problem = "PNG file is truncated";
+        return false;
+    }
+
+    void CheckFile(const StorageCipher* cipher, FileCheck& check) {
+        std::error_code error;
+        check.exists = fs::is_regular_file(fs::u8path(check.path), error);
+        if (!check.exists) {
+            return;
+        }
+        std::string data;
+        if (!ReadWholeFile(check.path, data)) {
+            check.problem = "unreadable";
+            return;
+        }
+        std::string name = check.path;
+        if (EndsWith(name, SEALED_FILE_SUFFIX)) {
+            name.resize(name.size() - strlen(SEALED_FILE_SUFFIX));
+            if (!cipher) {
+                check.verified = false;
+                return;
+            }
+            // Sealed with the path the record names as associated data
+            std::string opened;
+            if (!cipher->Open(data, check.path, opened)) {
+                check.problem = "sealed file does not open (modified, renamed or sealed with another key)";
+                return;
+            }
+            data.swap(opened);
+        }
+        check.size = data.size();
+        if (EndsWith(name, ".png")) {
+            CheckPng(data, check.width, check.height, check.problem);
+        }
+    }
+
+    // Splits "format:size:path"
+    std::string GetPayloadPath(const std::string& value, std::string& format, std::string* size = nullptr) {
+        size_t first = value.find(':');
+        size_t second = first == std::string::npos ? std::string::npos : value.find(':', first + 1);
+        format = value.substr(0, first);
+        if (size) {
+            *size = second == std::string::npos ? std::string() : value.substr(first + 1, second - first - 1);
+        }
+        return second == std::string::npos ? std::string() : value.substr(second + 1);
+    }
+
+    void AddFinding(Chunk& chunk, uint64_t offset, size_t length, const std::string& message, Action action) {
+        Finding finding;
+        finding.line = chunk.lines;
+        finding.offset = offset;
+        finding.length = length;
+        finding.message = message;
+        finding.action = action;
+        chunk.findings.push_back(finding);
+    }
+
+    void CheckRecord(const StorageCipher* cipher, Chunk& chunk, const std::string& line, uint64_t offset) {
+        HistoryRecord record;
+        if (!ParseHistoryRecord(line, record)) {
+            AddFinding(chunk, offset, line.size(), "malformed record (fewer than three fields or a bad attribute)",
+                       ACTION_DROP);
+            return;
+        }
+        if (!IsValidTimestamp(record.timestamp)) {
+            AddFinding(chunk, offset, line.size(), "bad timestamp \"" + record.timestamp + "\"", ACTION_DROP);
+            return;
+        }
+        if (record.FindAttribute("enc")) {
+            if (!cipher) {
+                chunk.sealedUnverified++;
+                return;
+            }
+            HistoryRecord sealed = record;
+            std::string opened;
+            if (!cipher->Open(sealed.content, GetSealedRecordAssociatedData(sealed), opened) ||
+                !ParseOpenedRecord(sealed, opened, record)) {
+                AddFinding(chunk, offset, line.size(),
+                           "sealed record does not open (modified, moved or sealed with another key)", ACTION_NONE);
+                return;
+            }
+        }
+        if (const std::string* compression = record.FindAttribute("lz")) {
+            CompressedText compressed;
+            compressed.data.swap(record.content);
+            compressed.dictionary = atoi(compression->c_str());
+            size_t separator = compression->find(':');
+            compressed.size = separator != std::string::npos ? strtoul(compression->c_str() + separator + 1, NULL, 10) : 0;
+            std::string text;
+            if (!TextCompressor::Decompress(compressed, text) || text.size() != compressed.size) {
+                AddFinding(chunk, offset, line.size(), "compressed content is corrupt", ACTION_DROP);
+                return;
+            }
+        }
+
+        Reference reference;
+        reference.line = chunk.lines;
+        reference.offset = offset;
+        reference.length = line.size();
+        if (const std::string* imagePath = record.FindAttribute("img")) {
+            const std::string* width = record.FindAttribute("w");
+            const std::string* height = record.FindAttribute("h");
+            reference.path = *imagePath;
+            reference.image = true;
+            reference.width = width ? atoi(width->c_str()) : 0;
+            reference.height = height ? atoi(height->c_str()) : 0;
+            chunk.references.push_back(reference);
+        }
+        for (const std::string& value : record.FindAttributes("fmt")) {
+            std::string format;
+            reference.path = GetPayloadPath(value, format, &reference.size);
+            reference.image = false;
+            reference.width = 0;
+            reference.height = 0;
+            // Metadata-only formats have no file
+            if (!reference.path.empty()) {
+                chunk.references.push_back(reference);
+            }
+        }
+    }
+
+    void ScanChunk(const char* data, const StorageCipher* cipher, Chunk& chunk) {
+        uint64_t position = chunk.begin;
+        std::string line;
+        while (position < chunk.end) {
+            const char* start = data + position;
+            const char* newline = (const char*)memchr(start, '\n', (size_t)(chunk.end - position));
+            size_t length = newline ? (size_t)(newline - start) : (size_t)(chunk.end - position);
+            size_t contentLength = length;
+            // Files written by wxTextFile on Windows end lines with CR LF
+            if (contentLength > 0 && start[contentLength - 1] == '\r') {
+                contentLength--;
+            }
+            // Blank lines are skipped by the manager and carry nothing
+            if (contentLength > 0) {
+                line.assign(start, contentLength);
+                chunk.records++;
+                CheckRecord(cipher, chunk, line, position);
+            }
+            chunk.lines++;
+            position += length + 1;
+        }
+    }
+
+    std::vector<Chunk> SplitIntoChunks(const char* data, uint64_t size, size_t threadCount) {
+        // Several chunks per thread, so a few huge records don't leave the other threads idle
+        uint64_t target = std::max<uint64_t>(size / (threadCount * 8) + 1, MIN_CHUNK_BYTES);
+        std::vector<Chunk> chunks;
+        uint64_t begin = 0;
+        while (begin < size) {
+            uint64_t end = std::min(begin + target, size);
+            if (end < size) {
+                const char* newline = (const char*)memchr(data + end, '\n', (size_t)(size - end));
+                end = newline ? (uint64_t)(newline - data) + 1 : size;
+            }
+            Chunk chunk = Chunk();
+            chunk.begin = begin;
+            chunk.end = end;
+            chunks.push_back(chunk);
+            begin = end;
+        }
+        return chunks;
+    }
+
+    // Runs work(i) for every i below count on threadCount threads
+    template <typename Work>
+    void RunParallel(size_t count, size_t threadCount, const Work& work) {
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < std::min(threadCount, count); ++t) {
+            threads.push_back(std::thread([&]() {
+                for (size_t i = next++; i < count; i = next++) {
+                    work(i);
+                }
+            }));
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void ListDirectory(const char* directory, std::vector<std::string>& paths) {
+        std::error_code error;
+        for (fs::directory_iterator it(fs::u8path(directory), error), end; !error && it != end; it.increment(error)) {
+            if (it->is_regular_file(error)) {
+                paths.push_back(std::string(directory) + "/" + it->path().filename().u8string());
+            }
+        }
+    }
+
+    // Formatted record with the changes applied; sealed again if it was sealed
+    bool RepairRecord(const StorageCipher* cipher, const std::string& line, const RecordRepair& repair,
+                      std::string& repaired) {
+        HistoryRecord record;
+        if (!ParseHistoryRecord(line, record)) {
+            return false;
+        }
+        bool sealed = record.FindAttribute("enc") != nullptr;
+        if (sealed) {
+            HistoryRecord outer = record;
+            std::string opened;
+            if (!cipher || !cipher->Open(outer.content, GetSealedRecordAssociatedData(outer), opened) ||
+                !ParseOpenedRecord(outer, opened, record)) {
+                return false;
+            }
+        }
+        std::vector<std::pair<std::string, std::string> > attributes;
+        for (const auto& attribute : record.attributes) {
+            std::string format;
+            if (attribute.first == "fmt" && repair.brokenFormats.count(GetPayloadPath(attribute.second, format))) {
+                continue;
+            }
+            if (repair.width > 0 && attribute.first == "w") {
+                attributes.push_back(std::make_pair(attribute.first, std::to_string(repair.width)));
+            } else if (repair.width > 0 && attribute.first == "h") {
+                attributes.push_back(std::make_pair(attribute.first, std::to_string(repair.height)));
+            } else {
+                attributes.push_back(attribute);
+            }
+        }
+        record.attributes.swap(attributes);
+        if (sealed) {
+            record = MakeSealedRecord(record, cipher->Seal(FormatHistoryRecord(record), GetSealedRecordAssociatedData(record)));
+        }
+        repaired = FormatHistoryRecord(record);
+        return true;
+    }
+
+    bool MoveToOrphans(const std::string& path) {
+        std::error_code error;
+        fs::path target = fs::u8path(ORPHAN_DIR) / fs::u8path(path);
+        fs::create_directories(target.parent_path(), error);
+        fs::rename(fs::u8path(path), target, error);
+        return !error;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    std::string directory;
+    size_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    bool repair = false;
+    bool quiet = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--dir" && i + 1 < args.size()) {
+            directory = args[++i];
+        } else if (args[i] == "--threads" && i + 1 < args.size()) {
+            threadCount = (size_t)std::max(atoi(args[++i].c_str()), 1);
+        } else if (args[i] == "--repair") {
+            repair = true;
+        } else if (args[i] == "--quiet") {
+            quiet = true;
+        } else {
+            return Usage();
+        }
+    }
+    // Records name files relative to the history, as the manager runs there
+    std::error_code error;
+    if (!directory.empty()) {
+        fs::current_path(fs::u8path(directory), error);
+        if (error) {
+            fprintf(stderr, "clipboard_fsck: cannot change to %s\n", directory.c_str());
+            return EXIT_FAILED;
+        }
+    }
+    if (repair) {
+        // The manager would overwrite the repaired history with its own on the next save
+        ControlClient client;
+        if (client.Connect(ControlServer::GetDefaultEndpoint())) {
+            fprintf(stderr, "clipboard_fsck: Clipboard Manager is running; close it before repairing\n");
+            return EXIT_FAILED;
+        }
+    }
+
+    std::shared_ptr<StorageCipher> cipher;
+    if (fs::exists(KEY_FILE, error)) {
+        cipher = std::make_shared<StorageCipher>();
+        const char* passphrase = getenv("CLIPBOARD_MANAGER_PASSPHRASE");
+        std::string unlockError;
+        // Never creates a key: the callback refuses
+        bool unlocked = cipher->Unlock(KEY_FILE, StorageCipher::PROTECTION_PASSPHRASE,
+            [passphrase](bool create, std::string& entered) {
+                if (create || !passphrase || !*passphrase) {
+                    return false;
+                }
+                entered = passphrase;
+                return true;
+            }, unlockError);
+        if (!unlocked) {
+            fprintf(stderr, "clipboard_fsck: %s; sealed records and files are not checked\n", unlockError.c_str());
+            cipher.reset();
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MappedFile history;
+    if (fs::exists(HISTORY_FILE, error) && !history.Open(HISTORY_FILE)) {
+        fprintf(stderr, "clipboard_fsck: cannot read %s\n", HISTORY_FILE);
+        return EXIT_FAILED;
+    }
+
+    // The directories are listed while the history is scanned
+    std::vector<std::string> listed;
+    std::thread lister([&listed]() {
+        ListDirectory(IMAGE_DIR, listed);
+        ListDirectory(PAYLOAD_DIR, listed);
+    });
+    std::vector<Chunk> chunks = SplitIntoChunks(history.GetData(), history.GetSize(), threadCount);
+    RunParallel(chunks.size(), threadCount, [&](size_t i) {
+        ScanChunk(history.GetData(), cipher.get(), chunks[i]);
+    });
+    lister.join();
+
+    // Chunk-relative line numbers become file line numbers (1-based)
+    std::vector<Finding> findings;
+    std::vector<Reference> references;
+    uint64_t lineBase = 1;
+    uint64_t records = 0;
+    uint64_t sealedUnverified = 0;
+    for (auto& chunk : chunks) {
+        for (auto& finding : chunk.findings) {
+            finding.line += lineBase;
+            findings.push_back(finding);
+        }
+        for (auto& reference : chunk.references) {
+            reference.line += lineBase;
+            references.push_back(reference);
+        }
+        lineBase += chunk.lines;
+        records += chunk.records;
+        sealedUnverified += chunk.sealedUnverified;
+    }
+
+    // Every listed or referenced file, checked once
+    std::vector<FileCheck> files;
+    std::unordered_map<std::string, size_t> fileIndex;
+    auto addFile = [&files, &fileIndex](const std::string& path, bool isListed) {
+        auto found = fileIndex.find(path);
+        if (found != fileIndex.end()) {
+            files[found->second].listed = files[found->second].listed || isListed;
+            return;
+        }
+        FileCheck check = FileCheck();
+        check.path = path;
+        check.listed = isListed;
+        check.verified = true;
+        fileIndex[path] = files.size();
+        files.push_back(check);
+    };
+    for (const auto& path : listed) {
+        addFile(path, true);
+    }
+    for (const auto& reference : references) {
+        addFile(reference.path, false);
+    }
+    RunParallel(files.size(), threadCount, [&](size_t i) {
+        CheckFile(cipher.get(), files[i]);
+    });
+
+    // Records whose files are missing or broken
+    std::vector<bool> referenced(files.size(), false);
+    std::map<uint64_t, RecordRepair> recordRepairs;   // By line offset
+    size_t unverifiedFiles = 0;
+    for (const auto& reference : references) {
+        const FileCheck& file = files[fileIndex[reference.path]];
+        referenced[fileIndex[reference.path]] = true;
+        std::string what = reference.image ? "image " : "captured format ";
+        Finding finding;
+        finding.line = reference.line;
+        finding.offset = reference.offset;
+        finding.length = reference.length;
+        finding.action = reference.image ? ACTION_DROP : ACTION_REWRITE;
+        if (!file.exists) {
+            finding.message = "missing " + what + reference.path;
+        } else if (!file.problem.empty()) {
+            finding.message = what + reference.path + ": " + file.problem;
+        } else {
+            if (reference.image && file.width > 0 && reference.width > 0 &&
+                (file.width != reference.width || file.height != reference.height)) {
+                finding.message = "image " + reference.path + " is " + std::to_string(file.width) + "x" +
+                                  std::to_string(file.height) + ", the record says " + std::to_string(reference.width) +
+                                  "x" + std::to_string(reference.height);
+                finding.action = ACTION_REWRITE;
+                recordRepairs[reference.offset].width = file.width;
+                recordRepairs[reference.offset].height = file.height;
+                findings.push_back(finding);
+            }
+            // A format of another size was cut short or replaced; it is removed like a broken one
+            if (!reference.image && file.verified && reference.size != std::to_string(file.size)) {
+                finding.message = "captured format " + reference.path + " is damaged: " +
+                                  std::to_string(file.size) + " bytes, the record says " +
+                                  (reference.size.empty() ? std::string("nothing") : reference.size);
+                recordRepairs[reference.offset].brokenFormats.insert(reference.path);
+                findings.push_back(finding);
+            }
+            continue;
+        }
+        if (finding.action == ACTION_REWRITE) {
+            recordRepairs[reference.offset].brokenFormats.insert(reference.path);
+        }
+        findings.push_back(finding);
+    }
+    std::sort(findings.begin(), findings.end(), [](const Finding& a, const Finding& b) {
+        return a.line != b.line ? a.line < b.line : a.action > b.action;
+    });
+
+    // Orphans are only certain when every record could be read
+    std::vector<std::string> orphans;
+    for (size_t i = 0; i < files.size(); ++i) {
+        unverifiedFiles += files[i].verified ? 0 : 1;
+        if (files[i].listed && !referenced[i] && sealedUnverified == 0) {
+            orphans.push_back(files[i].path);
+        }
+    }
+    std::sort(orphans.begin(), orphans.end());
+    double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!quiet) {
+        for (const auto& finding : findings) {
+            printf("%s:%llu: %s\n", HISTORY_FILE, (unsigned long long)finding.line, finding.message.c_str());
+        }
+        for (const auto& orphan : orphans) {
+            const FileCheck& file = files[fileIndex[orphan]];
+            printf("%s: orphaned, no record refers to it%s%s\n", orphan.c_str(), file.problem.empty() ? "" : "; ",
+                   file.problem.c_str());
+        }
+    }
+    double megabytes = history.GetSize() / (1024.0 * 1024.0);
+    printf("%llu records (%.1f MB) and %lu files checked in %.2f s with %lu thread%s (%.0f MB/s)\n",
+           (unsigned long long)records, megabytes, (unsigned long)files.size(), elapsedSeconds,
+           (unsigned long)threadCount, threadCount == 1 ? "" : "s", elapsedSeconds > 0.0 ? megabytes / elapsedSeconds : 0.0);
+    if (sealedUnverified > 0 || unverifiedFiles > 0) {
+        printf("%llu sealed records and %lu sealed files not checked without the key; orphans not looked for\n",
+               (unsigned long long)sealedUnverified, (unsigned long)unverifiedFiles);
+    }
+
+    size_t problems = findings.size() + orphans.size();
+    if (problems == 0) {
+        printf("no problems found\n");
+        return EXIT_CLEAN;
+    }
+    if (!repair) {
+        printf("%lu problems found; run with --repair to fix them\n", (unsigned long)problems);
+        return EXIT_PROBLEMS_LEFT;
+    }
+
+    // One action per line: dropping wins over rewriting
+    std::map<uint64_t, const Finding*> actions;
+    for (const auto& finding : findings) {
+        if (finding.action == ACTION_NONE) {
+            continue;
+        }
+        auto existing = actions.find(finding.offset);
+        if (existing == actions.end() || finding.action == ACTION_DROP) {
+            actions[finding.offset] = &finding;
+        }
+    }
+    size_t repaired = 0;
+    size_t left = 0;
+    for (const auto& finding : findings) {
+        left += finding.action == ACTION_NONE ? 1 : 0;
+    }
+    if (!actions.empty()) {
+        const char* data = history.GetData();
+        std::string output;
+        std::string rejected;
+        std::set<uint64_t> failedRewrites;
+        output.reserve(history.GetSize());
+        uint64_t copied = 0;
+        for (const auto& action : actions) {
+            const Finding& finding = *action.second;
+            // Lines end with \n (and maybe \r before it), except possibly the last
+            uint64_t lineEnd = finding.offset + finding.length;
+            while (lineEnd < history.GetSize() && data[lineEnd] != '\n') {
+                lineEnd++;
+            }
+            lineEnd = std::min<uint64_t>(lineEnd + 1, history.GetSize());
+            output.append(data + copied, (size_t)(finding.offset - copied));
+            std::string line(data + finding.offset, finding.length);
+            std::string rewritten;
+            if (finding.action == ACTION_DROP) {
+                rejected += line;
+                rejected += '\n';
+            } else if (RepairRecord(cipher.get(), line, recordRepairs[finding.offset], rewritten)) {
+                output += rewritten;
+                output += '\n';
+            } else {
+                output.append(data + finding.offset, (size_t)(lineEnd - finding.offset));
+                failedRewrites.insert(finding.offset);
+            }
+            copied = lineEnd;
+        }
+        output.append(data + copied, (size_t)(history.GetSize() - copied));
+        for (const auto& finding : findings) {
+            if (finding.action == ACTION_NONE || failedRewrites.count(finding.offset)) {
+                left += finding.action == ACTION_NONE ? 0 : 1;
+            } else {
+                repaired++;
+            }
+        }
+        // Windows can't replace a file that is mapped
+        history.Close();
+
+        // Rejected records are kept, never deleted
+        if (!rejected.empty()) {
+            std::ofstream file(REJECTED_FILE, std::ios::binary | std::ios::app);
+            if (!file.write(rejected.data(), rejected.size()) || !file.flush()) {
+                fprintf(stderr, "clipboard_fsck: cannot write %s; the history was not changed\n", REJECTED_FILE);
+                return EXIT_FAILED;
+            }
+        }
+        if (!WriteFileAtomically(HISTORY_FILE, output, true)) {
+            fprintf(stderr, "clipboard_fsck: cannot write %s\n", HISTORY_FILE);
+            return EXIT_FAILED;
+        }
+    }
+    // Files only the dropped records referred to go with them
+    if (sealedUnverified == 0) {
+        std::set<std::string> kept;
+        for (const auto& reference : references) {
+            auto action = actions.find(reference.offset);
+            if (action == actions.end() || action->second->action != ACTION_DROP) {
+                kept.insert(reference.path);
+            }
+        }
+        for (const auto& reference : references) {
+            const FileCheck& file = files[fileIndex[reference.path]];
+            if (file.exists && !kept.count(reference.path)) {
+                kept.insert(reference.path);
+                if (!MoveToOrphans(reference.path)) {
+                    fprintf(stderr, "clipboard_fsck: cannot move %s to %s\n", reference.path.c_str(), ORPHAN_DIR);
+                }
+            }
+        }
+    }
+    for (const auto& orphan : orphans) {
+        if (MoveToOrphans(orphan)) {
+            repaired++;
+        } else {
+            fprintf(stderr, "clipboard_fsck: cannot move %s to %s\n", orphan.c_str(), ORPHAN_DIR);
+            left++;
+        }
+    }
+    printf("%lu problems repaired, %lu left\n", (unsigned long)repaired, (unsigned long)left);
+    return left > 0 ? EXIT_PROBLEMS_LEFT : EXIT_REPAIRED;
+}
@@ -4,16 +4,350 @@
 #include <wx/stdpaths.h>
 #include <wx/filename.h>
 #include <wx/log.h>
+#include <wx/ffile.h>
+#include <wx/fileconf.h>
+#include <wx/artprov.h>
+#include <wx/cmdline.h>
+#include <wx/mstream.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "AtomicFile.h"
+#if defined(__WXGTK3__) && defined(CLIPBOARD_MONITOR_XFIXES)
+#include <gtk/gtk.h>
+#include <gdk/gdkx.h>
+#endif
 
 // Initialize static members
 const wxString ClipboardFrame::LOG_FILE = wxT("clipboard_history.txt");
+const wxString ClipboardFrame::PAYLOAD_DIR = wxT("clipboard_payloads");
+const wxString ClipboardFrame::KEY_FILE = wxT("clipboard_history.key");
+const wxString ClipboardFrame::SETTINGS_FILE = wxT("clipboard_manager.ini");
+#ifdef __WXMSW__
 ClipboardFrame* ClipboardFrame::s_instance = nullptr;
 bool ClipboardFrame::s_ctrlCPressed = false;
 wxDateTime ClipboardFrame::s_lastCtrlCTime;
+#endif
+
+namespace {
+    // Formats captured as raw bytes next to the main entry content
+    struct PayloadFormat {
+        const wxChar* name;
+        const wxChar* nativeName;   // Registered clipboard format name
+        const wxChar* extension;
+    };
+
+    const PayloadFormat RAW_PAYLOAD_FORMATS[] = {
+#ifdef __WXMSW__
+        { wxT("HTML"), wxT("HTML Format"), wxT("html") },
+        { wxT("RTF"), wxT("Rich Text Format"), wxT("rtf") },
+        { wxT("PNG"), wxT("PNG"), wxT("png") }
+#else
+        { wxT("HTML"), wxT("text/html"), wxT("html") },
+        { wxT("RTF"), wxT("text/rtf"), wxT("rtf") },
+        { wxT("PNG"), wxT("image/png"), wxT("png") }
+#endif
+    };
+
+    wxDataFormat GetPayloadDataFormat(const wxString& name) {
+        for (const PayloadFormat& format : RAW_PAYLOAD_FORMATS) {
+            if (name == format.name) {
+                return wxDataFormat(format.nativeName);
+            }
+        }
+        return wxDataFormat(wxDF_INVALID);
+    }
+
+    // Size of a clipboard format without copying it; 0 if unknown. Clipboard must be open.
+    size_t QueryFormatSize(const wxDataFormat& format) {
+#ifdef __WXMSW__
+        HANDLE handle = ::GetClipboardData(format.GetFormatId());
+        return handle ? ::GlobalSize(handle) : 0;
+#else
+        // Selection data is only transferred when requested
+        return 0;
+#endif
+    }
+
+    wxMemoryBuffer ReadFileToBuffer(const wxString& path) {
+        wxMemoryBuffer buffer;
+        wxFFile file(path, wxT("rb"));
+        if (file.IsOpened()) {
+            size_t length = (size_t)file.Length();
+            buffer.SetDataLen(file.Read(buffer.GetWriteBuf(length), length));
+        }
+        return buffer;
+    }
+
+    std::string ToUTF8(const wxString& text) {
+        wxScopedCharBuffer buffer = text.ToUTF8();
+        return std::string(buffer.data(), buffer.length());
+    }
+
+    // Extension of image and payload files sealed by the StorageCipher
+    const wxString SEALED_FILE_SUFFIX = wxT(".enc");
+
+    // Reads an image or payload file, opening sealed ones; empty on failure.
+    // The file path is the associated data, so files can't be swapped.
+    wxMemoryBuffer ReadStoredFile(const wxString& path, const StorageCipher* cipher) {
+        wxMemoryBuffer buffer = ReadFileToBuffer(path);
+        if (!path.EndsWith(SEALED_FILE_SUFFIX) || buffer.IsEmpty()) {
+            return buffer;
+        }
+        std::string plaintext;
+        if (!cipher || !cipher->Open(std::string((const char*)buffer.GetData(), buffer.GetDataLen()),
+                                     ToUTF8(path), plaintext)) {
+            wxLogError(wxT("Failed to decrypt %s"), path);
+            return wxMemoryBuffer();
+        }
+        wxMemoryBuffer opened;
+        opened.AppendData(plaintext.data(), plaintext.size());
+        return opened;
+    }
+
+    wxString FromUTF8(const std::string& text) {
+        return wxString::FromUTF8(text.data(), text.size());
+    }
+
+    // Bytes of compressed content decoded up front; enough for FormatListContent
+    const size_t PREVIEW_BYTES = 512;
+
+    // Start of UTF-8 text for entries whose full content stays compressed
+    wxString PreviewFromUTF8(const std::string& text) {
+        size_t end = wxMin(text.size(), PREVIEW_BYTES);
+        if (end < text.size()) {
+            // Don't cut a character in half
+            while (end > 0 && ((unsigned char)text[end] & 0xC0) == 0x80) {
+                end--;
+            }
+        }
+        return wxString::FromUTF8(text.data(), end);
+    }
+
+    // "<directory>/<file name>", the form of the paths the manager stores
+    bool IsFileInDirectory(const wxString& path, const wxString& directory) {
+        wxString name = path.AfterFirst(wxT('/'));
+        return path.BeforeFirst(wxT('/')) == directory && !name.IsEmpty() && name != wxT(".") &&
+               name != wxT("..") && name.find_first_of(wxT("/\\:")) == wxString::npos;
+    }
+
+    // Full content of an entry, decoding compressed text or reading spilled text on demand
+    wxString GetEntryContent(const ClipboardEntry& entry) {
+        if (entry.spilled) {
+            std::string text;
+            if (!entry.spilled->ReadText(text)) {
+                wxLogError(wxT("Failed to read spilled history entry"));
+                return entry.content;
+            }
+            return FromUTF8(text);
+        }
+        if (!entry.compressed) {
+            return entry.content;
+        }
+        std::string text;
+        if (!TextCompressor::Decompress(*entry.compressed, text)) {
+            wxLogError(wxT("Failed to decompress history entry"));
+            return entry.content;
+        }
+        return FromUTF8(text);
+    }
+
+    // Single-line preview used by the history list and the quick-paste picker
+    wxString FormatListContent(const wxString& content) {
+        wxString displayContent = content;
+        if (displayContent.Length() > 100) {
+            displayContent = displayContent.Left(100) + wxT("...");
+        }
+        displayContent.Replace(wxT("\n"), wxT(" "));
+        displayContent.Replace(wxT("\r"), wxT(" "));
+        return displayContent;
+    }
+
+    // Without content, only the attributes are filled in
+    HistoryRecord EntryToRecord(const ClipboardEntry& entry, bool withContent = true) {
+        HistoryRecord record;
+        record.timestamp = ToUTF8(entry.timestamp.Format(wxT("%Y-%m-%d %H:%M:%S")));
+        record.type = ToUTF8(entry.type);
+        if (withContent && entry.spilled) {
+            // Written back the way it was held before it was spilled
+            if (!entry.spilled->ReadStored(record.content)) {
+                wxLogError(wxT("Failed to read spilled history entry"));
+                record.content = ToUTF8(entry.content);
+            } else if (entry.spilled->compressed) {
+                record.AddAttribute("lz", std::to_string(entry.spilled->dictionary) + ":" +
+                                          std::to_string(entry.spilled->textSize));
+            }
+        } else if (withContent && entry.compressed) {
+            // lz=<dictionary>:<uncompressed size>, content holds the compressed bytes
+            record.content = entry.compressed->data;
+            record.AddAttribute("lz", std::to_string(entry.compressed->dictionary) + ":" +
+                                      std::to_string(entry.compressed->size));
+        } else if (withContent) {
+            record.content = ToUTF8(entry.content);
+        }
+        if (!entry.imagePath.IsEmpty()) {
+            record.AddAttribute("img", ToUTF8(entry.imagePath));
+            record.AddAttribute("w", std::to_string(entry.imageSize.GetWidth()));
+            record.AddAttribute("h", std::to_string(entry.imageSize.GetHeight()));
+        }
+        for (const auto& payload : entry.payloads) {
+            // fmt=<format>:<size>:<path>, path is empty for metadata-only formats
+            record.AddAttribute("fmt", ToUTF8(wxString::Format(wxT("%s:%lu:%s"),
+                payload.format, (unsigned long)payload.size, payload.path)));
+        }
+        for (const auto& version : entry.versions) {
+            // ver=<timestamp>|<content>
+            record.AddAttribute("ver", ToUTF8(version.timestamp.Format(wxT("%Y-%m-%d %H:%M:%S")) +
+                wxT("|") + version.content));
+        }
+        return record;
+    }
+
+    // mask: FuzzySearch::CharacterMask of the content if the caller knows it
+    std::shared_ptr<const ControlEntry> MakeControlEntry(const ClipboardEntry& entry, uint64_t mask = ~(uint64_t)0) {
+        std::shared_ptr<ControlEntry> item = std::make_shared<ControlEntry>();
+        item->id = entry.id;
+        item->time = (int64_t)entry.timestamp.GetTicks();
+        item->timestamp = ToUTF8(entry.timestamp.Format(wxT("%Y-%m-%d %H:%M:%S")));
+        item->type = ToUTF8(entry.type);
+        // Compressed content is shared, not copied, and not decoded until a client needs it
+        if (entry.spilled) {
+            // Read from the spill file when a client needs it; the preview serves list and search
+            std::shared_ptr<const SpilledText> spilled = entry.spilled;
+            item->text = ToUTF8(entry.content);
+            item->load = [spilled]() {
+                std::string text;
+                spilled->ReadText(text);
+                return text;
+            };
+            // Not read back for it; entries spilled after they were published keep theirs
+            item->mask = mask;
+        } else if (entry.compressed) {
+            item->compressed = entry.compressed;
+            // Decoded once here, so searches skip entries lacking the query's characters
+            item->mask = mask;
+            std::string text;
+            if (mask == ~(uint64_t)0 && TextCompressor::Decompress(*entry.compressed, text)) {
+                item->mask = FuzzySearch::CharacterMask(text);
+            }
+        } else {
+            item->text = ToUTF8(entry.content);
+            item->mask = FuzzySearch::CharacterMask(item->text);
+        }
+        // Everything else the history file stores, so exports can be imported without loss
+        HistoryRecord record = EntryToRecord(entry, false);
+        item->attributes = record.attributes;
+        return item;
+    }
+
+    // Heap bytes of a string; short strings may live inside the object, which is ignored
+    size_t GetStringBytes(const wxString& text) {
+        return (text.capacity() + 1) * sizeof(wxStringCharType);
+    }
+
+    size_t GetEntryMemoryBytes(const ClipboardEntry& entry) {
+        size_t bytes = sizeof(ClipboardEntry) + GetStringBytes(entry.content) + GetStringBytes(entry.type) +
+                       GetStringBytes(entry.imagePath);
+        if (entry.compressed) {
+            bytes += sizeof(CompressedText) + entry.compressed->data.capacity();
+        }
+        if (entry.spilled) {
+            bytes += sizeof(SpilledText);
+        }
+        for (const auto& payload : entry.payloads) {
+            bytes += sizeof(payload) + GetStringBytes(payload.format) + GetStringBytes(payload.path);
+        }
+        for (const auto& version : entry.versions) {
+            bytes += sizeof(version) + GetStringBytes(version.content);
+        }
+        return bytes;
+    }
+
+    size_t GetControlEntriesBytes(const std::unordered_map<size_t, std::shared_ptr<const ControlEntry> >& items) {
+        size_t bytes = 0;
+        for (const auto& item : items) {
+            // The published snapshot holds each item twice, newest first and by time
+            bytes += item.second->GetMemoryBytes() + sizeof(item) + sizeof(void*) +
+                     2 * sizeof(std::shared_ptr<const ControlEntry>);
+        }
+        return bytes;
+    }
+
+    // Native list items, estimated
+    const size_t LIST_ROW_BYTES = 128;
+
+    // The row's column strings are also copied into the native control
+    size_t GetListRowBytes(const ClipboardEntry& entry) {
+        size_t characters = 19 + entry.type.length() + 8 + FormatListContent(entry.content).length();
+        return 2 * characters * sizeof(wxChar) + LIST_ROW_BYTES;
+    }
+
+    bool OpenRecord(const StorageCipher& cipher, const HistoryRecord& outer, HistoryRecord& record) {
+        std::string line;
+        return cipher.Open(outer.content, GetSealedRecordAssociatedData(outer), line) &&
+               ParseOpenedRecord(outer, line, record);
+    }
+
+    bool RecordToEntry(const HistoryRecord& record, ClipboardEntry& entry) {
+        entry.timestamp.ParseFormat(FromUTF8(record.timestamp), wxT("%Y-%m-%d %H:%M:%S"));
+        entry.type = FromUTF8(record.type);
+        if (const std::string* compression = record.FindAttribute("lz")) {
+            std::shared_ptr<CompressedText> compressed = std::make_shared<CompressedText>();
+            compressed->data = record.content;
+            compressed->dictionary = atoi(compression->c_str());
+            size_t separator = compression->find(':');
+            compressed->size = separator != std::string::npos ? strtoul(compression->c_str() + separator + 1, NULL, 10) : 0;
+            // Only the preview is decoded while loading
+            std::string preview;
+            if (!TextCompressor::Decompress(*compressed, preview, PREVIEW_BYTES + 4)) {
+                return false;
+            }
+            entry.content = PreviewFromUTF8(preview);
+            entry.compressed = compressed;
+        } else {
+            entry.content = FromUTF8(record.content);
+        }
+
+        if (const std::string* imagePath = record.FindAttribute("img")) {
+            entry.imagePath = FromUTF8(*imagePath);
+            const std::string* width = record.FindAttribute("w");
+            const std::string* height = record.FindAttribute("h");
+            if (width && height) {
+                entry.imageSize = wxSize(atoi(width->c_str()), atoi(height->c_str()));
+            }
+        }
+
+        for (const std::string& value : record.FindAttributes("fmt")) {
+            wxString format = FromUTF8(value);
+            ClipboardPayload payload;
+            payload.format = format.BeforeFirst(wxT(':'));
+            wxString rest = format.AfterFirst(wxT(':'));
+            unsigned long size = 0;
+            rest.BeforeFirst(wxT(':')).ToULong(&size);
+            payload.size = size;
+            payload.path = rest.AfterFirst(wxT(':'));
+            entry.payloads.push_back(payload);
+        }
+
+        for (const std::string& value : record.FindAttributes("ver")) {
+            size_t separator = value.find('|');
+            ClipboardVersion version;
+            if (separator != std::string::npos &&
+                version.timestamp.ParseFormat(FromUTF8(value.substr(0, separator)), wxT("%Y-%m-%d %H:%M:%S"))) {
+                version.content = FromUTF8(value.substr(separator + 1));
+                entry.versions.push_back(version);
+            }
+        }
+
+        return entry.timestamp.IsValid() && !entry.type.IsEmpty();
+    }
+}
 
 // Event tables
 wxBEGIN_EVENT_TABLE(ClipboardTaskBarIcon, wxTaskBarIcon)
     EVT_MENU(ID_SHOW, ClipboardTaskBarIcon::OnMenuShow)
+    EVT_MENU(ID_STATS, ClipboardTaskBarIcon::OnMenuStats)
+    EVT_MENU(ID_QUICK_PASTE, ClipboardTaskBarIcon::OnMenuQuickPaste)
     EVT_MENU(ID_EXIT, ClipboardTaskBarIcon::OnMenuExit)
     EVT_TASKBAR_LEFT_UP(ClipboardTaskBarIcon::OnLeftButtonClick)
     EVT_TASKBAR_LEFT_DCLICK(ClipboardTaskBarIcon::OnLeftButtonDClick)
@@ -24,6 +358,12 @@ wxBEGIN_EVENT_TABLE(NotificationPopup, wxFrame)
     EVT_CLOSE(NotificationPopup::OnClose)
 wxEND_EVENT_TABLE()
 
+wxBEGIN_EVENT_TABLE(QuickPastePicker, wxFrame)
+    EVT_CHAR_HOOK(QuickPastePicker::OnCharHook)
+    EVT_LISTBOX_DCLICK(wxID_ANY, QuickPastePicker::OnListDClick)
+    EVT_ACTIVATE(QuickPastePicker::OnActivate)
+wxEND_EVENT_TABLE()
+
 wxBEGIN_EVENT_TABLE(ClipboardFrame, wxFrame)
     EVT_CLOSE(ClipboardFrame::OnClose)
     EVT_ICONIZE(ClipboardFrame::OnIconize)
@@ -31,13 +371,26 @@ wxBEGIN_EVENT_TABLE(ClipboardFrame, wxFrame)
     EVT_BUTTON(ID_CLEAR_ALL, ClipboardFrame::OnClearAll)
     EVT_BUTTON(ID_COPY_SELECTED, ClipboardFrame::OnCopySelected)
     EVT_LIST_ITEM_ACTIVATED(wxID_ANY, ClipboardFrame::OnItemActivated)
+    EVT_LIST_ITEM_SELECTED(wxID_ANY, ClipboardFrame::OnItemSelected)
+#if wxUSE_HOTKEY
+    EVT_HOTKEY(ID_QUICK_PASTE_HOTKEY, ClipboardFrame::OnQuickPasteHotKey)
+#endif
+    EVT_BUTTON(ID_SHOW_VERSIONS, ClipboardFrame::OnShowVersions)
+    EVT_TIMER(ID_REPLAY_TIMER, ClipboardFrame::OnReplayTimer)
+    EVT_TIMER(ID_SAVE_TIMER, ClipboardFrame::OnSaveTimer)
+    EVT_TEXT(ID_SEARCH, ClipboardFrame::OnSearchText)
+    EVT_SEARCHCTRL_CANCEL_BTN(ID_SEARCH, ClipboardFrame::OnSearchCancel)
 wxEND_EVENT_TABLE()
 
 // ClipboardTaskBarIcon implementation
 ClipboardTaskBarIcon::ClipboardTaskBarIcon(ClipboardFrame* parent) 
     : m_parent(parent) {
     // Set icon for system tray
+#ifdef __WXMSW__
     wxIcon icon(wxICON(wxICON_INFORMATION));
+#else
+    wxIcon icon = wxArtProvider::GetIcon(wxART_INFORMATION, wxART_OTHER);
+#endif
     SetIcon(icon, wxT("Clipboard Manager"));
 }
 
@@ -48,6 +401,14 @@ void ClipboardTaskBarIcon::OnMenuShow(wxCommandEvent& event) {
     m_parent->ShowFrame();
 }
 
+void ClipboardTaskBarIcon::OnMenuStats(wxCommandEvent& event) {
+    m_parent->ShowStatistics();
+}
+
+void ClipboardTaskBarIcon::OnMenuQuickPaste(wxCommandEvent& event) {
+    m_parent->ShowQuickPastePicker();
+}
+
 void ClipboardTaskBarIcon::OnMenuExit(wxCommandEvent& event) {
     m_parent->Close(true);
 }
@@ -68,6 +429,8 @@ void ClipboardTaskBarIcon::OnLeftButtonDClick(wxTaskBarIconEvent& event) {
 wxMenu* ClipboardTaskBarIcon::CreatePopupMenu() {
     wxMenu* menu = new wxMenu;
     menu->Append(ID_SHOW, wxT("&Show Clipboard Manager"));
+    menu->Append(ID_QUICK_PASTE, wxT("&Quick Paste"));
+    menu->Append(ID_STATS, wxT("S&tatistics"));
     menu->AppendSeparator();
     menu->Append(ID_EXIT, wxT("E&xit"));
     return menu;
@@ -77,7 +440,8 @@ wxMenu* ClipboardTaskBarIcon::CreatePopupMenu() {
 NotificationPopup::NotificationPopup(wxWindow* parent, const wxString& title, const wxString& content, bool isImage)
     : wxFrame(parent, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, 
               wxFRAME_NO_TASKBAR | wxSTAY_ON_TOP | wxBORDER_SIMPLE),
-      m_timer(nullptr) {
+      m_timer(nullptr),
+      m_memoryBytes(0) {
     
     // Set background color
     SetBackgroundColour(wxColour(245, 245, 245));
@@ -150,6 +514,9 @@ NotificationPopup::NotificationPopup(wxWindow* parent, const wxString& title, co
     
     // Set the calculated size
     SetSize(idealWidth, idealHeight);
+    // The text is held by wx and by the native control, the window by a 32-bit surface
+    m_memoryBytes = (title.length() + 2 * displayContent.length()) * sizeof(wxChar) +
+                    (size_t)idealWidth * idealHeight * 4;
     
     // Layout
     wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
@@ -197,8 +564,64 @@ void NotificationPopup::PositionWindow() {
     SetPosition(wxPoint(x, y));
 }
 
+// QuickPastePicker implementation
+QuickPastePicker::QuickPastePicker(ClipboardFrame* parent)
+    : wxFrame(parent, wxID_ANY, wxT("Quick Paste"), wxDefaultPosition, wxSize(480, 260),
+              wxFRAME_NO_TASKBAR | wxSTAY_ON_TOP | wxBORDER_SIMPLE | wxFRAME_FLOAT_ON_PARENT),
+      m_parent(parent) {
+    m_listBox = new wxListBox(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, 0, nullptr, wxLB_SINGLE);
+    
+    wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+    sizer->Add(m_listBox, 1, wxEXPAND | wxALL, 2);
+    SetSizer(sizer);
+}
+
+void QuickPastePicker::ShowEntries(const wxArrayString& labels) {
+    m_listBox->Set(labels);
+    if (!labels.IsEmpty()) {
+        m_listBox->SetSelection(0);
+    }
+    CentreOnScreen();
+    Show();
+    Raise();
+    m_listBox->SetFocus();
+}
+
+void QuickPastePicker::OnCharHook(wxKeyEvent& event) {
+    int keyCode = event.GetKeyCode();
+    if (keyCode == WXK_ESCAPE) {
+        Hide();
+    } else if (keyCode == WXK_RETURN || keyCode == WXK_NUMPAD_ENTER) {
+        Pick(m_listBox->GetSelection());
+    } else if (keyCode >= '1' && keyCode <= '9') {
+        Pick(keyCode - '1');
+    } else {
+        event.Skip();
+    }
+}
+
+void QuickPastePicker::OnListDClick(wxCommandEvent& event) {
+    Pick(event.GetSelection());
+}
+
+void QuickPastePicker::OnActivate(wxActivateEvent& event) {
+    // Clicking anywhere else dismisses the picker
+    if (!event.GetActive()) {
+        Hide();
+    }
+    event.Skip();
+}
+
+void QuickPastePicker::Pick(int selection) {
+    if (selection == wxNOT_FOUND || selection >= (int)m_listBox->GetCount()) {
+        return;
+    }
+    Hide();
+    m_parent->PasteFromPicker(selection);
+}
+
 // ClipboardFrame implementation
-ClipboardFrame::ClipboardFrame()
+ClipboardFrame::ClipboardFrame(bool replayMode)
     : wxFrame(NULL, wxID_ANY, wxT("Clipboard Manager"), 
               wxDefaultPosition, wxSize(800, 600)),
       m_taskBarIcon(nullptr),
@@ -206,16 +629,78 @@ ClipboardFrame::ClipboardFrame()
       m_timer(nullptr),
       m_clearButton(nullptr),
       m_copyButton(nullptr),
-      m_nextId(1),
-      m_keyboardHook(NULL) {
+      m_versionsButton(nullptr),
+      m_searchCtrl(nullptr),
+      m_restoredEntryId(0),
+      m_lastChangeCount(0),
+      m_clipboardReadFailed(false),
+      m_prefetcher(std::make_shared<ImagePrefetcher>()),
+      m_filterScans(0),
+      m_filterMatches(0),
+      m_filterTotalMs(0.0),
+      m_filterMaxMs(0.0),
+      m_picker(nullptr),
+#ifdef __WXMSW__
+      m_quickPasteTarget(NULL),
+#endif
+      m_pickerOpens(0),
+      m_pickerMaxOpenMs(0.0),
+      m_nearDuplicateLookups(0),
+      m_nearDuplicateMerges(0),
+      m_nearDuplicateMaxMs(0.0),
+      m_nearDuplicatesIndexed(true),
+      m_searchIndexed(true),
+      m_searchGeneration(0),
+      m_searchStartMs(0),
+      m_searchQueries(0),
+      m_searchMaxMs(0.0),
+      m_importBatchesPending(0),
+      m_closing(false),
+      m_importedEntries(0),
+      m_importSkipped(0),
+      m_historyLoadMs(0.0),
+      m_saveTimer(nullptr),
+      m_lastSnapshotMs(0),
+      m_snapshotWrites(0),
+      m_snapshotFailures(0),
+      m_snapshotMaxMs(0.0),
+      m_cipher(std::make_shared<StorageCipher>()),
+      m_storageLocked(false),
+      m_sealCount(0),
+      m_sealBytes(0),
+      m_sealMs(0.0),
+      m_spillFileCount(0),
+      m_cacheSheds(0),
+      m_spilledEntries(0),
+      m_spilledBytes(0),
+      m_memoryPeakBytes(0),
+      m_memoryPolicyMaxMs(0.0),
+      m_clipboard(wxTheClipboard),
+      m_replayTimer(nullptr),
+      m_traceIncludesContent(false),
+      m_ownsClipboardData(false),
+      m_nextId(1)
+#ifdef __WXMSW__
+      , m_keyboardHook(NULL)
+#endif
+      {
     
     try {
         // Enable logging to file for debugging
         wxLog::SetActiveTarget(new wxLogStderr());
         wxLogMessage(wxT("Starting ClipboardFrame constructor"));
-
-        // Create system tray icon
-        m_taskBarIcon = new ClipboardTaskBarIcon(this);
+        
+        LoadSettings();
+        UnlockStorage(replayMode);
+        
+        if (replayMode) {
+            // Replayed traces never touch the system clipboard
+            m_replayClipboard.reset(new FakeClipboard());
+            m_clipboard = m_replayClipboard.get();
+        } else {
+            // Create system tray icon
+            m_taskBarIcon = new ClipboardTaskBarIcon(this);
+        }
         
         // Create main panel
         wxPanel* panel = new wxPanel(this, wxID_ANY);
@@ -224,6 +709,11 @@ ClipboardFrame::ClipboardFrame()
             return;
         }
         
+        // Typing searches the history in the background
+        m_searchCtrl = new wxSearchCtrl(panel, ID_SEARCH, wxEmptyString, wxDefaultPosition, wxDefaultSize);
+        m_searchCtrl->ShowCancelButton(true);
+        m_searchCtrl->SetDescriptiveText(wxT("Search history"));
+        
         // Create list control for clipboard entries
         m_listCtrl = new wxListCtrl(panel, wxID_ANY, wxDefaultPosition, 
                                     wxDefaultSize, wxLC_REPORT | wxLC_SINGLE_SEL);
@@ -240,8 +730,9 @@ ClipboardFrame::ClipboardFrame()
         // Create buttons
         m_clearButton = new wxButton(panel, ID_CLEAR_ALL, wxT("Clear All"));
         m_copyButton = new wxButton(panel, ID_COPY_SELECTED, wxT("Copy Selected"));
+        m_versionsButton = new wxButton(panel, ID_SHOW_VERSIONS, wxT("Versions..."));
         
-        if (!m_clearButton || !m_copyButton) {
+        if (!m_clearButton || !m_copyButton || !m_versionsButton) {
             wxLogError(wxT("Failed to create buttons"));
             return;
         }
@@ -250,8 +741,10 @@ ClipboardFrame::ClipboardFrame()
         wxBoxSizer* buttonSizer = new wxBoxSizer(wxHORIZONTAL);
         buttonSizer->Add(m_clearButton, 0, wxALL, 5);
         buttonSizer->Add(m_copyButton, 0, wxALL, 5);
+        buttonSizer->Add(m_versionsButton, 0, wxALL, 5);
         
         wxBoxSizer* mainSizer = new wxBoxSizer(wxVERTICAL);
+        mainSizer->Add(m_searchCtrl, 0, wxEXPAND | wxLEFT | wxRIGHT | wxTOP, 5);
         mainSizer->Add(m_listCtrl, 1, wxEXPAND | wxALL, 5);
         mainSizer->Add(buttonSizer, 0, wxALIGN_CENTER | wxALL, 5);
         
@@ -264,12 +757,76 @@ ClipboardFrame::ClipboardFrame()
             return;
         }
         
-        if (!m_timer->Start(500)) { // Check every 500ms (0.5 seconds) for more responsive detection
-            wxLogError(wxT("Failed to start timer"));
-            return;
-        }
+        m_picker = new QuickPastePicker(this);
+        m_saveTimer = new wxTimer(this, ID_SAVE_TIMER);
         
-        wxLogMessage(wxT("Timer started successfully"));
+        // A replay drives CheckClipboard itself (see StartReplay)
+        if (!replayMode) {
+            // One-shot timer, rescheduled after every check by the capture scheduler
+            if (!m_timer->StartOnce(CaptureScheduler::MIN_IDLE_INTERVAL_MS)) {
+                wxLogError(wxT("Failed to start timer"));
+                return;
+            }
+            
+            wxLogMessage(wxT("Timer started successfully"));
+            
+#ifdef __WXMSW__
+            // Copy shortcuts trigger fast checks instead of waiting for the next poll
+            InstallKeyboardHook();
+#endif
+            
+#if defined(__WXGTK3__) && defined(CLIPBOARD_MONITOR_XFIXES)
+            // Restores take the clipboard from windows of the same X client as the frame
+            gtk_widget_realize(GetHandle());
+            GdkWindow* window = gtk_widget_get_window(GetHandle());
+            if (window && GDK_IS_X11_WINDOW(window)) {
+                m_clipboardMonitor.SetOwnWindow(GDK_WINDOW_XID(window));
+            }
+#endif
+            
+            // Where the platform reports clipboard changes (X11), each change is checked immediately
+            if (m_clipboardMonitor.Start(m_settings.capturePrimarySelection,
+                                         [this]() { CallAfter(&ClipboardFrame::OnClipboardChanged); })) {
+                wxLogMessage(wxT("Watching clipboard ownership changes"));
+            }
+            
+            // Scripts query the history through clipboard_ctl; restores and imports run on the UI thread
+            if (m_settings.controlEnabled) {
+                std::string endpoint = ControlServer::GetDefaultEndpoint();
+                bool started = m_controlServer.Start(endpoint, [this](size_t id) {
+                    CallAfter([this, id]() {
+                        int index = FindEntryIndex(id);
+                        if (index >= 0) {
+                            RestoreEntry(m_entries[index]);
+                        }
+                    });
+                }, [this](std::vector<HistoryRecord>& batch) {
+                    std::shared_ptr<std::vector<HistoryRecord> > records = std::make_shared<std::vector<HistoryRecord> >();
+                    records->swap(batch);
+                    m_importBatchesPending++;
+                    CallAfter([this, records]() {
+                        ImportRecords(*records);
+                        m_importBatchesPending--;
+                    });
+                    // At most one batch waits for the UI thread while the next is parsed
+                    while (m_importBatchesPending > 1 && !m_closing) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    }
+                });
+                if (started) {
+                    wxLogMessage(wxT("Control endpoint: %s"), FromUTF8(endpoint));
+                } else {
+                    wxLogError(wxT("Failed to open control endpoint %s (another instance running?)"), FromUTF8(endpoint));
+                }
+            }
+            
+            // Ctrl+Shift+V opens the quick-paste picker from any application
+#if wxUSE_HOTKEY
+            if (!RegisterHotKey(ID_QUICK_PASTE_HOTKEY, wxMOD_CONTROL | wxMOD_SHIFT, 'V')) {
+                wxLogError(wxT("Failed to register quick-paste hotkey"));
+            }
+#endif
+        }
         
         // Load existing history
         LoadFromFile();
@@ -296,16 +853,42 @@ ClipboardFrame::ClipboardFrame()
 }
 
 ClipboardFrame::~ClipboardFrame() {
+    m_clipboardMonitor.Stop();
+    m_closing = true;
+    m_controlServer.Stop();
+    m_search.Cancel();
+#ifdef __WXMSW__
+    UninstallKeyboardHook();
+#endif
+#if wxUSE_HOTKEY
+    UnregisterHotKey(ID_QUICK_PASTE_HOTKEY);
+#endif
+    
+    // Render lazily restored data now, otherwise it disappears with the application
+    if (m_ownsClipboardData && m_clipboard) {
+        m_clipboard->Flush();
+    }
+    
     if (m_timer) {
         m_timer->Stop();
         delete m_timer;
     }
     
+    if (m_replayTimer) {
+        m_replayTimer->Stop();
+        delete m_replayTimer;
+    }
+    
+    // Also writes a pending batched snapshot
+    WriteSnapshot();
+    if (m_saveTimer) {
+        m_saveTimer->Stop();
+        delete m_saveTimer;
+    }
+    
     if (m_taskBarIcon) {
         delete m_taskBarIcon;
     }
-    
-    SaveToFile();
 }
 
 void ClipboardFrame::OnClose(wxCloseEvent& event) {
@@ -315,7 +898,7 @@ void ClipboardFrame::OnClose(wxCloseEvent& event) {
         event.Veto();
     } else {
         // Force close
-        SaveToFile();
+        WriteSnapshot();
         Destroy();
     }
 }
@@ -329,7 +912,200 @@ void ClipboardFrame::OnIconize(wxIconizeEvent& event) {
 }
 
 void ClipboardFrame::OnTimer(wxTimerEvent& event) {
-    CheckClipboard();
+    PurgeExpiredEntries();
+    bool captured = CheckClipboard();
+    ScheduleNextCheck(m_scheduler.OnPoll(captured));
+}
+
+void ClipboardFrame::OnClipboardChanged() {
+    m_scheduler.OnChangeNotification();
+    bool captured = CheckClipboard();
+    ScheduleNextCheck(m_scheduler.OnPoll(captured));
+}
+
+void ClipboardFrame::ShowNotification(const wxString& title, const wxString& content, bool isImage) {
+    // Replays would otherwise open one popup per event
+    if (m_replay) {
+        return;
+    }
+    new NotificationPopup(this, title, content, isImage);
+}
+
+bool ClipboardFrame::StartRecording(const wxString& tracePath, bool includeContent) {
+    m_traceWriter.reset(new TraceWriter());
+    if (!m_traceWriter->Open(ToUTF8(tracePath))) {
+        wxLogError(wxT("Failed to open trace file: %s"), tracePath);
+        m_traceWriter.reset();
+        return false;
+    }
+    m_traceIncludesContent = includeContent;
+    wxLogMessage(wxT("Recording clipboard trace to %s%s"), tracePath,
+                 includeContent ? wxT(" (with content)") : wxT(""));
+    return true;
+}
+
+void ClipboardFrame::RecordTraceText(const wxString& type, const wxString& content) {
+    std::string text = ToUTF8(content);
+    TraceEvent event = TraceEvent();
+    event.type = ToUTF8(type);
+    event.size = text.size();
+    event.hash = HashTraceContent(text);
+    // Secrets stay out of traces even when content is recorded
+    event.hasContent = m_traceIncludesContent && m_sensitiveFilter.Scan(text).empty();
+    if (event.hasContent) {
+        event.content = text;
+    }
+    m_traceWriter->Write(event);
+}
+
+void ClipboardFrame::RecordTraceImage(const wxBitmap& bitmap, const wxString& imageHash) {
+    TraceEvent event = TraceEvent();
+    event.type = "Image";
+    event.width = bitmap.GetWidth();
+    event.height = bitmap.GetHeight();
+    event.size = (size_t)event.width * event.height * 4;
+    event.hash = ToUTF8(imageHash);
+    m_traceWriter->Write(event);
+}
+
+void ClipboardFrame::RecordStage(int stage, wxStopWatch& stopWatch) {
+    if (m_replay) {
+        m_replay->stages[stage].Add(stopWatch.TimeInMicro().ToDouble() / 1000.0);
+    }
+    stopWatch.Start();
+}
+
+bool ClipboardFrame::StartReplay(const wxString& tracePath, double speed, const wxString& reportPath) {
+    if (!m_replayClipboard) {
+        return false;
+    }
+    
+    std::unique_ptr<ReplayState> replay(new ReplayState());
+    if (!ReadTrace(ToUTF8(tracePath), replay->events)) {
+        wxLogError(wxT("Failed to read trace file: %s"), tracePath);
+        return false;
+    }
+    replay->next = 0;
+    replay->speed = wxMax(speed, 0.0);
+    replay->startMs = wxGetLocalTimeMillis().GetValue();
+    replay->captured = 0;
+    replay->reportPath = reportPath;
+    m_replay = std::move(replay);
+    
+    wxLogMessage(wxT("Replaying %lu trace events from %s"), (unsigned long)m_replay->events.size(), tracePath);
+    m_replayTimer = new wxTimer(this, ID_REPLAY_TIMER);
+    m_replayTimer->StartOnce(1);
+    return true;
+}
+
+void ClipboardFrame::OnReplayTimer(wxTimerEvent& event) {
+    long long sliceStartMs = wxGetLocalTimeMillis().GetValue();
+    while (m_replay->next < m_replay->events.size()) {
+        const TraceEvent& traceEvent = m_replay->events[m_replay->next];
+        long long nowMs = wxGetLocalTimeMillis().GetValue();
+        if (m_replay->speed > 0.0) {
+            long long dueMs = m_replay->startMs + (long long)(traceEvent.offsetMs / m_replay->speed);
+            if (dueMs > nowMs) {
+                m_replayTimer->StartOnce((int)wxMin(dueMs - nowMs, 60000LL));
+                return;
+            }
+        }
+        // Fast replays return to the event loop regularly so pending events are handled
+        if (nowMs - sliceStartMs > 50) {
+            m_replayTimer->StartOnce(1);
+            return;
+        }
+        
+        ApplyTraceEvent(traceEvent);
+        wxStopWatch stopWatch;
+        if (CheckClipboard()) {
+            m_replay->captured++;
+        }
+        m_replay->endToEnd.Add(stopWatch.TimeInMicro().ToDouble() / 1000.0);
+        m_replay->next++;
+    }
+    FinishReplay();
+}
+
+void ClipboardFrame::ApplyTraceEvent(const TraceEvent& event) {
+    if (event.type == "Image") {
+        // Pixels derive from the recorded hash, so repeated images stay duplicates
+        int width = wxMax(event.width, 1);
+        int height = wxMax(event.height, 1);
+        wxImage image(width, height, false);
+        uint32_t state = (uint32_t)std::hash<std::string>()(event.hash) | 1;
+        unsigned char* data = image.GetData();
+        for (size_t i = 0, count = (size_t)width * height * 3; i < count; ++i) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            data[i] = (unsigned char)state;
+        }
+        m_replayClipboard->SetBitmap(wxBitmap(image));
+        return;
+    }
+    
+    wxString content = FromUTF8(event.hasContent ? event.content : SynthesizeTraceText(event.hash, event.size));
+    if (event.type == "File") {
+        m_replayClipboard->SetFiles(wxSplit(content, wxT('\n'), wxT('\0')));
+    } else {
+        m_replayClipboard->SetText(content);
+    }
+}
+
+void ClipboardFrame::FinishReplay() {
+    static const char* const STAGE_NAMES[ReplayState::STAGE_COUNT] = {
+        "read", "filter", "dedup", "payloads", "insert", "save"
+    };
+    
+    double elapsedSeconds = wxMax((wxGetLocalTimeMillis().GetValue() - m_replay->startMs) / 1000.0, 0.001);
+    size_t eventCount = m_replay->events.size();
+    wxString report;
+    report += wxString::Format(wxT("Replayed %lu events (%lu captured) in %.2f s at speed %g\n"),
+                               (unsigned long)eventCount, (unsigned long)m_replay->captured,
+                               elapsedSeconds, m_replay->speed);
+    report += wxString::Format(wxT("Throughput: %.1f events/s\n\n"), eventCount / elapsedSeconds);
+    report += wxString::Format(wxT("%-10s %8s %10s %10s %10s\n"), "stage", "count", "avg ms", "p95 ms", "max ms");
+    for (int stage = 0; stage <= ReplayState::STAGE_COUNT; ++stage) {
+        // The last row is the whole pipeline per event
+        const LatencyStats& stats = stage < ReplayState::STAGE_COUNT ? m_replay->stages[stage] : m_replay->endToEnd;
+        report += wxString::Format(wxT("%-10s %8lu %10.3f %10.3f %10.3f\n"),
+                                   stage < ReplayState::STAGE_COUNT ? STAGE_NAMES[stage] : "total",
+                                   (unsigned long)stats.GetCount(), stats.GetAverage(),
+                                   stats.GetPercentile(95.0), stats.GetMax());
+    }
+    if (m_sealCount > 0) {
+        // Everything sealing costs; compare with a replay that has Encryption=none
+        double sealedMB = m_sealBytes / (1024.0 * 1024.0);
+        report += wxString::Format(wxT("\nEncryption: ChaCha20-Poly1305 (%s), %lu records and files, %.2f MB sealed in %.1f ms "
+                                       "(%.0f MB/s), %.3f ms per captured event\n"),
+                                   StorageCipher::GetImplementation(), (unsigned long)m_sealCount, sealedMB, m_sealMs,
+                                   m_sealMs > 0.0 ? sealedMB / (m_sealMs / 1000.0) : 0.0,
+                                   m_replay->captured ? m_sealMs / m_replay->captured : 0.0);
+    }
+    report += wxString::Format(wxT("\nPeak memory: %.1f MB\n"), GetPeakMemoryBytes() / (1024.0 * 1024.0));
+    report += wxString::Format(wxT("Accounted memory: %.1f MB at the end, peak %.1f MB; over budget %lu times, "
+                                   "%lu entries spilled (%.2f MB)\n"),
+                               GetMemoryUsage().GetTotal() / (1024.0 * 1024.0), m_memoryPeakBytes / (1024.0 * 1024.0),
+                               (unsigned long)m_cacheSheds, (unsigned long)m_spilledEntries,
+                               m_spilledBytes / (1024.0 * 1024.0));
+    report += wxString::Format(wxT("History written to %s\n"), wxGetCwd());
+    
+    wxLogMessage(wxT("%s"), report);
+    if (!m_replay->reportPath.IsEmpty()) {
+        wxFFile file(m_replay->reportPath, wxT("w"));
+        if (!file.IsOpened() || !file.Write(report)) {
+            wxLogError(wxT("Failed to write replay report: %s"), m_replay->reportPath);
+        }
+    }
+    Close(true);
+}
+
+void ClipboardFrame::ScheduleNextCheck(int delayMs) {
+    if (m_timer) {
+        // Restarts the timer if it is already running
+        m_timer->StartOnce(delayMs);
+    }
 }
 
 void ClipboardFrame::OnClearAll(wxCommandEvent& event) {
@@ -337,27 +1113,55 @@ void ClipboardFrame::OnClearAll(wxCommandEvent& event) {
                      wxT("Confirm"), wxYES_NO | wxICON_QUESTION) == wxYES) {
         m_entries.clear();
         m_listCtrl->DeleteAllItems();
+        m_frecency.Clear();
+        m_nearDuplicates.Clear();
+        m_search.Clear();
+        m_timeIndex.Clear();
+        m_unreadableRecords.clear();
+        m_resultIds.clear();
         SaveToFile();
     }
 }
 
 void ClipboardFrame::OnCopySelected(wxCommandEvent& event) {
-    long selectedItem = m_listCtrl->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
-    if (selectedItem != -1 && selectedItem < (long)m_entries.size()) {
-        const ClipboardEntry& entry = m_entries[selectedItem];
-        
-        if (entry.type == wxT("Image")) {
-            // Copy image to clipboard
-            CopyImageToClipboard(entry.imagePath);
-        } else {
-            // Copy text to clipboard
-            if (wxTheClipboard->Open()) {
-                wxTheClipboard->SetData(new wxTextDataObject(entry.content));
-                wxTheClipboard->Close();
-                m_lastClipboardContent = entry.content; // Prevent re-adding
-            }
-        }
+    int index = GetEntryIndexForRow(m_listCtrl->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED));
+    if (index >= 0) {
+        RestoreEntry(m_entries[index]);
+    }
+}
+
+void ClipboardFrame::OnShowVersions(wxCommandEvent& event) {
+    int index = GetEntryIndexForRow(m_listCtrl->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED));
+    if (index < 0) {
+        return;
+    }
+    const ClipboardEntry& entry = m_entries[index];
+    if (entry.versions.empty()) {
+        wxMessageBox(wxT("This entry has no earlier versions."), wxT("Versions"), wxOK | wxICON_INFORMATION);
+        return;
     }
+    
+    // Newest first, starting with the current content
+    wxArrayString choices;
+    choices.Add(entry.timestamp.Format(wxT("%Y-%m-%d %H:%M:%S")) + wxT("  (current)  ") + FormatListContent(entry.content));
+    for (auto it = entry.versions.rbegin(); it != entry.versions.rend(); ++it) {
+        choices.Add(it->timestamp.Format(wxT("%Y-%m-%d %H:%M:%S")) + wxT("  ") + FormatListContent(it->content));
+    }
+    int choice = wxGetSingleChoiceIndex(wxT("Copy which version to the clipboard?"), wxT("Versions"), choices, this);
+    if (choice < 0) {
+        return;
+    }
+    if (choice == 0) {
+        RestoreEntry(entry);
+        return;
+    }
+    // Captured formats belong to the current content only
+    ClipboardEntry version = entry;
+    version.content = entry.versions[entry.versions.size() - choice].content;
+    version.compressed.reset();
+    version.spilled.reset();
+    version.payloads.clear();
+    RestoreEntry(version);
 }
 
 void ClipboardFrame::OnItemActivated(wxListEvent& event) {
@@ -366,16 +1170,128 @@ void ClipboardFrame::OnItemActivated(wxListEvent& event) {
     OnCopySelected(cmdEvent);
 }
 
-void ClipboardFrame::CheckClipboard() {
+#if wxUSE_HOTKEY
+void ClipboardFrame::OnQuickPasteHotKey(wxKeyEvent& event) {
+    ShowQuickPastePicker();
+}
+#endif
+
+void ClipboardFrame::ShowQuickPastePicker() {
+    wxStopWatch stopWatch;
+    
+#ifdef __WXMSW__
+    // Paste goes back to the window the user was typing in
+    m_quickPasteTarget = ::GetForegroundWindow();
+#endif
+    
+    m_pickerIds.clear();
+    wxArrayString labels;
+    for (size_t id : m_frecency.GetTop((size_t)wxMax(m_settings.quickPasteCount, 1))) {
+        int index = FindEntryIndex(id);
+        if (index < 0) {
+            continue;
+        }
+        const ClipboardEntry& entry = m_entries[index];
+        wxString label = FormatListContent(entry.content);
+        if (m_pickerIds.size() < 9) {
+            label = wxString::Format(wxT("%lu   %s"), (unsigned long)m_pickerIds.size() + 1, label);
+        }
+        labels.Add(label);
+        m_pickerIds.push_back(id);
+    }
+    if (labels.IsEmpty()) {
+        return;
+    }
+    m_picker->ShowEntries(labels);
+    
+    double elapsedMs = stopWatch.TimeInMicro().ToDouble() / 1000.0;
+    m_pickerOpens++;
+    m_pickerMaxOpenMs = wxMax(m_pickerMaxOpenMs, elapsedMs);
+    if (elapsedMs > 16.0) {
+        wxLogMessage(wxT("Quick-paste picker took %.1f ms to open"), elapsedMs);
+    }
+}
+
+void ClipboardFrame::PasteFromPicker(int selection) {
+    if (selection < 0 || selection >= (int)m_pickerIds.size()) {
+        return;
+    }
+    int index = FindEntryIndex(m_pickerIds[selection]);
+    if (index < 0) {
+        return;
+    }
+    RestoreEntry(m_entries[index]);
+    
+#ifdef __WXMSW__
+    // Give focus back and paste with a synthesized Ctrl+V
+    if (m_quickPasteTarget && ::IsWindow(m_quickPasteTarget)) {
+        ::SetForegroundWindow(m_quickPasteTarget);
+        INPUT inputs[4] = {};
+        for (int i = 0; i < 4; ++i) {
+            inputs[i].type = INPUT_KEYBOARD;
+        }
+        inputs[0].ki.wVk = VK_CONTROL;
+        inputs[1].ki.wVk = 'V';
+        inputs[2].ki.wVk = 'V';
+        inputs[2].ki.dwFlags = KEYEVENTF_KEYUP;
+        inputs[3].ki.wVk = VK_CONTROL;
+        inputs[3].ki.dwFlags = KEYEVENTF_KEYUP;
+        ::SendInput(4, inputs, sizeof(INPUT));
+    }
+#endif
+}
+
+void ClipboardFrame::OnItemSelected(wxListEvent& event) {
+    // Start loading the selected image in the background so a restore is instant
+    int index = GetEntryIndexForRow(event.GetIndex());
+    if (index >= 0) {
+        const ClipboardEntry& entry = m_entries[index];
+        if (entry.type == wxT("Image") && !entry.imagePath.IsEmpty()) {
+            m_prefetcher->Prefetch(entry.imagePath);
+        }
+    }
+}
+
+bool ClipboardFrame::CheckClipboard() {
     try {
+        // Cheap change test: skip opening the clipboard if nothing was copied since the last check
+        uint64_t changeCount = m_replayClipboard ? m_replayClipboard->GetChangeCount() : m_clipboardMonitor.GetChangeCount();
+        if (changeCount != 0 && changeCount == m_lastChangeCount) {
+            return false;
+        }
+        // The count is only recorded once the clipboard was read: the source
+        // application may still hold it open, and the next check retries
+        m_clipboardReadFailed = false;
+        wxStopWatch stageWatch;
+        
+#ifdef __WXGTK__
+        // Read whichever selection changed last; restores always go to CLIPBOARD
+        if (!m_replayClipboard) {
+            m_clipboard->UsePrimarySelection(
+                m_clipboardMonitor.GetLastChangedSelection() == ClipboardMonitor::SELECTION_PRIMARY);
+        }
+#endif
+        
         wxString dataType = DetermineDataType();
+        if (m_clipboardReadFailed) {
+            return false;
+        }
         
         if (dataType == wxT("Image")) {
             // Handle image clipboard content
             wxBitmap bitmap = GetClipboardBitmap();
+            RecordStage(ReplayState::STAGE_READ, stageWatch);
+            if (m_clipboardReadFailed) {
+                return false;
+            }
+            m_lastChangeCount = changeCount;
             if (bitmap.IsOk()) {
                 // Calculate hash to detect duplicate images
                 wxString currentImageHash = CalculateImageHash(bitmap);
+                RecordStage(ReplayState::STAGE_DEDUP, stageWatch);
+                if (m_traceWriter) {
+                    RecordTraceImage(bitmap, currentImageHash);
+                }
                 
                 // Only add if it's different from the last image
                 if (currentImageHash != m_lastImageHash) {
@@ -389,36 +1305,56 @@ void ClipboardFrame::CheckClipboard() {
                     entry.imagePath = SaveImageToFile(bitmap, entry.id);
                     entry.content = wxString::Format(wxT("Image (%dx%d)"), 
                                                     bitmap.GetWidth(), bitmap.GetHeight());
+                    CapturePayloads(entry);
+                    RecordStage(ReplayState::STAGE_PAYLOADS, stageWatch);
                     
                     AddClipboardEntry(entry);
+                    RecordStage(ReplayState::STAGE_INSERT, stageWatch);
                     SaveToFile();
+                    RecordStage(ReplayState::STAGE_SAVE, stageWatch);
                     
                     // Update last image hash
                     m_lastImageHash = currentImageHash;
                     
                     // Show notification popup
-                    new NotificationPopup(this, wxT("Image Copied"), entry.content, true);
+                    ShowNotification(wxT("Image Copied"), entry.content, true);
                     
                     wxLogMessage(wxT("Added image entry: %s"), entry.content);
+                    return true;
                 } else {
                     wxLogMessage(wxT("Skipping duplicate image"));
                 }
             }
         } else {
-            // Handle text clipboard content
-            wxString currentContent = GetClipboardText();
-            
+            // Handle text clipboard content; file lists are stored as one path per line
+            wxString currentContent;
+            if (dataType == wxT("File")) {
+                currentContent = wxJoin(GetClipboardFiles(), wxT('\n'), wxT('\0'));
+            }
+            if (currentContent.IsEmpty()) {
+                currentContent = GetClipboardText();
+                dataType = wxT("Text");
+            }
+            RecordStage(ReplayState::STAGE_READ, stageWatch);
+            if (m_clipboardReadFailed) {
+                return false;
+            }
+            m_lastChangeCount = changeCount;
+            if (m_traceWriter && !currentContent.IsEmpty()) {
+                RecordTraceText(dataType, currentContent);
+            }
+            
             // Simple approach: Only save to history, no automatic notifications for text
             // This eliminates the selection vs copy problem entirely
             if (!currentContent.IsEmpty() && 
-                currentContent != m_lastClipboardContent && 
+                currentContent != m_lastClipboardContent && !IsRestoredContent(currentContent) &&
                 currentContent.Length() > 3) { // Minimum 4 characters
                 
                 // Skip if it's just whitespace
                 wxString trimmedContent = currentContent;
                 trimmedContent.Trim().Trim(false);
                 if (trimmedContent.IsEmpty() || trimmedContent.Length() < 3) {
-                    return;
+                    return false;
                 }
                 ClipboardEntry entry;
                 entry.content = currentContent;
@@ -426,18 +1362,55 @@ void ClipboardFrame::CheckClipboard() {
                 entry.timestamp = wxDateTime::Now();
                 entry.id = m_nextId++;
                 
-                AddClipboardEntry(entry);
                 m_lastClipboardContent = currentContent;
+                m_restoredEntryId = 0;
                 
                 // Clear image hash when text is copied (different clipboard content type)
                 m_lastImageHash.Clear();
                 
+                // Secrets are handled before anything reaches the history or the disk
+                wxString notificationText;
+                FilterResult filterResult = ApplySensitiveFilter(entry, notificationText);
+                RecordStage(ReplayState::STAGE_FILTER, stageWatch);
+                if (filterResult == FILTER_DROPPED) {
+                    return false;
+                }
+                if (filterResult == FILTER_CLEAN) {
+                    CapturePayloads(entry);
+                }
+                RecordStage(ReplayState::STAGE_PAYLOADS, stageWatch);
+                
+                // Edited copies of an earlier clip become a new version of that entry.
+                // Expiring entries stay separate so they can be purged on their own.
+                bool indexed = entry.type == wxT("Text") && filterResult != FILTER_EXPIRING;
+                NearDuplicateIndex::Fingerprint fingerprint;
+                if (indexed) {
+                    EnsureNearDuplicateIndex();
+                    fingerprint = NearDuplicateIndex::Compute(ToUTF8(entry.content));
+                    bool merged = MergeNearDuplicate(entry, fingerprint);
+                    RecordStage(ReplayState::STAGE_DEDUP, stageWatch);
+                    if (merged) {
+                        SaveToFile();
+                        RecordStage(ReplayState::STAGE_SAVE, stageWatch);
+                        ShowNotification(wxT("Text Updated"), notificationText, false);
+                        return true;
+                    }
+                }
+                
+                AddClipboardEntry(entry);
+                if (indexed) {
+                    m_nearDuplicates.Add(entry.id, fingerprint);
+                }
+                RecordStage(ReplayState::STAGE_INSERT, stageWatch);
                 SaveToFile();
+                RecordStage(ReplayState::STAGE_SAVE, stageWatch);
                 
                 // Show notification popup for text content
-                new NotificationPopup(this, wxT("Text Copied"), entry.content, false);
+                ShowNotification(wxT("Text Copied"), notificationText, false);
                 
-                wxLogMessage(wxT("Added clipboard entry: %s"), entry.content.Left(50));
+                // Never the content: an expiring entry holds its secret unmasked
+                wxLogMessage(wxT("Added %s entry (%lu characters)"), entry.type, (unsigned long)entry.content.length());
+                return true;
             }
         }
     }
@@ -447,63 +1420,303 @@ void ClipboardFrame::CheckClipboard() {
     catch (...) {
         wxLogError(wxT("Unknown exception in CheckClipboard"));
     }
+    return false;
+}
+
+void ClipboardFrame::LoadSettings() {
+    wxFileConfig config(wxEmptyString, wxEmptyString, SETTINGS_FILE, wxEmptyString,
+                        wxCONFIG_USE_LOCAL_FILE | wxCONFIG_USE_RELATIVE_PATH);
+    
+    config.Read(wxT("/Filter/Enabled"), &m_settings.filterEnabled, true);
+    config.Read(wxT("/Filter/Action"), &m_settings.filterAction, wxT("mask"));
+    config.Read(wxT("/Filter/ExpirySeconds"), &m_settings.filterExpirySeconds, 60);
+    config.Read(wxT("/Filter/EntropyBits"), &m_settings.filterEntropyBits, 4.0);
+    config.Read(wxT("/Filter/EntropyMinLength"), &m_settings.filterEntropyMinLength, 20);
+    config.Read(wxT("/QuickPaste/Count"), &m_settings.quickPasteCount, 10);
+    config.Read(wxT("/Linux/CapturePrimarySelection"), &m_settings.capturePrimarySelection, false);
+    config.Read(wxT("/Storage/Compression"), &m_settings.compressionEnabled, true);
+    config.Read(wxT("/Storage/CompressionMinBytes"), &m_settings.compressionMinBytes, 128);
+    config.Read(wxT("/Storage/Sync"), &m_settings.syncPolicy, wxT("batched"));
+    config.Read(wxT("/Storage/SyncIntervalMs"), &m_settings.syncIntervalMs, 1000);
+    config.Read(wxT("/Control/Enabled"), &m_settings.controlEnabled, true);
+    config.Read(wxT("/Storage/Encryption"), &m_settings.encryption, wxT("none"));
+    config.Read(wxT("/Memory/BudgetMB"), &m_settings.memoryBudgetMB, 128);
+    
+    // Comma-separated, e.g. Keywords=password,api_key,secret
+    m_settings.filterKeywords.Clear();
+    wxString keywords = config.Read(wxT("/Filter/Keywords"), wxEmptyString);
+    for (wxString keyword : wxSplit(keywords, wxT(','), wxT('\0'))) {
+        keyword.Trim().Trim(false);
+        if (!keyword.IsEmpty()) {
+            m_settings.filterKeywords.Add(keyword);
+        }
+    }
+    
+    if (!m_settings.filterKeywords.IsEmpty()) {
+        std::vector<std::string> compiled;
+        for (const auto& keyword : m_settings.filterKeywords) {
+            compiled.push_back(ToUTF8(keyword));
+        }
+        m_sensitiveFilter.SetKeywords(compiled);
+    }
+    m_sensitiveFilter.SetEntropyThreshold(m_settings.filterEntropyBits,
+                                          (size_t)wxMax(m_settings.filterEntropyMinLength, 1));
+    
+    wxLogMessage(wxT("Sensitive content filter: %s (%s)"),
+                 m_settings.filterEnabled ? wxT("enabled") : wxT("disabled"), m_settings.filterAction);
+}
+
+void ClipboardFrame::UnlockStorage(bool replayMode) {
+    m_prefetcher->SetCipher(m_cipher);
+    if (replayMode) {
+        // Replays measure the cost of encryption with a key that is never stored
+        if (m_settings.encryption != wxT("none") && !m_cipher->UseEphemeralKey()) {
+            wxLogError(wxT("Failed to create a key for the encrypted replay"));
+        }
+        return;
+    }
+    // An existing key is always unlocked, so history encrypted before the
+    // setting was turned off can still be read (and is saved in plain text)
+    if (m_settings.encryption == wxT("none") && !wxFileExists(KEY_FILE)) {
+        return;
+    }
+    
+    StorageCipher::Protection protection = m_settings.encryption == wxT("keystore") ?
+        StorageCipher::PROTECTION_KEYSTORE : StorageCipher::PROTECTION_PASSPHRASE;
+    std::string error;
+    bool unlocked = m_cipher->Unlock(ToUTF8(KEY_FILE), protection, [](bool create, std::string& passphrase) {
+        // Unattended starts (autostart scripts, tests) can pass it in the environment
+        wxString entered;
+        if (!wxGetEnv(wxT("CLIPBOARD_MANAGER_PASSPHRASE"), &entered)) {
+            entered = wxGetPasswordFromUser(create ? wxT("Choose a passphrase for the encrypted clipboard history:")
+                                                   : wxT("Passphrase of the encrypted clipboard history:"),
+                                            wxT("Clipboard Manager"));
+            if (create && !entered.IsEmpty() &&
+                wxGetPasswordFromUser(wxT("Repeat the passphrase:"), wxT("Clipboard Manager")) != entered) {
+                wxMessageBox(wxT("The passphrases don't match."), wxT("Clipboard Manager"), wxOK | wxICON_ERROR);
+                return false;
+            }
+        }
+        passphrase = ToUTF8(entered);
+        return !entered.IsEmpty();
+    }, error);
+    
+    if (!unlocked) {
+        // Saving without the key would replace the encrypted history
+        m_storageLocked = true;
+        wxString message = wxString::Format(wxT("The clipboard history could not be unlocked: %s\n\n"
+                                                "History will not be loaded or saved in this session."),
+                                            FromUTF8(error));
+        wxLogError(wxT("%s"), message);
+        wxMessageBox(message, wxT("Clipboard Manager"), wxOK | wxICON_ERROR);
+        return;
+    }
+    wxLogMessage(wxT("History encryption: ChaCha20-Poly1305 (%s), saving %s"),
+                 StorageCipher::GetImplementation(),
+                 m_settings.encryption != wxT("none") ? wxT("encrypted") : wxT("in plain text"));
+}
+
+ClipboardFrame::FilterResult ClipboardFrame::ApplySensitiveFilter(ClipboardEntry& entry, wxString& notificationText) {
+    notificationText = entry.content;
+    if (!m_settings.filterEnabled) {
+        return FILTER_CLEAN;
+    }
+    
+    std::string text = ToUTF8(entry.content);
+    wxStopWatch stopWatch;
+    std::vector<SensitiveFilter::Match> matches = m_sensitiveFilter.Scan(text);
+    double elapsedMs = stopWatch.TimeInMicro().ToDouble() / 1000.0;
+    
+    m_filterScans++;
+    m_filterTotalMs += elapsedMs;
+    m_filterMaxMs = wxMax(m_filterMaxMs, elapsedMs);
+    if (elapsedMs > 1.0) {
+        wxLogMessage(wxT("Sensitive content scan of %lu bytes took %.2f ms"), (unsigned long)text.size(), elapsedMs);
+    }
+    
+    if (matches.empty()) {
+        return FILTER_CLEAN;
+    }
+    m_filterMatches++;
+    
+    wxString masked = FromUTF8(SensitiveFilter::Mask(text, matches));
+    notificationText = masked;
+    
+    if (m_settings.filterAction == wxT("drop")) {
+        wxLogMessage(wxT("Dropped clipboard entry with sensitive content"));
+        return FILTER_DROPPED;
+    }
+    if (m_settings.filterAction == wxT("expire")) {
+        entry.expires = entry.timestamp + wxTimeSpan::Seconds(m_settings.filterExpirySeconds);
+        wxLogMessage(wxT("Sensitive clipboard entry kept in memory until %s"), entry.expires.FormatTime());
+        return FILTER_EXPIRING;
+    }
+    entry.content = masked;
+    wxLogMessage(wxT("Masked sensitive content in clipboard entry"));
+    return FILTER_MASKED;
+}
+
+bool ClipboardFrame::MergeNearDuplicate(const ClipboardEntry& entry, const NearDuplicateIndex::Fingerprint& fingerprint) {
+    wxStopWatch stopWatch;
+    size_t id = 0;
+    double similarity = 0.0;
+    bool found = m_nearDuplicates.FindNearest(fingerprint, id, similarity);
+    double elapsedMs = stopWatch.TimeInMicro().ToDouble() / 1000.0;
+    m_nearDuplicateLookups++;
+    m_nearDuplicateMaxMs = wxMax(m_nearDuplicateMaxMs, elapsedMs);
+    
+    int index = found ? FindEntryIndex(id) : -1;
+    if (index < 0) {
+        return false;
+    }
+    
+    // The group keeps its id, and with it the frecency score, and moves to the top
+    ClipboardEntry merged = m_entries[index];
+    wxString previousContent = GetEntryContent(merged);
+    if (previousContent != entry.content) {
+        ClipboardVersion version;
+        version.content = previousContent;
+        version.timestamp = merged.timestamp;
+        merged.versions.push_back(version);
+        if (merged.versions.size() > MAX_VERSIONS) {
+            merged.versions.erase(merged.versions.begin());
+        }
+    }
+    merged.content = entry.content;
+    merged.compressed.reset();
+    merged.spilled.reset();
+    merged.timestamp = entry.timestamp;
+    merged.payloads = entry.payloads;
+    
+    m_entries.erase(m_entries.begin() + index);
+    m_entries.insert(m_entries.begin(), merged);
+    if (m_searchQuery.IsEmpty()) {
+        m_listCtrl->DeleteItem(index);
+        InsertListItem(0, merged);
+    }
+    
+    RecordEntryUse(merged.id, merged.timestamp);
+    m_timeIndex.Add(merged.id, (int64_t)merged.timestamp.GetTicks());
+    m_nearDuplicates.Add(merged.id, fingerprint);
+    m_controlEntries.erase(merged.id);
+    m_nearDuplicateMerges++;
+    if (m_searchIndexed) {
+        m_search.Remove(merged.id);
+        m_search.Add(merged.id, ToUTF8(merged.content));
+    }
+    if (!m_searchQuery.IsEmpty()) {
+        StartSearch();
+    }
+    
+    wxLogMessage(wxT("Merged near-duplicate clip into existing entry (similarity %.2f, %lu earlier versions)"),
+                 similarity, (unsigned long)merged.versions.size());
+    return true;
+}
+
+void ClipboardFrame::PurgeExpiredEntries() {
+    wxDateTime now = wxDateTime::Now();
+    // List rows mirror m_entries, so remove from the back to keep indices valid
+    bool removed = false;
+    for (size_t i = m_entries.size(); i-- > 0;) {
+        if (m_entries[i].expires.IsValid() && m_entries[i].expires <= now) {
+            RemoveEntryAt(i);
+            removed = true;
+            wxLogMessage(wxT("Expired sensitive clipboard entry"));
+        }
+    }
+    if (removed && !m_searchQuery.IsEmpty()) {
+        StartSearch();
+    }
 }
 
 wxString ClipboardFrame::GetClipboardText() {
     wxString text;
     try {
-        if (wxTheClipboard && wxTheClipboard->Open()) {
-            if (wxTheClipboard->IsSupported(wxDF_TEXT)) {
+        if (m_clipboard && m_clipboard->Open()) {
+            if (m_clipboard->IsSupported(wxDF_TEXT)) {
                 wxTextDataObject data;
-                if (wxTheClipboard->GetData(data)) {
+                if (m_clipboard->GetData(data)) {
                     text = data.GetText();
                 }
             }
-            wxTheClipboard->Close();
+            m_clipboard->Close();
         } else {
             wxLogError(wxT("Failed to open clipboard for reading"));
+            m_clipboardReadFailed = true;
         }
     }
     catch (const std::exception& e) {
         wxLogError(wxT("Exception in GetClipboardText: %s"), e.what());
-        if (wxTheClipboard && wxTheClipboard->IsOpened()) {
-            wxTheClipboard->Close();
+        if (m_clipboard && m_clipboard->IsOpened()) {
+            m_clipboard->Close();
         }
     }
     catch (...) {
         wxLogError(wxT("Unknown exception in GetClipboardText"));
-        if (wxTheClipboard && wxTheClipboard->IsOpened()) {
-            wxTheClipboard->Close();
+        if (m_clipboard && m_clipboard->IsOpened()) {
+            m_clipboard->Close();
         }
     }
     return text;
 }
 
+wxArrayString ClipboardFrame::GetClipboardFiles() {
+    wxArrayString files;
+    try {
+        if (m_clipboard && m_clipboard->Open()) {
+            if (m_clipboard->IsSupported(wxDF_FILENAME)) {
+                wxFileDataObject data;
+                if (m_clipboard->GetData(data)) {
+                    files = data.GetFilenames();
+                }
+            }
+            m_clipboard->Close();
+        } else {
+            wxLogError(wxT("Failed to open clipboard for file list reading"));
+            m_clipboardReadFailed = true;
+        }
+    }
+    catch (const std::exception& e) {
+        wxLogError(wxT("Exception in GetClipboardFiles: %s"), e.what());
+        if (m_clipboard && m_clipboard->IsOpened()) {
+            m_clipboard->Close();
+        }
+    }
+    catch (...) {
+        wxLogError(wxT("Unknown exception in GetClipboardFiles"));
+        if (m_clipboard && m_clipboard->IsOpened()) {
+            m_clipboard->Close();
+        }
+    }
+    return files;
+}
+
 wxBitmap ClipboardFrame::GetClipboardBitmap() {
     wxBitmap bitmap;
     try {
-        if (wxTheClipboard && wxTheClipboard->Open()) {
-            if (wxTheClipboard->IsSupported(wxDF_BITMAP)) {
+        if (m_clipboard && m_clipboard->Open()) {
+            if (m_clipboard->IsSupported(wxDF_BITMAP)) {
                 wxBitmapDataObject data;
-                if (wxTheClipboard->GetData(data)) {
+                if (m_clipboard->GetData(data)) {
                     bitmap = data.GetBitmap();
                 }
             }
-            wxTheClipboard->Close();
+            m_clipboard->Close();
         } else {
             wxLogError(wxT("Failed to open clipboard for bitmap reading"));
+            m_clipboardReadFailed = true;
         }
     }
     catch (const std::exception& e) {
         wxLogError(wxT("Exception in GetClipboardBitmap: %s"), e.what());
-        if (wxTheClipboard && wxTheClipboard->IsOpened()) {
-            wxTheClipboard->Close();
+        if (m_clipboard && m_clipboard->IsOpened()) {
+            m_clipboard->Close();
         }
     }
     catch (...) {
         wxLogError(wxT("Unknown exception in GetClipboardBitmap"));
-        if (wxTheClipboard && wxTheClipboard->IsOpened()) {
-            wxTheClipboard->Close();
+        if (m_clipboard && m_clipboard->IsOpened()) {
+            m_clipboard->Close();
         }
     }
     return bitmap;
@@ -523,14 +1736,19 @@ wxString ClipboardFrame::SaveImageToFile(const wxBitmap& bitmap, size_t id) {
                                            (unsigned long)id,
                                            wxDateTime::Now().Format(wxT("%Y%m%d_%H%M%S")));
         
-        // Convert bitmap to image and save as PNG
+        // Convert bitmap to image and save as PNG, encoded in memory so it can be sealed
         wxImage image = bitmap.ConvertToImage();
-        if (image.IsOk() && image.SaveFile(filename, wxBITMAP_TYPE_PNG)) {
-            wxLogMessage(wxT("Saved image to: %s"), filename);
-            return filename;
-        } else {
-            wxLogError(wxT("Failed to save image to: %s"), filename);
+        wxMemoryOutputStream png;
+        if (image.IsOk() && image.SaveFile(png, wxBITMAP_TYPE_PNG)) {
+            std::string data(png.GetSize(), '\0');
+            png.CopyTo(&data[0], data.size());
+            wxString path = WriteStoredFile(filename, data.data(), data.size());
+            if (!path.IsEmpty()) {
+                wxLogMessage(wxT("Saved image to: %s"), path);
+                return path;
+            }
         }
+        wxLogError(wxT("Failed to save image to: %s"), filename);
     }
     catch (const std::exception& e) {
         wxLogError(wxT("Exception in SaveImageToFile: %s"), e.what());
@@ -541,35 +1759,151 @@ wxString ClipboardFrame::SaveImageToFile(const wxBitmap& bitmap, size_t id) {
     return wxEmptyString;
 }
 
+void ClipboardFrame::CapturePayloads(ClipboardEntry& entry) {
+    try {
+        if (!m_clipboard || !m_clipboard->Open()) {
+            wxLogError(wxT("Failed to open clipboard for format capture"));
+            return;
+        }
+        
+        // Cheap formats are always captured unless they are already the main content
+        if (entry.type != wxT("Text") && m_clipboard->IsSupported(wxDF_TEXT)) {
+            wxTextDataObject data;
+            if (m_clipboard->GetData(data) && !data.GetText().IsEmpty()) {
+                std::string text = ToUTF8(data.GetText());
+                ClipboardPayload payload;
+                payload.format = wxT("Text");
+                payload.size = text.size();
+                payload.path = SavePayloadToFile(text.data(), text.size(), entry.id, wxT("txt"));
+                entry.payloads.push_back(payload);
+            }
+        }
+        if (entry.type != wxT("File") && m_clipboard->IsSupported(wxDF_FILENAME)) {
+            wxFileDataObject data;
+            if (m_clipboard->GetData(data) && !data.GetFilenames().IsEmpty()) {
+                std::string files = ToUTF8(wxJoin(data.GetFilenames(), wxT('\n'), wxT('\0')));
+                ClipboardPayload payload;
+                payload.format = wxT("Files");
+                payload.size = files.size();
+                payload.path = SavePayloadToFile(files.data(), files.size(), entry.id, wxT("files"));
+                entry.payloads.push_back(payload);
+            }
+        }
+        
+        // Expensive formats are sized first and only copied if they fit the budget
+        for (const PayloadFormat& format : RAW_PAYLOAD_FORMATS) {
+            wxDataFormat dataFormat(format.nativeName);
+            if (!m_clipboard->IsSupported(dataFormat)) {
+                continue;
+            }
+            
+            ClipboardPayload payload;
+            payload.format = format.name;
+            payload.size = QueryFormatSize(dataFormat);
+            
+            if (payload.size <= MAX_PAYLOAD_BYTES) {
+                wxCustomDataObject data(dataFormat);
+                if (m_clipboard->GetData(data) && data.GetSize() <= MAX_PAYLOAD_BYTES) {
+                    payload.size = data.GetSize();
+                    payload.path = SavePayloadToFile(data.GetData(), data.GetSize(), entry.id, format.extension);
+                }
+            } else {
+                wxLogMessage(wxT("Recording %s format (%lu bytes) as metadata only"),
+                             format.name, (unsigned long)payload.size);
+            }
+            entry.payloads.push_back(payload);
+        }
+        
+        m_clipboard->Close();
+    }
+    catch (const std::exception& e) {
+        wxLogError(wxT("Exception in CapturePayloads: %s"), e.what());
+        if (m_clipboard && m_clipboard->IsOpened()) {
+            m_clipboard->Close();
+        }
+    }
+    catch (...) {
+        wxLogError(wxT("Unknown exception in CapturePayloads"));
+        if (m_clipboard && m_clipboard->IsOpened()) {
+            m_clipboard->Close();
+        }
+    }
+}
+
+wxString ClipboardFrame::SavePayloadToFile(const void* data, size_t size, size_t id, const wxString& extension) {
+    if (!wxDirExists(PAYLOAD_DIR)) {
+        wxMkdir(PAYLOAD_DIR);
+    }
+    
+    // Generate filename with id, timestamp and format extension
+    wxString filename = wxString::Format(wxT("%s/payload_%lu_%s.%s"),
+                                       PAYLOAD_DIR,
+                                       (unsigned long)id,
+                                       wxDateTime::Now().Format(wxT("%Y%m%d_%H%M%S")),
+                                       extension);
+    
+    wxString path = WriteStoredFile(filename, data, size);
+    if (path.IsEmpty()) {
+        wxLogError(wxT("Failed to save clipboard payload to: %s"), filename);
+    }
+    return path;
+}
+
+wxString ClipboardFrame::WriteStoredFile(const wxString& path, const void* data, size_t size) {
+    wxString storedPath = path;
+    std::string sealed;
+    if (m_settings.encryption != wxT("none") && m_cipher->IsEnabled()) {
+        storedPath += SEALED_FILE_SUFFIX;
+        sealed = SealData(std::string((const char*)data, size), ToUTF8(storedPath));
+        data = sealed.data();
+        size = sealed.size();
+    }
+    wxFFile file(storedPath, wxT("wb"));
+    if (!file.IsOpened() || file.Write(data, size) != size) {
+        return wxEmptyString;
+    }
+    return storedPath;
+}
+
+std::string ClipboardFrame::SealData(const std::string& plaintext, const std::string& associated) {
+    wxStopWatch stopWatch;
+    std::string sealed = m_cipher->Seal(plaintext, associated);
+    m_sealMs += stopWatch.TimeInMicro().ToDouble() / 1000.0;
+    m_sealCount++;
+    m_sealBytes += plaintext.size();
+    return sealed;
+}
+
 wxString ClipboardFrame::DetermineDataType() {
     wxString type = wxT("Text");
     try {
-        if (!wxTheClipboard || !wxTheClipboard->Open()) {
+        if (!m_clipboard || !m_clipboard->Open()) {
             wxLogError(wxT("Failed to open clipboard for type determination"));
+            m_clipboardReadFailed = true;
             return wxT("Unknown");
         }
         
-        if (wxTheClipboard->IsSupported(wxDF_BITMAP)) {
+        if (m_clipboard->IsSupported(wxDF_BITMAP)) {
             type = wxT("Image");
-        } else if (wxTheClipboard->IsSupported(wxDF_FILENAME)) {
+        } else if (m_clipboard->IsSupported(wxDF_FILENAME)) {
             type = wxT("File");
-        } else if (wxTheClipboard->IsSupported(wxDF_TEXT)) {
+        } else if (m_clipboard->IsSupported(wxDF_TEXT)) {
             type = wxT("Text");
         }
         
-        wxTheClipboard->Close();
+        m_clipboard->Close();
     }
     catch (const std::exception& e) {
         wxLogError(wxT("Exception in DetermineDataType: %s"), e.what());
-        if (wxTheClipboard && wxTheClipboard->IsOpened()) {
-            wxTheClipboard->Close();
+        if (m_clipboard && m_clipboard->IsOpened()) {
+            m_clipboard->Close();
         }
         type = wxT("Unknown");
     }
     catch (...) {
         wxLogError(wxT("Unknown exception in DetermineDataType"));
-        if (wxTheClipboard && wxTheClipboard->IsOpened()) {
-            wxTheClipboard->Close();
+        if (m_clipboard && m_clipboard->IsOpened()) {
+            m_clipboard->Close();
         }
         type = wxT("Unknown");
     }
@@ -632,61 +1966,343 @@ wxString ClipboardFrame::CalculateImageHash(const wxBitmap& bitmap) {
     return wxEmptyString;
 }
 
-void ClipboardFrame::CopyImageToClipboard(const wxString& imagePath) {
+void ClipboardFrame::RestoreEntry(const ClipboardEntry& entry) {
     try {
-        if (!wxFileExists(imagePath)) {
-            wxLogError(wxT("Image file not found: %s"), imagePath);
-            return;
-        }
+        // Formats are only advertised here; payloads are read when a consumer pastes
+        wxDataObjectComposite* data = new wxDataObjectComposite();
         
-        // Load image from file
-        wxImage image(imagePath, wxBITMAP_TYPE_PNG);
-        if (!image.IsOk()) {
-            wxLogError(wxT("Failed to load image: %s"), imagePath);
-            return;
+        if (entry.type == wxT("Image")) {
+            if (!wxFileExists(entry.imagePath)) {
+                wxLogError(wxT("Image file not found: %s"), entry.imagePath);
+                delete data;
+                return;
+            }
+            bool hasOriginalPng = false;
+            for (const auto& payload : entry.payloads) {
+                hasOriginalPng = hasOriginalPng || (payload.format == wxT("PNG") && !payload.path.IsEmpty());
+            }
+            AddImageFormats(data, entry.imagePath, !hasOriginalPng);
+        } else if (entry.type == wxT("File")) {
+            wxFileDataObject* files = new wxFileDataObject();
+            wxArrayString filenames = wxSplit(GetEntryContent(entry), wxT('\n'), wxT('\0'));
+            for (const auto& filename : filenames) {
+                files->AddFile(filename);
+            }
+            data->Add(files, true);
+        } else {
+            // Compressed or spilled text is decoded only when a consumer pastes
+            ClipboardEntry text;
+            text.id = entry.id;
+            text.content = entry.content;
+            text.compressed = entry.compressed;
+            text.spilled = entry.spilled;
+            data->Add(new LazyTextDataObject([text]() { return GetEntryContent(text); }), true);
         }
         
-        // Convert to bitmap and copy to clipboard
-        wxBitmap bitmap(image);
-        if (bitmap.IsOk() && wxTheClipboard->Open()) {
-            wxTheClipboard->SetData(new wxBitmapDataObject(bitmap));
-            wxTheClipboard->Close();
-            wxLogMessage(wxT("Copied image to clipboard: %s"), imagePath);
+        AddPayloadFormats(data, entry);
+        
+        if (SetClipboardData(data)) {
+            // Prevent re-adding; compared by id, so the text isn't decoded here
+            m_lastClipboardContent.Clear();
+            m_restoredEntryId = entry.id;
+            RecordEntryUse(entry.id, wxDateTime::Now());
+            wxLogMessage(wxT("Restored %s entry to clipboard"), entry.type);
         } else {
-            wxLogError(wxT("Failed to copy image to clipboard: %s"), imagePath);
+            wxLogError(wxT("Failed to restore %s entry to clipboard"), entry.type);
         }
     }
     catch (const std::exception& e) {
-        wxLogError(wxT("Exception in CopyImageToClipboard: %s"), e.what());
+        wxLogError(wxT("Exception in RestoreEntry: %s"), e.what());
     }
     catch (...) {
-        wxLogError(wxT("Unknown exception in CopyImageToClipboard"));
+        wxLogError(wxT("Unknown exception in RestoreEntry"));
     }
 }
 
+// Only a restore reads its own text back (clipboards without change counts);
+// an entry held compressed or spilled is decoded only if the size matches
+bool ClipboardFrame::IsRestoredContent(const wxString& content) const {
+    int index = m_restoredEntryId != 0 ? FindEntryIndex(m_restoredEntryId) : -1;
+    if (index < 0) {
+        return false;
+    }
+    const ClipboardEntry& entry = m_entries[index];
+    if (entry.spilled || entry.compressed) {
+        size_t size = entry.spilled ? entry.spilled->textSize : entry.compressed->size;
+        if (ToUTF8(content).size() != size) {
+            return false;
+        }
+    }
+    return GetEntryContent(entry) == content;
+}
+
+void ClipboardFrame::AddPayloadFormats(wxDataObjectComposite* data, const ClipboardEntry& entry) {
+    std::shared_ptr<const StorageCipher> cipher = m_cipher;
+    for (const auto& payload : entry.payloads) {
+        if (payload.path.IsEmpty()) {
+            continue; // Too large when captured, only metadata was kept
+        }
+        
+        wxString path = payload.path;
+        if (payload.format == wxT("Text")) {
+            data->Add(new LazyTextDataObject([path, cipher]() {
+                wxMemoryBuffer buffer = ReadStoredFile(path, cipher.get());
+                return wxString::FromUTF8((const char*)buffer.GetData(), buffer.GetDataLen());
+            }));
+        } else if (payload.format == wxT("Files")) {
+            wxFileDataObject* files = new wxFileDataObject();
+            wxMemoryBuffer buffer = ReadStoredFile(path, cipher.get());
+            wxString list = wxString::FromUTF8((const char*)buffer.GetData(), buffer.GetDataLen());
+            for (const auto& filename : wxSplit(list, wxT('\n'), wxT('\0'))) {
+                files->AddFile(filename);
+            }
+            data->Add(files);
+        } else {
+            wxDataFormat format = GetPayloadDataFormat(payload.format);
+            if (format.GetType() != wxDF_INVALID) {
+                data->Add(new LazyBlobDataObject(format, [path, cipher]() { return ReadStoredFile(path, cipher.get()); }));
+            }
+        }
+    }
+}
+
+void ClipboardFrame::AddImageFormats(wxDataObjectComposite* data, const wxString& imagePath, bool includePng) {
+    // Advertise PNG and bitmap formats now; the file is read and decoded
+    // only when a consumer pastes, using the prefetched copy if available
+    std::shared_ptr<ImagePrefetcher> prefetcher = m_prefetcher;
+    std::shared_ptr<const StorageCipher> cipher = m_cipher;
+    
+    if (includePng) {
+        data->Add(new LazyBlobDataObject(wxDataFormat(wxDF_PNG), [prefetcher, cipher, imagePath]() {
+            wxMemoryBuffer png;
+            if (!prefetcher->GetPngData(imagePath, png)) {
+                png = ReadStoredFile(imagePath, cipher.get());
+            }
+            return png;
+        }), true);
+    }
+    data->Add(new LazyBitmapDataObject([prefetcher, cipher, imagePath]() {
+        wxImage image;
+        if (!prefetcher->GetImage(imagePath, image)) {
+            wxMemoryBuffer png = ReadStoredFile(imagePath, cipher.get());
+            if (!png.IsEmpty()) {
+                wxMemoryInputStream stream(png.GetData(), png.GetDataLen());
+                image.LoadFile(stream, wxBITMAP_TYPE_PNG);
+            }
+        }
+        if (!image.IsOk()) {
+            wxLogError(wxT("Failed to load image: %s"), imagePath);
+            return wxBitmap();
+        }
+        return wxBitmap(image);
+    }), !includePng);
+}
+
+bool ClipboardFrame::SetClipboardData(wxDataObject* data) {
+#ifdef __WXGTK__
+    m_clipboard->UsePrimarySelection(false);
+#endif
+    if (!m_clipboard->Open()) {
+        delete data;
+        return false;
+    }
+    
+    bool ok = m_clipboard->SetData(data);
+    m_clipboard->Close();
+    
+    if (ok) {
+        m_ownsClipboardData = true;
+        // Our own change must not be captured again; reading it back would
+        // also force the delayed rendering we are trying to avoid
+        m_lastChangeCount = m_clipboardMonitor.GetChangeCount();
+    }
+    return ok;
+}
+
+int ClipboardFrame::FindEntryIndex(size_t id) const {
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        if (m_entries[i].id == id) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int ClipboardFrame::GetEntryIndexForRow(long row) const {
+    if (row < 0) {
+        return -1;
+    }
+    // While searching, rows hold results; the entry may have been removed since
+    if (!m_searchQuery.IsEmpty()) {
+        return row < (long)m_resultIds.size() ? FindEntryIndex(m_resultIds[row]) : -1;
+    }
+    return row < (long)m_entries.size() ? (int)row : -1;
+}
+
+void ClipboardFrame::InsertListItem(long index, const ClipboardEntry& entry) {
+    long item = m_listCtrl->InsertItem(index, entry.timestamp.Format(wxT("%Y-%m-%d %H:%M:%S")));
+    wxString type = entry.type;
+    if (!entry.versions.empty()) {
+        type += wxString::Format(wxT(" (%lu)"), (unsigned long)entry.versions.size() + 1);
+    }
+    m_listCtrl->SetItem(item, 1, type);
+    m_listCtrl->SetItem(item, 2, FormatListContent(entry.content));
+}
+
+void ClipboardFrame::ForgetEntry(const ClipboardEntry& entry) {
+    m_frecency.Remove(entry.id);
+    m_nearDuplicates.Remove(entry.id);
+    m_search.Remove(entry.id);
+    m_timeIndex.Remove(entry.id);
+}
+
+void ClipboardFrame::RemoveEntryAt(size_t index) {
+    ForgetEntry(m_entries[index]);
+    m_entries.erase(m_entries.begin() + index);
+    // Search results are refreshed by the caller
+    if (m_searchQuery.IsEmpty()) {
+        m_listCtrl->DeleteItem((long)index);
+    }
+}
+
+void ClipboardFrame::RecordEntryUse(size_t id, const wxDateTime& time) {
+    m_frecency.RecordUse(id, (int64_t)time.GetTicks());
+}
+
 void ClipboardFrame::AddClipboardEntry(const ClipboardEntry& entry) {
     // Add to internal storage
     m_entries.insert(m_entries.begin(), entry); // Add at beginning (most recent first)
-    
-    // Limit to 1000 entries
-    if (m_entries.size() > 1000) {
-        m_entries.resize(1000);
+    RecordEntryUse(entry.id, entry.timestamp);
+    m_timeIndex.Add(entry.id, (int64_t)entry.timestamp.GetTicks());
+    if (m_searchIndexed) {
+        m_search.Add(entry.id, ToUTF8(GetEntryContent(entry)));
     }
     
     // Add to list control
-    long index = m_listCtrl->InsertItem(0, entry.timestamp.Format(wxT("%Y-%m-%d %H:%M:%S")));
-    m_listCtrl->SetItem(index, 1, entry.type);
+    if (m_searchQuery.IsEmpty()) {
+        InsertListItem(0, entry);
+    }
     
-    // Truncate long content for display
-    wxString displayContent = entry.content;
-    if (displayContent.Length() > 100) {
-        displayContent = displayContent.Left(100) + wxT("...");
+    while (m_entries.size() > MAX_ENTRIES) {
+        RemoveEntryAt(m_entries.size() - 1);
     }
-    // Replace newlines with spaces for display
-    displayContent.Replace(wxT("\n"), wxT(" "));
-    displayContent.Replace(wxT("\r"), wxT(" "));
     
-    m_listCtrl->SetItem(index, 2, displayContent);
+    // The new entry may match the query
+    if (!m_searchQuery.IsEmpty()) {
+        StartSearch();
+    }
+}
+
+bool ClipboardFrame::IsDuplicateEntry(const ClipboardEntry& entry) const {
+    wxString content;
+    for (size_t id : m_timeIndex.Range((int64_t)entry.timestamp.GetTicks(), (int64_t)entry.timestamp.GetTicks())) {
+        int index = FindEntryIndex(id);
+        if (index < 0 || m_entries[index].type != entry.type) {
+            continue;
+        }
+        if (content.IsEmpty()) {
+            content = GetEntryContent(entry);
+        }
+        if (GetEntryContent(m_entries[index]) == content) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ClipboardFrame::ImportRecords(const std::vector<HistoryRecord>& records) {
+    std::vector<ClipboardEntry> entries;
+    size_t skipped = 0;
+    for (const auto& record : records) {
+        // Only plain text is filtered in full: compressed content would be filtered as its
+        // preview and saved unmasked, sealed content is not text. Exports never carry either.
+        if (record.FindAttribute("lz") || record.FindAttribute("enc")) {
+            skipped++;
+            continue;
+        }
+        ClipboardEntry entry;
+        if (!RecordToEntry(record, entry) || !entry.timestamp.IsValid()) {
+            skipped++;
+            continue;
+        }
+        // Files are read on restore and deleted with the entry: only our own directories
+        bool ownFiles = entry.imagePath.IsEmpty() || IsFileInDirectory(entry.imagePath, wxT("clipboard_images"));
+        for (const auto& payload : entry.payloads) {
+            ownFiles = ownFiles && (payload.path.IsEmpty() || IsFileInDirectory(payload.path, PAYLOAD_DIR));
+        }
+        if (!ownFiles) {
+            wxLogMessage(wxT("Rejected imported entry referring to files outside the history directories"));
+            skipped++;
+            continue;
+        }
+        // Imported text is filtered like copied text, earlier versions included
+        if (entry.type != wxT("Image")) {
+            wxString notificationText;
+            if (ApplySensitiveFilter(entry, notificationText) == FILTER_DROPPED) {
+                skipped++;
+                continue;
+            }
+            std::vector<ClipboardVersion> versions;
+            for (const auto& version : entry.versions) {
+                ClipboardEntry earlier;
+                earlier.content = version.content;
+                earlier.timestamp = version.timestamp;
+                FilterResult result = ApplySensitiveFilter(earlier, notificationText);
+                if (result == FILTER_CLEAN || result == FILTER_MASKED) {
+                    versions.push_back(version);
+                    versions.back().content = earlier.content;
+                }
+            }
+            entry.versions.swap(versions);
+        }
+        // Entries older than everything in a full history would be trimmed right away
+        bool tooOld = m_entries.size() >= MAX_ENTRIES && entry.timestamp.IsEarlierThan(m_entries.back().timestamp);
+        if (tooOld || IsDuplicateEntry(entry)) {
+            skipped++;
+            continue;
+        }
+        entry.id = m_nextId++;
+        entries.push_back(entry);
+    }
+    m_importSkipped += skipped;
+    if (!entries.empty()) {
+        InsertEntries(entries);
+    }
+    wxLogMessage(wxT("Imported %lu history entries (%lu skipped as invalid, sensitive, duplicate or too old)"),
+                 (unsigned long)entries.size(), (unsigned long)skipped);
+}
+
+void ClipboardFrame::InsertEntries(std::vector<ClipboardEntry>& entries) {
+    // One pass over the indexes, one re-sort, one list rebuild and one save for the whole batch
+    for (auto& entry : entries) {
+        RecordEntryUse(entry.id, entry.timestamp);
+        m_timeIndex.Add(entry.id, (int64_t)entry.timestamp.GetTicks());
+        if (m_searchIndexed) {
+            m_search.Add(entry.id, ToUTF8(GetEntryContent(entry)));
+        }
+        // Expiring entries stay separate, as when they are copied
+        if (m_nearDuplicatesIndexed && entry.type == wxT("Text") && !entry.expires.IsValid()) {
+            m_nearDuplicates.Add(entry.id, NearDuplicateIndex::Compute(ToUTF8(GetEntryContent(entry))));
+        }
+        m_entries.push_back(entry);
+    }
+    m_importedEntries += entries.size();
+    
+    // Imported entries may be older than the newest ones: keep the list newest first
+    std::stable_sort(m_entries.begin(), m_entries.end(), [](const ClipboardEntry& a, const ClipboardEntry& b) {
+        return a.timestamp.IsLaterThan(b.timestamp);
+    });
+    while (m_entries.size() > MAX_ENTRIES) {
+        ForgetEntry(m_entries.back());
+        m_entries.pop_back();
+    }
+    
+    if (m_searchQuery.IsEmpty()) {
+        ShowAllEntries();
+    } else {
+        StartSearch();
+    }
+    SaveToFile();
 }
 
 void ClipboardFrame::ShowFrame() {
@@ -707,95 +2323,527 @@ void ClipboardFrame::HideFrame() {
     Hide();
 }
 
+void ClipboardFrame::ShowStatistics() {
+    wxString stats = wxString::FromUTF8(m_scheduler.FormatStats().c_str());
+    stats += wxString::Format(wxT("\n\nSensitive filter: %lu scans, %lu with matches\n"
+                                  "Scan time: avg %.3f ms, max %.3f ms"),
+                              (unsigned long)m_filterScans, (unsigned long)m_filterMatches,
+                              m_filterScans ? m_filterTotalMs / m_filterScans : 0.0, m_filterMaxMs);
+    stats += wxString::Format(wxT("\n\nNear-duplicates: %lu merged in %lu lookups, slowest lookup %.3f ms"),
+                              (unsigned long)m_nearDuplicateMerges, (unsigned long)m_nearDuplicateLookups,
+                              m_nearDuplicateMaxMs);
+    stats += wxString::Format(wxT("\n\nQuick paste: opened %lu times, slowest %.1f ms"),
+                              (unsigned long)m_pickerOpens, m_pickerMaxOpenMs);
+    stats += wxString::Format(wxT("\nSearch: %lu queries, slowest %.1f ms to final results"),
+                              (unsigned long)m_searchQueries, m_searchMaxMs);
+    if (m_controlServer.IsRunning()) {
+        ControlServer::Stats control = m_controlServer.GetStats();
+        stats += wxString::Format(wxT("\nControl endpoint: %lu requests (%lu failed) on %lu connections, slowest %.1f ms"),
+                                  (unsigned long)control.requests, (unsigned long)control.errors,
+                                  (unsigned long)control.connections, control.maxRequestMs);
+    }
+    if (m_importedEntries || m_importSkipped) {
+        stats += wxString::Format(wxT("\nImports: %lu entries added, %lu skipped"),
+                                  (unsigned long)m_importedEntries, (unsigned long)m_importSkipped);
+    }
+    size_t compressedCount = 0;
+    size_t compressedBytes = 0;
+    size_t uncompressedBytes = 0;
+    for (const auto& entry : m_entries) {
+        if (entry.compressed) {
+            compressedCount++;
+            compressedBytes += entry.compressed->data.size();
+            uncompressedBytes += entry.compressed->size;
+        }
+    }
+    stats += wxString::Format(wxT("\n\nHistory: loaded in %.1f ms, %lu entries compressed (%.1f KB, %.1f KB uncompressed)"),
+                              m_historyLoadMs, (unsigned long)compressedCount,
+                              compressedBytes / 1024.0, uncompressedBytes / 1024.0);
+    stats += wxString::Format(wxT("\nSaves (%s): %lu snapshots written, %lu failed, slowest %.1f ms"),
+                              m_settings.syncPolicy, (unsigned long)m_snapshotWrites,
+                              (unsigned long)m_snapshotFailures, m_snapshotMaxMs);
+    if (m_sealCount > 0) {
+        stats += wxString::Format(wxT("\nEncryption (ChaCha20-Poly1305, %s): %lu records and files, %.1f KB sealed in %.1f ms"),
+                                  StorageCipher::GetImplementation(), (unsigned long)m_sealCount,
+                                  m_sealBytes / 1024.0, m_sealMs);
+    }
+    const double MB = 1024.0 * 1024.0;
+    MemoryUsage usage = GetMemoryUsage();
+    stats += wxString::Format(wxT("\n\nMemory (estimated): %.1f MB, peak %.1f MB, budget %s\n"
+                                  "Entries %.1f MB, list %.1f MB, images %.1f MB, notifications %.1f MB, "
+                                  "search index %.1f MB, caches %.1f MB"),
+                              usage.GetTotal() / MB, m_memoryPeakBytes / MB,
+                              m_settings.memoryBudgetMB > 0 ? wxString::Format(wxT("%d MB"), m_settings.memoryBudgetMB)
+                                                            : wxString(wxT("none")),
+                              usage.entries / MB, usage.previews / MB, usage.images / MB, usage.notifications / MB,
+                              usage.searchIndex / MB, usage.caches / MB);
+    if (m_cacheSheds > 0) {
+        stats += wxString::Format(wxT("\nOver budget %lu times: %lu entries spilled to disk (%.1f KB), slowest pass %.1f ms"),
+                                  (unsigned long)m_cacheSheds, (unsigned long)m_spilledEntries,
+                                  m_spilledBytes / 1024.0, m_memoryPolicyMaxMs);
+    }
+    wxMessageBox(stats, wxT("Clipboard Manager Statistics"), wxOK | wxICON_INFORMATION);
+}
+
 void ClipboardFrame::SaveToFile() {
-    wxTextFile file;
+    // Memory grows with the history, so it is checked on every change
+    MemoryUsage usage = ApplyMemoryPolicy();
+    // Every change to the history is saved, so clients see it right away
+    PublishControlSnapshot(usage);
     
-    if (wxFileName::FileExists(LOG_FILE)) {
-        file.Open(LOG_FILE);
-        file.Clear();
+    if (m_settings.syncPolicy == wxT("batched") && m_saveTimer) {
+        long long nowMs = wxGetLocalTimeMillis().GetValue();
+        long long dueMs = m_lastSnapshotMs + wxMax(m_settings.syncIntervalMs, 0);
+        if (nowMs < dueMs) {
+            // Saves within the interval share one snapshot
+            if (!m_saveTimer->IsRunning()) {
+                m_saveTimer->StartOnce((int)(dueMs - nowMs));
+            }
+            return;
+        }
+    }
+    WriteSnapshot();
+}
+
+void ClipboardFrame::OnSaveTimer(wxTimerEvent& event) {
+    WriteSnapshot();
+}
+
+void ClipboardFrame::WriteSnapshot() {
+    if (m_saveTimer) {
+        m_saveTimer->Stop();
+    }
+    if (m_storageLocked) {
+        return;
+    }
+    wxStopWatch stopWatch;
+    bool seal = m_settings.encryption != wxT("none") && m_cipher->IsEnabled();
+    
+    std::string data;
+    for (auto& entry : m_entries) {
+        // Expiring entries hold secrets and never reach the disk
+        if (entry.expires.IsValid()) {
+            continue;
+        }
+        CompressEntry(entry);
+        // Newlines are escaped by the record format
+        HistoryRecord record = EntryToRecord(entry);
+        if (m_frecency.Contains(entry.id)) {
+            char score[32];
+            snprintf(score, sizeof(score), "%.9f", m_frecency.GetScore(entry.id));
+            record.AddAttribute("frec", score);
+        }
+        if (seal) {
+            record = MakeSealedRecord(record, SealData(FormatHistoryRecord(record), GetSealedRecordAssociatedData(record)));
+        }
+        data += FormatHistoryRecord(record);
+        data += '\n';
+    }
+    for (const auto& line : m_unreadableRecords) {
+        data += line;
+        data += '\n';
+    }
+    
+    // Written as bytes (compressed content is not valid UTF-8) to a temporary
+    // file that replaces the history, so a crash never leaves a partial file
+    if (!WriteFileAtomically(ToUTF8(LOG_FILE), data, m_settings.syncPolicy != wxT("never"))) {
+        wxLogError(wxT("Failed to write history file: %s"), LOG_FILE);
+        m_snapshotFailures++;
     } else {
-        file.Create(LOG_FILE);
+        // A failed write leaves the batch interval open, so the next save retries
+        m_lastSnapshotMs = wxGetLocalTimeMillis().GetValue();
+        m_snapshotWrites++;
+    }
+    m_snapshotMaxMs = wxMax(m_snapshotMaxMs, stopWatch.TimeInMicro().ToDouble() / 1000.0);
+}
+
+void ClipboardFrame::CompressEntry(ClipboardEntry& entry) {
+    if (entry.compressed || entry.spilled || entry.type == wxT("Image") || !m_settings.compressionEnabled) {
+        return;
+    }
+    std::string text = ToUTF8(entry.content);
+    if (text.size() < (size_t)wxMax(m_settings.compressionMinBytes, 1)) {
+        return;
+    }
+    std::shared_ptr<CompressedText> compressed = std::make_shared<CompressedText>();
+    // Content that doesn't shrink (already compressed or random data) stays as it is
+    if (!TextCompressor::Compress(text, *compressed)) {
+        return;
+    }
+    // Compressed once; the full text is no longer kept in memory
+    entry.compressed = compressed;
+    entry.content = PreviewFromUTF8(text);
+}
+
+MemoryUsage ClipboardFrame::GetMemoryUsage() const {
+    MemoryUsage usage = {};
+    usage.entries = (m_entries.capacity() - m_entries.size()) * sizeof(ClipboardEntry);
+    for (const auto& entry : m_entries) {
+        usage.entries += GetEntryMemoryBytes(entry);
+    }
+    long rows = m_listCtrl ? m_listCtrl->GetItemCount() : 0;
+    for (long row = 0; row < rows; ++row) {
+        int index = GetEntryIndexForRow(row);
+        if (index >= 0) {
+            usage.previews += GetListRowBytes(m_entries[index]);
+        }
     }
+    usage.images = m_prefetcher->GetMemoryBytes();
+    // Popups are top-level children of the frame until they close
+    for (wxWindowList::compatibility_iterator node = GetChildren().GetFirst(); node; node = node->GetNext()) {
+        if (NotificationPopup* popup = dynamic_cast<NotificationPopup*>(node->GetData())) {
+            usage.notifications += popup->GetMemoryBytes();
+        }
+    }
+    usage.searchIndex = m_search.GetMemoryBytes();
+    usage.caches = m_nearDuplicates.GetMemoryBytes() + m_frecency.GetMemoryBytes() + m_timeIndex.GetMemoryBytes() +
+                   GetControlEntriesBytes(m_controlEntries);
+    return usage;
+}
+
+MemoryUsage ClipboardFrame::ApplyMemoryPolicy() {
+    wxStopWatch stopWatch;
+    // Blocks are never reused: once no entry refers to the spill file, it
+    // goes with its last reader and the next spill starts a new one
+    if (m_spillFile && std::none_of(m_entries.begin(), m_entries.end(),
+                                    [](const ClipboardEntry& entry) { return entry.spilled != nullptr; })) {
+        m_spillFile.reset();
+    }
+    
+    MemoryUsage usage = GetMemoryUsage();
+    size_t total = usage.GetTotal();
+    m_memoryPeakBytes = wxMax(m_memoryPeakBytes, total);
+    size_t budget = (size_t)wxMax(m_settings.memoryBudgetMB, 0) * 1024 * 1024;
+    if (budget == 0 || total <= budget) {
+        return usage;
+    }
+    
+    // Caches first: they are rebuilt when needed. The near-duplicate index
+    // stays, it is small and rebuilding it reads every entry on each capture.
+    m_prefetcher->Clear();
+    total -= usage.images;
+    usage.images = 0;
+    // A query that is shown still needs its index
+    if (m_searchIndexed && m_searchQuery.IsEmpty()) {
+        m_search.Clear();
+        m_searchIndexed = false;
+        total -= usage.searchIndex;
+        usage.searchIndex = 0;
+    }
+    m_cacheSheds++;
     
+    // Then the content of the oldest entries, down to the low watermark so
+    // the next few captures don't spill again
+    if (total > budget) {
+        size_t target = budget / 100 * MEMORY_LOW_WATERMARK_PERCENT;
+        for (auto it = m_entries.rbegin(); total > target && it != m_entries.rend(); ++it) {
+            size_t before = GetEntryMemoryBytes(*it);
+            if (SpillEntry(*it)) {
+                size_t freed = before - wxMin(before, GetEntryMemoryBytes(*it));
+                total -= wxMin(total, freed);
+                usage.entries -= wxMin(usage.entries, freed);
+            }
+        }
+    }
+    m_memoryPolicyMaxMs = wxMax(m_memoryPolicyMaxMs, stopWatch.TimeInMicro().ToDouble() / 1000.0);
+    return usage;
+}
+
+bool ClipboardFrame::SpillEntry(ClipboardEntry& entry) {
+    // Images only hold a description; expiring entries hold secrets that never reach the disk
+    if (entry.spilled || entry.type == wxT("Image") || entry.expires.IsValid()) {
+        return false;
+    }
+    CompressEntry(entry);
+    std::string stored = entry.compressed ? entry.compressed->data : ToUTF8(entry.content);
+    // The preview stays in memory either way
+    if (stored.size() <= PREVIEW_BYTES) {
+        return false;
+    }
+    if (!m_spillFile) {
+        // Numbered: a file still read by control clients keeps its name until they are done
+        wxString path = wxString::Format(wxT("clipboard_history.%lu.spill"), (unsigned long)++m_spillFileCount);
+        bool seal = m_settings.encryption != wxT("none") && m_cipher->IsEnabled();
+        std::shared_ptr<SpillFile> file = std::make_shared<SpillFile>();
+        if (!file->Open(ToUTF8(path), seal ? m_cipher : std::shared_ptr<StorageCipher>())) {
+            wxLogError(wxT("Failed to create spill file: %s"), path);
+            return false;
+        }
+        m_spillFile = file;
+    }
+    
+    std::shared_ptr<SpilledText> spilled = std::make_shared<SpilledText>();
+    spilled->file = m_spillFile;
+    spilled->compressed = entry.compressed != nullptr;
+    spilled->dictionary = entry.compressed ? entry.compressed->dictionary : 0;
+    spilled->textSize = entry.compressed ? entry.compressed->size : stored.size();
+    if (!m_spillFile->Write(stored, spilled->offset, spilled->size)) {
+        wxLogError(wxT("Failed to write spill file"));
+        return false;
+    }
+    if (!entry.compressed) {
+        entry.content = PreviewFromUTF8(stored);
+    }
+    entry.compressed.reset();
+    entry.spilled = spilled;
+    m_spilledEntries++;
+    m_spilledBytes += spilled->size;
+    return true;
+}
+
+void ClipboardFrame::EnsureNearDuplicateIndex() {
+    if (m_nearDuplicatesIndexed) {
+        return;
+    }
+    m_nearDuplicatesIndexed = true;
+    // Needs the full text of every entry, so it is built when the first text is captured
     for (const auto& entry : m_entries) {
-        wxString line = wxString::Format(wxT("%s|%s|%s"), 
-                                       entry.timestamp.Format(wxT("%Y-%m-%d %H:%M:%S")),
-                                       entry.type,
-                                       entry.content);
-        // Escape newlines for storage
-        line.Replace(wxT("\n"), wxT("\\n"));
-        line.Replace(wxT("\r"), wxT("\\r"));
-        file.AddLine(line);
+        if (entry.type == wxT("Text")) {
+            m_nearDuplicates.Add(entry.id, NearDuplicateIndex::Compute(ToUTF8(GetEntryContent(entry))));
+        }
+    }
+}
+
+void ClipboardFrame::EnsureSearchIndex() {
+    if (m_searchIndexed) {
+        return;
+    }
+    m_searchIndexed = true;
+    // Decompresses every entry, so it is left until the first query
+    for (const auto& entry : m_entries) {
+        m_search.Add(entry.id, ToUTF8(GetEntryContent(entry)));
+    }
+}
+
+void ClipboardFrame::OnSearchText(wxCommandEvent& event) {
+    wxString query = m_searchCtrl->GetValue();
+    query.Trim(true).Trim(false);
+    if (query == m_searchQuery) {
+        return;
+    }
+    m_searchQuery = query;
+    if (m_searchQuery.IsEmpty()) {
+        m_search.Cancel();
+        m_searchGeneration = 0;
+        m_resultIds.clear();
+        ShowAllEntries();
+        return;
+    }
+    StartSearch();
+}
+
+void ClipboardFrame::OnSearchCancel(wxCommandEvent& event) {
+    // Emits a text event, which lists the whole history again
+    m_searchCtrl->Clear();
+}
+
+void ClipboardFrame::StartSearch() {
+    EnsureSearchIndex();
+    m_searchStartMs = wxGetLocalTimeMillis().GetValue();
+    m_searchQueries++;
+    // Starting a query cancels the previous one. Results arrive on the
+    // worker threads and are shown unless a newer query has started by then.
+    m_searchGeneration = m_search.Search(ToUTF8(m_searchQuery), MAX_SEARCH_RESULTS,
+        [this](uint64_t generation, const std::vector<FuzzySearch::Result>& results, bool done) {
+            CallAfter([this, generation, results, done]() { ShowSearchResults(generation, results, done); });
+        });
+}
+
+void ClipboardFrame::ShowSearchResults(uint64_t generation, const std::vector<FuzzySearch::Result>& results, bool done) {
+    if (generation != m_searchGeneration || m_searchQuery.IsEmpty()) {
+        return;
+    }
+    // Keep the selected entry selected when the rows are replaced
+    int selected = GetEntryIndexForRow(m_listCtrl->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED));
+    size_t selectedId = selected >= 0 ? m_entries[selected].id : 0;
+    
+    m_listCtrl->Freeze();
+    m_listCtrl->DeleteAllItems();
+    m_resultIds.clear();
+    for (const auto& result : results) {
+        int index = FindEntryIndex(result.id);
+        if (index < 0) {
+            continue;
+        }
+        long row = (long)m_resultIds.size();
+        InsertListItem(row, m_entries[index]);
+        m_resultIds.push_back(result.id);
+        if (result.id == selectedId) {
+            m_listCtrl->SetItemState(row, wxLIST_STATE_SELECTED, wxLIST_STATE_SELECTED);
+        }
     }
+    m_listCtrl->Thaw();
     
-    file.Write();
+    if (done) {
+        double elapsedMs = (double)(wxGetLocalTimeMillis().GetValue() - m_searchStartMs);
+        m_searchMaxMs = wxMax(m_searchMaxMs, elapsedMs);
+    }
+}
+
+void ClipboardFrame::ShowAllEntries() {
+    m_listCtrl->Freeze();
+    m_listCtrl->DeleteAllItems();
+    for (const auto& entry : m_entries) {
+        InsertListItem(m_listCtrl->GetItemCount(), entry);
+    }
+    m_listCtrl->Thaw();
+}
+
+// usage is the memory use as of this change, before the snapshot is built
+void ClipboardFrame::PublishControlSnapshot(const MemoryUsage& usage) {
+    if (!m_controlServer.IsRunning()) {
+        return;
+    }
+    std::shared_ptr<ControlSnapshot> snapshot = std::make_shared<ControlSnapshot>();
+    std::unordered_map<size_t, std::shared_ptr<const ControlEntry> > published;
+    for (const auto& entry : m_entries) {
+        // Secrets waiting to expire stay inside the manager
+        if (entry.expires.IsValid()) {
+            continue;
+        }
+        auto found = m_controlEntries.find(entry.id);
+        std::shared_ptr<const ControlEntry> item;
+        if (found == m_controlEntries.end()) {
+            item = MakeControlEntry(entry);
+        } else if (entry.spilled && !found->second->load) {
+            // Spilled since: drop the old copy of the text or compressed data
+            item = MakeControlEntry(entry, found->second->mask);
+        } else if (entry.compressed && !found->second->compressed) {
+            // Compressed by a save since: share that instead of the copy of the text
+            std::shared_ptr<ControlEntry> copy = std::make_shared<ControlEntry>(*found->second);
+            copy->text = std::string();
+            copy->compressed = entry.compressed;
+            item = copy;
+        } else {
+            item = found->second;
+        }
+        snapshot->entries.push_back(item);
+        published[entry.id] = item;
+    }
+    for (const auto& key : m_timeIndex.GetKeys()) {
+        auto found = published.find(key.second);
+        if (found != published.end()) {
+            snapshot->byTime.push_back(found->second);
+        }
+    }
+    // For the stats command; only the control entries changed since usage was taken
+    MemoryUsage current = usage;
+    current.caches -= wxMin(current.caches, GetControlEntriesBytes(m_controlEntries));
+    m_controlEntries.swap(published);
+    current.caches += GetControlEntriesBytes(m_controlEntries);
+    snapshot->memory = {
+        {"entries", current.entries},
+        {"previews", current.previews},
+        {"images", current.images},
+        {"notifications", current.notifications},
+        {"search_index", current.searchIndex},
+        {"caches", current.caches},
+        {"total", current.GetTotal()},
+        {"peak", m_memoryPeakBytes},
+        {"budget", (uint64_t)wxMax(m_settings.memoryBudgetMB, 0) * 1024 * 1024},
+        {"spill_file", m_spillFile ? m_spillFile->GetSize() : 0}
+    };
+    m_controlServer.Publish(snapshot);
 }
 
 void ClipboardFrame::LoadFromFile() {
-    if (!wxFileName::FileExists(LOG_FILE)) {
+    if (m_storageLocked || !wxFileName::FileExists(LOG_FILE)) {
         return;
     }
     
-    wxTextFile file(LOG_FILE);
-    if (!file.Open()) {
+    wxStopWatch stopWatch;
+    // Read as bytes: compressed content is not valid UTF-8
+    wxFFile file(LOG_FILE, wxT("rb"));
+    if (!file.IsOpened()) {
         return;
     }
+    std::string data((size_t)file.Length(), '\0');
+    if (file.Read(&data[0], data.size()) != data.size()) {
+        wxLogError(wxT("Failed to read history file: %s"), LOG_FILE);
+        return;
+    }
+    file.Close();
     
     m_entries.clear();
     m_listCtrl->DeleteAllItems();
+    m_frecency.Clear();
+    m_nearDuplicates.Clear();
+    m_nearDuplicatesIndexed = false;
+    m_search.Clear();
+    m_searchIndexed = false;
+    m_timeIndex.Clear();
+    m_controlEntries.clear();
     
-    for (size_t i = 0; i < file.GetLineCount(); ++i) {
-        wxString line = file.GetLine(i);
+    m_unreadableRecords.clear();
+    size_t lineStart = 0;
+    while (lineStart < data.size()) {
+        size_t lineEnd = data.find('\n', lineStart);
+        if (lineEnd == std::string::npos) {
+            lineEnd = data.size();
+        }
+        // Files written by wxTextFile on Windows end lines with CR LF
+        size_t length = lineEnd - lineStart;
+        if (length > 0 && data[lineEnd - 1] == '\r') {
+            length--;
+        }
+        std::string line = data.substr(lineStart, length);
+        lineStart = lineEnd + 1;
         
-        // Parse: timestamp|type|content
-        wxStringTokenizer tokenizer(line, wxT("|"));
-        if (tokenizer.CountTokens() >= 3) {
-            ClipboardEntry entry;
-            
-            wxString timeStr = tokenizer.GetNextToken();
-            entry.timestamp.ParseFormat(timeStr, wxT("%Y-%m-%d %H:%M:%S"));
-            
-            entry.type = tokenizer.GetNextToken();
-            
-            entry.content = tokenizer.GetString(); // Get remaining content
-            // Unescape newlines
-            entry.content.Replace(wxT("\\n"), wxT("\n"));
-            entry.content.Replace(wxT("\\r"), wxT("\r"));
-            
+        // Parse: timestamp|type[;attributes]|content
+        HistoryRecord record;
+        ClipboardEntry entry;
+        if (!ParseHistoryRecord(line, record)) {
+            continue;
+        }
+        if (record.FindAttribute("enc")) {
+            HistoryRecord sealed = record;
+            if (!OpenRecord(*m_cipher, sealed, record)) {
+                m_unreadableRecords.push_back(line);
+                continue;
+            }
+        }
+        if (RecordToEntry(record, entry)) {
             entry.id = m_nextId++;
-            
+            // Files without a stored score count the capture as the only use
+            const std::string* score = record.FindAttribute("frec");
+            if (score) {
+                m_frecency.SetScore(entry.id, atof(score->c_str()));
+            } else {
+                RecordEntryUse(entry.id, entry.timestamp);
+            }
+            m_timeIndex.Add(entry.id, (int64_t)entry.timestamp.GetTicks());
             m_entries.push_back(entry);
         }
     }
     
     // Update list control
     for (const auto& entry : m_entries) {
-        long index = m_listCtrl->InsertItem(m_listCtrl->GetItemCount(), 
-                                          entry.timestamp.Format(wxT("%Y-%m-%d %H:%M:%S")));
-        m_listCtrl->SetItem(index, 1, entry.type);
-        
-        wxString displayContent = entry.content;
-        if (displayContent.Length() > 100) {
-            displayContent = displayContent.Left(100) + wxT("...");
-        }
-        displayContent.Replace(wxT("\n"), wxT(" "));
-        displayContent.Replace(wxT("\r"), wxT(" "));
-        
-        m_listCtrl->SetItem(index, 2, displayContent);
+        InsertListItem(m_listCtrl->GetItemCount(), entry);
     }
+    
+    PublishControlSnapshot(GetMemoryUsage());
+    
+    if (!m_unreadableRecords.empty()) {
+        wxLogError(wxT("%lu encrypted history entries could not be decrypted; they are kept in the file but not shown"),
+                   (unsigned long)m_unreadableRecords.size());
+    }
+    m_historyLoadMs = stopWatch.TimeInMicro().ToDouble() / 1000.0;
+    wxLogMessage(wxT("Loaded %lu history entries (%lu bytes) in %.1f ms"),
+                 (unsigned long)m_entries.size(), (unsigned long)data.size(), m_historyLoadMs);
 }
 
+#ifdef __WXMSW__
 // Keyboard hook implementation
 LRESULT CALLBACK ClipboardFrame::LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam) {
     if (nCode >= 0) {
         KBDLLHOOKSTRUCT* pKeyboard = (KBDLLHOOKSTRUCT*)lParam;
         
         if (wParam == WM_KEYDOWN) {
-            // Check for Ctrl+C (Ctrl key must be down and C key pressed)
-            if (pKeyboard->vkCode == 'C' && (GetAsyncKeyState(VK_CONTROL) & 0x8000)) {
+            // Check for Ctrl+C, Ctrl+X or Ctrl+Insert (Ctrl key must be down)
+            bool isCopyKey = pKeyboard->vkCode == 'C' || pKeyboard->vkCode == 'X' || pKeyboard->vkCode == VK_INSERT;
+            if (isCopyKey && (GetAsyncKeyState(VK_CONTROL) & 0x8000)) {
                 s_ctrlCPressed = true;
                 s_lastCtrlCTime = wxDateTime::Now();
-                wxLogMessage(wxT("Ctrl+C detected!"));
                 
                 if (s_instance) {
                     s_instance->OnCtrlCPressed();
@@ -829,16 +2877,51 @@ void ClipboardFrame::UninstallKeyboardHook() {
 
 void ClipboardFrame::OnCtrlCPressed() {
     // This method is called when Ctrl+C is detected
-    // We can use this to mark the next clipboard change as intentional
-    wxLogMessage(wxT("Intentional copy detected - next clipboard change should show notification"));
+    // The source application updates the clipboard shortly after the key press,
+    // so schedule a burst of fast checks instead of waiting for the next idle poll
+    ScheduleNextCheck(m_scheduler.OnCopyHint());
 }
+#endif
 
 // ClipboardApp implementation
+ClipboardApp::ClipboardApp()
+    : m_frame(nullptr),
+      m_recordContent(false),
+      m_replaySpeed(1.0) {
+}
+
+void ClipboardApp::OnInitCmdLine(wxCmdLineParser& parser) {
+    wxApp::OnInitCmdLine(parser);
+    parser.AddOption(wxT("r"), wxT("record"), wxT("record clipboard activity to a trace file"));
+    parser.AddSwitch(wxEmptyString, wxT("record-content"), wxT("include copied text in the trace (secrets are never recorded)"));
+    parser.AddOption(wxEmptyString, wxT("replay"), wxT("replay a trace file, write a latency report and exit"));
+    parser.AddOption(wxEmptyString, wxT("speed"), wxT("replay speed factor, 0 for as fast as possible (default 1)"),
+                     wxCMD_LINE_VAL_DOUBLE);
+}
+
+bool ClipboardApp::OnCmdLineParsed(wxCmdLineParser& parser) {
+    if (!wxApp::OnCmdLineParsed(parser)) {
+        return false;
+    }
+    parser.Found(wxT("record"), &m_recordPath);
+    m_recordContent = parser.Found(wxT("record-content"));
+    parser.Found(wxT("replay"), &m_replayPath);
+    parser.Found(wxT("speed"), &m_replaySpeed);
+    if (!m_recordPath.IsEmpty() && !m_replayPath.IsEmpty()) {
+        wxLogError(wxT("--record and --replay cannot be combined"));
+        return false;
+    }
+    return true;
+}
+
 bool ClipboardApp::OnInit() {
     if (!wxApp::OnInit()) {
         return false;
     }
     
+    // PNG support for saving, restoring and prefetching history images
+    wxInitAllImageHandlers();
+    
     // Temporarily disable system tray check for testing
     // Check if system tray is available
     // if (!wxTaskBarIcon::IsAvailable()) {
@@ -847,7 +2930,38 @@ bool ClipboardApp::OnInit() {
     //     return false;
     // }
     
-    m_frame = new ClipboardFrame();
+    bool replayMode = !m_replayPath.IsEmpty();
+    wxString reportPath;
+    if (replayMode) {
+        // Replays run in a scratch directory with a copy of the settings,
+        // so the real history is never touched
+        wxFileName tracePath(m_replayPath);
+        tracePath.MakeAbsolute();
+        m_replayPath = tracePath.GetFullPath();
+        reportPath = wxFileName(wxGetCwd(), wxT("replay_report.txt")).GetFullPath();
+        
+        wxString replayDir = wxFileName(wxFileName::GetTempDir(),
+            wxDateTime::Now().Format(wxT("clipboard_replay_%Y%m%d_%H%M%S"))).GetFullPath();
+        if (!wxDirExists(replayDir) && !wxMkdir(replayDir)) {
+            wxLogError(wxT("Failed to create replay directory: %s"), replayDir);
+            return false;
+        }
+        if (wxFileExists(ClipboardFrame::SETTINGS_FILE)) {
+            wxCopyFile(ClipboardFrame::SETTINGS_FILE,
+                       wxFileName(replayDir, ClipboardFrame::SETTINGS_FILE).GetFullPath());
+        }
+        wxSetWorkingDirectory(replayDir);
+    }
+    
+    m_frame = new ClipboardFrame(replayMode);
+    
+    if (replayMode) {
+        if (!m_frame->StartReplay(m_replayPath, m_replaySpeed, reportPath)) {
+            m_frame->Close(true);
+        }
+    } else if (!m_recordPath.IsEmpty()) {
+        m_frame->StartRecording(m_recordPath, m_recordContent);
+    }
     
     return true;
 }
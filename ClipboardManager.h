@@ -13,9 +13,30 @@
 #include <wx/bitmap.h>
 #include <wx/dataobj.h>
 #include <wx/imaglist.h>
+#include <wx/srchctrl.h>
 #include <vector>
 #include <fstream>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#ifdef __WXMSW__
 #include <windows.h>
+#endif
+#include "CaptureScheduler.h"
+#include "ClipboardMonitor.h"
+#include "ClipboardTrace.h"
+#include "FakeClipboard.h"
+#include "LazyDataObjects.h"
+#include "HistoryRecord.h"
+#include "SensitiveFilter.h"
+#include "TextCompressor.h"
+#include "FrecencyIndex.h"
+#include "NearDuplicateIndex.h"
+#include "FuzzySearch.h"
+#include "ControlServer.h"
+#include "TimeIndex.h"
+#include "StorageCipher.h"
+#include "SpillFile.h"
 
 // Forward declaration
 class ClipboardFrame;
@@ -26,12 +47,16 @@ public:
     NotificationPopup(wxWindow* parent, const wxString& title, const wxString& content, bool isImage = false);
     virtual ~NotificationPopup();
 
+    // Estimated: the text and the native window
+    size_t GetMemoryBytes() const { return m_memoryBytes; }
+
 private:
     void OnTimer(wxTimerEvent& event);
     void OnClose(wxCloseEvent& event);
     void PositionWindow();
     
     wxTimer* m_timer;
+    size_t m_memoryBytes;
     
     enum {
         ID_NOTIFICATION_TIMER = 30001
@@ -40,13 +65,109 @@ private:
     DECLARE_EVENT_TABLE()
 };
 
+// Quick-paste popup listing the most frequently and recently used entries.
+// Created once and reused so the hotkey only has to refill the list.
+class QuickPastePicker : public wxFrame {
+public:
+    QuickPastePicker(ClipboardFrame* parent);
+
+    void ShowEntries(const wxArrayString& labels);
+
+private:
+    void OnCharHook(wxKeyEvent& event);
+    void OnListDClick(wxCommandEvent& event);
+    void OnActivate(wxActivateEvent& event);
+    void Pick(int selection);
+
+    ClipboardFrame* m_parent;
+    wxListBox* m_listBox;
+
+    DECLARE_EVENT_TABLE()
+};
+
+// Additional clipboard format captured alongside the main content
+struct ClipboardPayload {
+    wxString format;         // "Text", "Files", "HTML", "RTF", "PNG"
+    size_t size;             // Size in bytes, 0 if the clipboard did not report it
+    wxString path;           // Saved payload file, empty if too large to materialize
+};
+
+// Earlier content of an entry that near-duplicate clips were merged into
+struct ClipboardVersion {
+    wxString content;
+    wxDateTime timestamp;
+};
+
 struct ClipboardEntry {
-    wxString content;        // Text content or image file path
+    wxString content;        // Text content, file list or image description
     wxString type;           // "Text", "Image", "File"
     wxDateTime timestamp;
     size_t id;
     wxString imagePath;      // Path to saved image file (for images)
     wxSize imageSize;        // Original image dimensions
+    std::vector<ClipboardPayload> payloads;
+    wxDateTime expires;      // Sensitive entries kept in memory only until then; invalid = never
+    std::vector<ClipboardVersion> versions;  // Replaced near-duplicate contents, oldest first
+    // Content as stored in the history file once compressed. content then
+    // only holds a preview; the full text is decoded when it is needed.
+    std::shared_ptr<const CompressedText> compressed;
+    // Set instead of compressed when the memory policy moved the content to
+    // the spill file; content again only holds a preview
+    std::shared_ptr<const SpilledText> spilled;
+};
+
+// User settings, read from clipboard_manager.ini next to the history file
+struct ClipboardSettings {
+    bool filterEnabled;
+    wxString filterAction;        // "mask", "drop" or "expire"
+    int filterExpirySeconds;
+    wxArrayString filterKeywords; // Empty uses the built-in list
+    double filterEntropyBits;     // Minimum bits per character for random-looking tokens
+    int filterEntropyMinLength;
+    int quickPasteCount;          // Entries shown by the quick-paste picker
+    bool capturePrimarySelection; // X11: also record the mouse selection
+    bool compressionEnabled;
+    int compressionMinBytes;      // Smaller text is stored uncompressed
+    wxString syncPolicy;          // "always", "batched" or "never"
+    int syncIntervalMs;           // Batched: at most one synced snapshot per interval
+    bool controlEnabled;          // Serve the local control endpoint (clipboard_ctl)
+    wxString encryption;          // "none", "passphrase" or "keystore" (Windows)
+    int memoryBudgetMB;           // Above this, caches are dropped and old content spilled; 0 = no limit
+};
+
+// Estimated memory use by component, in bytes (see ClipboardFrame::GetMemoryUsage)
+struct MemoryUsage {
+    size_t entries;               // History content, versions and payload metadata
+    size_t previews;              // Row strings held by the list control
+    size_t images;                // Prefetched PNG data and decoded pixels
+    size_t notifications;         // Open notification popups
+    size_t searchIndex;           // Full text copies in the fuzzy search index
+    size_t caches;                // Control snapshot, near-duplicate, frecency and time indexes
+
+    size_t GetTotal() const { return entries + previews + images + notifications + searchIndex + caches; }
+};
+
+// Progress and measurements of a trace replay
+struct ReplayState {
+    // Capture pipeline stages timed during the replay
+    enum Stage {
+        STAGE_READ,
+        STAGE_FILTER,
+        STAGE_DEDUP,
+        STAGE_PAYLOADS,
+        STAGE_INSERT,
+        STAGE_SAVE,
+        STAGE_COUNT
+    };
+
+    std::vector<TraceEvent> events;
+    size_t next;
+    double speed;                 // 1 = recorded pace, 0 = as fast as possible
+    long long startMs;
+    size_t captured;
+    wxString reportPath;
+    LatencyStats stages[STAGE_COUNT];
+    LatencyStats endToEnd;        // Whole CheckClipboard call per event
 };
 
 class ClipboardTaskBarIcon : public wxTaskBarIcon {
@@ -55,6 +176,8 @@ public:
     virtual ~ClipboardTaskBarIcon();
 
     void OnMenuShow(wxCommandEvent& event);
+    void OnMenuStats(wxCommandEvent& event);
+    void OnMenuQuickPaste(wxCommandEvent& event);
     void OnMenuExit(wxCommandEvent& event);
     void OnLeftButtonClick(wxTaskBarIconEvent& event);
     void OnLeftButtonDClick(wxTaskBarIconEvent& event);
@@ -66,7 +189,9 @@ private:
 
     enum {
         ID_SHOW = 10001,
-        ID_EXIT = 10002
+        ID_EXIT = 10002,
+        ID_STATS = 10003,
+        ID_QUICK_PASTE = 10004
     };
 
     DECLARE_EVENT_TABLE()
@@ -74,12 +199,20 @@ private:
 
 class ClipboardFrame : public wxFrame {
 public:
-    ClipboardFrame();
+    // Replay mode reads from an in-memory clipboard and installs no system hooks
+    explicit ClipboardFrame(bool replayMode = false);
     virtual ~ClipboardFrame();
 
     void AddClipboardEntry(const ClipboardEntry& entry);
     void ShowFrame();
     void HideFrame();
+    void ShowStatistics();
+    void ShowQuickPastePicker();
+    void PasteFromPicker(int selection);
+    bool StartRecording(const wxString& tracePath, bool includeContent);
+    bool StartReplay(const wxString& tracePath, double speed, const wxString& reportPath);
+
+    static const wxString SETTINGS_FILE;
 
 private:
     void OnClose(wxCloseEvent& event);
@@ -88,50 +221,194 @@ private:
     void OnClearAll(wxCommandEvent& event);
     void OnCopySelected(wxCommandEvent& event);
     void OnItemActivated(wxListEvent& event);
+    void OnItemSelected(wxListEvent& event);
+#if wxUSE_HOTKEY
+    void OnQuickPasteHotKey(wxKeyEvent& event);
+#endif
+    void OnShowVersions(wxCommandEvent& event);
+    void OnSearchText(wxCommandEvent& event);
+    void OnSearchCancel(wxCommandEvent& event);
 
-    void CheckClipboard();
+    enum FilterResult {
+        FILTER_CLEAN,
+        FILTER_MASKED,
+        FILTER_EXPIRING,
+        FILTER_DROPPED
+    };
+
+    bool CheckClipboard();
+    void OnClipboardChanged();
+    void ShowNotification(const wxString& title, const wxString& content, bool isImage);
+    void RecordTraceText(const wxString& type, const wxString& content);
+    void RecordTraceImage(const wxBitmap& bitmap, const wxString& imageHash);
+    void RecordStage(int stage, wxStopWatch& stopWatch);
+    void OnReplayTimer(wxTimerEvent& event);
+    void ApplyTraceEvent(const TraceEvent& event);
+    void FinishReplay();
+    void LoadSettings();
+    void UnlockStorage(bool replayMode);
+    std::string SealData(const std::string& plaintext, const std::string& associated);
+    wxString WriteStoredFile(const wxString& path, const void* data, size_t size);
+    FilterResult ApplySensitiveFilter(ClipboardEntry& entry, wxString& notificationText);
+    void CompressEntry(ClipboardEntry& entry);
+    MemoryUsage GetMemoryUsage() const;
+    // Returns the memory use once caches were dropped and content spilled
+    MemoryUsage ApplyMemoryPolicy();
+    bool SpillEntry(ClipboardEntry& entry);
+    void EnsureNearDuplicateIndex();
+    void EnsureSearchIndex();
+    void StartSearch();
+    void ShowSearchResults(uint64_t generation, const std::vector<FuzzySearch::Result>& results, bool done);
+    void ShowAllEntries();
+    void PublishControlSnapshot(const MemoryUsage& usage);
+    void PurgeExpiredEntries();
+    bool MergeNearDuplicate(const ClipboardEntry& entry, const NearDuplicateIndex::Fingerprint& fingerprint);
+    void ScheduleNextCheck(int delayMs);
     void SaveToFile();
+    void WriteSnapshot();
+    void OnSaveTimer(wxTimerEvent& event);
     void LoadFromFile();
     wxString GetClipboardText();
+    wxArrayString GetClipboardFiles();
     wxBitmap GetClipboardBitmap();
     wxString SaveImageToFile(const wxBitmap& bitmap, size_t id);
     wxString DetermineDataType();
     wxString CalculateImageHash(const wxBitmap& bitmap);
-    void CopyImageToClipboard(const wxString& imagePath);
+    void CapturePayloads(ClipboardEntry& entry);
+    wxString SavePayloadToFile(const void* data, size_t size, size_t id, const wxString& extension);
+    void RestoreEntry(const ClipboardEntry& entry);
+    bool IsRestoredContent(const wxString& content) const;
+    void AddPayloadFormats(wxDataObjectComposite* data, const ClipboardEntry& entry);
+    void AddImageFormats(wxDataObjectComposite* data, const wxString& imagePath, bool includePng);
+    bool SetClipboardData(wxDataObject* data);
+    int FindEntryIndex(size_t id) const;
+    int GetEntryIndexForRow(long row) const;
+    void InsertListItem(long index, const ClipboardEntry& entry);
+    void RemoveEntryAt(size_t index);
+    void ForgetEntry(const ClipboardEntry& entry);
+    void ImportRecords(const std::vector<HistoryRecord>& records);
+    void InsertEntries(std::vector<ClipboardEntry>& entries);
+    bool IsDuplicateEntry(const ClipboardEntry& entry) const;
+    void RecordEntryUse(size_t id, const wxDateTime& time);
     
+#ifdef __WXMSW__
     // Keyboard monitoring
     bool InstallKeyboardHook();
     void UninstallKeyboardHook();
     static LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam);
     void OnCtrlCPressed();
+#endif
 
     ClipboardTaskBarIcon* m_taskBarIcon;
     wxListCtrl* m_listCtrl;
     wxTimer* m_timer;
     wxButton* m_clearButton;
     wxButton* m_copyButton;
+    wxButton* m_versionsButton;
+    wxSearchCtrl* m_searchCtrl;
 
     std::vector<ClipboardEntry> m_entries;
     wxString m_lastClipboardContent;
+    size_t m_restoredEntryId;  // Entry last put on the clipboard by a restore; 0 = none since the last capture
     wxString m_lastImageHash;  // Hash of last processed image
+    ClipboardMonitor m_clipboardMonitor;
+    uint64_t m_lastChangeCount; // Clipboard change count of the last successful read
+    bool m_clipboardReadFailed; // The clipboard could not be opened since the check started
+    CaptureScheduler m_scheduler;
+    std::shared_ptr<ImagePrefetcher> m_prefetcher;
+    ClipboardSettings m_settings;
+    SensitiveFilter m_sensitiveFilter;
+    size_t m_filterScans;
+    size_t m_filterMatches;
+    double m_filterTotalMs;
+    double m_filterMaxMs;
+    FrecencyIndex m_frecency;
+    QuickPastePicker* m_picker;
+    std::vector<size_t> m_pickerIds;   // Entry ids in picker order
+#ifdef __WXMSW__
+    HWND m_quickPasteTarget;           // Window that had focus when the picker was opened
+#endif
+    size_t m_pickerOpens;
+    double m_pickerMaxOpenMs;
+    NearDuplicateIndex m_nearDuplicates;
+    size_t m_nearDuplicateLookups;
+    size_t m_nearDuplicateMerges;
+    double m_nearDuplicateMaxMs;
+    bool m_nearDuplicatesIndexed;      // Loaded entries are indexed on the first capture
+    FuzzySearch m_search;
+    bool m_searchIndexed;              // Built when the first query is typed
+    wxString m_searchQuery;            // Empty when the whole history is listed
+    uint64_t m_searchGeneration;       // Query whose results the list shows
+    std::vector<size_t> m_resultIds;   // Entry ids in list order while searching
+    long long m_searchStartMs;
+    size_t m_searchQueries;
+    double m_searchMaxMs;              // Slowest query, typing to final results
+    ControlServer m_controlServer;
+    // Entries as last published to control clients, reused while they don't change
+    std::unordered_map<size_t, std::shared_ptr<const ControlEntry> > m_controlEntries;
+    TimeIndex m_timeIndex;
+    std::atomic<int> m_importBatchesPending;   // Handed over by the control thread, not yet inserted
+    std::atomic<bool> m_closing;
+    size_t m_importedEntries;
+    size_t m_importSkipped;
+    double m_historyLoadMs;
+    wxTimer* m_saveTimer;              // Pending batched snapshot
+    long long m_lastSnapshotMs;
+    size_t m_snapshotWrites;
+    size_t m_snapshotFailures;
+    double m_snapshotMaxMs;
+    std::shared_ptr<StorageCipher> m_cipher;   // Shared with lazy data objects and the prefetcher
+    bool m_storageLocked;              // Encrypted history that could not be unlocked: never read or written
+    std::vector<std::string> m_unreadableRecords;  // Sealed lines that failed to open, written back unchanged
+    size_t m_sealCount;
+    size_t m_sealBytes;
+    double m_sealMs;
+    std::shared_ptr<SpillFile> m_spillFile;    // Created on the first spill; shared with control entries
+    size_t m_spillFileCount;
+    size_t m_cacheSheds;               // Times the memory policy dropped the caches
+    size_t m_spilledEntries;
+    size_t m_spilledBytes;
+    size_t m_memoryPeakBytes;          // Highest accounted total
+    double m_memoryPolicyMaxMs;
+    wxClipboardBase* m_clipboard;      // The system clipboard, or the fake one during replays
+    std::unique_ptr<FakeClipboard> m_replayClipboard;
+    std::unique_ptr<ReplayState> m_replay;
+    wxTimer* m_replayTimer;
+    std::unique_ptr<TraceWriter> m_traceWriter;
+    bool m_traceIncludesContent;
+    bool m_ownsClipboardData;   // Restored data is rendered lazily and must be flushed on exit
     size_t m_nextId;
     
     // Debounce mechanism variables (unused but kept for future)
     wxString m_pendingClipboardContent;
     wxDateTime m_pendingContentTimestamp;
     
+#ifdef __WXMSW__
     // Keyboard hook variables
     HHOOK m_keyboardHook;
     static ClipboardFrame* s_instance;
     static bool s_ctrlCPressed;
     static wxDateTime s_lastCtrlCTime;
+#endif
 
     static const wxString LOG_FILE;
+    static const wxString PAYLOAD_DIR;
+    static const wxString KEY_FILE;
+    static const size_t MAX_PAYLOAD_BYTES = 4 * 1024 * 1024;  // Expensive formats above this are metadata only
+    static const size_t MAX_VERSIONS = 20;                     // Earlier versions kept per entry
+    static const size_t MAX_SEARCH_RESULTS = 200;              // Rows listed for a query
+    static const size_t MAX_ENTRIES = 1000;                    // History limit, oldest entries go first
+    static const int MEMORY_LOW_WATERMARK_PERCENT = 80;        // Spilling stops at this share of the budget
 
     enum {
         ID_TIMER = 20001,
         ID_CLEAR_ALL = 20002,
-        ID_COPY_SELECTED = 20003
+        ID_COPY_SELECTED = 20003,
+        ID_QUICK_PASTE_HOTKEY = 20004,
+        ID_SHOW_VERSIONS = 20005,
+        ID_REPLAY_TIMER = 20006,
+        ID_SAVE_TIMER = 20007,
+        ID_SEARCH = 20008
     };
 
     DECLARE_EVENT_TABLE()
@@ -139,11 +416,19 @@ private:
 
 class ClipboardApp : public wxApp {
 public:
+    ClipboardApp();
+
     virtual bool OnInit() override;
     virtual int OnExit() override;
+    virtual void OnInitCmdLine(wxCmdLineParser& parser) override;
+    virtual bool OnCmdLineParsed(wxCmdLineParser& parser) override;
 
 private:
     ClipboardFrame* m_frame;
+    wxString m_recordPath;       // --record: trace file to write
+    bool m_recordContent;        // --record-content: include copied text in the trace
+    wxString m_replayPath;       // --replay: trace file to replay
+    double m_replaySpeed;        // --speed: replay speed factor
 };
 
 DECLARE_APP(ClipboardApp)
@@ -0,0 +1,187 @@
+#include "ClipboardMonitor.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#ifdef CLIPBOARD_MONITOR_XFIXES
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/Xlib-xcb.h>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#ifdef CLIPBOARD_MONITOR_XFIXES
+ClipboardMonitor::ClipboardMonitor()
+    : m_display(nullptr),
+      m_eventBase(0),
+      m_clipboardAtom(None),
+      m_changeCount(1),
+      m_lastSelection(SELECTION_CLIPBOARD),
+      m_clientMask(0),
+      m_ownWindow(None) {
+    m_wakePipe[0] = -1;
+    m_wakePipe[1] = -1;
+}
+#else
+ClipboardMonitor::ClipboardMonitor() {
+}
+#endif
+
+ClipboardMonitor::~ClipboardMonitor() {
+    Stop();
+}
+
+bool ClipboardMonitor::Start(bool watchPrimary, const ChangeCallback& onChange) {
+#ifdef CLIPBOARD_MONITOR_XFIXES
+    if (m_display) {
+        return true;
+    }
+
+    // A connection of our own: the toolkit's connection is not thread-safe
+    Display* display = XOpenDisplay(nullptr);
+    if (!display) {
+        return false;
+    }
+    int eventBase = 0;
+    int errorBase = 0;
+    if (!XFixesQueryExtension(display, &eventBase, &errorBase) || pipe(m_wakePipe) != 0) {
+        XCloseDisplay(display);
+        return false;
+    }
+
+    const unsigned long mask = XFixesSetSelectionOwnerNotifyMask |
+                               XFixesSelectionWindowDestroyNotifyMask |
+                               XFixesSelectionClientCloseNotifyMask;
+    Window root = DefaultRootWindow(display);
+    m_clipboardAtom = XInternAtom(display, "CLIPBOARD", False);
+    XFixesSelectSelectionInput(display, root, m_clipboardAtom, mask);
+    if (watchPrimary) {
+        XFixesSelectSelectionInput(display, root, XA_PRIMARY, mask);
+    }
+    XFlush(display);
+
+    // The server assigns every client a range of resource ids; the bits
+    // outside resource_id_mask are the same for all windows of one client
+    m_clientMask = ~(unsigned long)xcb_get_setup(XGetXCBConnection(display))->resource_id_mask;
+    m_display = display;
+    m_eventBase = eventBase;
+    m_onChange = onChange;
+    m_worker = std::thread(&ClipboardMonitor::WorkerLoop, this);
+    return true;
+#else
+    (void)watchPrimary;
+    (void)onChange;
+    return false;
+#endif
+}
+
+void ClipboardMonitor::Stop() {
+#ifdef CLIPBOARD_MONITOR_XFIXES
+    if (!m_display) {
+        return;
+    }
+    char wake = 1;
+    if (write(m_wakePipe[1], &wake, 1) != 1) {
+        // The worker only blocks in poll(), closing the pipe wakes it as well
+        close(m_wakePipe[1]);
+        m_wakePipe[1] = -1;
+    }
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+    XCloseDisplay(m_display);
+    m_display = nullptr;
+    for (int& fd : m_wakePipe) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+#endif
+}
+
+bool ClipboardMonitor::IsEventDriven() const {
+#ifdef CLIPBOARD_MONITOR_XFIXES
+    return m_display != nullptr;
+#else
+    return false;
+#endif
+}
+
+uint64_t ClipboardMonitor::GetChangeCount() const {
+#if defined(_WIN32)
+    return ::GetClipboardSequenceNumber();
+#elif defined(CLIPBOARD_MONITOR_XFIXES)
+    return m_display ? m_changeCount.load() : 0;
+#else
+    return 0;
+#endif
+}
+
+ClipboardMonitor::Selection ClipboardMonitor::GetLastChangedSelection() const {
+#ifdef CLIPBOARD_MONITOR_XFIXES
+    return (Selection)m_lastSelection.load();
+#else
+    return SELECTION_CLIPBOARD;
+#endif
+}
+
+void ClipboardMonitor::SetOwnWindow(unsigned long window) {
+#ifdef CLIPBOARD_MONITOR_XFIXES
+    m_ownWindow = window;
+#else
+    (void)window;
+#endif
+}
+
+#ifdef CLIPBOARD_MONITOR_XFIXES
+bool ClipboardMonitor::IsOwnChange(unsigned long owner) const {
+    unsigned long ownWindow = m_ownWindow;
+    if (owner == None || ownWindow == None) {
+        return false;
+    }
+    return (owner & m_clientMask) == (ownWindow & m_clientMask);
+}
+
+void ClipboardMonitor::WorkerLoop() {
+    struct pollfd fds[2];
+    fds[0].fd = ConnectionNumber(m_display);
+    fds[0].events = POLLIN;
+    fds[1].fd = m_wakePipe[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        // XPending also reads whatever has arrived on the connection
+        while (XPending(m_display) > 0) {
+            XEvent event;
+            XNextEvent(m_display, &event);
+            if (event.type != m_eventBase + XFixesSelectionNotify) {
+                continue;
+            }
+            const XFixesSelectionNotifyEvent* notify = (const XFixesSelectionNotifyEvent*)&event;
+            bool isClipboard = notify->selection == m_clipboardAtom;
+            if (isClipboard && notify->subtype == XFixesSetSelectionOwnerNotify && IsOwnChange(notify->owner)) {
+                continue;
+            }
+            m_lastSelection = isClipboard ? SELECTION_CLIPBOARD : SELECTION_PRIMARY;
+            m_changeCount++;
+            if (m_onChange) {
+                m_onChange();
+            }
+        }
+
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+            return;
+        }
+        if (fds[1].revents != 0 || (fds[0].revents & (POLLERR | POLLHUP)) != 0) {
+            return;
+        }
+    }
+}
+#endif
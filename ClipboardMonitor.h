@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+struct _XDisplay;
+
+// Tells the frame whether the clipboard may have changed since it last looked.
+// Windows: the clipboard sequence number, cheap enough to read on every poll.
+// X11 (built with CLIPBOARD_MONITOR_XFIXES): XFixes selection-owner
+// notifications, received on a background thread, so changes are reported
+// as they happen instead of being found by polling.
+// Elsewhere the change count is unknown (0) and every poll reads the clipboard.
+class ClipboardMonitor {
+public:
+    enum Selection {
+        SELECTION_CLIPBOARD,
+        SELECTION_PRIMARY    // X11 mouse selection
+    };
+
+    typedef std::function<void()> ChangeCallback;
+
+    ClipboardMonitor();
+    ~ClipboardMonitor();
+
+    // Starts change notifications; onChange is called on the monitor thread.
+    // Returns false if the platform cannot report changes as they happen.
+    bool Start(bool watchPrimary, const ChangeCallback& onChange);
+    void Stop();
+    bool IsEventDriven() const;
+
+    // Different after every change made by another application; 0 if unknown
+    uint64_t GetChangeCount() const;
+    Selection GetLastChangedSelection() const;
+
+    // X window of the frame. Selections owned by windows of the same X client
+    // are our own changes and not reported: wxGTK takes the clipboard with a
+    // hidden window of the toolkit's connection, not with the frame itself.
+    void SetOwnWindow(unsigned long window);
+
+private:
+#ifdef CLIPBOARD_MONITOR_XFIXES
+    void WorkerLoop();
+    bool IsOwnChange(unsigned long owner) const;
+
+    _XDisplay* m_display;             // Private connection, only used by the worker after Start
+    int m_eventBase;
+    unsigned long m_clipboardAtom;
+    int m_wakePipe[2];                // Written by Stop to end the worker
+    std::thread m_worker;
+    ChangeCallback m_onChange;
+    std::atomic<uint64_t> m_changeCount;
+    std::atomic<int> m_lastSelection;
+    unsigned long m_clientMask;       // Bits of an X resource id that identify its client
+    std::atomic<unsigned long> m_ownWindow;
+#endif
+};
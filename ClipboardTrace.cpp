@@ -0,0 +1,180 @@
+#include "ClipboardTrace.h"
+#include "HistoryRecord.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+    int64_t NowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t Fnv1a(const std::string& data) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : data) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+}
+
+TraceWriter::TraceWriter()
+    : m_startMs(0) {
+}
+
+bool TraceWriter::Open(const std::string& path) {
+    m_file.open(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    m_startMs = NowMs();
+    if (m_file.is_open()) {
+        m_file << "# clipboard trace v1\n";
+    }
+    return m_file.is_open();
+}
+
+void TraceWriter::Write(TraceEvent event) {
+    if (!m_file.is_open()) {
+        return;
+    }
+    HistoryRecord record;
+    record.timestamp = std::to_string(NowMs() - m_startMs);
+    record.type = event.type;
+    record.AddAttribute("size", std::to_string(event.size));
+    record.AddAttribute("hash", event.hash);
+    if (event.type == "Image") {
+        record.AddAttribute("w", std::to_string(event.width));
+        record.AddAttribute("h", std::to_string(event.height));
+    }
+    if (event.hasContent) {
+        record.AddAttribute("content", "1");
+        record.content = event.content;
+    }
+    // Flushed per event so a trace survives a crash of the process being traced
+    m_file << FormatHistoryRecord(record) << '\n';
+    m_file.flush();
+}
+
+bool ReadTrace(const std::string& path, std::vector<TraceEvent>& events) {
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    events.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        HistoryRecord record;
+        if (!ParseHistoryRecord(line, record)) {
+            continue;
+        }
+        TraceEvent event;
+        event.offsetMs = atoll(record.timestamp.c_str());
+        event.type = record.type;
+        const std::string* size = record.FindAttribute("size");
+        const std::string* hash = record.FindAttribute("hash");
+        const std::string* width = record.FindAttribute("w");
+        const std::string* height = record.FindAttribute("h");
+        const std::string* content = record.FindAttribute("content");
+        event.size = size ? (size_t)strtoull(size->c_str(), nullptr, 10) : 0;
+        event.hash = hash ? *hash : std::string();
+        event.width = width ? atoi(width->c_str()) : 0;
+        event.height = height ? atoi(height->c_str()) : 0;
+        event.hasContent = content && *content == "1";
+        event.content = record.content;
+        events.push_back(event);
+    }
+    // Replays walk the events in time order
+    std::stable_sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+        return a.offsetMs < b.offsetMs;
+    });
+    return true;
+}
+
+std::string HashTraceContent(const std::string& content) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)Fnv1a(content));
+    return hex;
+}
+
+std::string SynthesizeTraceText(const std::string& hash, size_t size) {
+    static const char* const WORDS[] = {
+        "the", "clipboard", "report", "meeting", "value", "server", "build", "error",
+        "user", "release", "config", "query", "update", "review", "data", "file"
+    };
+    uint64_t state = Fnv1a(hash) | 1;
+    std::string text;
+    text.reserve(size);
+    while (text.size() < size) {
+        // xorshift64
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        if (!text.empty()) {
+            text += (state & 0xF00) == 0 ? '\n' : ' ';
+        }
+        text += WORDS[state & 0xF];
+    }
+    text.resize(size);
+    return text;
+}
+
+LatencyStats::LatencyStats()
+    : m_total(0.0) {
+}
+
+void LatencyStats::Add(double ms) {
+    m_samples.push_back(ms);
+    m_total += ms;
+}
+
+double LatencyStats::GetAverage() const {
+    return m_samples.empty() ? 0.0 : m_total / m_samples.size();
+}
+
+double LatencyStats::GetPercentile(double percentile) const {
+    if (m_samples.empty()) {
+        return 0.0;
+    }
+    std::vector<double> sorted(m_samples);
+    size_t index = (size_t)(percentile / 100.0 * (sorted.size() - 1) + 0.5);
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+double LatencyStats::GetMax() const {
+    return m_samples.empty() ? 0.0 : *std::max_element(m_samples.begin(), m_samples.end());
+}
+
+size_t GetPeakMemoryBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
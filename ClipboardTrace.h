@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Clipboard activity traces, recorded in the field and replayed to reproduce
+// performance problems. One event per line in the history record format:
+//
+//     offsetMs|type;size=N;hash=H[;w=W;h=H][;content=1]|content
+//
+// offsetMs counts from the start of the recording. Content is only present
+// when recorded with content (content=1); otherwise replays synthesize
+// content of the same size, with equal hashes giving equal content.
+struct TraceEvent {
+    int64_t offsetMs;
+    std::string type;        // "Text", "File", "Image"
+    size_t size;             // UTF-8 bytes for text and file lists, RGBA bytes for images
+    std::string hash;
+    int width;               // Images only
+    int height;
+    bool hasContent;
+    std::string content;     // UTF-8; file lists have one path per line
+};
+
+class TraceWriter {
+public:
+    TraceWriter();
+
+    bool Open(const std::string& path);
+    bool IsOpen() const { return m_file.is_open(); }
+    // Stamps the event with the time since Open
+    void Write(TraceEvent event);
+
+private:
+    std::ofstream m_file;
+    int64_t m_startMs;
+};
+
+bool ReadTrace(const std::string& path, std::vector<TraceEvent>& events);
+std::string HashTraceContent(const std::string& content);
+// Deterministic stand-in for text that was recorded without content
+std::string SynthesizeTraceText(const std::string& hash, size_t size);
+
+// Latency samples of one stage of the capture pipeline
+class LatencyStats {
+public:
+    LatencyStats();
+
+    void Add(double ms);
+    size_t GetCount() const { return m_samples.size(); }
+    double GetTotal() const { return m_total; }
+    double GetAverage() const;
+    double GetPercentile(double percentile) const;
+    double GetMax() const;
+
+private:
+    std::vector<double> m_samples;
+    double m_total;
+};
+
+// Peak resident memory of this process in bytes; 0 if unknown
+size_t GetPeakMemoryBytes();
@@ -0,0 +1,996 @@
+#include "ControlServer.h"
+#include "FuzzySearch.h"
+#include "TimeIndex.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sddl.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const size_t DEFAULT_LIST_COUNT = 20;
+    // A client that doesn't read its responses stops being read from
+    const size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;
+
+    std::string Error(const std::string& message) {
+        return "ERR " + message + "\n";
+    }
+
+    bool ParseNumber(const std::string& text, size_t& value) {
+        if (text.empty() || text.size() > 18) {
+            return false;
+        }
+        value = 0;
+        for (char c : text) {
+            if (c < '0' || c > '9') {
+                return false;
+            }
+            value = value * 10 + (size_t)(c - '0');
+        }
+        return true;
+    }
+
+    // At most maxBytes, without cutting a UTF-8 character in half
+    std::string Preview(const std::string& text, size_t maxBytes) {
+        if (text.size() <= maxBytes) {
+            return text;
+        }
+        size_t end = maxBytes;
+        while (end > 0 && ((unsigned char)text[end] & 0xC0) == 0x80) {
+            end--;
+        }
+        return text.substr(0, end);
+    }
+
+    std::string FormatEntry(const ControlEntry& entry, const std::string& content) {
+        return std::to_string(entry.id) + "|" + entry.timestamp + "|" + entry.type + "|" +
+               ControlServer::EscapeContent(content) + "\n";
+    }
+
+    // "-" leaves that end of the range open
+    bool ParseTimeArgument(const std::string& text, int64_t open, int64_t& time) {
+        if (text == "-") {
+            time = open;
+            return true;
+        }
+        return TimeIndex::ParseTime(text, time);
+    }
+
+    // Splits "<from> <to>[ <rest>]"
+    bool ParseTimeRange(const std::string& arguments, int64_t& from, int64_t& to, std::string* rest) {
+        size_t first = arguments.find(' ');
+        if (first == std::string::npos) {
+            return false;
+        }
+        size_t second = arguments.find(' ', first + 1);
+        if ((second == std::string::npos) != (rest == nullptr)) {
+            return false;
+        }
+        if (rest) {
+            *rest = arguments.substr(second + 1);
+        }
+        return ParseTimeArgument(arguments.substr(0, first), INT64_MIN, from) &&
+               ParseTimeArgument(arguments.substr(first + 1, second == std::string::npos ? std::string::npos : second - first - 1),
+                                 INT64_MAX, to);
+    }
+
+    typedef std::vector<std::shared_ptr<const ControlEntry> >::const_iterator EntryIterator;
+
+    // Binary search of the time-ordered entries
+    std::pair<EntryIterator, EntryIterator> FindTimeRange(const ControlSnapshot& snapshot, int64_t from, int64_t to) {
+        EntryIterator begin = std::lower_bound(snapshot.byTime.begin(), snapshot.byTime.end(), from,
+            [](const std::shared_ptr<const ControlEntry>& entry, int64_t time) { return entry->time < time; });
+        EntryIterator end = std::upper_bound(begin, snapshot.byTime.end(), to,
+            [](int64_t time, const std::shared_ptr<const ControlEntry>& entry) { return time < entry->time; });
+        return std::make_pair(begin, end);
+    }
+
+    // Content for list and search lines; only the start of compressed text is decoded
+    std::string PreviewContent(const ControlEntry& entry) {
+        if (!entry.compressed) {
+            return Preview(entry.text, ControlServer::PREVIEW_BYTES);
+        }
+        std::string text;
+        TextCompressor::Decompress(*entry.compressed, text, ControlServer::PREVIEW_BYTES + 4);
+        return Preview(text, ControlServer::PREVIEW_BYTES);
+    }
+
+#ifdef _WIN32
+    std::wstring ToWide(const std::string& text) {
+        int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), (int)text.size(), NULL, 0);
+        std::wstring wide(length, L'\0');
+        if (length > 0) {
+            MultiByteToWideChar(CP_UTF8, 0, text.data(), (int)text.size(), &wide[0], length);
+        }
+        return wide;
+    }
+
+    // Pipe instances served at the same time; further clients wait for a free one
+    const size_t MAX_PIPE_INSTANCES = 16;
+    const DWORD PIPE_BUFFER_BYTES = 64 * 1024;
+
+    // Full access for the current user and the system, nobody else
+    PSECURITY_DESCRIPTOR CreateUserOnlySecurity() {
+        HANDLE token = NULL;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+            return NULL;
+        }
+        DWORD size = 0;
+        GetTokenInformation(token, TokenUser, NULL, 0, &size);
+        std::vector<char> buffer(size);
+        LPWSTR sid = NULL;
+        if (size > 0 && GetTokenInformation(token, TokenUser, buffer.data(), size, &size)) {
+            ConvertSidToStringSidW(((TOKEN_USER*)buffer.data())->User.Sid, &sid);
+        }
+        CloseHandle(token);
+        if (!sid) {
+            return NULL;
+        }
+        std::wstring sddl = std::wstring(L"D:P(A;;GA;;;") + sid + L")(A;;GA;;;SY)";
+        LocalFree(sid);
+        PSECURITY_DESCRIPTOR descriptor = NULL;
+        if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(sddl.c_str(), SDDL_REVISION_1, &descriptor, NULL)) {
+            return NULL;
+        }
+        return descriptor;
+    }
+
+    HANDLE CreatePipeInstance(const std::wstring& name, bool first) {
+        PSECURITY_DESCRIPTOR descriptor = CreateUserOnlySecurity();
+        if (!descriptor) {
+            return INVALID_HANDLE_VALUE;
+        }
+        SECURITY_ATTRIBUTES attributes = { sizeof(attributes), descriptor, FALSE };
+        // The first instance fails if another manager already serves the name
+        DWORD openMode = PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0);
+        HANDLE pipe = CreateNamedPipeW(name.c_str(), openMode,
+                                       PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                                       (DWORD)MAX_PIPE_INSTANCES, PIPE_BUFFER_BYTES, PIPE_BUFFER_BYTES, 0, &attributes);
+        LocalFree(descriptor);
+        return pipe;
+    }
+
+    struct PipeInstance {
+        enum State {
+            CONNECTING,
+            READING,
+            WRITING,
+            BROKEN
+        };
+
+        HANDLE pipe;
+        OVERLAPPED overlapped;
+        State state;
+        bool pending;                 // overlapped has an operation to complete
+        std::string input;
+        std::string output;
+        char buffer[16 * 1024];
+    };
+
+    bool ConnectPipe(PipeInstance& instance) {
+        instance.state = PipeInstance::CONNECTING;
+        instance.input.clear();
+        instance.output.clear();
+        // Overlapped ConnectNamedPipe always returns FALSE
+        ConnectNamedPipe(instance.pipe, &instance.overlapped);
+        switch (GetLastError()) {
+        case ERROR_IO_PENDING:
+            instance.pending = true;
+            return true;
+        case ERROR_PIPE_CONNECTED:
+            // Connected between CreateNamedPipe and ConnectNamedPipe
+            instance.pending = false;
+            SetEvent(instance.overlapped.hEvent);
+            return true;
+        default:
+            instance.state = PipeInstance::BROKEN;
+            ResetEvent(instance.overlapped.hEvent);
+            return false;
+        }
+    }
+
+    void Reconnect(PipeInstance& instance) {
+        DisconnectNamedPipe(instance.pipe);
+        ConnectPipe(instance);
+    }
+
+    // Completion is signaled through the event even when the call finishes at once
+    void StartRead(PipeInstance& instance) {
+        instance.state = PipeInstance::READING;
+        instance.pending = true;
+        if (!ReadFile(instance.pipe, instance.buffer, sizeof(instance.buffer), NULL, &instance.overlapped) &&
+            GetLastError() != ERROR_IO_PENDING) {
+            Reconnect(instance);
+        }
+    }
+
+    void StartWrite(PipeInstance& instance) {
+        instance.state = PipeInstance::WRITING;
+        instance.pending = true;
+        DWORD size = (DWORD)std::min<size_t>(instance.output.size(), PIPE_BUFFER_BYTES);
+        if (!WriteFile(instance.pipe, instance.output.data(), size, NULL, &instance.overlapped) &&
+            GetLastError() != ERROR_IO_PENDING) {
+            Reconnect(instance);
+        }
+    }
+#else
+    bool MakeAddress(const std::string& path, sockaddr_un& address) {
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            return false;
+        }
+        memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    struct Client {
+        int fd;
+        bool closing;                 // The client has stopped sending
+        std::string input;
+        std::string output;
+    };
+#endif
+
+    FILE* OpenFile(const std::string& path, bool write) {
+#ifdef _WIN32
+        return _wfopen(ToWide(path).c_str(), write ? L"wb" : L"rb");
+#else
+        return fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+    }
+}
+
+std::string ControlEntry::GetContent() const {
+    if (load) {
+        return load();
+    }
+    if (!compressed) {
+        return text;
+    }
+    std::string content;
+    TextCompressor::Decompress(*compressed, content);
+    return content;
+}
+
+size_t ControlEntry::GetMemoryBytes() const {
+    size_t bytes = sizeof(ControlEntry) + timestamp.capacity() + type.capacity() + text.capacity();
+    for (const auto& attribute : attributes) {
+        bytes += sizeof(attribute) + attribute.first.capacity() + attribute.second.capacity();
+    }
+    return bytes;
+}
+
+// std::min takes it by reference, so it needs a definition
+const size_t ControlServer::MAX_RESULTS;
+
+ControlServer::ControlServer()
+    : m_running(false),
+      m_stopping(false),
+      m_snapshot(std::make_shared<ControlSnapshot>()),
+      m_stats()
+#ifdef _WIN32
+      , m_stopEvent(NULL),
+      m_firstPipe(NULL)
+#else
+      , m_listenFd(-1)
+#endif
+{
+#ifndef _WIN32
+    m_wakePipe[0] = -1;
+    m_wakePipe[1] = -1;
+#endif
+}
+
+ControlServer::~ControlServer() {
+    Stop();
+}
+
+bool ControlServer::Start(const std::string& endpoint, const RestoreCallback& onRestore, const ImportCallback& onImport) {
+    if (m_running) {
+        return true;
+    }
+    m_endpoint = endpoint;
+    m_onRestore = onRestore;
+    m_onImport = onImport;
+    m_stopping = false;
+#ifdef _WIN32
+    HANDLE pipe = CreatePipeInstance(ToWide(endpoint), true);
+    if (pipe == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    m_firstPipe = pipe;
+    m_stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!m_stopEvent) {
+        CloseHandle(pipe);
+        m_firstPipe = NULL;
+        return false;
+    }
+#else
+    sockaddr_un address;
+    if (!MakeAddress(endpoint, address)) {
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        if (errno != EADDRINUSE) {
+            close(fd);
+            return false;
+        }
+        // A socket nobody accepts on is left over from a crash; a live one belongs to another instance
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 && connect(probe, (sockaddr*)&address, sizeof(address)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (live || unlink(endpoint.c_str()) != 0 || bind(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            close(fd);
+            return false;
+        }
+    }
+    // $XDG_RUNTIME_DIR is private already; the /tmp fallback relies on this
+    chmod(endpoint.c_str(), 0600);
+    if (listen(fd, SOMAXCONN) != 0 || pipe2(m_wakePipe, O_CLOEXEC) != 0) {
+        close(fd);
+        unlink(endpoint.c_str());
+        return false;
+    }
+    m_listenFd = fd;
+#endif
+    m_running = true;
+    m_thread = std::thread(&ControlServer::ServerLoop, this);
+    return true;
+}
+
+void ControlServer::Stop() {
+    if (!m_running) {
+        return;
+    }
+    m_stopping = true;
+#ifdef _WIN32
+    SetEvent(m_stopEvent);
+#else
+    char wake = 0;
+    ssize_t written = write(m_wakePipe[1], &wake, 1);
+    (void)written;
+#endif
+    m_thread.join();
+    m_running = false;
+#ifdef _WIN32
+    CloseHandle(m_stopEvent);
+    m_stopEvent = NULL;
+    m_firstPipe = NULL;
+#else
+    close(m_listenFd);
+    close(m_wakePipe[0]);
+    close(m_wakePipe[1]);
+    m_listenFd = -1;
+    m_wakePipe[0] = -1;
+    m_wakePipe[1] = -1;
+    unlink(m_endpoint.c_str());
+#endif
+}
+
+bool ControlServer::IsRunning() const {
+    return m_running;
+}
+
+void ControlServer::Publish(const std::shared_ptr<const ControlSnapshot>& snapshot) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_snapshot = snapshot;
+}
+
+std::shared_ptr<const ControlSnapshot> ControlServer::GetSnapshot() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_snapshot;
+}
+
+ControlServer::Stats ControlServer::GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::string ControlServer::HandleRequest(const std::string& request) {
+    size_t space = request.find(' ');
+    std::string command = request.substr(0, space);
+    std::string arguments = space == std::string::npos ? std::string() : request.substr(space + 1);
+    std::shared_ptr<const ControlSnapshot> snapshot = GetSnapshot();
+    const auto& entries = snapshot->entries;
+
+    if (command == "list") {
+        size_t count = DEFAULT_LIST_COUNT;
+        if (!arguments.empty() && !ParseNumber(arguments, count)) {
+            return Error("usage: list [count]");
+        }
+        count = std::min(std::min(count, MAX_RESULTS), entries.size());
+        std::string response = "OK " + std::to_string(count) + "\n";
+        for (size_t i = 0; i < count; ++i) {
+            response += FormatEntry(*entries[i], PreviewContent(*entries[i]));
+        }
+        return response;
+    }
+
+    if (command == "search") {
+        size_t separator = arguments.find(' ');
+        size_t count = 0;
+        if (separator == std::string::npos || !ParseNumber(arguments.substr(0, separator), count)) {
+            return Error("usage: search <count> <query>");
+        }
+        std::string query = arguments.substr(separator + 1);
+        uint64_t mask = FuzzySearch::QueryMask(query);
+        // (score, index); the stable sort keeps newer entries first among equal scores
+        std::vector<std::pair<int, size_t> > matches;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if ((mask & ~entries[i]->mask) != 0) {
+                continue;
+            }
+            int score = FuzzySearch::ScoreQuery(query, entries[i]->GetContent());
+            if (score >= 0) {
+                matches.push_back(std::make_pair(score, i));
+            }
+        }
+        std::stable_sort(matches.begin(), matches.end(),
+                         [](const std::pair<int, size_t>& a, const std::pair<int, size_t>& b) { return a.first > b.first; });
+        count = std::min(std::min(count, MAX_RESULTS), matches.size());
+        std::string response = "OK " + std::to_string(count) + "\n";
+        for (size_t i = 0; i < count; ++i) {
+            const ControlEntry& entry = *entries[matches[i].second];
+            response += FormatEntry(entry, PreviewContent(entry));
+        }
+        return response;
+    }
+
+    if (command == "get" || command == "restore") {
+        size_t id = 0;
+        if (!ParseNumber(arguments, id)) {
+            return Error("usage: " + command + " <id>");
+        }
+        for (const auto& entry : entries) {
+            if (entry->id != id) {
+                continue;
+            }
+            if (command == "get") {
+                return "OK 1\n" + FormatEntry(*entry, entry->GetContent());
+            }
+            if (m_onRestore) {
+                m_onRestore(id);
+            }
+            return "OK 0\n";
+        }
+        return Error("no entry " + arguments);
+    }
+
+    if (command == "range") {
+        int64_t from = 0;
+        int64_t to = 0;
+        if (!ParseTimeRange(arguments, from, to, nullptr)) {
+            return Error("usage: range <from> <to>");
+        }
+        auto range = FindTimeRange(*snapshot, from, to);
+        std::string response = "OK " + std::to_string(range.second - range.first) + "\n";
+        for (auto it = range.first; it != range.second; ++it) {
+            response += FormatEntry(**it, PreviewContent(**it));
+        }
+        return response;
+    }
+
+    if (command == "export") {
+        return ExportHistory(*snapshot, arguments);
+    }
+
+    if (command == "import") {
+        return ImportHistory(arguments);
+    }
+
+    if (command == "stats") {
+        size_t compressedCount = 0;
+        size_t spilledCount = 0;
+        uint64_t bytes = 0;
+        for (const auto& entry : entries) {
+            // Spilled content is not in memory and its size is not known without reading it
+            if (entry->load) {
+                spilledCount++;
+                continue;
+            }
+            compressedCount += entry->compressed ? 1 : 0;
+            bytes += entry->compressed ? entry->compressed->size : entry->text.size();
+        }
+        Stats stats = GetStats();
+        char maxRequestMs[32];
+        snprintf(maxRequestMs, sizeof(maxRequestMs), "%.3f", stats.maxRequestMs);
+        std::string lines =
+            "entries=" + std::to_string(entries.size()) + "\n" +
+            "compressed=" + std::to_string(compressedCount) + "\n" +
+            "spilled=" + std::to_string(spilledCount) + "\n" +
+            "bytes=" + std::to_string(bytes) + "\n" +
+            "connections=" + std::to_string(stats.connections) + "\n" +
+            "requests=" + std::to_string(stats.requests) + "\n" +
+            "errors=" + std::to_string(stats.errors) + "\n" +
+            "max_request_ms=" + maxRequestMs + "\n";
+        for (const auto& component : snapshot->memory) {
+            lines += "memory_" + component.first + "=" + std::to_string(component.second) + "\n";
+        }
+        return "OK " + std::to_string(8 + snapshot->memory.size()) + "\n" + lines;
+    }
+
+    return Error("unknown command: " + command);
+}
+
+std::string ControlServer::ExportHistory(const ControlSnapshot& snapshot, const std::string& arguments) {
+    int64_t from = 0;
+    int64_t to = 0;
+    std::string path;
+    if (!ParseTimeRange(arguments, from, to, &path) || path.empty()) {
+        return Error("usage: export <from> <to> <path>");
+    }
+    FILE* file = OpenFile(path, true);
+    if (!file) {
+        return Error("cannot create " + path);
+    }
+    // One entry in memory at a time
+    auto range = FindTimeRange(snapshot, from, to);
+    size_t count = 0;
+    bool ok = true;
+    for (auto it = range.first; ok && it != range.second; ++it) {
+        const ControlEntry& entry = **it;
+        HistoryRecord record;
+        record.timestamp = entry.timestamp;
+        record.type = entry.type;
+        record.content = entry.GetContent();
+        record.attributes = entry.attributes;
+        std::string line = FormatJsonRecord(record);
+        line += '\n';
+        ok = fwrite(line.data(), 1, line.size(), file) == line.size();
+        count++;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        return Error("failed to write " + path);
+    }
+    return "OK 1\nexported=" + std::to_string(count) + "\n";
+}
+
+std::string ControlServer::ImportHistory(const std::string& path) {
+    if (path.empty()) {
+        return Error("usage: import <path>");
+    }
+    if (!m_onImport) {
+        return Error("import is not available");
+    }
+    FILE* file = OpenFile(path, false);
+    if (!file) {
+        return Error("cannot open " + path);
+    }
+    // Read in blocks and handed over in batches, so memory use doesn't depend on the file size
+    std::vector<HistoryRecord> batch;
+    std::string pending;
+    size_t records = 0;
+    size_t invalid = 0;
+    char buffer[64 * 1024];
+    bool more = true;
+    while (more && !m_stopping) {
+        size_t count = fread(buffer, 1, sizeof(buffer), file);
+        more = count > 0;
+        pending.append(buffer, count);
+        size_t start = 0;
+        size_t end;
+        while (start < pending.size() &&
+               ((end = pending.find('\n', start)) != std::string::npos || (!more && (end = pending.size())))) {
+            size_t length = end - start;
+            if (length > 0 && pending[end - 1] == '\r') {
+                length--;
+            }
+            if (length > 0) {
+                HistoryRecord record;
+                if (ParseJsonRecord(pending.substr(start, length), record)) {
+                    batch.push_back(std::move(record));
+                    records++;
+                } else {
+                    invalid++;
+                }
+            }
+            start = end + 1;
+            if (batch.size() >= IMPORT_BATCH_SIZE) {
+                m_onImport(batch);
+                batch.clear();
+            }
+        }
+        pending.erase(0, std::min(start, pending.size()));
+    }
+    bool failed = ferror(file) != 0;
+    fclose(file);
+    if (!batch.empty()) {
+        m_onImport(batch);
+    }
+    if (failed) {
+        return Error("failed to read " + path);
+    }
+    return "OK 2\nrecords=" + std::to_string(records) + "\ninvalid=" + std::to_string(invalid) + "\n";
+}
+
+void ControlServer::HandleInput(std::string& input, std::string& output) {
+    size_t start = 0;
+    size_t end;
+    while ((end = input.find('\n', start)) != std::string::npos) {
+        std::string request = input.substr(start, end - start);
+        start = end + 1;
+        if (!request.empty() && request[request.size() - 1] == '\r') {
+            request.erase(request.size() - 1);
+        }
+        if (request.empty()) {
+            continue;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        std::string response = HandleRequest(request);
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        output += response;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.requests++;
+        m_stats.errors += response.compare(0, 4, "ERR ") == 0 ? 1 : 0;
+        m_stats.maxRequestMs = std::max(m_stats.maxRequestMs, elapsedMs);
+    }
+    input.erase(0, start);
+}
+
+#ifdef _WIN32
+void ControlServer::ServerLoop() {
+    std::wstring name = ToWide(m_endpoint);
+    std::vector<std::unique_ptr<PipeInstance> > instances;
+    std::vector<HANDLE> events;
+    events.push_back((HANDLE)m_stopEvent);
+    for (size_t i = 0; i < MAX_PIPE_INSTANCES; ++i) {
+        HANDLE pipe = i == 0 ? (HANDLE)m_firstPipe : CreatePipeInstance(name, false);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            break;
+        }
+        std::unique_ptr<PipeInstance> instance(new PipeInstance());
+        instance->pipe = pipe;
+        instance->overlapped.hEvent = CreateEventW(NULL, TRUE, TRUE, NULL);
+        ConnectPipe(*instance);
+        events.push_back(instance->overlapped.hEvent);
+        instances.push_back(std::move(instance));
+    }
+
+    for (;;) {
+        DWORD wait = WaitForMultipleObjects((DWORD)events.size(), events.data(), FALSE, INFINITE);
+        if (wait <= WAIT_OBJECT_0 || wait >= WAIT_OBJECT_0 + events.size()) {
+            break;
+        }
+        PipeInstance& instance = *instances[wait - WAIT_OBJECT_0 - 1];
+        if (instance.state == PipeInstance::BROKEN) {
+            ResetEvent(instance.overlapped.hEvent);
+            continue;
+        }
+        DWORD bytes = 0;
+        BOOL ok = instance.pending ? GetOverlappedResult(instance.pipe, &instance.overlapped, &bytes, FALSE) : TRUE;
+
+        switch (instance.state) {
+        case PipeInstance::CONNECTING:
+            if (!ok) {
+                Reconnect(instance);
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stats.connections++;
+            }
+            StartRead(instance);
+            break;
+        case PipeInstance::READING:
+            if (!ok || bytes == 0) {
+                Reconnect(instance);
+                break;
+            }
+            instance.input.append(instance.buffer, bytes);
+            HandleInput(instance.input, instance.output);
+            if (instance.input.size() > MAX_REQUEST_BYTES) {
+                Reconnect(instance);
+            } else if (!instance.output.empty()) {
+                StartWrite(instance);
+            } else {
+                StartRead(instance);
+            }
+            break;
+        case PipeInstance::WRITING:
+            if (!ok) {
+                Reconnect(instance);
+                break;
+            }
+            instance.output.erase(0, bytes);
+            if (!instance.output.empty()) {
+                StartWrite(instance);
+            } else {
+                StartRead(instance);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Pending operations write into the instances, so they end before those are freed
+    for (auto& instance : instances) {
+        if (instance->pending && instance->state != PipeInstance::BROKEN) {
+            DWORD bytes = 0;
+            CancelIoEx(instance->pipe, &instance->overlapped);
+            GetOverlappedResult(instance->pipe, &instance->overlapped, &bytes, TRUE);
+        }
+        CloseHandle(instance->pipe);
+        CloseHandle(instance->overlapped.hEvent);
+    }
+}
+#else
+void ControlServer::ServerLoop() {
+    std::vector<Client> clients;
+    std::vector<pollfd> fds;
+    for (;;) {
+        fds.clear();
+        fds.push_back({ m_wakePipe[0], POLLIN, 0 });
+        fds.push_back({ m_listenFd, POLLIN, 0 });
+        for (const auto& client : clients) {
+            short events = 0;
+            if (!client.closing && client.output.size() < MAX_PENDING_OUTPUT) {
+                events |= POLLIN;
+            }
+            if (!client.output.empty()) {
+                events |= POLLOUT;
+            }
+            fds.push_back({ client.fd, events, 0 });
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents) {
+            break;
+        }
+
+        // Clients from before the poll; new ones are added after
+        for (size_t i = clients.size(); i-- > 0;) {
+            Client& client = clients[i];
+            short revents = fds[i + 2].revents;
+            bool open = true;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                char buffer[16 * 1024];
+                ssize_t count = read(client.fd, buffer, sizeof(buffer));
+                if (count > 0) {
+                    client.input.append(buffer, (size_t)count);
+                    HandleInput(client.input, client.output);
+                    open = client.input.size() <= MAX_REQUEST_BYTES;
+                } else if (count == 0) {
+                    // Answered requests are still sent
+                    client.closing = true;
+                } else if (errno != EAGAIN && errno != EINTR) {
+                    open = false;
+                }
+            }
+            // Written right away; POLLOUT only matters once the socket buffer is full
+            if (open && !client.output.empty()) {
+                ssize_t count = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+                if (count > 0) {
+                    client.output.erase(0, (size_t)count);
+                } else if (count < 0 && errno != EAGAIN && errno != EINTR) {
+                    open = false;
+                }
+            }
+            if (!open || (client.closing && client.output.empty())) {
+                close(client.fd);
+                clients.erase(clients.begin() + i);
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            int fd;
+            while ((fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                Client client;
+                client.fd = fd;
+                client.closing = false;
+                clients.push_back(client);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stats.connections++;
+            }
+        }
+    }
+
+    for (const auto& client : clients) {
+        close(client.fd);
+    }
+}
+#endif
+
+std::string ControlServer::GetDefaultEndpoint() {
+#ifdef _WIN32
+    wchar_t user[256];
+    DWORD length = 256;
+    std::string name = "\\\\.\\pipe\\clipboard_manager";
+    if (GetUserNameW(user, &length) && length > 1) {
+        int size = WideCharToMultiByte(CP_UTF8, 0, user, (int)length - 1, NULL, 0, NULL, NULL);
+        std::string utf8(size, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, user, (int)length - 1, &utf8[0], size, NULL, NULL);
+        name += "-" + utf8;
+    }
+    return name;
+#else
+    const char* runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir && *runtimeDir) {
+        return std::string(runtimeDir) + "/clipboard_manager.sock";
+    }
+    return "/tmp/clipboard_manager-" + std::to_string(getuid()) + ".sock";
+#endif
+}
+
+std::string ControlServer::EscapeContent(const std::string& content) {
+    std::string escaped;
+    escaped.reserve(content.size());
+    for (char c : content) {
+        switch (c) {
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\r': escaped += "\\r"; break;
+        default: escaped += c; break;
+        }
+    }
+    return escaped;
+}
+
+std::string ControlServer::UnescapeContent(const std::string& content) {
+    std::string text;
+    text.reserve(content.size());
+    for (size_t i = 0; i < content.size(); ++i) {
+        if (content[i] != '\\' || i + 1 == content.size()) {
+            text += content[i];
+            continue;
+        }
+        char c = content[++i];
+        text += c == 'n' ? '\n' : c == 'r' ? '\r' : c;
+    }
+    return text;
+}
+
+ControlClient::ControlClient()
+#ifdef _WIN32
+    : m_pipe(INVALID_HANDLE_VALUE)
+#else
+    : m_fd(-1)
+#endif
+{
+}
+
+ControlClient::~ControlClient() {
+    Close();
+}
+
+bool ControlClient::Connect(const std::string& endpoint) {
+    Close();
+#ifdef _WIN32
+    std::wstring name = ToWide(endpoint);
+    for (int attempt = 0; attempt < 10; ++attempt) {
+        HANDLE pipe = CreateFileW(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (pipe != INVALID_HANDLE_VALUE) {
+            m_pipe = pipe;
+            return true;
+        }
+        // All instances are serving other clients
+        if (GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeW(name.c_str(), 2000)) {
+            return false;
+        }
+    }
+    return false;
+#else
+    sockaddr_un address;
+    if (!MakeAddress(endpoint, address)) {
+        return false;
+    }
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0) {
+        return false;
+    }
+    if (connect(m_fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        Close();
+        return false;
+    }
+    return true;
+#endif
+}
+
+void ControlClient::Close() {
+    m_buffer.clear();
+#ifdef _WIN32
+    if (m_pipe != INVALID_HANDLE_VALUE) {
+        CloseHandle((HANDLE)m_pipe);
+        m_pipe = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+#endif
+}
+
+bool ControlClient::Request(const std::string& request, std::string& status, std::vector<std::string>& lines) {
+    lines.clear();
+    // A newline would end the request early
+    std::string line = request;
+    std::replace(line.begin(), line.end(), '\n', ' ');
+    if (!Send(line + "\n") || !ReadLine(status)) {
+        return false;
+    }
+    size_t count = 0;
+    if (status.compare(0, 3, "OK ") != 0 || !ParseNumber(status.substr(3), count)) {
+        return true;
+    }
+    lines.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!ReadLine(lines[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ControlClient::Send(const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+#ifdef _WIN32
+        DWORD count = 0;
+        if (!WriteFile((HANDLE)m_pipe, data.data() + written, (DWORD)(data.size() - written), &count, NULL)) {
+            return false;
+        }
+#else
+        ssize_t count = send(m_fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+#endif
+        written += (size_t)count;
+    }
+    return true;
+}
+
+bool ControlClient::ReadLine(std::string& line) {
+    size_t end;
+    while ((end = m_buffer.find('\n')) == std::string::npos) {
+        char buffer[16 * 1024];
+#ifdef _WIN32
+        DWORD count = 0;
+        if (!ReadFile((HANDLE)m_pipe, buffer, sizeof(buffer), &count, NULL) || count == 0) {
+            return false;
+        }
+#else
+        ssize_t count = recv(m_fd, buffer, sizeof(buffer), 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+#endif
+        m_buffer.append(buffer, (size_t)count);
+    }
+    line = m_buffer.substr(0, end);
+    m_buffer.erase(0, end + 1);
+    return true;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "HistoryRecord.h"
+#include "TextCompressor.h"
+
+// History entry as seen by control clients. Immutable once published.
+struct ControlEntry {
+    size_t id;
+    int64_t time;            // Seconds since the epoch
+    std::string timestamp;   // "%Y-%m-%d %H:%M:%S"
+    std::string type;
+    std::string text;        // UTF-8 content, empty when compressed is set, a preview when load is set
+    std::shared_ptr<const CompressedText> compressed;
+    std::function<std::string()> load;   // Reads content the manager moved out of memory
+    uint64_t mask;           // FuzzySearch::CharacterMask of the content, all bits if not known
+    std::vector<std::pair<std::string, std::string> > attributes;   // History record attributes, for export
+
+    std::string GetContent() const;
+    // Held by this entry alone; shared compressed content is not counted
+    size_t GetMemoryBytes() const;
+};
+
+// The history at one point in time
+struct ControlSnapshot {
+    std::vector<std::shared_ptr<const ControlEntry> > entries;   // Newest first
+    std::vector<std::shared_ptr<const ControlEntry> > byTime;    // Oldest first, from the TimeIndex
+    std::vector<std::pair<std::string, uint64_t> > memory;       // Manager memory use by component, for stats
+};
+
+// Local query/control endpoint of the running manager, so scripts don't
+// have to parse the history file while it is being replaced.
+// Linux: a Unix domain socket only the user can open. Windows: a named pipe
+// restricted to the user, rejecting remote clients.
+// One background thread serves all clients with non-blocking I/O (poll on
+// Linux, overlapped I/O on Windows). Requests are answered from the last
+// published snapshot, so they never wait for the UI thread.
+//
+// Protocol: one request per line, answered in order.
+//
+//     list [count]               newest entries (default 20)
+//     search <count> <query>     fuzzy search, best first
+//     get <id>                   full content of one entry
+//     restore <id>               put an entry back on the clipboard
+//     range <from> <to>          entries captured in a time range, oldest first
+//     export <from> <to> <path>  write a time range as JSON Lines
+//     import <path>              add the entries of a JSON Lines file
+//     stats                      key=value lines, memory_<component> in bytes
+//
+// Responses are "OK <n>" followed by n lines, or "ERR <message>". Entry
+// lines are "<id>|<timestamp>|<type>|<content>"; list, search and range
+// send a preview of the content. Backslashes, newlines and carriage
+// returns in content are escaped as \\, \n and \r.
+// Times are local "YYYY-MM-DDTHH:MM[:SS]" or "@<Unix time>" (see
+// TimeIndex::ParseTime), or "-" for an open end. Paths are absolute.
+// Export and import stream the file, so their memory use does not grow
+// with its size; other clients wait while they run.
+class ControlServer {
+public:
+    // Called on the server thread for a restore of a published entry
+    typedef std::function<void(size_t id)> RestoreCallback;
+    // Called on the server thread with each batch of imported records; may
+    // block until the batch is inserted, which bounds the memory used
+    typedef std::function<void(std::vector<HistoryRecord>& batch)> ImportCallback;
+
+    struct Stats {
+        uint64_t connections;
+        uint64_t requests;
+        uint64_t errors;
+        double maxRequestMs;
+    };
+
+    ControlServer();
+    ~ControlServer();
+
+    // Fails if the endpoint is in use by another running instance
+    bool Start(const std::string& endpoint, const RestoreCallback& onRestore, const ImportCallback& onImport);
+    void Stop();
+    bool IsRunning() const;
+    void Publish(const std::shared_ptr<const ControlSnapshot>& snapshot);
+    Stats GetStats() const;
+
+    // Answer to one request line, without the transport
+    std::string HandleRequest(const std::string& request);
+
+    // Per-user socket path or pipe name
+    static std::string GetDefaultEndpoint();
+    static std::string EscapeContent(const std::string& content);
+    static std::string UnescapeContent(const std::string& content);
+
+    static const size_t MAX_REQUEST_BYTES = 64 * 1024;   // Longer requests close the connection
+    static const size_t PREVIEW_BYTES = 200;              // Content sent by list and search
+    static const size_t MAX_RESULTS = 1000;
+    static const size_t IMPORT_BATCH_SIZE = 500;
+
+private:
+    void ServerLoop();
+    // Answers every complete line in input and removes it
+    void HandleInput(std::string& input, std::string& output);
+    std::shared_ptr<const ControlSnapshot> GetSnapshot() const;
+    std::string ExportHistory(const ControlSnapshot& snapshot, const std::string& arguments);
+    std::string ImportHistory(const std::string& path);
+
+    std::string m_endpoint;
+    RestoreCallback m_onRestore;
+    ImportCallback m_onImport;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_stopping;      // Ends a running import
+    mutable std::mutex m_mutex;        // Guards the snapshot and the stats
+    std::shared_ptr<const ControlSnapshot> m_snapshot;
+    Stats m_stats;
+#ifdef _WIN32
+    void* m_stopEvent;
+    void* m_firstPipe;                 // Created by Start, owned by the loop
+#else
+    int m_listenFd;
+    int m_wakePipe[2];                 // Written by Stop to end the loop
+#endif
+};
+
+// Blocking client connection, used by clipboard_ctl
+class ControlClient {
+public:
+    ControlClient();
+    ~ControlClient();
+
+    bool Connect(const std::string& endpoint);
+    void Close();
+    // Sends one request line; lines receives the response lines after the status line
+    bool Request(const std::string& request, std::string& status, std::vector<std::string>& lines);
+
+private:
+    bool Send(const std::string& data);
+    bool ReadLine(std::string& line);
+
+    std::string m_buffer;
+#ifdef _WIN32
+    void* m_pipe;
+#else
+    int m_fd;
+#endif
+};
@@ -0,0 +1,99 @@
+#include "FakeClipboard.h"
+
+FakeClipboard::FakeClipboard()
+    : m_kind(CONTENT_NONE),
+      m_changeCount(1),
+      m_opened(false) {
+}
+
+void FakeClipboard::SetText(const wxString& text) {
+    Clear();
+    m_kind = CONTENT_TEXT;
+    m_text = text;
+    m_changeCount++;
+}
+
+void FakeClipboard::SetFiles(const wxArrayString& files) {
+    Clear();
+    m_kind = CONTENT_FILES;
+    m_files = files;
+    m_changeCount++;
+}
+
+void FakeClipboard::SetBitmap(const wxBitmap& bitmap) {
+    Clear();
+    m_kind = CONTENT_BITMAP;
+    m_bitmap = bitmap;
+    m_changeCount++;
+}
+
+bool FakeClipboard::Open() {
+    if (m_opened) {
+        return false;
+    }
+    m_opened = true;
+    return true;
+}
+
+void FakeClipboard::Close() {
+    m_opened = false;
+}
+
+bool FakeClipboard::IsOpened() const {
+    return m_opened;
+}
+
+bool FakeClipboard::AddData(wxDataObject* data) {
+    delete data;
+    return true;
+}
+
+bool FakeClipboard::SetData(wxDataObject* data) {
+    delete data;
+    return true;
+}
+
+bool FakeClipboard::IsSupported(const wxDataFormat& format) {
+    switch (m_kind) {
+        case CONTENT_TEXT:
+            return format == wxDF_TEXT || format == wxDF_UNICODETEXT;
+        case CONTENT_FILES:
+            return format == wxDF_FILENAME;
+        case CONTENT_BITMAP:
+            return format == wxDF_BITMAP;
+        default:
+            return false;
+    }
+}
+
+bool FakeClipboard::GetData(wxDataObject& data) {
+    if (m_kind == CONTENT_TEXT) {
+        wxTextDataObject* text = dynamic_cast<wxTextDataObject*>(&data);
+        if (text) {
+            text->SetText(m_text);
+            return true;
+        }
+    } else if (m_kind == CONTENT_FILES) {
+        wxFileDataObject* files = dynamic_cast<wxFileDataObject*>(&data);
+        if (files) {
+            for (const auto& filename : m_files) {
+                files->AddFile(filename);
+            }
+            return true;
+        }
+    } else if (m_kind == CONTENT_BITMAP) {
+        wxBitmapDataObject* bitmap = dynamic_cast<wxBitmapDataObject*>(&data);
+        if (bitmap) {
+            bitmap->SetBitmap(m_bitmap);
+            return true;
+        }
+    }
+    return false;
+}
+
+void FakeClipboard::Clear() {
+    m_kind = CONTENT_NONE;
+    m_text.clear();
+    m_files.Clear();
+    m_bitmap = wxBitmap();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <wx/wx.h>
+#include <wx/clipbrd.h>
+#include <wx/dataobj.h>
+#include <cstdint>
+
+// In-memory clipboard used to replay traces through the capture pipeline
+// without touching the system clipboard. Holds one kind of content at a
+// time, like a copy from a typical application; data set by the manager
+// itself (restores) is accepted and discarded.
+class FakeClipboard : public wxClipboardBase {
+public:
+    FakeClipboard();
+
+    void SetText(const wxString& text);
+    void SetFiles(const wxArrayString& files);
+    void SetBitmap(const wxBitmap& bitmap);
+    // Increases with every Set call, like the system clipboard sequence number
+    uint64_t GetChangeCount() const { return m_changeCount; }
+
+    virtual bool Open() override;
+    virtual void Close() override;
+    virtual bool IsOpened() const override;
+    virtual bool AddData(wxDataObject* data) override;
+    virtual bool SetData(wxDataObject* data) override;
+    virtual bool IsSupported(const wxDataFormat& format) override;
+    virtual bool GetData(wxDataObject& data) override;
+    virtual void Clear() override;
+
+private:
+    enum ContentKind {
+        CONTENT_NONE,
+        CONTENT_TEXT,
+        CONTENT_FILES,
+        CONTENT_BITMAP
+    };
+
+    ContentKind m_kind;
+    wxString m_text;
+    wxArrayString m_files;
+    wxBitmap m_bitmap;
+    uint64_t m_changeCount;
+    bool m_opened;
+};
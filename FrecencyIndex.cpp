@@ -0,0 +1,64 @@
+#include "FrecencyIndex.h"
+#include <cmath>
+
+namespace {
+    const double DECAY_RATE = std::log(2.0) / FrecencyIndex::HALF_LIFE_SECONDS;
+
+    // log(exp(a) + exp(b)) without overflow
+    double LogAddExp(double a, double b) {
+        double high = a > b ? a : b;
+        double low = a > b ? b : a;
+        return high + std::log1p(std::exp(low - high));
+    }
+}
+
+void FrecencyIndex::RecordUse(size_t id, int64_t unixTime) {
+    double use = DECAY_RATE * (double)unixTime;
+    auto existing = m_scores.find(id);
+    SetScore(id, existing == m_scores.end() ? use : LogAddExp(existing->second, use));
+}
+
+void FrecencyIndex::SetScore(size_t id, double score) {
+    auto existing = m_scores.find(id);
+    if (existing != m_scores.end()) {
+        m_ranking.erase(RankKey(existing->second, id));
+        existing->second = score;
+    } else {
+        m_scores.emplace(id, score);
+    }
+    m_ranking.insert(RankKey(score, id));
+}
+
+void FrecencyIndex::Remove(size_t id) {
+    auto existing = m_scores.find(id);
+    if (existing != m_scores.end()) {
+        m_ranking.erase(RankKey(existing->second, id));
+        m_scores.erase(existing);
+    }
+}
+
+void FrecencyIndex::Clear() {
+    m_ranking.clear();
+    m_scores.clear();
+}
+
+size_t FrecencyIndex::GetMemoryBytes() const {
+    // Tree nodes hold three links and a color, hash nodes one link
+    return m_ranking.size() * (sizeof(RankKey) + 4 * sizeof(void*)) +
+           m_scores.size() * (sizeof(std::pair<const size_t, double>) + sizeof(void*)) +
+           m_scores.bucket_count() * sizeof(void*);
+}
+
+double FrecencyIndex::GetScore(size_t id) const {
+    auto existing = m_scores.find(id);
+    return existing != m_scores.end() ? existing->second : -HUGE_VAL;
+}
+
+std::vector<size_t> FrecencyIndex::GetTop(size_t count) const {
+    std::vector<size_t> ids;
+    ids.reserve(count < m_ranking.size() ? count : m_ranking.size());
+    for (auto it = m_ranking.begin(); it != m_ranking.end() && ids.size() < count; ++it) {
+        ids.push_back(it->second);
+    }
+    return ids;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Ranks history entries by frecency: every use (capture or restore) adds a
+// contribution that halves every HALF_LIFE_SECONDS, so entries used often
+// and recently come first.
+// Scores are kept as log(sum(exp(lambda * useTime))). Decay then applies to
+// all entries alike and never changes the order, so nothing has to be
+// rescored as time passes: a use is one O(log n) update of an ordered index
+// and the top K entries are read in O(K).
+class FrecencyIndex {
+public:
+    // Records a use of an entry at the given Unix time, adding it if necessary
+    void RecordUse(size_t id, int64_t unixTime);
+    // Restores a score previously returned by GetScore
+    void SetScore(size_t id, double score);
+    void Remove(size_t id);
+    void Clear();
+
+    bool Contains(size_t id) const { return m_scores.count(id) != 0; }
+    double GetScore(size_t id) const;
+    size_t GetSize() const { return m_scores.size(); }
+    // Estimated from the node sizes of the standard containers
+    size_t GetMemoryBytes() const;
+
+    // Highest ranked entries first; ties go to the newer (higher) id
+    std::vector<size_t> GetTop(size_t count) const;
+
+    static const int64_t HALF_LIFE_SECONDS = 3 * 24 * 60 * 60;
+
+private:
+    typedef std::pair<double, size_t> RankKey;
+
+    std::set<RankKey, std::greater<RankKey> > m_ranking;
+    std::unordered_map<size_t, double> m_scores;
+};
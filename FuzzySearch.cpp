@@ -0,0 +1,439 @@
+#include "FuzzySearch.h"
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FUZZY_SEARCH_SSE2 1
+#endif
+
+namespace {
+    const int SCORE_MATCH = 16;
+    const int SCORE_GAP_START = -3;
+    const int SCORE_GAP_EXTENSION = -1;
+    const int BONUS_BOUNDARY = 8;          // Match at the start of a word
+    const int BONUS_CAMEL_CASE = 7;        // Match at an upper case letter after a lower case one
+    const int BONUS_CONSECUTIVE = 4;
+    const int BONUS_FIRST_CHAR_MULTIPLIER = 2;
+
+    inline unsigned char FoldCase(unsigned char c) {
+        return c >= 'A' && c <= 'Z' ? (unsigned char)(c + ('a' - 'A')) : c;
+    }
+
+    inline bool IsWordByte(unsigned char c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+    }
+
+    int BoundaryBonus(const std::string& text, size_t pos) {
+        unsigned char c = (unsigned char)text[pos];
+        if (!IsWordByte(c)) {
+            return 0;
+        }
+        if (pos == 0) {
+            return BONUS_BOUNDARY;
+        }
+        unsigned char previous = (unsigned char)text[pos - 1];
+        if (!IsWordByte(previous)) {
+            return BONUS_BOUNDARY;
+        }
+        if (c >= 'A' && c <= 'Z' && previous >= 'a' && previous <= 'z') {
+            return BONUS_CAMEL_CASE;
+        }
+        return 0;
+    }
+
+#ifdef FUZZY_SEARCH_SSE2
+    // Positions of the set bits of every byte, so the prefilter writes the
+    // candidates of eight entries without a branch per entry
+    struct CompactTable {
+        uint8_t count[256];
+        uint8_t positions[256][8];
+
+        CompactTable() {
+            for (int bits = 0; bits < 256; ++bits) {
+                count[bits] = 0;
+                for (int i = 0; i < 8; ++i) {
+                    positions[bits][i] = 0;
+                }
+                for (int i = 0; i < 8; ++i) {
+                    if (bits & (1 << i)) {
+                        positions[bits][count[bits]++] = (uint8_t)i;
+                    }
+                }
+            }
+        }
+    };
+    const CompactTable COMPACT_TABLE;
+#endif
+
+    int64_t NowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Best first; equal scores go to the entry added last
+    bool IsBetter(const std::pair<FuzzySearch::Result, uint64_t>& a, const std::pair<FuzzySearch::Result, uint64_t>& b) {
+        return a.first.score != b.first.score ? a.first.score > b.first.score : a.second > b.second;
+    }
+
+    // Smart case: upper case in the query makes it case-sensitive
+    bool IsCaseSensitive(const std::string& query) {
+        for (unsigned char c : query) {
+            if (c >= 'A' && c <= 'Z') {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::string> SplitTerms(const std::string& query) {
+        std::vector<std::string> terms;
+        size_t start = 0;
+        while (start < query.size()) {
+            size_t end = query.find(' ', start);
+            if (end == std::string::npos) {
+                end = query.size();
+            }
+            if (end > start) {
+                terms.push_back(query.substr(start, end - start));
+            }
+            start = end + 1;
+        }
+        return terms;
+    }
+}
+
+FuzzySearch::FuzzySearch(size_t threadCount)
+    : m_snapshot(std::make_shared<Snapshot>()),
+      m_size(0),
+      m_memoryBytes(0),
+      m_generation(0),
+      m_nextSequence(0),
+      m_stopping(false) {
+    if (threadCount == 0) {
+        size_t cores = std::thread::hardware_concurrency();
+        threadCount = cores > 1 ? cores - 1 : 1;
+    }
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_workers.push_back(std::thread(&FuzzySearch::WorkerLoop, this));
+    }
+}
+
+FuzzySearch::~FuzzySearch() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_generation++;
+    }
+    m_wakeup.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void FuzzySearch::Add(size_t id, const std::string& text) {
+    std::shared_ptr<Item> item = std::make_shared<Item>();
+    item->id = id;
+    item->text = text;
+    uint64_t mask = CharacterMask(text);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    item->sequence = m_nextSequence++;
+    std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>(*m_snapshot);
+    std::shared_ptr<Chunk> chunk;
+    if (snapshot->empty() || snapshot->back()->items.size() >= CHUNK_SIZE) {
+        chunk = std::make_shared<Chunk>();
+        snapshot->push_back(chunk);
+    } else {
+        chunk = std::make_shared<Chunk>(*snapshot->back());
+        snapshot->back() = chunk;
+    }
+    chunk->masks.push_back(mask);
+    chunk->items.push_back(item);
+    m_snapshot = snapshot;
+    m_size++;
+    m_memoryBytes += GetItemBytes(*item);
+}
+
+void FuzzySearch::Remove(size_t id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Snapshot& current = *m_snapshot;
+    for (size_t c = 0; c < current.size(); ++c) {
+        const Chunk& chunk = *current[c];
+        for (size_t i = 0; i < chunk.items.size(); ++i) {
+            if (chunk.items[i]->id != id) {
+                continue;
+            }
+            std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>(current);
+            if (chunk.items.size() == 1) {
+                snapshot->erase(snapshot->begin() + c);
+            } else {
+                std::shared_ptr<Chunk> copy = std::make_shared<Chunk>(chunk);
+                copy->masks.erase(copy->masks.begin() + i);
+                copy->items.erase(copy->items.begin() + i);
+                (*snapshot)[c] = copy;
+            }
+            m_memoryBytes -= GetItemBytes(*chunk.items[i]);
+            m_snapshot = snapshot;
+            m_size--;
+            return;
+        }
+    }
+}
+
+void FuzzySearch::Clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_snapshot = std::make_shared<Snapshot>();
+    m_size = 0;
+    m_memoryBytes = 0;
+}
+
+size_t FuzzySearch::GetSize() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_size;
+}
+
+size_t FuzzySearch::GetMemoryBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memoryBytes;
+}
+
+size_t FuzzySearch::GetItemBytes(const Item& item) {
+    // The item and its reference counts share one allocation; the chunk holds a pointer and a mask.
+    // Snapshots still held by a running query are not counted.
+    return sizeof(Item) + 2 * sizeof(long) + item.text.capacity() +
+           sizeof(std::shared_ptr<const Item>) + sizeof(uint64_t);
+}
+
+uint64_t FuzzySearch::Search(const std::string& query, size_t maxResults, const ResultCallback& callback) {
+    std::shared_ptr<Query> next = std::make_shared<Query>();
+    next->terms = SplitTerms(query);
+    next->mask = QueryMask(query);
+    next->caseSensitive = IsCaseSensitive(query);
+    next->maxResults = maxResults;
+    next->callback = callback;
+    next->nextChunk = 0;
+    next->finishedChunks = 0;
+    next->lastReportMs = NowMs();
+
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        next->snapshot = m_snapshot;
+        // At least one unit of work, so an empty history also reports that it is done
+        next->chunkCount = std::max<size_t>(m_snapshot->size(), 1);
+        generation = ++m_generation;
+        next->generation = generation;
+        m_query = next;
+    }
+    m_wakeup.notify_all();
+    return generation;
+}
+
+void FuzzySearch::Cancel() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation++;
+    m_query.reset();
+}
+
+void FuzzySearch::WorkerLoop() {
+    for (;;) {
+        std::shared_ptr<Query> query;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeup.wait(lock, [this] {
+                return m_stopping || (m_query && m_query->nextChunk.load() < m_query->chunkCount);
+            });
+            if (m_stopping) {
+                return;
+            }
+            query = m_query;
+        }
+
+        for (;;) {
+            size_t chunk = query->nextChunk++;
+            if (chunk >= query->chunkCount || !IsCurrent(*query)) {
+                break;
+            }
+            static const Chunk empty;
+            RunChunk(*query, chunk < query->snapshot->size() ? *(*query->snapshot)[chunk] : empty);
+        }
+    }
+}
+
+void FuzzySearch::RunChunk(Query& query, const Chunk& chunk) {
+    // Prefilter without branches: keep entries containing all character classes of the query
+    uint32_t candidates[CHUNK_SIZE];
+    size_t candidateCount = 0;
+    const uint64_t* masks = chunk.masks.data();
+    size_t maskCount = chunk.masks.size();
+    size_t i = 0;
+#ifdef FUZZY_SEARCH_SSE2
+    // Eight entries per step. An entry is a candidate when both 32-bit
+    // halves of query & ~mask are zero; movemask gives one bit per entry.
+    // Writing all eight positions never passes i, so the buffer suffices.
+    const __m128i queryMask = _mm_set_epi32((int)(query.mask >> 32), (int)query.mask,
+                                            (int)(query.mask >> 32), (int)query.mask);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= maskCount; i += 8) {
+        int bits = 0;
+        for (int pair = 0; pair < 4; ++pair) {
+            __m128i missing = _mm_andnot_si128(_mm_loadu_si128((const __m128i*)(masks + i + 2 * pair)), queryMask);
+            __m128i halves = _mm_cmpeq_epi32(missing, zero);
+            __m128i both = _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+            bits |= _mm_movemask_pd(_mm_castsi128_pd(both)) << (2 * pair);
+        }
+        const uint8_t* positions = COMPACT_TABLE.positions[bits];
+        for (int k = 0; k < 8; ++k) {
+            candidates[candidateCount + k] = (uint32_t)i + positions[k];
+        }
+        candidateCount += COMPACT_TABLE.count[bits];
+    }
+#endif
+    for (; i < maskCount; ++i) {
+        candidates[candidateCount] = (uint32_t)i;
+        candidateCount += (query.mask & ~masks[i]) == 0;
+    }
+
+    std::vector<std::pair<Result, uint64_t> > matches;
+    for (size_t c = 0; c < candidateCount; ++c) {
+        if ((c & 15) == 15 && !IsCurrent(query)) {
+            return;
+        }
+        const Item& item = *chunk.items[candidates[c]];
+        int total = 0;
+        for (const auto& term : query.terms) {
+            int score = Score(term, item.text, query.caseSensitive);
+            if (score < 0) {
+                total = -1;
+                break;
+            }
+            total += score;
+        }
+        if (total >= 0) {
+            Result result;
+            result.id = item.id;
+            result.score = total;
+            matches.push_back(std::make_pair(result, item.sequence));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(query.mutex);
+    if (!IsCurrent(query)) {
+        return;
+    }
+    query.best.insert(query.best.end(), matches.begin(), matches.end());
+    if (query.best.size() > query.maxResults) {
+        std::partial_sort(query.best.begin(), query.best.begin() + query.maxResults, query.best.end(), IsBetter);
+        query.best.resize(query.maxResults);
+    }
+
+    bool done = ++query.finishedChunks == query.chunkCount;
+    int64_t now = NowMs();
+    if (!done && (matches.empty() || now - query.lastReportMs < REPORT_INTERVAL_MS)) {
+        return;
+    }
+    query.lastReportMs = now;
+    std::sort(query.best.begin(), query.best.end(), IsBetter);
+    std::vector<Result> results;
+    results.reserve(query.best.size());
+    for (const auto& match : query.best) {
+        results.push_back(match.first);
+    }
+    // Reported under the lock, so the final results always arrive last
+    query.callback(query.generation, results, done);
+}
+
+int FuzzySearch::Score(const std::string& query, const std::string& text, bool caseSensitive) {
+    if (query.empty()) {
+        return 0;
+    }
+    auto fold = [caseSensitive](char c) { return caseSensitive ? (unsigned char)c : FoldCase((unsigned char)c); };
+
+    // Forward: the earliest position where all characters have been seen in order
+    size_t q = 0;
+    size_t end = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (fold(text[i]) == fold(query[q]) && ++q == query.size()) {
+            end = i;
+            break;
+        }
+    }
+    if (q < query.size()) {
+        return -1;
+    }
+
+    // Backward from there: the latest start, which gives the shortest match
+    size_t start = end;
+    for (size_t i = end + 1; i-- > 0;) {
+        if (fold(text[i]) == fold(query[q - 1]) && --q == 0) {
+            start = i;
+            break;
+        }
+    }
+
+    int score = 0;
+    bool consecutive = false;
+    bool inGap = false;
+    q = 0;
+    for (size_t i = start; i <= end && q < query.size(); ++i) {
+        if (fold(text[i]) == fold(query[q])) {
+            int bonus = BoundaryBonus(text, i);
+            if (q == 0) {
+                bonus *= BONUS_FIRST_CHAR_MULTIPLIER;
+            } else if (consecutive) {
+                bonus = std::max(bonus, BONUS_CONSECUTIVE);
+            }
+            score += SCORE_MATCH + bonus;
+            consecutive = true;
+            inGap = false;
+            q++;
+        } else {
+            score += inGap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+            consecutive = false;
+            inGap = true;
+        }
+    }
+    return std::max(score, 0);
+}
+
+int FuzzySearch::ScoreQuery(const std::string& query, const std::string& text) {
+    bool caseSensitive = IsCaseSensitive(query);
+    int total = 0;
+    for (const auto& term : SplitTerms(query)) {
+        int score = Score(term, text, caseSensitive);
+        if (score < 0) {
+            return -1;
+        }
+        total += score;
+    }
+    return total;
+}
+
+uint64_t FuzzySearch::QueryMask(const std::string& query) {
+    uint64_t mask = 0;
+    for (const auto& term : SplitTerms(query)) {
+        mask |= CharacterMask(term);
+    }
+    return mask;
+}
+
+uint64_t FuzzySearch::CharacterMask(const std::string& text) {
+    // Bits 0-25 letters (either case), 26-35 digits, 36-62 other ASCII, 63 anything else
+    uint64_t mask = 0;
+    for (unsigned char c : text) {
+        c = FoldCase(c);
+        int bit;
+        if (c >= 'a' && c <= 'z') {
+            bit = c - 'a';
+        } else if (c >= '0' && c <= '9') {
+            bit = 26 + (c - '0');
+        } else if (c < 0x80) {
+            bit = 36 + c % 27;
+        } else {
+            bit = 63;
+        }
+        mask |= (uint64_t)1 << bit;
+    }
+    return mask;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// fzf-style fuzzy search over the history, run on a pool of worker threads.
+// Each space-separated term of a query must match: the text contains its
+// characters in order (ASCII case is ignored unless the query has upper
+// case letters). Matches score higher when their characters are
+// consecutive or start words.
+// Each entry has a bitmask of the character classes it contains; entries
+// missing any of the query's classes are skipped without being scanned.
+// The masks are kept in one contiguous array that the prefilter walks
+// without branches: with SSE2, eight entries per step, their candidates
+// written out through a table indexed by the movemask bits.
+// Entries are stored in chunks of up to CHUNK_SIZE that the workers take in
+// turn. Results are reported while the search runs, and a new query cancels
+// the old one.
+class FuzzySearch {
+public:
+    struct Result {
+        size_t id;
+        int score;
+    };
+
+    // Called on a worker thread with the best results so far, best first.
+    // done is set on the last call of a query that was not cancelled.
+    typedef std::function<void(uint64_t generation, const std::vector<Result>& results, bool done)> ResultCallback;
+
+    // threadCount 0 uses all cores but one
+    explicit FuzzySearch(size_t threadCount = 0);
+    ~FuzzySearch();
+
+    // Entries added later rank above earlier ones with the same score
+    void Add(size_t id, const std::string& text);
+    void Remove(size_t id);
+    void Clear();
+    size_t GetSize() const;
+    // Text copies, masks and chunk lists of the current entries
+    size_t GetMemoryBytes() const;
+
+    // Cancels the running query; returns the generation passed to the callback
+    uint64_t Search(const std::string& query, size_t maxResults, const ResultCallback& callback);
+    void Cancel();
+
+    // Score of the best match of query in text, or -1 if it does not match
+    static int Score(const std::string& query, const std::string& text, bool caseSensitive);
+    static uint64_t CharacterMask(const std::string& text);
+    // A whole query on the calling thread: every term must match, with smart
+    // case. Entries whose CharacterMask lacks bits of QueryMask never match.
+    static int ScoreQuery(const std::string& query, const std::string& text);
+    static uint64_t QueryMask(const std::string& query);
+
+    static const size_t CHUNK_SIZE = 256;              // Entries per unit of work
+    static const int REPORT_INTERVAL_MS = 30;          // Between streamed results
+
+private:
+    struct Item {
+        size_t id;
+        uint64_t sequence;
+        std::string text;
+    };
+
+    // Chunks are immutable: a change copies one chunk and the chunk list,
+    // so running queries keep their snapshot and never lock the entries
+    struct Chunk {
+        std::vector<uint64_t> masks;
+        std::vector<std::shared_ptr<const Item> > items;
+    };
+    typedef std::vector<std::shared_ptr<const Chunk> > Snapshot;
+
+    struct Query {
+        uint64_t generation;
+        std::vector<std::string> terms;
+        uint64_t mask;
+        bool caseSensitive;
+        size_t maxResults;
+        ResultCallback callback;
+        std::shared_ptr<const Snapshot> snapshot;
+        std::atomic<size_t> nextChunk;
+        size_t chunkCount;
+        std::mutex mutex;                      // Guards the fields below
+        size_t finishedChunks;
+        std::vector<std::pair<Result, uint64_t> > best;  // (result, sequence), at most maxResults
+        int64_t lastReportMs;
+    };
+
+    static size_t GetItemBytes(const Item& item);
+    void WorkerLoop();
+    void RunChunk(Query& query, const Chunk& chunk);
+    bool IsCurrent(const Query& query) const { return query.generation == m_generation.load(); }
+
+    std::vector<std::thread> m_workers;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::shared_ptr<const Snapshot> m_snapshot;
+    size_t m_size;
+    size_t m_memoryBytes;                      // Sum of GetItemBytes
+    std::shared_ptr<Query> m_query;            // Query the workers are on, null when idle
+    std::atomic<uint64_t> m_generation;
+    uint64_t m_nextSequence;
+    bool m_stopping;
+};
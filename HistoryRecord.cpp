@@ -0,0 +1,456 @@
+#include "HistoryRecord.h"
+#include <cctype>
+#include <cstdint>
+
+namespace {
+    const char* HEX_DIGITS = "0123456789ABCDEF";
+
+    bool NeedsPercentEncoding(unsigned char c) {
+        return c < 0x20 || c == '%' || c == '|' || c == ';' || c == '=';
+    }
+
+    std::string PercentEncode(const std::string& value) {
+        std::string encoded;
+        encoded.reserve(value.size());
+        for (unsigned char c : value) {
+            if (NeedsPercentEncoding(c)) {
+                encoded += '%';
+                encoded += HEX_DIGITS[c >> 4];
+                encoded += HEX_DIGITS[c & 0x0F];
+            } else {
+                encoded += (char)c;
+            }
+        }
+        return encoded;
+    }
+
+    int HexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+
+    bool PercentDecode(const std::string& value, std::string& decoded) {
+        decoded.clear();
+        decoded.reserve(value.size());
+        for (size_t i = 0; i < value.size(); ++i) {
+            if (value[i] != '%') {
+                decoded += value[i];
+                continue;
+            }
+            if (i + 2 >= value.size()) {
+                return false;
+            }
+            int high = HexValue(value[i + 1]);
+            int low = HexValue(value[i + 2]);
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            decoded += (char)((high << 4) | low);
+            i += 2;
+        }
+        return true;
+    }
+
+    std::string EscapeContent(const std::string& content) {
+        std::string escaped;
+        escaped.reserve(content.size() + content.size() / 16);
+        for (char c : content) {
+            switch (c) {
+                case '\\': escaped += "\\\\"; break;
+                case '\n': escaped += "\\n"; break;
+                case '\r': escaped += "\\r"; break;
+                default: escaped += c; break;
+            }
+        }
+        return escaped;
+    }
+
+    std::string UnescapeContent(const std::string& content) {
+        std::string unescaped;
+        unescaped.reserve(content.size());
+        for (size_t i = 0; i < content.size(); ++i) {
+            if (content[i] == '\\' && i + 1 < content.size()) {
+                char next = content[i + 1];
+                if (next == '\\' || next == 'n' || next == 'r') {
+                    unescaped += next == 'n' ? '\n' : next == 'r' ? '\r' : '\\';
+                    ++i;
+                    continue;
+                }
+            }
+            unescaped += content[i];
+        }
+        return unescaped;
+    }
+
+    void AppendJsonString(std::string& json, const std::string& value) {
+        json += '"';
+        for (unsigned char c : value) {
+            switch (c) {
+                case '"': json += "\\\""; break;
+                case '\\': json += "\\\\"; break;
+                case '\n': json += "\\n"; break;
+                case '\r': json += "\\r"; break;
+                case '\t': json += "\\t"; break;
+                default:
+                    if (c < 0x20) {
+                        json += "\\u00";
+                        json += HEX_DIGITS[c >> 4];
+                        json += HEX_DIGITS[c & 0x0F];
+                    } else {
+                        json += (char)c;
+                    }
+                    break;
+            }
+        }
+        json += '"';
+    }
+
+    void AppendUTF8(std::string& text, uint32_t codePoint) {
+        if (codePoint < 0x80) {
+            text += (char)codePoint;
+        } else if (codePoint < 0x800) {
+            text += (char)(0xC0 | (codePoint >> 6));
+            text += (char)(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            text += (char)(0xE0 | (codePoint >> 12));
+            text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            text += (char)(0x80 | (codePoint & 0x3F));
+        } else {
+            text += (char)(0xF0 | (codePoint >> 18));
+            text += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+            text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            text += (char)(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    // Reads the JSON written by FormatJsonRecord, and skips any other value
+    class JsonReader {
+    public:
+        explicit JsonReader(const std::string& text) : m_text(text), m_pos(0) {}
+
+        bool Consume(char c) {
+            SkipSpace();
+            if (m_pos < m_text.size() && m_text[m_pos] == c) {
+                m_pos++;
+                return true;
+            }
+            return false;
+        }
+
+        bool AtEnd() {
+            SkipSpace();
+            return m_pos == m_text.size();
+        }
+
+        bool ReadString(std::string& value) {
+            value.clear();
+            if (!Consume('"')) {
+                return false;
+            }
+            while (m_pos < m_text.size()) {
+                char c = m_text[m_pos++];
+                if (c == '"') {
+                    return true;
+                }
+                if (c != '\\') {
+                    value += c;
+                    continue;
+                }
+                if (m_pos >= m_text.size()) {
+                    return false;
+                }
+                c = m_text[m_pos++];
+                switch (c) {
+                    case 'n': value += '\n'; break;
+                    case 'r': value += '\r'; break;
+                    case 't': value += '\t'; break;
+                    case 'b': value += '\b'; break;
+                    case 'f': value += '\f'; break;
+                    case 'u': {
+                        uint32_t codePoint = 0;
+                        if (!ReadHex4(codePoint)) {
+                            return false;
+                        }
+                        // A surrogate pair encodes one character outside the BMP
+                        uint32_t low = 0;
+                        if (codePoint >= 0xD800 && codePoint < 0xDC00 && m_text.compare(m_pos, 2, "\\u") == 0) {
+                            m_pos += 2;
+                            if (!ReadHex4(low) || low < 0xDC00 || low > 0xDFFF) {
+                                return false;
+                            }
+                            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        AppendUTF8(value, codePoint);
+                        break;
+                    }
+                    default: value += c; break;   // " \\ /
+                }
+            }
+            return false;
+        }
+
+        bool SkipValue(int depth = 0) {
+            SkipSpace();
+            if (m_pos >= m_text.size() || depth > 64) {
+                return false;
+            }
+            char c = m_text[m_pos];
+            if (c == '"') {
+                std::string ignored;
+                return ReadString(ignored);
+            }
+            if (c == '{' || c == '[') {
+                char close = c == '{' ? '}' : ']';
+                m_pos++;
+                if (Consume(close)) {
+                    return true;
+                }
+                do {
+                    if (c == '{') {
+                        std::string key;
+                        if (!ReadString(key) || !Consume(':')) {
+                            return false;
+                        }
+                    }
+                    if (!SkipValue(depth + 1)) {
+                        return false;
+                    }
+                } while (Consume(','));
+                return Consume(close);
+            }
+            // Number, true, false or null
+            size_t start = m_pos;
+            while (m_pos < m_text.size() && (isalnum((unsigned char)m_text[m_pos]) ||
+                                             m_text[m_pos] == '-' || m_text[m_pos] == '+' || m_text[m_pos] == '.')) {
+                m_pos++;
+            }
+            return m_pos > start;
+        }
+
+    private:
+        void SkipSpace() {
+            while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' ||
+                                             m_text[m_pos] == '\r' || m_text[m_pos] == '\n')) {
+                m_pos++;
+            }
+        }
+
+        bool ReadHex4(uint32_t& value) {
+            if (m_pos + 4 > m_text.size()) {
+                return false;
+            }
+            value = 0;
+            for (int i = 0; i < 4; ++i) {
+                int digit = HexValue(m_text[m_pos++]);
+                if (digit < 0) {
+                    return false;
+                }
+                value = (value << 4) | (uint32_t)digit;
+            }
+            return true;
+        }
+
+        const std::string& m_text;
+        size_t m_pos;
+    };
+
+    // Files written before attributes existed only replaced newlines
+    std::string UnescapeLegacyContent(const std::string& content) {
+        std::string unescaped;
+        unescaped.reserve(content.size());
+        for (size_t i = 0; i < content.size(); ++i) {
+            if (content[i] == '\\' && i + 1 < content.size() && (content[i + 1] == 'n' || content[i + 1] == 'r')) {
+                unescaped += content[i + 1] == 'n' ? '\n' : '\r';
+                ++i;
+                continue;
+            }
+            unescaped += content[i];
+        }
+        return unescaped;
+    }
+}
+
+const std::string* HistoryRecord::FindAttribute(const std::string& key) const {
+    for (const auto& attribute : attributes) {
+        if (attribute.first == key) {
+            return &attribute.second;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<std::string> HistoryRecord::FindAttributes(const std::string& key) const {
+    std::vector<std::string> values;
+    for (const auto& attribute : attributes) {
+        if (attribute.first == key) {
+            values.push_back(attribute.second);
+        }
+    }
+    return values;
+}
+
+void HistoryRecord::AddAttribute(const std::string& key, const std::string& value) {
+    attributes.push_back(std::make_pair(key, value));
+}
+
+std::string FormatHistoryRecord(const HistoryRecord& record) {
+    std::string line;
+    line.reserve(record.timestamp.size() + record.type.size() + record.content.size() + 16);
+    line += record.timestamp;
+    line += '|';
+    line += record.type;
+    line += ";esc=1";
+    for (const auto& attribute : record.attributes) {
+        line += ';';
+        line += attribute.first;
+        line += '=';
+        line += PercentEncode(attribute.second);
+    }
+    line += '|';
+    line += EscapeContent(record.content);
+    return line;
+}
+
+bool ParseHistoryRecord(const std::string& line, HistoryRecord& record) {
+    size_t typeStart = line.find('|');
+    if (typeStart == std::string::npos) {
+        return false;
+    }
+    size_t contentStart = line.find('|', typeStart + 1);
+    if (contentStart == std::string::npos) {
+        return false;
+    }
+
+    record.timestamp = line.substr(0, typeStart);
+    record.attributes.clear();
+
+    std::string typeField = line.substr(typeStart + 1, contentStart - typeStart - 1);
+    size_t separator = typeField.find(';');
+    record.type = typeField.substr(0, separator);
+    if (record.timestamp.empty() || record.type.empty()) {
+        return false;
+    }
+
+    bool escaped = false;
+    while (separator != std::string::npos) {
+        size_t next = typeField.find(';', separator + 1);
+        std::string attribute = typeField.substr(separator + 1,
+            next == std::string::npos ? std::string::npos : next - separator - 1);
+        separator = next;
+
+        size_t equals = attribute.find('=');
+        if (equals == std::string::npos || equals == 0) {
+            return false;
+        }
+        std::string key = attribute.substr(0, equals);
+        std::string value;
+        if (!PercentDecode(attribute.substr(equals + 1), value)) {
+            return false;
+        }
+        if (key == "esc") {
+            escaped = value == "1";
+        } else {
+            record.AddAttribute(key, value);
+        }
+    }
+
+    std::string content = line.substr(contentStart + 1);
+    record.content = escaped ? UnescapeContent(content) : UnescapeLegacyContent(content);
+    return true;
+}
+
+HistoryRecord MakeSealedRecord(const HistoryRecord& record, const std::string& sealed) {
+    HistoryRecord outer;
+    outer.timestamp = record.timestamp;
+    outer.type = record.type;
+    outer.AddAttribute("enc", "1");
+    outer.content = sealed;
+    return outer;
+}
+
+std::string GetSealedRecordAssociatedData(const HistoryRecord& record) {
+    return record.timestamp + "|" + record.type;
+}
+
+bool ParseOpenedRecord(const HistoryRecord& sealed, const std::string& line, HistoryRecord& record) {
+    return ParseHistoryRecord(line, record) && record.timestamp == sealed.timestamp && record.type == sealed.type;
+}
+
+std::string FormatJsonRecord(const HistoryRecord& record) {
+    std::string json;
+    json.reserve(record.content.size() + record.content.size() / 16 + 64);
+    json += "{\"timestamp\":";
+    AppendJsonString(json, record.timestamp);
+    json += ",\"type\":";
+    AppendJsonString(json, record.type);
+    json += ",\"content\":";
+    AppendJsonString(json, record.content);
+    json += ",\"attributes\":[";
+    bool first = true;
+    for (const auto& attribute : record.attributes) {
+        // The content here is never compressed
+        if (attribute.first == "lz") {
+            continue;
+        }
+        json += first ? "[" : ",[";
+        AppendJsonString(json, attribute.first);
+        json += ',';
+        AppendJsonString(json, attribute.second);
+        json += ']';
+        first = false;
+    }
+    json += "]}";
+    return json;
+}
+
+bool ParseJsonRecord(const std::string& line, HistoryRecord& record) {
+    record = HistoryRecord();
+    JsonReader reader(line);
+    bool hasContent = false;
+    if (!reader.Consume('{')) {
+        return false;
+    }
+    if (!reader.Consume('}')) {
+        do {
+            std::string key;
+            if (!reader.ReadString(key) || !reader.Consume(':')) {
+                return false;
+            }
+            bool ok;
+            if (key == "timestamp") {
+                ok = reader.ReadString(record.timestamp);
+            } else if (key == "type") {
+                ok = reader.ReadString(record.type);
+            } else if (key == "content") {
+                ok = hasContent = reader.ReadString(record.content);
+            } else if (key == "attributes") {
+                ok = reader.Consume('[');
+                if (ok && !reader.Consume(']')) {
+                    do {
+                        std::string name;
+                        std::string value;
+                        // Content is text: compressed or sealed content would pass for it
+                        ok = reader.Consume('[') && reader.ReadString(name) && reader.Consume(',') &&
+                             reader.ReadString(value) && reader.Consume(']') && !name.empty() &&
+                             name != "lz" && name != "enc";
+                        if (ok) {
+                            record.AddAttribute(name, value);
+                        }
+                    } while (ok && reader.Consume(','));
+                    ok = ok && reader.Consume(']');
+                }
+            } else {
+                ok = reader.SkipValue();
+            }
+            if (!ok) {
+                return false;
+            }
+        } while (reader.Consume(','));
+        if (!reader.Consume('}')) {
+            return false;
+        }
+    }
+    return reader.AtEnd() && hasContent && !record.timestamp.empty() && !record.type.empty();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// One line of clipboard_history.txt:
+//
+//     timestamp|type[;key=value...]|content
+//
+// Attribute values are percent-encoded. Content written by this version
+// escapes backslashes, newlines and carriage returns (marked with esc=1);
+// older files only escaped newlines and are still read as before.
+// All strings are UTF-8, except content compressed by TextCompressor
+// (marked with lz=<dictionary>:<size>) and content sealed by StorageCipher
+// (marked with enc=1, holding another formatted record), which are binary.
+struct HistoryRecord {
+    std::string timestamp;   // "%Y-%m-%d %H:%M:%S"
+    std::string type;        // "Text", "Image", "File"
+    std::vector<std::pair<std::string, std::string> > attributes;
+    std::string content;
+
+    const std::string* FindAttribute(const std::string& key) const;
+    std::vector<std::string> FindAttributes(const std::string& key) const;
+    void AddAttribute(const std::string& key, const std::string& value);
+};
+
+std::string FormatHistoryRecord(const HistoryRecord& record);
+bool ParseHistoryRecord(const std::string& line, HistoryRecord& record);
+
+// Sealed records keep the time and type readable (and authenticated):
+// attributes and content are sealed as one formatted record, with
+// "<timestamp>|<type>" as associated data
+HistoryRecord MakeSealedRecord(const HistoryRecord& record, const std::string& sealed);
+std::string GetSealedRecordAssociatedData(const HistoryRecord& record);
+// The opened line must hold a record with the time and type of the sealed one
+bool ParseOpenedRecord(const HistoryRecord& sealed, const std::string& line, HistoryRecord& record);
+
+// The same record as one line of JSON, for export and import:
+//
+//     {"timestamp":"...","type":"Text","content":"...","attributes":[["img","..."],...]}
+//
+// Content must be text (decompressed): records with an lz or enc attribute
+// are rejected on import. Other members are ignored, so an "id" or fields
+// added by other tools do no harm.
+std::string FormatJsonRecord(const HistoryRecord& record);
+bool ParseJsonRecord(const std::string& line, HistoryRecord& record);
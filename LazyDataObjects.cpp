@@ -0,0 +1,249 @@
+#include "LazyDataObjects.h"
+#include <wx/ffile.h>
+#include <wx/mstream.h>
+#include <cstdlib>
+#include <cstring>
+
+// LazyTextDataObject implementation
+LazyTextDataObject::LazyTextDataObject(const TextLoader& loader)
+    : m_loader(loader),
+      m_loaded(false) {
+}
+
+void LazyTextDataObject::EnsureLoaded() const {
+    if (!m_loaded) {
+        m_loaded = true;
+        // Store through the base class so every rendering path sees the text
+        const_cast<LazyTextDataObject*>(this)->SetText(m_loader());
+    }
+}
+
+size_t LazyTextDataObject::GetTextLength() const {
+    EnsureLoaded();
+    return wxTextDataObject::GetTextLength();
+}
+
+wxString LazyTextDataObject::GetText() const {
+    EnsureLoaded();
+    return wxTextDataObject::GetText();
+}
+
+size_t LazyTextDataObject::GetDataSize(const wxDataFormat& format) const {
+    EnsureLoaded();
+    return wxTextDataObject::GetDataSize(format);
+}
+
+bool LazyTextDataObject::GetDataHere(const wxDataFormat& format, void* buf) const {
+    EnsureLoaded();
+    return wxTextDataObject::GetDataHere(format, buf);
+}
+
+// LazyBitmapDataObject implementation
+LazyBitmapDataObject::LazyBitmapDataObject(const BitmapLoader& loader)
+    : m_loader(loader),
+      m_loaded(false) {
+}
+
+void LazyBitmapDataObject::EnsureLoaded() const {
+    if (!m_loaded) {
+        m_loaded = true;
+        const_cast<LazyBitmapDataObject*>(this)->SetBitmap(m_loader());
+    }
+}
+
+wxBitmap LazyBitmapDataObject::GetBitmap() const {
+    EnsureLoaded();
+    return wxBitmapDataObject::GetBitmap();
+}
+
+size_t LazyBitmapDataObject::GetDataSize() const {
+    EnsureLoaded();
+    return wxBitmapDataObject::GetDataSize();
+}
+
+bool LazyBitmapDataObject::GetDataHere(void* buf) const {
+    EnsureLoaded();
+    return wxBitmapDataObject::GetDataHere(buf);
+}
+
+// LazyBlobDataObject implementation
+LazyBlobDataObject::LazyBlobDataObject(const wxDataFormat& format, const BlobLoader& loader)
+    : wxDataObjectSimple(format),
+      m_loader(loader),
+      m_loaded(false) {
+}
+
+void LazyBlobDataObject::EnsureLoaded() const {
+    if (!m_loaded) {
+        m_loaded = true;
+        m_data = m_loader();
+    }
+}
+
+size_t LazyBlobDataObject::GetDataSize() const {
+    EnsureLoaded();
+    return m_data.GetDataLen();
+}
+
+bool LazyBlobDataObject::GetDataHere(void* buf) const {
+    EnsureLoaded();
+    if (m_data.GetDataLen() == 0) {
+        return false;
+    }
+    memcpy(buf, m_data.GetData(), m_data.GetDataLen());
+    return true;
+}
+
+bool LazyBlobDataObject::SetData(size_t len, const void* buf) {
+    m_data.Clear();
+    m_data.AppendData(buf, len);
+    m_loaded = true;
+    return true;
+}
+
+// ImagePrefetcher implementation
+ImagePrefetcher::ImagePrefetcher()
+    : m_stopping(false) {
+    m_worker = std::thread(&ImagePrefetcher::WorkerLoop, this);
+}
+
+ImagePrefetcher::~ImagePrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_all();
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+}
+
+void ImagePrefetcher::Prefetch(const wxString& imagePath) {
+    std::string path = imagePath.ToStdString(wxConvUTF8);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (Find(path)) {
+            return;
+        }
+        m_pendingPath = path;
+    }
+    m_wakeup.notify_one();
+}
+
+void ImagePrefetcher::SetCipher(const std::shared_ptr<const StorageCipher>& cipher) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cipher = cipher;
+}
+
+const ImagePrefetcher::CachedImage* ImagePrefetcher::Find(const std::string& path) const {
+    for (const auto& cached : m_cache) {
+        if (cached.path == path) {
+            return &cached;
+        }
+    }
+    return nullptr;
+}
+
+bool ImagePrefetcher::GetPngData(const wxString& imagePath, wxMemoryBuffer& data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const CachedImage* cached = Find(imagePath.ToStdString(wxConvUTF8));
+    if (!cached || cached->png.empty()) {
+        return false;
+    }
+    data.Clear();
+    data.AppendData(cached->png.data(), cached->png.size());
+    return true;
+}
+
+bool ImagePrefetcher::GetImage(const wxString& imagePath, wxImage& image) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const CachedImage* cached = Find(imagePath.ToStdString(wxConvUTF8));
+    if (!cached || cached->rgb.empty()) {
+        return false;
+    }
+    // wxImage takes ownership of malloc'ed buffers
+    unsigned char* rgb = (unsigned char*)malloc(cached->rgb.size());
+    memcpy(rgb, cached->rgb.data(), cached->rgb.size());
+    image = wxImage(cached->width, cached->height, rgb);
+    if (!cached->alpha.empty()) {
+        unsigned char* alpha = (unsigned char*)malloc(cached->alpha.size());
+        memcpy(alpha, cached->alpha.data(), cached->alpha.size());
+        image.SetAlpha(alpha);
+    }
+    return image.IsOk();
+}
+
+void ImagePrefetcher::Clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cache.clear();
+}
+
+size_t ImagePrefetcher::GetMemoryBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t bytes = 0;
+    for (const auto& cached : m_cache) {
+        bytes += sizeof(cached) + cached.path.capacity() + cached.png.capacity() +
+                 cached.rgb.capacity() + cached.alpha.capacity();
+    }
+    return bytes;
+}
+
+void ImagePrefetcher::WorkerLoop() {
+    for (;;) {
+        std::string path;
+        std::shared_ptr<const StorageCipher> cipher;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeup.wait(lock, [this] { return m_stopping || !m_pendingPath.empty(); });
+            if (m_stopping) {
+                return;
+            }
+            path.swap(m_pendingPath);
+            cipher = m_cipher;
+        }
+
+        CachedImage cached;
+        cached.path = path;
+        cached.width = 0;
+        cached.height = 0;
+
+        wxFFile file(wxString::FromUTF8(path.c_str()), wxT("rb"));
+        if (!file.IsOpened()) {
+            continue;
+        }
+        cached.png.resize((size_t)file.Length());
+        if (cached.png.empty() || file.Read(cached.png.data(), cached.png.size()) != cached.png.size()) {
+            continue;
+        }
+        file.Close();
+
+        // Sealed with the path as associated data, see ClipboardFrame::WriteStoredFile
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".enc") == 0) {
+            std::string plaintext;
+            if (!cipher || !cipher->Open(std::string(cached.png.begin(), cached.png.end()), path, plaintext)) {
+                continue;
+            }
+            cached.png.assign(plaintext.begin(), plaintext.end());
+        }
+
+        {
+            // The wxImage never leaves this thread; only plain pixel buffers are shared
+            wxMemoryInputStream stream(cached.png.data(), cached.png.size());
+            wxImage image(stream, wxBITMAP_TYPE_PNG);
+            if (image.IsOk()) {
+                cached.width = image.GetWidth();
+                cached.height = image.GetHeight();
+                cached.rgb.assign(image.GetData(), image.GetData() + (size_t)cached.width * cached.height * 3);
+                if (image.HasAlpha()) {
+                    cached.alpha.assign(image.GetAlpha(), image.GetAlpha() + (size_t)cached.width * cached.height);
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cache.push_front(std::move(cached));
+        if (m_cache.size() > MAX_CACHED_IMAGES) {
+            m_cache.pop_back();
+        }
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <wx/wx.h>
+#include <wx/dataobj.h>
+#include <wx/image.h>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "StorageCipher.h"
+
+// Loaders run on the UI thread when another application actually requests the data
+typedef std::function<wxString()> TextLoader;
+typedef std::function<wxBitmap()> BitmapLoader;
+typedef std::function<wxMemoryBuffer()> BlobLoader;
+
+// Text data object that produces its text only when a consumer asks for it
+class LazyTextDataObject : public wxTextDataObject {
+public:
+    explicit LazyTextDataObject(const TextLoader& loader);
+
+    virtual size_t GetTextLength() const override;
+    virtual wxString GetText() const override;
+
+    using wxTextDataObject::GetDataSize;
+    using wxTextDataObject::GetDataHere;
+    virtual size_t GetDataSize(const wxDataFormat& format) const override;
+    virtual bool GetDataHere(const wxDataFormat& format, void* buf) const override;
+
+private:
+    void EnsureLoaded() const;
+
+    TextLoader m_loader;
+    mutable bool m_loaded;
+};
+
+// Bitmap data object that decodes its image only when a consumer asks for it
+class LazyBitmapDataObject : public wxBitmapDataObject {
+public:
+    explicit LazyBitmapDataObject(const BitmapLoader& loader);
+
+    virtual wxBitmap GetBitmap() const override;
+
+    using wxBitmapDataObject::GetDataSize;
+    using wxBitmapDataObject::GetDataHere;
+    virtual size_t GetDataSize() const override;
+    virtual bool GetDataHere(void* buf) const override;
+
+private:
+    void EnsureLoaded() const;
+
+    BitmapLoader m_loader;
+    mutable bool m_loaded;
+};
+
+// Raw bytes in a single clipboard format, read only when a consumer asks for them
+class LazyBlobDataObject : public wxDataObjectSimple {
+public:
+    LazyBlobDataObject(const wxDataFormat& format, const BlobLoader& loader);
+
+    using wxDataObjectSimple::GetDataSize;
+    using wxDataObjectSimple::GetDataHere;
+    using wxDataObjectSimple::SetData;
+    virtual size_t GetDataSize() const override;
+    virtual bool GetDataHere(void* buf) const override;
+    virtual bool SetData(size_t len, const void* buf) override;
+
+private:
+    void EnsureLoaded() const;
+
+    BlobLoader m_loader;
+    mutable wxMemoryBuffer m_data;
+    mutable bool m_loaded;
+};
+
+// Reads and decodes history images on a background thread so that
+// restoring the selected entry does not block on disk I/O and PNG decoding
+class ImagePrefetcher {
+public:
+    ImagePrefetcher();
+    ~ImagePrefetcher();
+
+    // Queue an image for prefetching; only the most recent request is kept
+    void Prefetch(const wxString& imagePath);
+    // Opens sealed (.enc) images
+    void SetCipher(const std::shared_ptr<const StorageCipher>& cipher);
+
+    // Fetch from the cache, returns false if the image was not prefetched (yet)
+    bool GetPngData(const wxString& imagePath, wxMemoryBuffer& data);
+    bool GetImage(const wxString& imagePath, wxImage& image);
+
+    void Clear();
+    // PNG data and decoded pixels of the cached images
+    size_t GetMemoryBytes() const;
+
+private:
+    // Decoded pixels are kept outside wxImage, whose reference counting is not thread-safe
+    struct CachedImage {
+        std::string path;            // UTF-8
+        std::vector<unsigned char> png;
+        std::vector<unsigned char> rgb;
+        std::vector<unsigned char> alpha;
+        int width;
+        int height;
+    };
+
+    void WorkerLoop();
+    const CachedImage* Find(const std::string& path) const;
+
+    static const size_t MAX_CACHED_IMAGES = 4;
+
+    std::thread m_worker;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::string m_pendingPath;       // UTF-8, empty when idle
+    std::shared_ptr<const StorageCipher> m_cipher;
+    std::list<CachedImage> m_cache;  // Most recently prefetched first
+    bool m_stopping;
+};
@@ -0,0 +1,253 @@
+#include "NearDuplicateIndex.h"
+#include <algorithm>
+
+const double NearDuplicateIndex::MIN_SIMILARITY = 0.6;
+
+namespace {
+    // Finalizer from MurmurHash3, spreads a 4-gram over all 64 bits
+    uint64_t Mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    bool IsWordByte(unsigned char c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+    }
+
+    // Per-bit vote counters for the SimHash. Bit 8k+j of each feature is
+    // added to byte k of m_lanes[j], so a feature costs 8 additions instead
+    // of 64; the byte counters are flushed before they can overflow.
+    class BitVotes {
+    public:
+        BitVotes() : m_pending(0), m_features(0) {
+            for (int i = 0; i < 64; ++i) m_ones[i] = 0;
+            for (int j = 0; j < 8; ++j) m_lanes[j] = 0;
+        }
+
+        void Add(uint64_t feature) {
+            for (int j = 0; j < 8; ++j) {
+                m_lanes[j] += (feature >> j) & 0x0101010101010101ULL;
+            }
+            m_features++;
+            if (++m_pending == 255) {
+                Flush();
+            }
+        }
+
+        uint64_t GetHash() {
+            Flush();
+            uint64_t hash = 0;
+            for (int bit = 0; bit < 64; ++bit) {
+                if (2 * m_ones[bit] > m_features) {
+                    hash |= 1ULL << bit;
+                }
+            }
+            return hash;
+        }
+
+    private:
+        void Flush() {
+            for (int j = 0; j < 8; ++j) {
+                for (int k = 0; k < 8; ++k) {
+                    m_ones[8 * k + j] += (m_lanes[j] >> (8 * k)) & 0xFF;
+                }
+                m_lanes[j] = 0;
+            }
+            m_pending = 0;
+        }
+
+        uint64_t m_lanes[8];
+        size_t m_ones[64];
+        size_t m_pending;
+        size_t m_features;
+    };
+
+    // Keeps the smallest distinct values seen, for a bottom-k MinHash sketch
+    class BottomK {
+    public:
+        explicit BottomK(size_t k) : m_k(k) {}
+
+        void Add(uint32_t value) {
+            if (m_heap.size() == m_k && value >= m_heap.front()) {
+                return; // The common case for long text: one comparison
+            }
+            if (std::find(m_heap.begin(), m_heap.end(), value) != m_heap.end()) {
+                return;
+            }
+            if (m_heap.size() == m_k) {
+                std::pop_heap(m_heap.begin(), m_heap.end());
+                m_heap.pop_back();
+            }
+            m_heap.push_back(value);
+            std::push_heap(m_heap.begin(), m_heap.end());
+        }
+
+        std::vector<uint32_t> GetSorted() const {
+            std::vector<uint32_t> values = m_heap;
+            std::sort(values.begin(), values.end());
+            return values;
+        }
+
+    private:
+        size_t m_k;
+        std::vector<uint32_t> m_heap;   // Max-heap of the current k smallest
+    };
+}
+
+NearDuplicateIndex::Fingerprint NearDuplicateIndex::Compute(const std::string& text) {
+    BitVotes votes;
+    BottomK sketch(SKETCH_SIZE);
+    auto addFeature = [&votes, &sketch](uint64_t feature) {
+        votes.Add(feature);
+        sketch.Add((uint32_t)(feature >> 32));
+    };
+    uint32_t window = 0;
+    size_t length = 0;
+    bool pendingSpace = false;
+
+    for (unsigned char c : text) {
+        if (!IsWordByte(c)) {
+            pendingSpace = length > 0;
+            continue;
+        }
+        if (pendingSpace) {
+            window = (window << 8) | ' ';
+            if (++length >= 4) {
+                addFeature(Mix(window));
+            }
+            pendingSpace = false;
+        }
+        if (c >= 'A' && c <= 'Z') {
+            c = (unsigned char)(c - 'A' + 'a');
+        }
+        window = (window << 8) | c;
+        if (++length >= 4) {
+            addFeature(Mix(window));
+        }
+    }
+
+    Fingerprint fingerprint;
+    fingerprint.length = length;
+    if (length > 0 && length < 4) {
+        // Too short for a 4-gram: the whole text is the only feature
+        addFeature(Mix(window | ((uint64_t)length << 32)));
+    }
+    fingerprint.hash = length > 0 ? votes.GetHash() : 0;
+    fingerprint.sketch = sketch.GetSorted();
+    return fingerprint;
+}
+
+int NearDuplicateIndex::Distance(uint64_t a, uint64_t b) {
+    uint64_t x = a ^ b;
+    int count = 0;
+    while (x) {
+        x &= x - 1;
+        count++;
+    }
+    return count;
+}
+
+double NearDuplicateIndex::Similarity(const Fingerprint& a, const Fingerprint& b) {
+    // The k smallest hashes of the union are a uniform sample of it; the
+    // fraction present in both sketches estimates the Jaccard similarity.
+    // Text with fewer than k 4-grams gives the exact value.
+    size_t i = 0, j = 0, sampled = 0, shared = 0;
+    while (sampled < SKETCH_SIZE && (i < a.sketch.size() || j < b.sketch.size())) {
+        if (j == b.sketch.size() || (i < a.sketch.size() && a.sketch[i] < b.sketch[j])) {
+            ++i;
+        } else if (i == a.sketch.size() || b.sketch[j] < a.sketch[i]) {
+            ++j;
+        } else {
+            ++shared;
+            ++i;
+            ++j;
+        }
+        ++sampled;
+    }
+    return sampled > 0 ? (double)shared / sampled : 0.0;
+}
+
+size_t NearDuplicateIndex::BucketIndex(uint64_t hash, int band) {
+    return ((size_t)band << BAND_BITS) | (size_t)((hash >> (band * BAND_BITS)) & ((1u << BAND_BITS) - 1));
+}
+
+void NearDuplicateIndex::Add(size_t id, const Fingerprint& fingerprint) {
+    if (fingerprint.length == 0) {
+        return;
+    }
+    if (m_buckets.empty()) {
+        m_buckets.resize((size_t)BAND_COUNT << BAND_BITS);
+    }
+    Remove(id);
+    m_fingerprints[id] = fingerprint;
+    for (int band = 0; band < BAND_COUNT; ++band) {
+        m_buckets[BucketIndex(fingerprint.hash, band)].push_back(std::make_pair(fingerprint.hash, id));
+    }
+}
+
+void NearDuplicateIndex::Remove(size_t id) {
+    auto existing = m_fingerprints.find(id);
+    if (existing == m_fingerprints.end()) {
+        return;
+    }
+    for (int band = 0; band < BAND_COUNT; ++band) {
+        Bucket& bucket = m_buckets[BucketIndex(existing->second.hash, band)];
+        for (size_t i = 0; i < bucket.size(); ++i) {
+            if (bucket[i].second == id) {
+                bucket[i] = bucket.back();
+                bucket.pop_back();
+                break;
+            }
+        }
+    }
+    m_fingerprints.erase(existing);
+}
+
+void NearDuplicateIndex::Clear() {
+    m_buckets.clear();
+    m_fingerprints.clear();
+}
+
+size_t NearDuplicateIndex::GetMemoryBytes() const {
+    size_t bytes = m_buckets.capacity() * sizeof(Bucket);
+    for (const auto& bucket : m_buckets) {
+        bytes += bucket.capacity() * sizeof(Bucket::value_type);
+    }
+    // Hash nodes hold one link
+    for (const auto& fingerprint : m_fingerprints) {
+        bytes += sizeof(fingerprint) + sizeof(void*) + fingerprint.second.sketch.capacity() * sizeof(uint32_t);
+    }
+    return bytes + m_fingerprints.bucket_count() * sizeof(void*);
+}
+
+bool NearDuplicateIndex::FindNearest(const Fingerprint& fingerprint, size_t& id, double& similarity) const {
+    if (fingerprint.length == 0 || m_buckets.empty()) {
+        return false;
+    }
+    bool fuzzy = fingerprint.length >= MIN_FUZZY_LENGTH;
+    bool found = false;
+    for (int band = 0; band < BAND_COUNT; ++band) {
+        for (const auto& candidate : m_buckets[BucketIndex(fingerprint.hash, band)]) {
+            // Entries sharing several bands are seen more than once; that is cheaper than deduplicating
+            if (Distance(fingerprint.hash, candidate.first) > (fuzzy ? MAX_DISTANCE : 0)) {
+                continue;
+            }
+            double candidateSimilarity = Similarity(fingerprint, m_fingerprints.at(candidate.second));
+            if (candidateSimilarity < (fuzzy ? MIN_SIMILARITY : 1.0)) {
+                continue;
+            }
+            // Prefer the most similar, then the most recent entry
+            if (!found || candidateSimilarity > similarity ||
+                (candidateSimilarity == similarity && candidate.second > id)) {
+                id = candidate.second;
+                similarity = candidateSimilarity;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Finds earlier clips that are near-duplicates of a new one.
+// Text is normalized (ASCII case folded, punctuation and whitespace runs
+// collapsed) and reduced to a 64-bit SimHash of its character 4-grams, so
+// small edits only flip a few bits. Fingerprints are indexed in 8 bands of
+// 8 bits: fingerprints up to 7 bits apart always share a band, and most up
+// to MAX_DISTANCE do, so a lookup only looks at the entries in 8 buckets
+// instead of the whole history.
+// SimHash distances are noisy for clips of a few lines, so candidates are
+// confirmed with a bottom-k MinHash sketch of the same 4-grams, which
+// estimates their Jaccard similarity.
+class NearDuplicateIndex {
+public:
+    struct Fingerprint {
+        uint64_t hash;
+        size_t length;                 // Normalized length; 0 for text without letters or digits
+        std::vector<uint32_t> sketch;  // Smallest SKETCH_SIZE distinct 4-gram hashes, ascending
+    };
+
+    static Fingerprint Compute(const std::string& text);
+    static int Distance(uint64_t a, uint64_t b);
+    static double Similarity(const Fingerprint& a, const Fingerprint& b);
+
+    void Add(size_t id, const Fingerprint& fingerprint);
+    void Remove(size_t id);
+    void Clear();
+    // Estimated from the node sizes of the standard containers
+    size_t GetMemoryBytes() const;
+
+    // Most similar indexed entry at or above MIN_SIMILARITY (identical 4-grams for short text)
+    bool FindNearest(const Fingerprint& fingerprint, size_t& id, double& similarity) const;
+
+    static const int MAX_DISTANCE = 16;          // Candidates further apart are not verified
+    static const size_t SKETCH_SIZE = 32;
+    static const size_t MIN_FUZZY_LENGTH = 32;   // Shorter text has too few 4-grams to compare fuzzily
+    static const double MIN_SIMILARITY;
+
+private:
+    static const int BAND_COUNT = 8;
+    static const int BAND_BITS = 8;
+
+    typedef std::vector<std::pair<uint64_t, size_t> > Bucket;
+
+    static size_t BucketIndex(uint64_t hash, int band);
+
+    std::vector<Bucket> m_buckets;               // BAND_COUNT << BAND_BITS buckets of (hash, id)
+    std::unordered_map<size_t, Fingerprint> m_fingerprints;
+};
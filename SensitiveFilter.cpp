@@ -0,0 +1,818 @@
+#include "SensitiveFilter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SENSITIVE_FILTER_SSE2 1
+#endif
+
+namespace {
+    const size_t ALPHABET = 256;
+    const size_t BLOCK_SIZE = 64;
+    const size_t MAX_VALUE_LENGTH = 256;   // Bounds the scan after a keyword hit
+    const size_t MIN_CARD_DIGITS = 13;
+    const size_t MAX_CARD_DIGITS = 19;
+    const size_t PREFIX_BYTES = 4;
+    const int PREFIX_HASH_BITS = 16;
+    const size_t ENTROPY_SAMPLES = 64;     // Bytes of a token the entropy estimate counts at most
+    const size_t SAMPLE_RUN = 16;          // Counted as four evenly spaced runs of this many
+    const size_t NO_TOKEN = ~size_t(0);
+
+    // Character classes, looked up once per byte on the scalar paths
+    enum {
+        CLASS_DIGIT = 1,
+        CLASS_UPPER = 2,
+        CLASS_LOWER = 4,
+        CLASS_TOKEN = 8,      // Characters that make up keys, tokens and base64 blobs
+        CLASS_SEPARATOR = 16  // Separators allowed between the digit groups of card numbers
+    };
+
+    struct CharClassTable {
+        unsigned char classes[256];
+
+        CharClassTable() {
+            for (int c = 0; c < 256; ++c) {
+                unsigned char cls = 0;
+                if (c >= '0' && c <= '9') cls |= CLASS_DIGIT | CLASS_TOKEN;
+                if (c >= 'A' && c <= 'Z') cls |= CLASS_UPPER | CLASS_TOKEN;
+                if (c >= 'a' && c <= 'z') cls |= CLASS_LOWER | CLASS_TOKEN;
+                if (c == '+' || c == '/' || c == '=' || c == '_' || c == '-' || c == '.') cls |= CLASS_TOKEN;
+                if (c == ' ' || c == '-') cls |= CLASS_SEPARATOR;
+                classes[c] = cls;
+            }
+        }
+    };
+
+    const CharClassTable CHAR_CLASSES;
+
+    // c * log2(c) for small counts, used by the entropy estimate. Token bytes
+    // add up the 16.16 fixed-point increase of their count instead, so the
+    // sum is a chain of integer adds rather than floating-point ones
+    struct EntropyTable {
+        static const size_t SIZE = 1024;
+        static const size_t FIXED_SIZE = 256;
+        static constexpr double FIXED_ONE = 65536.0;
+        double values[SIZE];
+        uint32_t fixed[FIXED_SIZE];
+        uint32_t increase[FIXED_SIZE - 1];    // fixed[c + 1] - fixed[c]
+
+        EntropyTable() {
+            values[0] = 0.0;
+            for (size_t c = 1; c < SIZE; ++c) {
+                values[c] = c * std::log2((double)c);
+            }
+            for (size_t c = 0; c < FIXED_SIZE; ++c) {
+                fixed[c] = (uint32_t)std::lround(values[c] * FIXED_ONE);
+            }
+            for (size_t c = 0; c + 1 < FIXED_SIZE; ++c) {
+                increase[c] = fixed[c + 1] - fixed[c];
+            }
+        }
+
+        double operator()(uint32_t count) const {
+            return count < SIZE ? values[count] : count * std::log2((double)count);
+        }
+    };
+
+    const EntropyTable COUNT_LOG_COUNT;
+
+#ifdef SENSITIVE_FILTER_SSE2
+    // Byte i of the result is byte i + BYTES of `v`, wrapping around
+    template <int BYTES>
+    inline __m128i RotateBytes(__m128i v) {
+        return _mm_or_si128(_mm_srli_si128(v, BYTES), _mm_slli_si128(v, 16 - BYTES));
+    }
+
+    // Pairs of equal bytes among the 32 bytes of two runs. Comparing a run
+    // with its rotations by 1 to 7 meets every pair within it once, by 8
+    // twice; comparing with all 16 rotations of the other run meets every
+    // pair across them once
+    unsigned CountEqualPairs(const unsigned char* first, const unsigned char* second) {
+        __m128i a = _mm_loadu_si128((const __m128i*)first);
+        __m128i b = _mm_loadu_si128((const __m128i*)second);
+        // Equal lanes are -1, so subtracting counts them; a lane counts 31 pairs at most
+        __m128i pairs = _mm_setzero_si128();
+        __m128i rotatedA[4] = { a, RotateBytes<1>(a), RotateBytes<2>(a), RotateBytes<3>(a) };
+        __m128i rotatedB[4] = { b, RotateBytes<1>(b), RotateBytes<2>(b), RotateBytes<3>(b) };
+        for (int i = 0; i < 4; ++i) {
+            if (i > 0) {
+                pairs = _mm_sub_epi8(pairs, _mm_cmpeq_epi8(a, rotatedA[i]));
+                pairs = _mm_sub_epi8(pairs, _mm_cmpeq_epi8(b, rotatedB[i]));
+            }
+            // Rotating by 4 more bytes is a single dword shuffle
+            pairs = _mm_sub_epi8(pairs, _mm_cmpeq_epi8(a, _mm_shuffle_epi32(rotatedA[i], 0x39)));
+            pairs = _mm_sub_epi8(pairs, _mm_cmpeq_epi8(b, _mm_shuffle_epi32(rotatedB[i], 0x39)));
+            for (int j = 0; j < 4; ++j) {
+                pairs = _mm_sub_epi8(pairs, _mm_cmpeq_epi8(a, rotatedB[i]));
+                rotatedB[i] = _mm_shuffle_epi32(rotatedB[i], 0x39);
+            }
+        }
+        // By 8, only the low half of the lanes counts
+        __m128i half = _mm_cmpeq_epi8(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+        pairs = _mm_sub_epi8(pairs, half);
+        __m128i sums = _mm_sad_epu8(pairs, _mm_setzero_si128());
+        return (unsigned)(_mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums)));
+    }
+#endif
+
+    // Adds the bytes to the counts; returns how much sum(c * log2(c)) grew
+    uint32_t CountBytes(const unsigned char* bytes, size_t length, uint8_t* counts) {
+        uint32_t fixedSum = 0;
+        for (size_t i = 0; i < length; ++i) {
+            uint8_t& count = counts[bytes[i]];
+            fixedSum += COUNT_LOG_COUNT.increase[count];
+            count++;
+        }
+        return fixedSum;
+    }
+
+    // log2(n) - sum / n >= threshold, without the logarithm
+    bool AboveThreshold(uint32_t fixedSum, size_t counted, double threshold) {
+        return fixedSum <= (COUNT_LOG_COUNT.values[counted] - counted * threshold) * EntropyTable::FIXED_ONE;
+    }
+
+    // Tells whether a token reaches `threshold` bits per byte. Tokens longer
+    // than ENTROPY_SAMPLES are judged on four evenly spaced runs of bytes,
+    // the first and the third tried first: random tokens mostly settle there
+    bool ReachesEntropy(const unsigned char* token, size_t length, double threshold) {
+        uint8_t counts[ALPHABET];
+        memset(counts, 0, sizeof(counts));
+        if (length <= ENTROPY_SAMPLES) {
+            return AboveThreshold(CountBytes(token, length, counts), length, threshold);
+        }
+        size_t spacing = (length - SAMPLE_RUN) / 3;
+        const unsigned char* runs[4] = { token, token + spacing, token + 2 * spacing, token + 3 * spacing };
+#ifdef SENSITIVE_FILTER_SSE2
+        // The collision entropy log2(n^2 / (n + 2 * pairs)) never exceeds the
+        // Shannon entropy, and needs no counts
+        size_t squares = 2 * SAMPLE_RUN + 2 * CountEqualPairs(runs[0], runs[2]);
+        if (COUNT_LOG_COUNT(squares) <= squares * (2 * std::log2(2.0 * SAMPLE_RUN) - threshold)) {
+            return true;
+        }
+#endif
+        uint32_t fixedSum = CountBytes(runs[0], SAMPLE_RUN, counts) + CountBytes(runs[2], SAMPLE_RUN, counts);
+        if (AboveThreshold(fixedSum, 2 * SAMPLE_RUN, threshold)) {
+            return true;
+        }
+        fixedSum += CountBytes(runs[1], SAMPLE_RUN, counts) + CountBytes(runs[3], SAMPLE_RUN, counts);
+        return AboveThreshold(fixedSum, ENTROPY_SAMPLES, threshold);
+    }
+
+    unsigned char ToLowerAscii(unsigned char c) {
+        return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+    }
+
+    bool IsDigit(unsigned char c) {
+        return (CHAR_CLASSES.classes[c] & CLASS_DIGIT) != 0;
+    }
+
+    bool IsAlpha(unsigned char c) {
+        return (CHAR_CLASSES.classes[c] & (CLASS_UPPER | CLASS_LOWER)) != 0;
+    }
+
+    bool IsTokenChar(unsigned char c) {
+        return (CHAR_CLASSES.classes[c] & CLASS_TOKEN) != 0;
+    }
+
+    // Characters between a keyword and its value, e.g. `password = "`
+    bool IsValueSeparator(unsigned char c) {
+        return c == ' ' || c == '\t' || c == ':' || c == '=' || c == '"' || c == '\'';
+    }
+
+    bool IsValueChar(unsigned char c) {
+        return c > ' ' && c != '"' && c != '\'' && c != ',' && c != ';';
+    }
+
+    // ':' or '=' mark an assignment; without one a keyword is just a word in a sentence
+    bool IsAssignment(unsigned char c) {
+        return c == ':' || c == '=';
+    }
+
+    uint32_t FoldPrefix(const unsigned char* data, uint32_t mask) {
+        // Setting bit 0x20 folds ASCII case; other characters that collide only add false candidates
+        uint32_t prefix;
+        memcpy(&prefix, data, PREFIX_BYTES);
+        return (prefix | 0x20202020u) & mask;
+    }
+
+    uint32_t HashPrefix(uint32_t prefix) {
+        return (prefix * 0x9E3779B1u) >> (32 - PREFIX_HASH_BITS);
+    }
+
+    unsigned CountTrailingZeros(uint64_t value) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return (unsigned)index;
+#else
+        return (unsigned)__builtin_ctzll(value);
+#endif
+    }
+
+    unsigned HighestBit(uint64_t value) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return (unsigned)index;
+#else
+        return 63 - (unsigned)__builtin_clzll(value);
+#endif
+    }
+
+    // True if one of the aligned nibbles of `mask` is all ones; a run of at
+    // least 7 set bits always covers one
+    bool HasFullNibble(uint64_t mask) {
+        return (mask & (mask >> 1) & (mask >> 2) & (mask >> 3) & 0x1111111111111111ull) != 0;
+    }
+
+    // Per-byte class bits of one 64-byte block
+    struct BlockMasks {
+        uint64_t digit;
+        uint64_t alpha;
+        uint64_t token;
+        uint64_t separator;
+    };
+
+#ifdef SENSITIVE_FILTER_SSE2
+    // Range test in two instructions: moving `lo` to -128 leaves the range
+    // at the bottom of the signed bytes
+    inline __m128i InRange(__m128i bytes, char lo, char hi) {
+        __m128i moved = _mm_add_epi8(bytes, _mm_set1_epi8((char)(0x80 - (unsigned char)lo)));
+        return _mm_cmplt_epi8(moved, _mm_set1_epi8((char)(hi - lo - 127)));
+    }
+
+    inline __m128i Equals(__m128i bytes, char c) {
+        return _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c));
+    }
+
+    // Position of the next ':' or '=' at or after `from`, or `length`
+    size_t FindAssignment(const unsigned char* data, size_t length, size_t from) {
+        for (; from + 16 <= length; from += 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(data + from));
+            unsigned found = (unsigned)_mm_movemask_epi8(_mm_or_si128(Equals(bytes, ':'), Equals(bytes, '=')));
+            if (found) {
+                return from + CountTrailingZeros(found);
+            }
+        }
+        while (from < length && !IsAssignment(data[from])) {
+            ++from;
+        }
+        return from;
+    }
+
+    void ClassifyBlock(const unsigned char* block, BlockMasks& masks) {
+        masks.digit = masks.alpha = masks.token = masks.separator = 0;
+        for (int chunk = 0; chunk < 4; ++chunk) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(block + chunk * 16));
+            __m128i digit = InRange(bytes, '0', '9');
+            __m128i alpha = InRange(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 'z');
+            // '-', '.' and '/' come right before the digits
+            __m128i token = _mm_or_si128(_mm_or_si128(InRange(bytes, '-', '9'), alpha),
+                            _mm_or_si128(Equals(bytes, '+'), _mm_or_si128(Equals(bytes, '='), Equals(bytes, '_'))));
+            __m128i separator = _mm_or_si128(Equals(bytes, ' '), Equals(bytes, '-'));
+
+            int shift = chunk * 16;
+            masks.digit |= (uint64_t)(unsigned)_mm_movemask_epi8(digit) << shift;
+            masks.alpha |= (uint64_t)(unsigned)_mm_movemask_epi8(alpha) << shift;
+            masks.token |= (uint64_t)(unsigned)_mm_movemask_epi8(token) << shift;
+            masks.separator |= (uint64_t)(unsigned)_mm_movemask_epi8(separator) << shift;
+        }
+    }
+
+    // Bytes with bit 0x20 set: the lower-case ones among the letters
+    uint64_t LowerCaseBits(const unsigned char* block) {
+        uint64_t lower = 0;
+        for (int chunk = 0; chunk < 4; ++chunk) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(block + chunk * 16));
+            lower |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_slli_epi16(bytes, 2)) << (chunk * 16);
+        }
+        return lower;
+    }
+#else
+    size_t FindAssignment(const unsigned char* data, size_t length, size_t from) {
+        while (from < length && !IsAssignment(data[from])) {
+            ++from;
+        }
+        return from;
+    }
+
+    void ClassifyBlock(const unsigned char* block, BlockMasks& masks) {
+        masks.digit = masks.alpha = masks.token = masks.separator = 0;
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+            unsigned char cls = CHAR_CLASSES.classes[block[i]];
+            uint64_t bit = uint64_t(1) << i;
+            if (cls & CLASS_DIGIT) masks.digit |= bit;
+            if (cls & (CLASS_UPPER | CLASS_LOWER)) masks.alpha |= bit;
+            if (cls & CLASS_TOKEN) masks.token |= bit;
+            if (cls & CLASS_SEPARATOR) masks.separator |= bit;
+        }
+    }
+
+    uint64_t LowerCaseBits(const unsigned char* block) {
+        uint64_t lower = 0;
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+            lower |= uint64_t((block[i] >> 5) & 1) << i;
+        }
+        return lower;
+    }
+#endif
+    // The next ':' or '=' in the text and where the value separators before
+    // it begin. A keyword only has a value if it starts at most its length
+    // before those, so in text full of assignments most words still skip
+    // the automaton
+    class AssignmentCursor {
+    public:
+        AssignmentCursor(const unsigned char* data, size_t length)
+            : m_data(data), m_length(length), m_next(NO_TOKEN), m_reach(0) {
+            Seek(0);
+        }
+
+        // Moves to the first assignment at or after `pos`
+        void Seek(size_t pos) {
+            size_t next = FindAssignment(m_data, m_length, pos);
+            size_t begin = next;
+            // Separators before the previous assignment were walked already
+            while (begin > 0 && IsValueSeparator(m_data[begin - 1])) {
+                if (--begin == m_next) {
+                    begin = m_reach;
+                    break;
+                }
+            }
+            m_next = next;
+            m_reach = next < m_length ? begin : m_length;
+        }
+
+        // Bits of the block at `start` where a keyword of at most `longest`
+        // bytes can begin and still have a value, one assignment at a time
+        uint64_t FindReaching(size_t start, size_t longest) {
+            if (m_next < start) {
+                Seek(start);
+            }
+            uint64_t reaching = 0;
+            size_t last = start + BLOCK_SIZE - 1;
+            size_t from = start;
+            for (;;) {
+                // Up to this assignment, positions look ahead to it
+                size_t begin = std::max(from, m_reach > longest ? m_reach - longest : 0);
+                size_t end = std::min(m_next, last);
+                if (begin <= end) {
+                    uint64_t upTo = end - start == BLOCK_SIZE - 1 ? ~uint64_t(0) : (uint64_t(1) << (end - start + 1)) - 1;
+                    reaching |= upTo & ~((uint64_t(1) << (begin - start)) - 1);
+                }
+                if (m_next >= last) {
+                    return reaching;
+                }
+                from = m_next + 1;
+                Seek(from);
+            }
+        }
+
+    private:
+        const unsigned char* m_data;
+        size_t m_length;
+        size_t m_next;
+        size_t m_reach;
+    };
+
+    // Finds positions where a run of at least minLength set bits ends,
+    // carrying partial runs over from the previous block
+    class RunDetector {
+    public:
+        explicit RunDetector(size_t minLength)
+            : m_minLength(std::max<size_t>(1, std::min<size_t>(minLength, BLOCK_SIZE - 1))) {
+            memset(m_previous, 0, sizeof(m_previous));
+        }
+
+        uint64_t Feed(uint64_t mask) {
+            // Doubling: stage k marks runs of at least 2^k
+            uint64_t runs = mask;
+            size_t length = 1;
+            int stage = 0;
+            while (length * 2 <= m_minLength) {
+                uint64_t shifted = ShiftIn(runs, m_previous[stage], (unsigned)length);
+                m_previous[stage] = runs;
+                runs &= shifted;
+                length *= 2;
+                stage++;
+            }
+            if (length < m_minLength) {
+                uint64_t shifted = ShiftIn(runs, m_previous[stage], (unsigned)(m_minLength - length));
+                m_previous[stage] = runs;
+                runs &= shifted;
+            } else {
+                m_previous[stage] = runs;
+            }
+            return runs;
+        }
+
+    private:
+        static uint64_t ShiftIn(uint64_t current, uint64_t previous, unsigned shift) {
+            return (current << shift) | (previous >> (64 - shift));
+        }
+
+        size_t m_minLength;
+        uint64_t m_previous[8];
+    };
+}
+
+SensitiveFilter::SensitiveFilter()
+    : m_prefixMask(0),
+      m_hasKeywords(false),
+      m_keywordsStartWithLetter(true),
+      m_longestKeyword(0),
+      m_entropyThreshold(4.0),
+      m_entropyMinLength(20) {
+    SetKeywords(GetDefaultKeywords());
+}
+
+std::vector<std::string> SensitiveFilter::GetDefaultKeywords() {
+    return {
+        "password", "passwd", "passphrase", "pwd:", "secret", "api_key", "api-key", "apikey",
+        "access_token", "auth_token", "refresh_token", "client_secret", "private key",
+        "aws_secret_access_key", "authorization: bearer", "authorization: basic"
+    };
+}
+
+void SensitiveFilter::SetKeywords(const std::vector<std::string>& keywords) {
+    // Build the trie; node 0 is the root, -1 marks a missing edge
+    m_transitions.assign(ALPHABET, -1);
+    m_outputLength.assign(1, 0);
+    m_hasKeywords = false;
+    m_keywordsStartWithLetter = true;
+
+    size_t shortest = PREFIX_BYTES;
+    for (const std::string& keyword : keywords) {
+        if (!keyword.empty()) {
+            shortest = std::min(shortest, keyword.size());
+        }
+    }
+    // Only the first `shortest` bytes of the 4-byte window take part in the prefilter
+    unsigned char maskBytes[PREFIX_BYTES] = { 0 };
+    memset(maskBytes, 0xFF, shortest);
+    memcpy(&m_prefixMask, maskBytes, PREFIX_BYTES);
+    m_prefixBits.assign((size_t(1) << PREFIX_HASH_BITS) / 64, 0);
+    m_longestKeyword = 0;
+
+    for (const std::string& keyword : keywords) {
+        if (keyword.empty()) {
+            continue;
+        }
+        m_hasKeywords = true;
+        m_keywordsStartWithLetter = m_keywordsStartWithLetter && IsAlpha((unsigned char)keyword[0]);
+        m_longestKeyword = std::max(m_longestKeyword, keyword.size());
+
+        unsigned char prefix[PREFIX_BYTES] = { 0 };
+        memcpy(prefix, keyword.data(), std::min(PREFIX_BYTES, keyword.size()));
+        uint32_t hash = HashPrefix(FoldPrefix(prefix, m_prefixMask));
+        m_prefixBits[hash / 64] |= uint64_t(1) << (hash % 64);
+
+        int32_t node = 0;
+        for (unsigned char c : keyword) {
+            unsigned char lower = ToLowerAscii(c);
+            if (m_transitions[node * ALPHABET + lower] < 0) {
+                m_transitions[node * ALPHABET + lower] = (int32_t)m_outputLength.size();
+                m_transitions.resize(m_transitions.size() + ALPHABET, -1);
+                m_outputLength.push_back(0);
+            }
+            node = m_transitions[node * ALPHABET + lower];
+        }
+        m_outputLength[node] = (uint16_t)std::max<size_t>(m_outputLength[node], std::min<size_t>(keyword.size(), 0xFFFF));
+    }
+
+    // Breadth-first pass resolving failure links into direct transitions
+    std::vector<int32_t> failure(m_outputLength.size(), 0);
+    std::queue<int32_t> pending;
+    for (size_t c = 0; c < ALPHABET; ++c) {
+        int32_t& next = m_transitions[c];
+        if (next < 0) {
+            next = 0;
+        } else {
+            failure[next] = 0;
+            pending.push(next);
+        }
+    }
+    while (!pending.empty()) {
+        int32_t node = pending.front();
+        pending.pop();
+        m_outputLength[node] = std::max(m_outputLength[node], m_outputLength[failure[node]]);
+        for (size_t c = 0; c < ALPHABET; ++c) {
+            int32_t& next = m_transitions[node * ALPHABET + c];
+            int32_t fallback = m_transitions[failure[node] * ALPHABET + c];
+            if (next < 0) {
+                next = fallback;
+            } else {
+                failure[next] = fallback;
+                pending.push(next);
+            }
+        }
+    }
+
+    // Upper-case input maps onto the lower-case edges
+    for (size_t node = 0; node < m_outputLength.size(); ++node) {
+        for (size_t c = 'A'; c <= 'Z'; ++c) {
+            m_transitions[node * ALPHABET + c] = m_transitions[node * ALPHABET + ToLowerAscii((unsigned char)c)];
+        }
+    }
+}
+
+void SensitiveFilter::SetEntropyThreshold(double bitsPerChar, size_t minLength) {
+    m_entropyThreshold = bitsPerChar;
+    m_entropyMinLength = std::max<size_t>(minLength, 1);
+}
+
+bool SensitiveFilter::IsCandidate(const unsigned char* data) const {
+    uint32_t hash = HashPrefix(FoldPrefix(data, m_prefixMask));
+    return (m_prefixBits[hash / 64] >> (hash % 64)) & 1;
+}
+
+std::vector<SensitiveFilter::Match> SensitiveFilter::Scan(const std::string& text) const {
+    std::vector<Match> matches;
+    const unsigned char* data = (const unsigned char*)text.data();
+    size_t length = text.size();
+
+    size_t keywordsDone = 0;     // Keyword matching has consumed everything before this
+    size_t cardsDone = 0;        // Card scanning has consumed everything before this
+    BlockMasks previous = { 0, 0, 0, 0 };
+    uint64_t previousLower = 0;
+    uint64_t previousCardStarts = 0;
+    RunDetector tokenRuns(m_entropyMinLength);
+    uint64_t previousLongRun = 0;
+    // The token running into the current block, once it had a long run: where
+    // it started and whether it had digits and letters before the block
+    size_t tokenStart = NO_TOKEN;
+    bool tokenDigit = false;
+    bool tokenAlpha = false;
+    AssignmentCursor assignments(data, m_hasKeywords ? length : 0);
+
+    for (size_t start = 0; start < length; start += BLOCK_SIZE) {
+        const unsigned char* block = data + start;
+        size_t blockLength = std::min(BLOCK_SIZE, length - start);
+        unsigned char padded[BLOCK_SIZE];
+        if (blockLength < BLOCK_SIZE) {
+            memset(padded, 0, sizeof(padded));
+            memcpy(padded, block, blockLength);
+            block = padded;
+        }
+
+        BlockMasks masks;
+        ClassifyBlock(block, masks);
+
+        if (m_hasKeywords) {
+            uint64_t candidates = assignments.FindReaching(start, m_longestKeyword);
+            if (candidates) {
+                // Word starts: letters not preceded by a letter, and camelCase humps
+                uint64_t lower = masks.alpha & LowerCaseBits(block);
+                uint64_t upper = masks.alpha & ~lower;
+                if (m_keywordsStartWithLetter) {
+                    candidates &= (masks.alpha & ~((masks.alpha << 1) | (previous.alpha >> 63))) |
+                                  (upper & ((lower << 1) | previousLower));
+                }
+                previousLower = lower >> 63;
+            } else {
+                previousLower = (masks.alpha >> 63) & (block[BLOCK_SIZE - 1] >> 5);
+            }
+
+            while (candidates) {
+                size_t pos = start + CountTrailingZeros(candidates);
+                candidates &= candidates - 1;
+                if (pos >= length || pos < keywordsDone) {
+                    continue;
+                }
+                if (pos + PREFIX_BYTES <= length && !IsCandidate(data + pos)) {
+                    continue;
+                }
+                keywordsDone = MatchKeywordsAt(data, length, pos, matches);
+            }
+        }
+
+        // Card numbers: digits, and separators following a digit. A run of 13
+        // of those covers an aligned nibble and starts at most a block before it
+        uint64_t card = masks.digit | (masks.separator & ((masks.digit << 1) | (previous.digit >> 63)));
+        uint64_t cardStarts = masks.digit & ~((masks.token << 1) | (previous.token >> 63));
+        if (HasFullNibble(card)) {
+            if (start >= BLOCK_SIZE) {
+                cardsDone = MatchCards(data, length, start - BLOCK_SIZE, previousCardStarts, cardsDone, matches);
+            }
+            cardsDone = MatchCards(data, length, start, cardStarts, cardsDone, matches);
+        }
+        previousCardStarts = cardStarts;
+
+        // Tokens ending in this block, at the first byte after them; only
+        // worth finding where a run long enough for the entropy check ends
+        uint64_t token = masks.token;
+        uint64_t longRuns = tokenRuns.Feed(token);
+        if (longRuns || previousLongRun) {
+            uint64_t running = previous.token >> 63;
+            if (running && tokenStart == NO_TOKEN) {
+                // Started in the previous block, too short to be followed there
+                unsigned first = HighestBit(~previous.token) + 1;
+                uint64_t tail = ~uint64_t(0) << first;
+                tokenStart = start - BLOCK_SIZE + first;
+                tokenDigit = (previous.digit & tail) != 0;
+                tokenAlpha = (previous.alpha & tail) != 0;
+            }
+            uint64_t starts = token & ~((token << 1) | running);
+            // Only the ends of runs long enough are worth a look
+            uint64_t ends = ~token & ((longRuns << 1) | previousLongRun);
+            while (ends) {
+                unsigned end = CountTrailingZeros(ends);
+                ends &= ends - 1;
+                uint64_t before = (uint64_t(1) << end) - 1;
+                size_t begin = tokenStart;
+                bool digit = tokenDigit;
+                bool alpha = tokenAlpha;
+                if (starts & before) {
+                    unsigned first = HighestBit(starts & before);
+                    before &= ~((uint64_t(1) << first) - 1);
+                    begin = start + first;
+                    digit = alpha = false;
+                }
+                // Random tokens mix letters and digits
+                if (start + end - begin >= m_entropyMinLength && (digit || (masks.digit & before)) &&
+                    (alpha || (masks.alpha & before))) {
+                    CheckToken(data, begin, start + end, matches);
+                }
+            }
+
+            // Follow the token running into the next block
+            if (token == ~uint64_t(0)) {
+                if (!running) {
+                    tokenStart = start;
+                    tokenDigit = tokenAlpha = false;
+                }
+                tokenDigit = tokenDigit || masks.digit != 0;
+                tokenAlpha = tokenAlpha || masks.alpha != 0;
+            } else if (token >> 63) {
+                unsigned first = HighestBit(~token) + 1;
+                uint64_t tail = ~uint64_t(0) << first;
+                tokenStart = start + first;
+                tokenDigit = (masks.digit & tail) != 0;
+                tokenAlpha = (masks.alpha & tail) != 0;
+            } else {
+                tokenStart = NO_TOKEN;
+            }
+        } else {
+            tokenStart = NO_TOKEN;
+        }
+        previousLongRun = longRuns >> 63;
+        previous = masks;
+    }
+
+    // A token running to the end of the text
+    if (tokenStart != NO_TOKEN && length - tokenStart >= m_entropyMinLength && tokenDigit && tokenAlpha) {
+        CheckToken(data, tokenStart, length, matches);
+    }
+    return matches;
+}
+
+size_t SensitiveFilter::MatchKeywordsAt(const unsigned char* data, size_t length, size_t pos, std::vector<Match>& matches) const {
+    // Run the automaton from its root until it falls back there
+    const int32_t* transitions = m_transitions.data();
+    int32_t node = 0;
+    size_t i = pos;
+    size_t consumed = pos;
+
+    while (i < length) {
+        node = transitions[(size_t)node * ALPHABET + data[i]];
+        ++i;
+        if (node == 0) {
+            break;
+        }
+        // A keyword directly followed by a letter is part of a longer word ("secretary")
+        if (m_outputLength[node] == 0 || i < consumed || (i < length && IsAlpha(data[i]) && IsAlpha(data[i - 1]))) {
+            continue;
+        }
+
+        // The secret is the value assigned to the keyword: "password: x", "api_key=x",
+        // or any value after a keyword that contains the ':' itself ("authorization: bearer x")
+        bool assigned = false;
+        for (size_t k = i - m_outputLength[node]; k < i; ++k) {
+            assigned = assigned || IsAssignment(data[k]);
+        }
+        size_t begin = i;
+        size_t limit = std::min(length, begin + MAX_VALUE_LENGTH);
+        while (begin < limit && IsValueSeparator(data[begin])) {
+            assigned = assigned || IsAssignment(data[begin]);
+            ++begin;
+        }
+        if (!assigned) {
+            continue;
+        }
+        size_t end = begin;
+        while (end < limit && IsValueChar(data[end])) {
+            ++end;
+        }
+        if (end == begin) {
+            continue;
+        }
+
+        Match match = { begin, end, MATCH_KEYWORD };
+        matches.push_back(match);
+        consumed = end;
+    }
+    return std::max(i, consumed);
+}
+
+size_t SensitiveFilter::MatchCards(const unsigned char* data, size_t length, size_t blockStart, uint64_t starts, size_t done, std::vector<Match>& matches) const {
+    // Digit groups separated by single spaces or dashes, from a token start
+    while (starts) {
+        size_t i = blockStart + CountTrailingZeros(starts);
+        starts &= starts - 1;
+        if (i < done) {
+            continue;
+        }
+        char digits[MAX_CARD_DIGITS + 1];
+        size_t digitCount = 0;
+        size_t end = i;
+        while (end < length && digitCount <= MAX_CARD_DIGITS) {
+            if (IsDigit(data[end])) {
+                digits[digitCount++] = (char)data[end];
+                ++end;
+            } else if ((data[end] == ' ' || data[end] == '-') && end + 1 < length && IsDigit(data[end + 1])) {
+                ++end;
+            } else {
+                break;
+            }
+        }
+        bool bounded = end == length || !IsTokenChar(data[end]);
+        if (bounded && digitCount >= MIN_CARD_DIGITS && digitCount <= MAX_CARD_DIGITS && IsLuhnValid(digits, digitCount)) {
+            Match match = { i, end, MATCH_CARD_NUMBER };
+            matches.push_back(match);
+            done = end;
+        } else {
+            // Another card may start within the digits read
+            done = i + 1;
+        }
+    }
+    return done;
+}
+
+void SensitiveFilter::CheckToken(const unsigned char* data, size_t begin, size_t end, std::vector<Match>& matches) const {
+    if (ReachesEntropy(data + begin, end - begin, m_entropyThreshold)) {
+        Match match = { begin, end, MATCH_HIGH_ENTROPY };
+        matches.push_back(match);
+    }
+}
+
+std::string SensitiveFilter::Mask(const std::string& text, const std::vector<Match>& matches) {
+    std::string masked(text);
+    for (const Match& match : matches) {
+        for (size_t i = match.begin; i < match.end && i < masked.size(); ++i) {
+            masked[i] = '*';
+        }
+    }
+    return masked;
+}
+
+bool SensitiveFilter::IsLuhnValid(const char* digits, size_t count) {
+    int sum = 0;
+    bool doubleDigit = false;
+    for (size_t i = count; i-- > 0;) {
+        int digit = digits[i] - '0';
+        if (doubleDigit) {
+            digit *= 2;
+            if (digit > 9) {
+                digit -= 9;
+            }
+        }
+        sum += digit;
+        doubleDigit = !doubleDigit;
+    }
+    return count > 0 && sum % 10 == 0;
+}
+
+double SensitiveFilter::ShannonEntropy(const char* data, size_t length) {
+    if (length == 0) {
+        return 0.0;
+    }
+    // H = log2(n) - sum(c * log2(c)) / n; the second pass visits only the
+    // token's own bytes and clears each count once it has been added
+    double sum = 0.0;
+    if (length < EntropyTable::FIXED_SIZE) {
+        uint8_t counts[ALPHABET];
+        memset(counts, 0, sizeof(counts));
+        for (size_t i = 0; i < length; ++i) {
+            counts[(unsigned char)data[i]]++;
+        }
+        uint32_t fixedSum = 0;
+        for (size_t i = 0; i < length; ++i) {
+            uint8_t& count = counts[(unsigned char)data[i]];
+            fixedSum += COUNT_LOG_COUNT.fixed[count];
+            count = 0;
+        }
+        sum = fixedSum / EntropyTable::FIXED_ONE;
+    } else {
+        uint32_t counts[ALPHABET];
+        memset(counts, 0, sizeof(counts));
+        for (size_t i = 0; i < length; ++i) {
+            counts[(unsigned char)data[i]]++;
+        }
+        for (size_t c = 0; c < ALPHABET; ++c) {
+            sum += COUNT_LOG_COUNT(counts[c]);
+        }
+    }
+    return std::log2((double)length) - sum / length;
+}
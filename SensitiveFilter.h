@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Detects secrets in copied text before it reaches the history.
+// The text is classified 64 bytes at a time (SSE2 where available) into bit
+// masks, and only the interesting parts are examined further: an Aho-Corasick
+// automaton over the configured keywords (ASCII case-insensitive, run from
+// word starts close enough to a ':' or '='), card numbers passing the Luhn
+// check from where 13 digits could start, and the entropy of tokens long
+// enough, estimated on at most 64 of their bytes. Scanning is linear.
+class SensitiveFilter {
+public:
+    enum MatchKind {
+        MATCH_KEYWORD,       // Value assigned to a keyword: "password: x", "api_key=x"
+        MATCH_CARD_NUMBER,   // 13-19 digits passing the Luhn check
+        MATCH_HIGH_ENTROPY   // Long random-looking token (API keys, hashes)
+    };
+
+    struct Match {
+        size_t begin;        // Byte offsets of the sensitive part
+        size_t end;
+        MatchKind kind;
+    };
+
+    SensitiveFilter();
+
+    // Compiles the keyword automaton; keywords are matched case-insensitively
+    void SetKeywords(const std::vector<std::string>& keywords);
+    void SetEntropyThreshold(double bitsPerChar, size_t minLength);
+
+    std::vector<Match> Scan(const std::string& text) const;
+
+    // Replaces every matched byte with '*'
+    static std::string Mask(const std::string& text, const std::vector<Match>& matches);
+
+    static bool IsLuhnValid(const char* digits, size_t count);
+    static double ShannonEntropy(const char* data, size_t length);
+
+    static std::vector<std::string> GetDefaultKeywords();
+
+private:
+    size_t MatchKeywordsAt(const unsigned char* data, size_t length, size_t pos, std::vector<Match>& matches) const;
+    size_t MatchCards(const unsigned char* data, size_t length, size_t blockStart, uint64_t starts, size_t done, std::vector<Match>& matches) const;
+    void CheckToken(const unsigned char* data, size_t begin, size_t end, std::vector<Match>& matches) const;
+    bool IsCandidate(const unsigned char* data) const;
+
+    // Fully resolved automaton: one table lookup per input byte
+    std::vector<int32_t> m_transitions;       // node * 256 + byte -> node
+    std::vector<uint16_t> m_outputLength;     // Longest keyword ending at node, 0 if none
+    // Prefilter: hashed set of case-folded 4-byte keyword prefixes
+    std::vector<uint64_t> m_prefixBits;
+    uint32_t m_prefixMask;
+    bool m_hasKeywords;
+    bool m_keywordsStartWithLetter;           // Allows checking word starts only
+    size_t m_longestKeyword;                  // How far before its assignment a keyword can start
+    double m_entropyThreshold;
+    size_t m_entropyMinLength;
+};
@@ -0,0 +1,170 @@
+#include "SpillFile.h"
+#include "StorageCipher.h"
+#include "TextCompressor.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+#ifdef _WIN32
+    std::wstring ToWide(const std::string& text) {
+        int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), (int)text.size(), NULL, 0);
+        std::wstring wide(length, L'\0');
+        if (length > 0) {
+            MultiByteToWideChar(CP_UTF8, 0, text.data(), (int)text.size(), &wide[0], length);
+        }
+        return wide;
+    }
+#endif
+
+    std::string GetAssociatedData(uint64_t offset) {
+        return "spill@" + std::to_string(offset);
+    }
+}
+
+SpillFile::SpillFile()
+    : m_size(0),
+#ifdef _WIN32
+      m_file(INVALID_HANDLE_VALUE) {
+#else
+      m_fd(-1) {
+#endif
+}
+
+SpillFile::~SpillFile() {
+#ifdef _WIN32
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle((HANDLE)m_file);
+    }
+#else
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+#endif
+}
+
+bool SpillFile::Open(const std::string& path, const std::shared_ptr<const StorageCipher>& cipher) {
+    m_cipher = cipher;
+#ifdef _WIN32
+    // Other processes can't open it, and Windows deletes it with the last handle
+    HANDLE file = CreateFileW(ToWide(path).c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    m_file = file;
+#else
+    // Only readable by the user, and unlinked right away
+    m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (m_fd < 0) {
+        return false;
+    }
+    unlink(path.c_str());
+#endif
+    return true;
+}
+
+bool SpillFile::Write(const std::string& data, uint64_t& offset, size_t& size) {
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    offset = m_size.load();
+    std::string sealed;
+    const std::string* block = &data;
+    if (m_cipher && m_cipher->IsEnabled()) {
+        sealed = m_cipher->Seal(data, GetAssociatedData(offset));
+        block = &sealed;
+    }
+    size = block->size();
+
+    size_t written = 0;
+#ifdef _WIN32
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    while (written < size) {
+        uint64_t position = offset + written;
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)position;
+        overlapped.OffsetHigh = (DWORD)(position >> 32);
+        DWORD chunk = (DWORD)(size - written < 0x40000000 ? size - written : 0x40000000);
+        DWORD count = 0;
+        if (!WriteFile((HANDLE)m_file, block->data() + written, chunk, &count, &overlapped) || count == 0) {
+            return false;
+        }
+        written += count;
+    }
+#else
+    if (m_fd < 0) {
+        return false;
+    }
+    while (written < size) {
+        ssize_t count = pwrite(m_fd, block->data() + written, size - written, (off_t)(offset + written));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        written += (size_t)count;
+    }
+#endif
+    // Readers only learn about the block once it is complete
+    m_size.store(offset + size);
+    return true;
+}
+
+bool SpillFile::Read(uint64_t offset, size_t size, std::string& data) const {
+    if (offset + size > m_size.load()) {
+        return false;
+    }
+    std::string block(size, '\0');
+    size_t done = 0;
+#ifdef _WIN32
+    while (done < size) {
+        uint64_t position = offset + done;
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)position;
+        overlapped.OffsetHigh = (DWORD)(position >> 32);
+        DWORD chunk = (DWORD)(size - done < 0x40000000 ? size - done : 0x40000000);
+        DWORD count = 0;
+        if (!ReadFile((HANDLE)m_file, &block[done], chunk, &count, &overlapped) || count == 0) {
+            return false;
+        }
+        done += count;
+    }
+#else
+    while (done < size) {
+        ssize_t count = pread(m_fd, &block[done], size - done, (off_t)(offset + done));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        done += (size_t)count;
+    }
+#endif
+    if (m_cipher && m_cipher->IsEnabled()) {
+        return m_cipher->Open(block, GetAssociatedData(offset), data);
+    }
+    data.swap(block);
+    return true;
+}
+
+bool SpilledText::ReadStored(std::string& data) const {
+    return file && file->Read(offset, size, data);
+}
+
+bool SpilledText::ReadText(std::string& text) const {
+    if (!compressed) {
+        return ReadStored(text);
+    }
+    CompressedText stored;
+    stored.size = textSize;
+    stored.dictionary = dictionary;
+    return ReadStored(stored.data) && TextCompressor::Decompress(stored, text);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class StorageCipher;
+
+// Session file for history content moved out of memory by the memory
+// policy (see ClipboardFrame::ApplyMemoryPolicy). Blocks are appended and
+// never rewritten, so readers on other threads (control clients, lazy
+// clipboard data) only need an offset and never wait for a write.
+// The file is deleted as soon as it is created (Linux) or when it is
+// closed (Windows), so nothing is left behind after a crash; the history
+// file stays the only record. With a cipher, each block is sealed with its
+// offset as associated data.
+class SpillFile {
+public:
+    SpillFile();
+    ~SpillFile();
+
+    // Creates the file, truncating any file at the path. The path is UTF-8.
+    bool Open(const std::string& path, const std::shared_ptr<const StorageCipher>& cipher);
+    // Appends a block; fails if the file can't be written
+    bool Write(const std::string& data, uint64_t& offset, size_t& size);
+    // Thread-safe; fails on a short read or a block that doesn't open
+    bool Read(uint64_t offset, size_t size, std::string& data) const;
+    uint64_t GetSize() const { return m_size.load(); }
+
+private:
+    SpillFile(const SpillFile&);
+    SpillFile& operator=(const SpillFile&);
+
+    std::shared_ptr<const StorageCipher> m_cipher;
+    std::mutex m_writeMutex;           // Serializes appends
+    std::atomic<uint64_t> m_size;
+#ifdef _WIN32
+    void* m_file;
+#else
+    int m_fd;
+#endif
+};
+
+// Entry content as it was held in memory before it was spilled: UTF-8 text,
+// or the data of a CompressedText
+struct SpilledText {
+    std::shared_ptr<SpillFile> file;
+    uint64_t offset;
+    size_t size;             // Bytes in the spill file
+    bool compressed;
+    int dictionary;          // Of the compressed data
+    size_t textSize;         // UTF-8 bytes of the content
+
+    // Data as it was held: compressed bytes if compressed is set
+    bool ReadStored(std::string& data) const;
+    bool ReadText(std::string& text) const;
+};
@@ -0,0 +1,771 @@
+#include "StorageCipher.h"
+#include "AtomicFile.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <bcrypt.h>
+#include <wincrypt.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// STORAGE_CIPHER_PORTABLE forces the portable code (storage_cipher_portable_test)
+#if !defined(STORAGE_CIPHER_PORTABLE) && \
+    (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define STORAGE_CIPHER_SSE2
+#endif
+
+namespace {
+    const char KEY_FILE_MAGIC[4] = { 'C', 'M', 'K', '1' };
+    const size_t SALT_BYTES = 16;
+    // Key files asking for far more PBKDF2 work than we write are refused
+    // rather than keeping Unlock busy for minutes
+    const uint32_t MAX_PBKDF2_ITERATIONS = 16 * StorageCipher::PBKDF2_ITERATIONS;
+
+    inline uint32_t Load32(const unsigned char* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    inline void Store32(unsigned char* p, uint32_t v) {
+        p[0] = (unsigned char)v;
+        p[1] = (unsigned char)(v >> 8);
+        p[2] = (unsigned char)(v >> 16);
+        p[3] = (unsigned char)(v >> 24);
+    }
+
+    inline void Store64(unsigned char* p, uint64_t v) {
+        Store32(p, (uint32_t)v);
+        Store32(p + 4, (uint32_t)(v >> 32));
+    }
+
+    inline uint32_t Rotl(uint32_t v, int n) {
+        return (v << n) | (v >> (32 - n));
+    }
+
+    // Doesn't stop at the first difference
+    bool EqualConstantTime(const unsigned char* a, const unsigned char* b, size_t size) {
+        unsigned char difference = 0;
+        for (size_t i = 0; i < size; ++i) {
+            difference |= a[i] ^ b[i];
+        }
+        return difference == 0;
+    }
+
+    void Wipe(void* data, size_t size) {
+        volatile unsigned char* p = (volatile unsigned char*)data;
+        while (size--) {
+            *p++ = 0;
+        }
+    }
+
+    // --- ChaCha20 -----------------------------------------------------------
+
+    struct ChaChaState {
+        uint32_t words[16];   // Constants, key, block counter, nonce
+    };
+
+    void ChaChaInit(ChaChaState& state, const unsigned char key[32], uint32_t counter, const unsigned char nonce[12]) {
+        state.words[0] = 0x61707865;
+        state.words[1] = 0x3320646e;
+        state.words[2] = 0x79622d32;
+        state.words[3] = 0x6b206574;
+        for (int i = 0; i < 8; ++i) {
+            state.words[4 + i] = Load32(key + 4 * i);
+        }
+        state.words[12] = counter;
+        for (int i = 0; i < 3; ++i) {
+            state.words[13 + i] = Load32(nonce + 4 * i);
+        }
+    }
+
+#define CHACHA_QUARTER_ROUND(a, b, c, d) \
+    a += b; d = Rotl(d ^ a, 16);         \
+    c += d; b = Rotl(b ^ c, 12);         \
+    a += b; d = Rotl(d ^ a, 8);          \
+    c += d; b = Rotl(b ^ c, 7);
+
+    void ChaChaBlock(const ChaChaState& state, unsigned char out[64]) {
+        uint32_t x[16];
+        memcpy(x, state.words, sizeof(x));
+        for (int round = 0; round < 10; ++round) {
+            CHACHA_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+            CHACHA_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+            CHACHA_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+            CHACHA_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+            CHACHA_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+            CHACHA_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+            CHACHA_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+            CHACHA_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; ++i) {
+            Store32(out + 4 * i, x[i] + state.words[i]);
+        }
+    }
+
+#ifdef STORAGE_CIPHER_SSE2
+    inline __m128i RotlVector(__m128i v, int n) {
+        return _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - n));
+    }
+
+#define CHACHA_QUARTER_ROUND_SSE2(a, b, c, d)                     \
+    a = _mm_add_epi32(a, b); d = RotlVector(_mm_xor_si128(d, a), 16); \
+    c = _mm_add_epi32(c, d); b = RotlVector(_mm_xor_si128(b, c), 12); \
+    a = _mm_add_epi32(a, b); d = RotlVector(_mm_xor_si128(d, a), 8);  \
+    c = _mm_add_epi32(c, d); b = RotlVector(_mm_xor_si128(b, c), 7);
+
+    // Four consecutive blocks, one per 32-bit lane: 256 bytes of in are XORed into out
+    void ChaChaXor4(ChaChaState& state, const unsigned char* in, unsigned char* out) {
+        __m128i x[16];
+        __m128i original[16];
+        for (int i = 0; i < 16; ++i) {
+            original[i] = _mm_set1_epi32((int)state.words[i]);
+        }
+        original[12] = _mm_add_epi32(original[12], _mm_set_epi32(3, 2, 1, 0));
+        for (int i = 0; i < 16; ++i) {
+            x[i] = original[i];
+        }
+        for (int round = 0; round < 10; ++round) {
+            CHACHA_QUARTER_ROUND_SSE2(x[0], x[4], x[8], x[12]);
+            CHACHA_QUARTER_ROUND_SSE2(x[1], x[5], x[9], x[13]);
+            CHACHA_QUARTER_ROUND_SSE2(x[2], x[6], x[10], x[14]);
+            CHACHA_QUARTER_ROUND_SSE2(x[3], x[7], x[11], x[15]);
+            CHACHA_QUARTER_ROUND_SSE2(x[0], x[5], x[10], x[15]);
+            CHACHA_QUARTER_ROUND_SSE2(x[1], x[6], x[11], x[12]);
+            CHACHA_QUARTER_ROUND_SSE2(x[2], x[7], x[8], x[13]);
+            CHACHA_QUARTER_ROUND_SSE2(x[3], x[4], x[9], x[14]);
+        }
+        // Transpose each group of four words so every register holds 16 bytes of one block
+        for (int group = 0; group < 4; ++group) {
+            __m128i a = _mm_add_epi32(x[4 * group], original[4 * group]);
+            __m128i b = _mm_add_epi32(x[4 * group + 1], original[4 * group + 1]);
+            __m128i c = _mm_add_epi32(x[4 * group + 2], original[4 * group + 2]);
+            __m128i d = _mm_add_epi32(x[4 * group + 3], original[4 * group + 3]);
+            __m128i ab0 = _mm_unpacklo_epi32(a, b);
+            __m128i cd0 = _mm_unpacklo_epi32(c, d);
+            __m128i ab1 = _mm_unpackhi_epi32(a, b);
+            __m128i cd1 = _mm_unpackhi_epi32(c, d);
+            __m128i blocks[4] = {
+                _mm_unpacklo_epi64(ab0, cd0), _mm_unpackhi_epi64(ab0, cd0),
+                _mm_unpacklo_epi64(ab1, cd1), _mm_unpackhi_epi64(ab1, cd1)
+            };
+            for (int block = 0; block < 4; ++block) {
+                size_t offset = 64 * block + 16 * group;
+                __m128i data = _mm_loadu_si128((const __m128i*)(in + offset));
+                _mm_storeu_si128((__m128i*)(out + offset), _mm_xor_si128(data, blocks[block]));
+            }
+        }
+        state.words[12] += 4;
+    }
+#endif
+
+    // in and out may be the same buffer
+    void ChaChaXor(ChaChaState& state, const unsigned char* in, unsigned char* out, size_t size) {
+#ifdef STORAGE_CIPHER_SSE2
+        while (size >= 256) {
+            ChaChaXor4(state, in, out);
+            in += 256;
+            out += 256;
+            size -= 256;
+        }
+#endif
+        unsigned char keyStream[64];
+        while (size > 0) {
+            ChaChaBlock(state, keyStream);
+            state.words[12]++;
+            size_t count = size < 64 ? size : 64;
+            for (size_t i = 0; i < count; ++i) {
+                out[i] = in[i] ^ keyStream[i];
+            }
+            in += count;
+            out += count;
+            size -= count;
+        }
+        Wipe(keyStream, sizeof(keyStream));
+    }
+
+    // --- Poly1305 -----------------------------------------------------------
+
+    class Poly1305 {
+    public:
+        explicit Poly1305(const unsigned char key[32]) : m_leftover(0) {
+            m_r[0] = Load32(key) & 0x3ffffff;
+            m_r[1] = (Load32(key + 3) >> 2) & 0x3ffff03;
+            m_r[2] = (Load32(key + 6) >> 4) & 0x3ffc0ff;
+            m_r[3] = (Load32(key + 9) >> 6) & 0x3f03fff;
+            m_r[4] = (Load32(key + 12) >> 8) & 0x00fffff;
+            for (int i = 0; i < 5; ++i) {
+                m_h[i] = 0;
+            }
+            for (int i = 0; i < 4; ++i) {
+                m_pad[i] = Load32(key + 16 + 4 * i);
+            }
+        }
+
+        ~Poly1305() {
+            Wipe(m_r, sizeof(m_r));
+            Wipe(m_pad, sizeof(m_pad));
+        }
+
+        void Update(const unsigned char* data, size_t size) {
+            if (m_leftover) {
+                size_t count = 16 - m_leftover < size ? 16 - m_leftover : size;
+                memcpy(m_buffer + m_leftover, data, count);
+                m_leftover += count;
+                data += count;
+                size -= count;
+                if (m_leftover < 16) {
+                    return;
+                }
+                Blocks(m_buffer, 16, 1 << 24);
+                m_leftover = 0;
+            }
+            size_t whole = size & ~(size_t)15;
+            Blocks(data, whole, 1 << 24);
+            memcpy(m_buffer, data + whole, size - whole);
+            m_leftover = size - whole;
+        }
+
+        // Zeros up to the next multiple of 16 bytes, as the AEAD construction wants
+        void Pad() {
+            if (m_leftover) {
+                static const unsigned char zeros[16] = { 0 };
+                Update(zeros, 16 - m_leftover);
+            }
+        }
+
+        void Finish(unsigned char tag[16]) {
+            if (m_leftover) {
+                // The last partial block gets its 1 bit here instead of bit 128
+                m_buffer[m_leftover] = 1;
+                memset(m_buffer + m_leftover + 1, 0, 16 - m_leftover - 1);
+                Blocks(m_buffer, 16, 0);
+            }
+            uint32_t h0 = m_h[0], h1 = m_h[1], h2 = m_h[2], h3 = m_h[3], h4 = m_h[4];
+            uint32_t c;
+            c = h1 >> 26; h1 &= 0x3ffffff;
+            h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+            h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+            h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+            h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+            h1 += c;
+
+            // h - p, kept if it doesn't go below zero
+            uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+            uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+            uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+            uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+            uint32_t g4 = h4 + c - (1 << 26);
+            uint32_t mask = (g4 >> 31) - 1;
+            h0 = (h0 & ~mask) | (g0 & mask);
+            h1 = (h1 & ~mask) | (g1 & mask);
+            h2 = (h2 & ~mask) | (g2 & mask);
+            h3 = (h3 & ~mask) | (g3 & mask);
+            h4 = (h4 & ~mask) | (g4 & mask);
+
+            uint32_t w0 = h0 | (h1 << 26);
+            uint32_t w1 = (h1 >> 6) | (h2 << 20);
+            uint32_t w2 = (h2 >> 12) | (h3 << 14);
+            uint32_t w3 = (h3 >> 18) | (h4 << 8);
+            uint64_t f = (uint64_t)w0 + m_pad[0];
+            Store32(tag, (uint32_t)f);
+            f = (uint64_t)w1 + m_pad[1] + (f >> 32);
+            Store32(tag + 4, (uint32_t)f);
+            f = (uint64_t)w2 + m_pad[2] + (f >> 32);
+            Store32(tag + 8, (uint32_t)f);
+            f = (uint64_t)w3 + m_pad[3] + (f >> 32);
+            Store32(tag + 12, (uint32_t)f);
+        }
+
+    private:
+        void Blocks(const unsigned char* data, size_t size, uint32_t highBit) {
+            const uint32_t r0 = m_r[0], r1 = m_r[1], r2 = m_r[2], r3 = m_r[3], r4 = m_r[4];
+            const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+            uint32_t h0 = m_h[0], h1 = m_h[1], h2 = m_h[2], h3 = m_h[3], h4 = m_h[4];
+            for (; size >= 16; data += 16, size -= 16) {
+                h0 += Load32(data) & 0x3ffffff;
+                h1 += (Load32(data + 3) >> 2) & 0x3ffffff;
+                h2 += (Load32(data + 6) >> 4) & 0x3ffffff;
+                h3 += (Load32(data + 9) >> 6) & 0x3ffffff;
+                h4 += (Load32(data + 12) >> 8) | highBit;
+
+                uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+                uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+                uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+                uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+                uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+                uint32_t c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & 0x3ffffff;
+                d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & 0x3ffffff;
+                d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & 0x3ffffff;
+                d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & 0x3ffffff;
+                d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & 0x3ffffff;
+                h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+                h1 += c;
+            }
+            m_h[0] = h0; m_h[1] = h1; m_h[2] = h2; m_h[3] = h3; m_h[4] = h4;
+        }
+
+        uint32_t m_r[5];
+        uint32_t m_h[5];
+        uint32_t m_pad[4];
+        unsigned char m_buffer[16];
+        size_t m_leftover;
+    };
+
+    // RFC 8439 section 2.8: the Poly1305 key is the first block of the key stream
+    void ComputeTag(const unsigned char key[32], const unsigned char nonce[12], const std::string& associated,
+                    const unsigned char* ciphertext, size_t size, unsigned char tag[16]) {
+        ChaChaState state;
+        ChaChaInit(state, key, 0, nonce);
+        unsigned char block[64];
+        ChaChaBlock(state, block);
+        Poly1305 mac(block);
+        Wipe(block, sizeof(block));
+        Wipe(&state, sizeof(state));
+
+        mac.Update((const unsigned char*)associated.data(), associated.size());
+        mac.Pad();
+        mac.Update(ciphertext, size);
+        mac.Pad();
+        unsigned char lengths[16];
+        Store64(lengths, associated.size());
+        Store64(lengths + 8, size);
+        mac.Update(lengths, sizeof(lengths));
+        mac.Finish(tag);
+    }
+
+    void SealWithNonce(const unsigned char key[32], const unsigned char nonce[12], const std::string& plaintext,
+                       const std::string& associated, std::string& sealed) {
+        sealed.resize(StorageCipher::NONCE_BYTES + plaintext.size() + StorageCipher::TAG_BYTES);
+        unsigned char* out = (unsigned char*)&sealed[0];
+        memcpy(out, nonce, StorageCipher::NONCE_BYTES);
+        ChaChaState state;
+        ChaChaInit(state, key, 1, nonce);
+        ChaChaXor(state, (const unsigned char*)plaintext.data(), out + StorageCipher::NONCE_BYTES, plaintext.size());
+        Wipe(&state, sizeof(state));
+        ComputeTag(key, nonce, associated, out + StorageCipher::NONCE_BYTES, plaintext.size(),
+                   out + StorageCipher::NONCE_BYTES + plaintext.size());
+    }
+
+    bool OpenWithKey(const unsigned char key[32], const std::string& sealed, const std::string& associated,
+                     std::string& plaintext) {
+        if (sealed.size() < StorageCipher::OVERHEAD) {
+            return false;
+        }
+        const unsigned char* in = (const unsigned char*)sealed.data();
+        size_t size = sealed.size() - StorageCipher::OVERHEAD;
+        unsigned char tag[16];
+        ComputeTag(key, in, associated, in + StorageCipher::NONCE_BYTES, size, tag);
+        if (!EqualConstantTime(tag, in + StorageCipher::NONCE_BYTES + size, sizeof(tag))) {
+            return false;
+        }
+        plaintext.resize(size);
+        ChaChaState state;
+        ChaChaInit(state, key, 1, in);
+        ChaChaXor(state, in + StorageCipher::NONCE_BYTES, (unsigned char*)&plaintext[0], size);
+        Wipe(&state, sizeof(state));
+        return true;
+    }
+
+    // --- SHA-256, HMAC and PBKDF2 for the passphrase ------------------------
+
+    class Sha256 {
+    public:
+        Sha256() : m_size(0) {
+            static const uint32_t INITIAL[8] = {
+                0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+            };
+            memcpy(m_state, INITIAL, sizeof(m_state));
+        }
+
+        void Update(const unsigned char* data, size_t size) {
+            while (size > 0) {
+                size_t used = (size_t)(m_size % 64);
+                size_t count = 64 - used < size ? 64 - used : size;
+                memcpy(m_block + used, data, count);
+                m_size += count;
+                data += count;
+                size -= count;
+                if (m_size % 64 == 0) {
+                    Transform();
+                }
+            }
+        }
+
+        void Finish(unsigned char digest[32]) {
+            uint64_t bits = m_size * 8;
+            unsigned char padding = 0x80;
+            Update(&padding, 1);
+            padding = 0;
+            while (m_size % 64 != 56) {
+                Update(&padding, 1);
+            }
+            unsigned char length[8];
+            for (int i = 0; i < 8; ++i) {
+                length[i] = (unsigned char)(bits >> (56 - 8 * i));
+            }
+            Update(length, 8);
+            for (int i = 0; i < 8; ++i) {
+                digest[4 * i] = (unsigned char)(m_state[i] >> 24);
+                digest[4 * i + 1] = (unsigned char)(m_state[i] >> 16);
+                digest[4 * i + 2] = (unsigned char)(m_state[i] >> 8);
+                digest[4 * i + 3] = (unsigned char)m_state[i];
+            }
+        }
+
+    private:
+        void Transform() {
+            static const uint32_t K[64] = {
+                0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+            };
+            uint32_t w[64];
+            for (int i = 0; i < 16; ++i) {
+                w[i] = ((uint32_t)m_block[4 * i] << 24) | ((uint32_t)m_block[4 * i + 1] << 16) |
+                       ((uint32_t)m_block[4 * i + 2] << 8) | (uint32_t)m_block[4 * i + 3];
+            }
+            for (int i = 16; i < 64; ++i) {
+                uint32_t s0 = Rotl(w[i - 15], 25) ^ Rotl(w[i - 15], 14) ^ (w[i - 15] >> 3);
+                uint32_t s1 = Rotl(w[i - 2], 15) ^ Rotl(w[i - 2], 13) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+            uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+            for (int i = 0; i < 64; ++i) {
+                uint32_t t1 = h + (Rotl(e, 26) ^ Rotl(e, 21) ^ Rotl(e, 7)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+                uint32_t t2 = (Rotl(a, 30) ^ Rotl(a, 19) ^ Rotl(a, 10)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g; g = f; f = e; e = d + t1;
+                d = c; c = b; b = a; a = t1 + t2;
+            }
+            m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+            m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+        }
+
+        uint32_t m_state[8];
+        unsigned char m_block[64];
+        uint64_t m_size;
+    };
+
+    class HmacSha256 {
+    public:
+        explicit HmacSha256(const std::string& key) {
+            unsigned char block[64] = { 0 };
+            if (key.size() > 64) {
+                Sha256 hash;
+                hash.Update((const unsigned char*)key.data(), key.size());
+                hash.Finish(block);
+            } else {
+                memcpy(block, key.data(), key.size());
+            }
+            for (int i = 0; i < 64; ++i) {
+                m_innerPad[i] = block[i] ^ 0x36;
+                m_outerPad[i] = block[i] ^ 0x5c;
+            }
+            Wipe(block, sizeof(block));
+        }
+
+        ~HmacSha256() {
+            Wipe(m_innerPad, sizeof(m_innerPad));
+            Wipe(m_outerPad, sizeof(m_outerPad));
+        }
+
+        void Compute(const unsigned char* data, size_t size, unsigned char mac[32]) const {
+            Sha256 inner;
+            inner.Update(m_innerPad, sizeof(m_innerPad));
+            inner.Update(data, size);
+            unsigned char innerDigest[32];
+            inner.Finish(innerDigest);
+            Sha256 outer;
+            outer.Update(m_outerPad, sizeof(m_outerPad));
+            outer.Update(innerDigest, sizeof(innerDigest));
+            outer.Finish(mac);
+        }
+
+    private:
+        unsigned char m_innerPad[64];
+        unsigned char m_outerPad[64];
+    };
+
+    // One 32-byte output block is all the key wrapping needs
+    void Pbkdf2Sha256(const std::string& passphrase, const unsigned char* salt, size_t saltSize,
+                      uint32_t iterations, unsigned char key[32]) {
+        HmacSha256 hmac(passphrase);
+        std::vector<unsigned char> first(salt, salt + saltSize);
+        unsigned char blockIndex[4] = { 0, 0, 0, 1 };
+        first.insert(first.end(), blockIndex, blockIndex + 4);
+        unsigned char u[32];
+        hmac.Compute(first.data(), first.size(), u);
+        memcpy(key, u, 32);
+        for (uint32_t i = 1; i < iterations; ++i) {
+            hmac.Compute(u, sizeof(u), u);
+            for (int j = 0; j < 32; ++j) {
+                key[j] ^= u[j];
+            }
+        }
+        Wipe(u, sizeof(u));
+    }
+
+    // --- Key file -----------------------------------------------------------
+
+    bool ReadWholeFile(const std::string& path, std::string& data) {
+#ifdef _WIN32
+        int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+        std::wstring widePath(length > 0 ? length : 1, L'\0');
+        MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], length);
+        FILE* file = _wfopen(widePath.c_str(), L"rb");
+#else
+        FILE* file = fopen(path.c_str(), "rb");
+#endif
+        if (!file) {
+            return false;
+        }
+        data.clear();
+        char buffer[4096];
+        size_t count;
+        while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            data.append(buffer, count);
+        }
+        bool ok = !ferror(file);
+        fclose(file);
+        return ok;
+    }
+
+#ifdef _WIN32
+    bool ProtectWithKeystore(const unsigned char* key, size_t size, std::string& blob) {
+        DATA_BLOB input = { (DWORD)size, (BYTE*)key };
+        DATA_BLOB output = { 0, NULL };
+        if (!CryptProtectData(&input, L"Clipboard Manager history key", NULL, NULL, NULL,
+                              CRYPTPROTECT_UI_FORBIDDEN, &output)) {
+            return false;
+        }
+        blob.assign((const char*)output.pbData, output.cbData);
+        LocalFree(output.pbData);
+        return true;
+    }
+
+    bool UnprotectWithKeystore(const std::string& blob, std::string& key) {
+        DATA_BLOB input = { (DWORD)blob.size(), (BYTE*)blob.data() };
+        DATA_BLOB output = { 0, NULL };
+        if (!CryptUnprotectData(&input, NULL, NULL, NULL, NULL, CRYPTPROTECT_UI_FORBIDDEN, &output)) {
+            return false;
+        }
+        key.assign((const char*)output.pbData, output.cbData);
+        SecureZeroMemory(output.pbData, output.cbData);
+        LocalFree(output.pbData);
+        return true;
+    }
+#endif
+}
+
+StorageCipher::StorageCipher()
+    : m_nonceCounter(0),
+      m_enabled(false) {
+    memset(m_key, 0, sizeof(m_key));
+    memset(m_nonceKey, 0, sizeof(m_nonceKey));
+}
+
+StorageCipher::~StorageCipher() {
+    Wipe(m_key, sizeof(m_key));
+    Wipe(m_nonceKey, sizeof(m_nonceKey));
+}
+
+bool StorageCipher::SetKey(const unsigned char key[KEY_BYTES]) {
+    if (!RandomBytes(m_nonceKey, sizeof(m_nonceKey))) {
+        return false;
+    }
+    memcpy(m_key, key, KEY_BYTES);
+    m_nonceCounter = 0;
+    m_enabled = true;
+    return true;
+}
+
+bool StorageCipher::UseEphemeralKey() {
+    unsigned char key[KEY_BYTES];
+    bool ok = RandomBytes(key, sizeof(key)) && SetKey(key);
+    Wipe(key, sizeof(key));
+    return ok;
+}
+
+bool StorageCipher::Unlock(const std::string& keyPath, Protection protection, const PassphraseCallback& askPassphrase,
+                           std::string& error) {
+    // Header: magic, protection. Passphrase files continue with the PBKDF2
+    // iterations and salt, then the data key sealed with the derived key and
+    // the header as associated data; keystore files with the DPAPI blob.
+    std::string file;
+    bool exists = ReadWholeFile(keyPath, file);
+    if (exists && (file.size() < 5 || memcmp(file.data(), KEY_FILE_MAGIC, 4) != 0)) {
+        error = "not a history key file: " + keyPath;
+        return false;
+    }
+    if (exists) {
+        protection = (Protection)(unsigned char)file[4];
+    }
+
+    unsigned char key[KEY_BYTES];
+    if (protection == PROTECTION_KEYSTORE) {
+#ifdef _WIN32
+        if (exists) {
+            std::string unwrapped;
+            if (!UnprotectWithKeystore(file.substr(5), unwrapped) || unwrapped.size() != KEY_BYTES) {
+                error = "the OS keystore could not unlock the history key (other user or machine?)";
+                return false;
+            }
+            memcpy(key, unwrapped.data(), KEY_BYTES);
+            Wipe(&unwrapped[0], unwrapped.size());
+        } else {
+            std::string blob;
+            if (!RandomBytes(key, sizeof(key)) || !ProtectWithKeystore(key, sizeof(key), blob)) {
+                error = "the OS keystore could not protect a new history key";
+                return false;
+            }
+            file.assign(KEY_FILE_MAGIC, 4);
+            file += (char)PROTECTION_KEYSTORE;
+            file += blob;
+        }
+#else
+        error = "no OS keystore on this platform, use passphrase protection";
+        return false;
+#endif
+    } else if (protection == PROTECTION_PASSPHRASE) {
+        std::string passphrase;
+        if (!askPassphrase || !askPassphrase(!exists, passphrase) || passphrase.empty()) {
+            error = "no passphrase given";
+            return false;
+        }
+        const size_t headerSize = 5 + 4 + SALT_BYTES;
+        const size_t sealedSize = OVERHEAD + KEY_BYTES;
+        unsigned char wrappingKey[KEY_BYTES];
+        if (exists) {
+            if (file.size() != headerSize + sealedSize) {
+                error = "damaged history key file: " + keyPath;
+                return false;
+            }
+            uint32_t iterations = Load32((const unsigned char*)file.data() + 5);
+            if (iterations < PBKDF2_ITERATIONS || iterations > MAX_PBKDF2_ITERATIONS) {
+                error = "unsupported key derivation settings in " + keyPath;
+                return false;
+            }
+            Pbkdf2Sha256(passphrase, (const unsigned char*)file.data() + 9, SALT_BYTES, iterations, wrappingKey);
+            std::string unwrapped;
+            bool ok = OpenWithKey(wrappingKey, file.substr(headerSize), file.substr(0, headerSize), unwrapped);
+            Wipe(wrappingKey, sizeof(wrappingKey));
+            if (!ok) {
+                error = "wrong passphrase";
+                return false;
+            }
+            memcpy(key, unwrapped.data(), KEY_BYTES);
+            Wipe(&unwrapped[0], unwrapped.size());
+        } else {
+            unsigned char header[headerSize];
+            memcpy(header, KEY_FILE_MAGIC, 4);
+            header[4] = (unsigned char)PROTECTION_PASSPHRASE;
+            Store32(header + 5, PBKDF2_ITERATIONS);
+            unsigned char nonce[NONCE_BYTES];
+            if (!RandomBytes(header + 9, SALT_BYTES) || !RandomBytes(nonce, sizeof(nonce)) ||
+                !RandomBytes(key, sizeof(key))) {
+                error = "no random numbers from the OS";
+                return false;
+            }
+            Pbkdf2Sha256(passphrase, header + 9, SALT_BYTES, PBKDF2_ITERATIONS, wrappingKey);
+            std::string sealed;
+            SealWithNonce(wrappingKey, nonce, std::string((const char*)key, KEY_BYTES),
+                          std::string((const char*)header, headerSize), sealed);
+            Wipe(wrappingKey, sizeof(wrappingKey));
+            file.assign((const char*)header, headerSize);
+            file += sealed;
+        }
+        Wipe(&passphrase[0], passphrase.size());
+    } else {
+        error = "unknown key protection in " + keyPath;
+        return false;
+    }
+
+    if (!exists && !WriteFileAtomically(keyPath, file, true)) {
+        Wipe(key, sizeof(key));
+        error = "failed to write " + keyPath;
+        return false;
+    }
+    bool ok = SetKey(key);
+    Wipe(key, sizeof(key));
+    if (!ok) {
+        error = "no random numbers from the OS";
+    }
+    return ok;
+}
+
+std::string StorageCipher::Seal(const std::string& plaintext, const std::string& associated) const {
+    // ChaCha20 under the session's random nonce key, used as a random
+    // generator: every seal gets 96 fresh random-looking bits, so nonces
+    // from different sessions collide no more often than random ones
+    unsigned char counter[NONCE_BYTES] = { 0 };
+    Store64(counter, m_nonceCounter++);
+    ChaChaState state;
+    ChaChaInit(state, m_nonceKey, 0, counter);
+    unsigned char block[64];
+    ChaChaBlock(state, block);
+    unsigned char nonce[NONCE_BYTES];
+    memcpy(nonce, block, NONCE_BYTES);
+    Wipe(block, sizeof(block));
+    Wipe(&state, sizeof(state));
+
+    std::string sealed;
+    SealWithNonce(m_key, nonce, plaintext, associated, sealed);
+    return sealed;
+}
+
+bool StorageCipher::Open(const std::string& sealed, const std::string& associated, std::string& plaintext) const {
+    return m_enabled && OpenWithKey(m_key, sealed, associated, plaintext);
+}
+
+bool StorageCipher::IsKeystoreAvailable() {
+#ifdef _WIN32
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool StorageCipher::RandomBytes(void* data, size_t size) {
+#ifdef _WIN32
+    return BCryptGenRandom(NULL, (PUCHAR)data, (ULONG)size, BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0;
+#else
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    unsigned char* out = (unsigned char*)data;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t count = read(fd, out + done, size - done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        done += (size_t)count;
+    }
+    close(fd);
+    return done == size;
+#endif
+}
+
+const char* StorageCipher::GetImplementation() {
+#ifdef STORAGE_CIPHER_SSE2
+    return "SSE2";
+#else
+    return "portable";
+#endif
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Authenticated encryption of the history at rest with ChaCha20-Poly1305
+// (RFC 8439). Every history record and every saved image or payload file is
+// sealed on its own: a 12-byte nonce, the ciphertext and a 16-byte tag.
+// The associated data (record time and type, or the file path) is
+// authenticated but not encrypted, so sealed data can't be swapped around.
+//
+// ChaCha20 runs four blocks at a time in SSE2 registers where available
+// (every x86-64 CPU), which keeps sealing far below the cost of writing the
+// file; other CPUs use the portable code. Poly1305 uses 26-bit limbs.
+//
+// The data key is random and stored in a key file, wrapped either with a
+// key derived from a passphrase (PBKDF2-HMAC-SHA256) or, on Windows, by
+// the OS keystore (DPAPI, bound to the user account).
+// Nonces are 96 random bits per seal, drawn from ChaCha20 under a nonce key
+// that is taken from the OS random generator whenever a key is set. Sealing
+// never waits for the OS, and nonces from earlier sessions (every save
+// re-seals the whole history) collide only by chance.
+class StorageCipher {
+public:
+    enum Protection {
+        PROTECTION_PASSPHRASE = 1,
+        PROTECTION_KEYSTORE = 2
+    };
+
+    // Asked for the passphrase; create is set when a new key file is made
+    typedef std::function<bool(bool create, std::string& passphrase)> PassphraseCallback;
+
+    StorageCipher();
+    ~StorageCipher();
+
+    bool IsEnabled() const { return m_enabled; }
+
+    // Reads the key file, or creates it with a new random key protected as
+    // requested. The protection of an existing file wins.
+    bool Unlock(const std::string& keyPath, Protection protection, const PassphraseCallback& askPassphrase,
+                std::string& error);
+    // Random key that is never stored (replays)
+    bool UseEphemeralKey();
+
+    std::string Seal(const std::string& plaintext, const std::string& associated) const;
+    // Fails if the data was modified, sealed with another key or with other associated data
+    bool Open(const std::string& sealed, const std::string& associated, std::string& plaintext) const;
+
+    static bool IsKeystoreAvailable();
+    static bool RandomBytes(void* data, size_t size);
+    // "SSE2" or "portable"
+    static const char* GetImplementation();
+
+    static const size_t KEY_BYTES = 32;
+    static const size_t NONCE_BYTES = 12;
+    static const size_t TAG_BYTES = 16;
+    static const size_t OVERHEAD = NONCE_BYTES + TAG_BYTES;
+    static const uint32_t PBKDF2_ITERATIONS = 200000;
+
+private:
+    StorageCipher(const StorageCipher&);
+    StorageCipher& operator=(const StorageCipher&);
+
+    bool SetKey(const unsigned char key[KEY_BYTES]);
+
+    unsigned char m_key[KEY_BYTES];
+    unsigned char m_nonceKey[KEY_BYTES];
+    mutable std::atomic<uint64_t> m_nonceCounter;   // Block of the nonce generator
+    bool m_enabled;
+};
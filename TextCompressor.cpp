@@ -0,0 +1,273 @@
+#include "TextCompressor.h"
+#include <cstring>
+#include <vector>
+
+namespace {
+    // Fragments that recur in copied text. Later fragments are the most
+    // common ones: their offsets stay small for the start of a clip.
+    const char DEFAULT_DICTIONARY_TEXT[] =
+        // Logs and stack traces
+        "Traceback (most recent call last):\n  File \"/usr/lib/python3/dist-packages/"
+        "Exception in thread \"main\" java.lang.NullPointerException\n\tat "
+        "java.lang.IllegalArgumentException: "
+        "    at System.Runtime.CompilerServices.TaskAwaiter.HandleNonSuccessAndDebuggerNotification(Task task)\n"
+        "Segmentation fault (core dumped)\n"
+        " [INFO] [WARN] [ERROR] [DEBUG] [TRACE] INFO  WARN  ERROR DEBUG "
+        "2024-01-01T00:00:00.000Z 2025-01-01 12:00:00,000 "
+        "error: expected ';' before '}' token\n"
+        "warning: unused variable\n"
+        "note: in expansion of macro\n"
+        "failed to connect to localhost:8080: Connection refused\n"
+        "npm ERR! code ERESOLVE\nnpm WARN deprecated "
+        "fatal: not a git repository (or any of the parent directories): .git\n"
+        "HTTP/1.1 200 OK\r\nContent-Type: application/json; charset=utf-8\r\nContent-Length: "
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/"
+        "Authorization: Bearer Cache-Control: no-cache\r\n"
+        // Shell and paths
+        "sudo apt-get install -y git clone https://github.com/ cd .. && make && make install "
+        "docker run --rm -it -v $(pwd):/app kubectl get pods -n default "
+        "C:\\Users\\\\AppData\\Local\\Temp\\ C:\\Program Files (x86)\\ C:\\Windows\\System32\\ "
+        "/home/user/ /usr/local/bin/ /var/log/ /etc/ ~/.config/ ./node_modules/ ../src/ "
+        "D:\\Projects\\ Documents\\ Downloads\\ Desktop\\ .exe .dll .txt .pdf .png .jpg .zip "
+        // Markup
+        "<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n<meta charset=\"UTF-8\">\n"
+        "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n<title></title>\n"
+        "<link rel=\"stylesheet\" href=\"<script src=\"</script>\n</head>\n<body>\n</body>\n</html>\n"
+        "<div class=\"container\"></div>\n<span class=\"</span><a href=\"https://</a><p></p>"
+        "<ul>\n<li></li>\n</ul><table><tr><td></td></tr></table><br/><img src=\"\" alt=\"\" />"
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "# ## ### - [ ] - [x] **Note:** ```bash\n```\n```cpp\n```python\n```json\n"
+        // Code
+        "#include <stdio.h>\n#include <stdlib.h>\n#include <string.h>\n#include <vector>\n#include <string>\n"
+        "#include <iostream>\n#include <memory>\n#pragma once\n#define #ifdef #ifndef #endif\n"
+        "int main(int argc, char* argv[]) {\n    return 0;\n}\n"
+        "std::vector<std::string> std::unique_ptr<std::shared_ptr<std::cout << std::endl;\n"
+        "static const unsigned int size_t uint8_t uint32_t uint64_t nullptr sizeof(template <typename T>\n"
+        "public:\n    private:\n    protected:\n    virtual ~override;\n"
+        "public static void main(String[] args) {\n        System.out.println(\n"
+        "import java.util.List;\nimport java.util.Map;\n@Override\n"
+        "using System;\nusing System.Collections.Generic;\nusing System.Linq;\nnamespace "
+        "public async Task<IActionResult> await "
+        "def __init__(self, self.\nimport os\nimport sys\nimport numpy as np\nimport pandas as pd\n"
+        "from typing import List, Dict, Optional\nif __name__ == \"__main__\":\n    main()\n"
+        "    raise ValueError(\nexcept Exception as e:\n    print(f\"\nreturn None\nelif lambda "
+        "package main\n\nimport (\n\t\"fmt\"\n)\n\nfunc if err != nil {\n\t\treturn nil, err\n\t}\n"
+        "fn main() {\n    let mut impl pub struct Result<Option<Some(None => unwrap()\n"
+        "import React, { useState, useEffect } from 'react';\nexport default function "
+        "const { } = require(' module.exports = async function (req, res) {\n"
+        "document.getElementById(' addEventListener('click', () => {\n"
+        "console.log( JSON.stringify( JSON.parse( .then((response) => response.json())\n"
+        "SELECT * FROM WHERE id = ORDER BY LIMIT INSERT INTO VALUES (UPDATE SET DELETE FROM "
+        "CREATE TABLE IF NOT EXISTS PRIMARY KEY VARCHAR(255) NOT NULL DEFAULT LEFT JOIN GROUP BY "
+        "    } else {\n        }\n    }\n}\n\n"
+        "for (int i = 0; i < ; ++i) {\n        if (!= nullptr) {\n            return true;\n"
+        "while (true) {\n    break;\n    continue;\n    switch (case default: "
+        "function (return false;\n} catch (err) {\n  throw new Error(`${ this.props. "
+        // JSON and config
+        "{\n  \"name\": \"version\": \"1.0.0\",\n  \"description\": \"dependencies\": {\n    \""
+        "\"id\": \"type\": \"status\": \"message\": \"data\": [\n    {\n      \"created_at\": \"updated_at\": "
+        "\"error\": \"success\": true, \"items\": \"url\": \"https://\", \"value\": null, false, \"key\": "
+        "\"title\": \"text\": \"count\": \"email\": \"user\": \"token\": \"timestamp\": \"properties\": "
+        "  },\n  {\n  ]\n}\n[section]\nkey=value\nenabled=true\n---\napiVersion: v1\nkind: metadata:\n  name: spec:\n"
+        // URLs and mail
+        "https://www.google.com/search?q= https://stackoverflow.com/questions/ "
+        "https://docs.microsoft.com/en-us/ https://en.wikipedia.org/wiki/ "
+        "https://www.youtube.com/watch?v= https://drive.google.com/ "
+        "mailto: @gmail.com @outlook.com .com/ .org/ .net/ .io/ .html ?id= &amp; utm_source= "
+        "Best regards,\nThanks,\nHi all,\nDear Sir or Madam,\nPlease find attached \n"
+        "Subject: Re: Fwd: From: To: Cc: Sent: "
+        // Prose
+        "However, Therefore, For example, In addition, On the other hand, "
+        "The Monday Tuesday Wednesday Thursday Friday Saturday Sunday January February "
+        "March April May June July August September October November December "
+        "information development government company following including between "
+        "something because through without another should would could there their "
+        "about which these other after first where those being while under "
+        "please thank you will have from with that this they were been what when "
+        "your more some into than them only also just like make know time people "
+        ". The , and the of the in the to the for the on the is a that is it is "
+        "and the of to in is for on that with as was by at are be this from or an ";
+
+    inline uint32_t Read32(const unsigned char* p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline void WriteLength(std::string& out, size_t length) {
+        while (length >= 255) {
+            out += (char)255;
+            length -= 255;
+        }
+        out += (char)length;
+    }
+
+    bool ReadLength(const unsigned char*& p, const unsigned char* end, size_t& length) {
+        unsigned char byte;
+        do {
+            if (p >= end) {
+                return false;
+            }
+            byte = *p++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    void WriteSequence(std::string& out, const unsigned char* literals, size_t literalCount,
+                       size_t offset, size_t matchLength) {
+        // The final sequence has no match (matchLength 0)
+        size_t extraMatch = matchLength > 4 ? matchLength - 4 : 0;
+        unsigned char token = (unsigned char)((literalCount < 15 ? literalCount : 15) << 4);
+        token |= (unsigned char)(extraMatch < 15 ? extraMatch : 15);
+        out += (char)token;
+        if (literalCount >= 15) {
+            WriteLength(out, literalCount - 15);
+        }
+        out.append((const char*)literals, literalCount);
+        if (matchLength == 0) {
+            return;
+        }
+        out += (char)(offset & 0xFF);
+        out += (char)(offset >> 8);
+        if (extraMatch >= 15) {
+            WriteLength(out, extraMatch - 15);
+        }
+    }
+}
+
+const std::string* TextCompressor::GetDictionary(int id) {
+    static const std::string none;
+    static const std::string defaultDictionary(DEFAULT_DICTIONARY_TEXT, sizeof(DEFAULT_DICTIONARY_TEXT) - 1);
+    switch (id) {
+        case 0: return &none;
+        case DEFAULT_DICTIONARY: return &defaultDictionary;
+        default: return nullptr;
+    }
+}
+
+bool TextCompressor::Compress(const std::string& text, CompressedText& compressed) {
+    const std::string& dictionary = *GetDictionary(DEFAULT_DICTIONARY);
+    compressed.data.clear();
+    compressed.size = text.size();
+    compressed.dictionary = DEFAULT_DICTIONARY;
+
+    // The dictionary sits right before the text, so matches can reach into it
+    std::string window;
+    window.reserve(dictionary.size() + text.size());
+    window += dictionary;
+    window += text;
+    const unsigned char* base = (const unsigned char*)window.data();
+    const size_t start = dictionary.size();
+    const size_t end = window.size();
+
+    std::vector<int32_t> table((size_t)1 << HASH_BITS, -1);
+    auto hash = [base](size_t pos) {
+        return (Read32(base + pos) * 2654435761u) >> (32 - HASH_BITS);
+    };
+    for (size_t pos = 0; pos + MIN_MATCH <= start; ++pos) {
+        table[hash(pos)] = (int32_t)pos;
+    }
+
+    std::string& out = compressed.data;
+    out.reserve(text.size() / 2 + 16);
+    size_t anchor = start;
+    size_t pos = start;
+    size_t misses = 0;
+    while (pos + MIN_MATCH <= end) {
+        uint32_t h = hash(pos);
+        int32_t candidate = table[h];
+        table[h] = (int32_t)pos;
+        if (candidate < 0 || pos - candidate > MAX_OFFSET || Read32(base + candidate) != Read32(base + pos)) {
+            // Skip faster through data without matches
+            pos += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+
+        size_t match = (size_t)candidate;
+        while (pos > anchor && match > 0 && base[pos - 1] == base[match - 1]) {
+            pos--;
+            match--;
+        }
+        size_t length = MIN_MATCH;
+        while (pos + length < end && base[match + length] == base[pos + length]) {
+            length++;
+        }
+
+        WriteSequence(out, base + anchor, pos - anchor, pos - match, length);
+        pos += length;
+        anchor = pos;
+        // Positions inside the match are only indexed near its end
+        if (pos - 2 + MIN_MATCH <= end) {
+            table[hash(pos - 2)] = (int32_t)(pos - 2);
+        }
+        if (out.size() >= text.size()) {
+            return false;
+        }
+    }
+    WriteSequence(out, base + anchor, end - anchor, 0, 0);
+    return out.size() < text.size();
+}
+
+bool TextCompressor::Decompress(const CompressedText& compressed, std::string& text, size_t maxBytes) {
+    const std::string* dictionary = GetDictionary(compressed.dictionary);
+    if (!dictionary) {
+        return false;
+    }
+    size_t limit = compressed.size < maxBytes ? compressed.size : maxBytes;
+
+    // Decoded after the dictionary, so offsets into it resolve like any other
+    std::string window;
+    window.reserve(dictionary->size() + limit + 64);
+    window += *dictionary;
+    const size_t start = dictionary->size();
+
+    const unsigned char* p = (const unsigned char*)compressed.data.data();
+    const unsigned char* end = p + compressed.data.size();
+    while (p < end && window.size() - start < limit) {
+        unsigned char token = *p++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLength(p, end, literalCount)) {
+            return false;
+        }
+        if (literalCount > (size_t)(end - p) || window.size() - start + literalCount > compressed.size) {
+            return false;
+        }
+        window.append((const char*)p, literalCount);
+        p += literalCount;
+        if (p == end) {
+            break;
+        }
+
+        if (end - p < 2) {
+            return false;
+        }
+        size_t offset = p[0] | (p[1] << 8);
+        p += 2;
+        size_t length = (token & 0x0F) + MIN_MATCH;
+        if ((token & 0x0F) == 15 && !ReadLength(p, end, length)) {
+            return false;
+        }
+        if (offset == 0 || offset > window.size() || window.size() - start + length > compressed.size) {
+            return false;
+        }
+        size_t from = window.size() - offset;
+        if (offset >= length) {
+            window.append(window, from, length);
+        } else {
+            // Overlapping copy repeats the last offset bytes
+            for (size_t i = 0; i < length; ++i) {
+                window += window[from + i];
+            }
+        }
+    }
+
+    size_t decoded = window.size() - start;
+    if (decoded < limit) {
+        return false;
+    }
+    text.assign(window, start, limit);
+    return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Compressed history content, stored in the history file as is
+struct CompressedText {
+    std::string data;
+    size_t size;             // Uncompressed size in bytes
+    int dictionary;          // Dictionary the data was compressed with, 0 = none
+};
+
+// Compression of history text at rest. LZ77 in the style of an LZ4 block:
+// greedy matching through one hash table of 4-byte sequences, a 64 KB
+// window and byte-aligned sequences, so both directions run at several
+// hundred MB/s. Matching starts with a built-in dictionary of fragments
+// common in clipboard text (prose, code, JSON, logs, URLs) in the window,
+// which lets clips of a few hundred bytes compress as well.
+//
+// Each sequence is a token (literal count << 4 | match length - 4), the
+// extra length bytes of a count of 15 or more (255 = more follow), the
+// literals, the 2-byte little-endian match offset and the extra match
+// length bytes. The last sequence only has literals.
+class TextCompressor {
+public:
+    // Fails if the data would not get smaller
+    static bool Compress(const std::string& text, CompressedText& compressed);
+    // Decodes at most maxBytes; fails on corrupt data or an unknown dictionary
+    static bool Decompress(const CompressedText& compressed, std::string& text, size_t maxBytes = SIZE_MAX);
+
+    // Dictionaries are part of the file format and must never change;
+    // a better one gets a new id
+    static const int DEFAULT_DICTIONARY = 1;
+    static const std::string* GetDictionary(int id);
+
+private:
+    static const size_t MIN_MATCH = 4;
+    static const size_t MAX_OFFSET = 65535;
+    static const int HASH_BITS = 14;
+};
@@ -0,0 +1,86 @@
+#include "TimeIndex.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+void TimeIndex::Add(size_t id, int64_t unixTime) {
+    Remove(id);
+    Key key(unixTime, id);
+    if (m_keys.empty() || m_keys.back() < key) {
+        m_keys.push_back(key);
+    } else {
+        m_keys.insert(std::lower_bound(m_keys.begin(), m_keys.end(), key), key);
+    }
+    m_times[id] = unixTime;
+}
+
+void TimeIndex::Remove(size_t id) {
+    auto existing = m_times.find(id);
+    if (existing == m_times.end()) {
+        return;
+    }
+    Key key(existing->second, id);
+    auto position = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+    if (position != m_keys.end() && *position == key) {
+        m_keys.erase(position);
+    }
+    m_times.erase(existing);
+}
+
+void TimeIndex::Clear() {
+    m_keys.clear();
+    m_times.clear();
+}
+
+size_t TimeIndex::GetMemoryBytes() const {
+    // Hash nodes hold one link
+    return m_keys.capacity() * sizeof(Key) +
+           m_times.size() * (sizeof(std::pair<const size_t, int64_t>) + sizeof(void*)) +
+           m_times.bucket_count() * sizeof(void*);
+}
+
+std::vector<size_t> TimeIndex::Range(int64_t from, int64_t to) const {
+    std::vector<size_t> ids;
+    auto begin = std::lower_bound(m_keys.begin(), m_keys.end(), Key(from, 0));
+    auto end = std::upper_bound(begin, m_keys.end(), Key(to, SIZE_MAX));
+    ids.reserve(end - begin);
+    for (auto it = begin; it != end; ++it) {
+        ids.push_back(it->second);
+    }
+    return ids;
+}
+
+bool TimeIndex::ParseTime(const std::string& text, int64_t& unixTime) {
+    if (text.size() > 1 && text[0] == '@') {
+        char* end = nullptr;
+        long long seconds = strtoll(text.c_str() + 1, &end, 10);
+        unixTime = (int64_t)seconds;
+        return *end == '\0';
+    }
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    char separator = ' ';
+    int length = 0;
+    int fields = sscanf(text.c_str(), "%4d-%2d-%2d%n%c%2d:%2d%n:%2d%n",
+                        &year, &month, &day, &length, &separator, &hour, &minute, &length, &second, &length);
+    if (fields < 3 || (fields > 3 && fields < 6) || (fields > 3 && separator != ' ' && separator != 'T') ||
+        (size_t)length != text.size() || month < 1 || month > 12 || day < 1 || day > 31 ||
+        hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+    std::tm local = {};
+    local.tm_year = year - 1900;
+    local.tm_mon = month - 1;
+    local.tm_mday = day;
+    local.tm_hour = hour;
+    local.tm_min = minute;
+    local.tm_sec = second;
+    local.tm_isdst = -1;
+    std::time_t time = std::mktime(&local);
+    if (time == (std::time_t)-1) {
+        return false;
+    }
+    unixTime = (int64_t)time;
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// History entries ordered by capture time, for range queries such as
+// "everything from yesterday 14:00 to 15:00" in O(log n + k).
+// Kept as one sorted array of (time, id): entries are captured in time
+// order, so adding one is nearly always an append; only imported and
+// merged entries are inserted in the middle.
+class TimeIndex {
+public:
+    typedef std::pair<int64_t, size_t> Key;   // (Unix time, id)
+
+    void Add(size_t id, int64_t unixTime);
+    void Remove(size_t id);
+    void Clear();
+
+    size_t GetSize() const { return m_keys.size(); }
+    size_t GetMemoryBytes() const;
+    // Oldest first
+    const std::vector<Key>& GetKeys() const { return m_keys; }
+    // Ids with from <= time <= to, oldest first
+    std::vector<size_t> Range(int64_t from, int64_t to) const;
+
+    // Local time "YYYY-MM-DD", "YYYY-MM-DD HH:MM" or "YYYY-MM-DD HH:MM:SS"
+    // ('T' may replace the space), or Unix time as "@<seconds>"
+    static bool ParseTime(const std::string& text, int64_t& unixTime);
+
+private:
+    std::vector<Key> m_keys;
+    std::unordered_map<size_t, int64_t> m_times;
+};
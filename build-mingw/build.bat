@@ -35,7 +35,7 @@ REM Set wxWidgets compile and link flags
 set WX_CXXFLAGS=-I"%WX_DIR%\include" -I"%WX_SETUP_DIR%" -D__WXMSW__
 set WX_LIBS=-L"%WX_LIB_DIR%" -lwxmsw33u_core -lwxbase33u -lwxmsw33u_adv -lwxpng -lwxzlib -lwxjpeg -lwxexpat -lwxlexilla
 REM Add Windows system libraries
-set SYS_LIBS=-lkernel32 -luser32 -lgdi32 -lwinspool -lcomdlg32 -ladvapi32 -lshell32 -lole32 -loleaut32 -luuid -lodbc32 -lodbccp32 -lcomctl32 -lrpcrt4 -lwinmm -luxtheme -lgdiplus -lshlwapi -lmsimg32 -loleacc -lversion
+set SYS_LIBS=-lkernel32 -luser32 -lgdi32 -lwinspool -lcomdlg32 -ladvapi32 -lshell32 -lole32 -loleaut32 -luuid -lodbc32 -lodbccp32 -lcomctl32 -lrpcrt4 -lwinmm -luxtheme -lgdiplus -lshlwapi -lmsimg32 -loleacc -lversion -lpsapi -lbcrypt -lcrypt32
 
 echo wxWidgets found and configured
 
@@ -63,6 +63,22 @@ g++ -std=c++17 ^
     -static ^
     -o "%BUILD_DIR%output\ClipboardManager.exe" ^
     "%PROJECT_DIR%\ClipboardManager.cpp" ^
+    "%PROJECT_DIR%\CaptureScheduler.cpp" ^
+    "%PROJECT_DIR%\LazyDataObjects.cpp" ^
+    "%PROJECT_DIR%\HistoryRecord.cpp" ^
+    "%PROJECT_DIR%\SensitiveFilter.cpp" ^
+    "%PROJECT_DIR%\FrecencyIndex.cpp" ^
+    "%PROJECT_DIR%\NearDuplicateIndex.cpp" ^
+    "%PROJECT_DIR%\ClipboardMonitor.cpp" ^
+    "%PROJECT_DIR%\ClipboardTrace.cpp" ^
+    "%PROJECT_DIR%\FakeClipboard.cpp" ^
+    "%PROJECT_DIR%\TextCompressor.cpp" ^
+    "%PROJECT_DIR%\AtomicFile.cpp" ^
+    "%PROJECT_DIR%\FuzzySearch.cpp" ^
+    "%PROJECT_DIR%\ControlServer.cpp" ^
+    "%PROJECT_DIR%\TimeIndex.cpp" ^
+    "%PROJECT_DIR%\StorageCipher.cpp" ^
+    "%PROJECT_DIR%\SpillFile.cpp" ^
     "%BUILD_DIR%temp_resources.o" ^
     %WX_LIBS% %SYS_LIBS%
 
@@ -71,6 +87,52 @@ if %errorlevel% neq 0 (
     exit /b 1
 )
 
+REM Compile the command line client
+echo Compiling clipboard_ctl...
+g++ -std=c++17 ^
+    -I"%PROJECT_DIR%" ^
+    -O2 ^
+    -static-libgcc ^
+    -static-libstdc++ ^
+    -static ^
+    -o "%BUILD_DIR%output\clipboard_ctl.exe" ^
+    "%PROJECT_DIR%\ClipboardCtl.cpp" ^
+    "%PROJECT_DIR%\ControlServer.cpp" ^
+    "%PROJECT_DIR%\FuzzySearch.cpp" ^
+    "%PROJECT_DIR%\TextCompressor.cpp" ^
+    "%PROJECT_DIR%\TimeIndex.cpp" ^
+    "%PROJECT_DIR%\HistoryRecord.cpp" ^
+    -ladvapi32
+
+if %errorlevel% neq 0 (
+    echo Build failed!
+    exit /b 1
+)
+
+REM Compile the history check and repair tool
+echo Compiling clipboard_fsck...
+g++ -std=c++17 ^
+    -I"%PROJECT_DIR%" ^
+    -O2 ^
+    -static-libgcc ^
+    -static-libstdc++ ^
+    -static ^
+    -o "%BUILD_DIR%output\clipboard_fsck.exe" ^
+    "%PROJECT_DIR%\ClipboardFsck.cpp" ^
+    "%PROJECT_DIR%\HistoryRecord.cpp" ^
+    "%PROJECT_DIR%\TextCompressor.cpp" ^
+    "%PROJECT_DIR%\StorageCipher.cpp" ^
+    "%PROJECT_DIR%\AtomicFile.cpp" ^
+    "%PROJECT_DIR%\ControlServer.cpp" ^
+    "%PROJECT_DIR%\FuzzySearch.cpp" ^
+    "%PROJECT_DIR%\TimeIndex.cpp" ^
+    -ladvapi32 -lbcrypt -lcrypt32
+
+if %errorlevel% neq 0 (
+    echo Build failed!
+    exit /b 1
+)
+
 REM Clean up temporary files
 if exist "%BUILD_DIR%temp_resources.o" del "%BUILD_DIR%temp_resources.o"
 
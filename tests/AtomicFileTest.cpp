@@ -0,0 +1,313 @@
+// Fault injection for WriteFileAtomically. The file system calls it makes
+// are wrapped at link time (-Wl,--wrap=open,...), so the test can crash the
+// writer right before any one of them, or make that call fail, and then
+// check that the file holds the complete old or the complete new contents.
+//
+//     atomic_file_test
+//
+// Works in a new directory below the current one and removes it at the end.
+// Exits with 1 on the first violation.
+
+#include "AtomicFile.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    const int CRASHED = 3;              // Exit status of a child stopped by an injected crash
+    const int FINISHED = 4;             // Exit status of a child that got past every step
+    const size_t WRITE_CHUNK = 4096;    // Writes are cut short so the data takes several steps
+
+    std::atomic<int> g_step(0);
+    int g_crashAt = -1;
+    int g_failAt = -1;
+
+    // Counts the call; true if it has to fail
+    bool Step() {
+        int step = g_step++;
+        if (step == g_crashAt) {
+            _exit(CRASHED);
+        }
+        return step == g_failAt;
+    }
+}
+
+extern "C" {
+    int __real_open(const char* path, int flags, ...);
+    ssize_t __real_write(int fd, const void* data, size_t size);
+    int __real_fsync(int fd);
+    int __real_close(int fd);
+    int __real_rename(const char* from, const char* to);
+
+    int __wrap_open(const char* path, int flags, ...) {
+        mode_t mode = 0;
+        if (flags & O_CREAT) {
+            va_list args;
+            va_start(args, flags);
+            mode = (mode_t)va_arg(args, int);
+            va_end(args);
+        }
+        if (Step()) {
+            errno = EIO;
+            return -1;
+        }
+        return __real_open(path, flags, mode);
+    }
+
+    ssize_t __wrap_write(int fd, const void* data, size_t size) {
+        if (Step()) {
+            errno = ENOSPC;
+            return -1;
+        }
+        return __real_write(fd, data, size < WRITE_CHUNK ? size : WRITE_CHUNK);
+    }
+
+    int __wrap_fsync(int fd) {
+        if (Step()) {
+            errno = EIO;
+            return -1;
+        }
+        return __real_fsync(fd);
+    }
+
+    int __wrap_close(int fd) {
+        if (Step()) {
+            __real_close(fd);
+            errno = EIO;
+            return -1;
+        }
+        return __real_close(fd);
+    }
+
+    int __wrap_rename(const char* from, const char* to) {
+        if (Step()) {
+            errno = EIO;
+            return -1;
+        }
+        return __real_rename(from, to);
+    }
+}
+
+namespace {
+    std::string g_directory;
+    std::string g_path;
+
+    std::string MakeContents(char seed, size_t size) {
+        std::string data(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = (char)(seed + i % 23);
+        }
+        return data;
+    }
+
+    // The file system is read through the C++ library, which isn't wrapped
+    bool ReadFile(const std::string& path, std::string& data) {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        std::ostringstream buffer;
+        buffer << in.rdbuf();
+        data = buffer.str();
+        return true;
+    }
+
+    void WriteFile(const std::string& path, const std::string& data) {
+        std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+        out << data;
+    }
+
+    std::vector<std::string> ListTempFiles() {
+        std::vector<std::string> names;
+        DIR* directory = opendir(g_directory.c_str());
+        while (dirent* entry = directory ? readdir(directory) : NULL) {
+            std::string name = entry->d_name;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) {
+                names.push_back(name);
+            }
+        }
+        if (directory) {
+            closedir(directory);
+        }
+        return names;
+    }
+
+    void RemoveTempFiles() {
+        for (const std::string& name : ListTempFiles()) {
+            unlink((g_directory + "/" + name).c_str());
+        }
+    }
+
+    bool Fail(const char* message, int step) {
+        fprintf(stderr, "FAIL: %s (step %d)\n", message, step);
+        return false;
+    }
+
+    // The file must hold one of the two versions, complete
+    bool CheckIntact(const std::string& before, const std::string& after, int step, bool requireNew) {
+        std::string contents;
+        if (!ReadFile(g_path, contents)) {
+            return Fail("the file is gone", step);
+        }
+        if (contents != before && contents != after) {
+            return Fail("the file holds neither the old nor the new contents", step);
+        }
+        if (requireNew && contents != after) {
+            return Fail("the write reported success but the old contents remain", step);
+        }
+        return true;
+    }
+
+    // Number of wrapped calls a successful write makes
+    int CountSteps(const std::string& data) {
+        g_step = 0;
+        bool ok = WriteFileAtomically(g_path, data, true);
+        return ok ? g_step.load() : -1;
+    }
+
+    bool TestStaleTempFiles(const std::string& before, const std::string& after) {
+        // Temp files a crashed process left under the names this one picks first
+        std::string stale = g_path + "." + std::to_string((unsigned long)getpid()) + ".";
+        WriteFile(stale + "0.tmp", "stale");
+        WriteFile(stale + "1.tmp", "stale");
+        WriteFile(g_path, before);
+        if (!WriteFileAtomically(g_path, after, true) || !CheckIntact(before, after, -1, true)) {
+            return Fail("names of stale temp files are not skipped", -1);
+        }
+        std::string contents;
+        if (!ReadFile(stale + "0.tmp", contents) || contents != "stale") {
+            return Fail("a stale temp file was overwritten", -1);
+        }
+        RemoveTempFiles();
+        printf("stale temp files skipped\n");
+        return true;
+    }
+
+    bool TestCrashes(const std::string& before, const std::string& after, int steps) {
+        for (int crashAt = 0; crashAt <= steps; ++crashAt) {
+            WriteFile(g_path, before);
+            pid_t child = fork();
+            if (child == 0) {
+                g_step = 0;
+                g_crashAt = crashAt;
+                bool ok = WriteFileAtomically(g_path, after, true);
+                _exit(ok ? FINISHED : 1);
+            }
+            int status = 0;
+            if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status)) {
+                return Fail("the writer could not be run", crashAt);
+            }
+            int code = WEXITSTATUS(status);
+            if (code != CRASHED && code != FINISHED) {
+                return Fail("the write failed without an injected fault", crashAt);
+            }
+            if (!CheckIntact(before, after, crashAt, code == FINISHED)) {
+                return false;
+            }
+            RemoveTempFiles();
+        }
+        printf("crash before each of %d steps: intact\n", steps);
+        return true;
+    }
+
+    bool TestFailures(const std::string& before, const std::string& after, int steps) {
+        for (int failAt = 0; failAt < steps; ++failAt) {
+            WriteFile(g_path, before);
+            g_step = 0;
+            g_failAt = failAt;
+            bool ok = WriteFileAtomically(g_path, after, true);
+            g_failAt = -1;
+            if (!CheckIntact(before, after, failAt, ok)) {
+                return false;
+            }
+            if (!ListTempFiles().empty()) {
+                return Fail("a failed write left its temp file behind", failAt);
+            }
+        }
+        printf("failure of each of %d steps: intact, no temp file left\n", steps);
+        return true;
+    }
+
+    // Two writers replacing the same file at once, as the manager and
+    // clipboard_fsck --repair may; each write must land whole
+    bool TestConcurrentWriters() {
+        const int WRITES = 200;
+        std::vector<std::string> versions;
+        for (int i = 0; i < 2 * WRITES; ++i) {
+            versions.push_back(MakeContents((char)('a' + i % 26), 20000 + i));
+        }
+        WriteFile(g_path, versions[0]);
+        std::atomic<bool> failed(false);
+        std::atomic<int> running(2);
+        auto writer = [&](int first) {
+            for (int i = first; i < 2 * WRITES; i += 2) {
+                if (!WriteFileAtomically(g_path, versions[i], false)) {
+                    failed = true;
+                }
+            }
+            running--;
+        };
+        std::thread a(writer, 0);
+        std::thread b(writer, 1);
+        bool torn = false;
+        while (running > 0 && !torn) {
+            std::string contents;
+            if (ReadFile(g_path, contents)) {
+                size_t index = contents.size() - 20000;
+                torn = index >= versions.size() || contents != versions[index];
+            }
+        }
+        a.join();
+        b.join();
+        if (failed) {
+            return Fail("a concurrent write failed", -1);
+        }
+        if (torn) {
+            return Fail("a reader saw a mix of two writes", -1);
+        }
+        if (!ListTempFiles().empty()) {
+            return Fail("concurrent writes left temp files behind", -1);
+        }
+        printf("%d concurrent writes: intact\n", 2 * WRITES);
+        return true;
+    }
+}
+
+int main() {
+    char directory[] = "atomic_file_test.XXXXXX";
+    if (!mkdtemp(directory)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    g_directory = directory;
+    g_path = g_directory + "/history.txt";
+
+    std::string before = MakeContents('A', 50000);
+    std::string after = MakeContents('a', 60000);
+    WriteFile(g_path, before);
+    int steps = CountSteps(after);
+    bool ok = steps > 0 || Fail("a write without faults failed", -1);
+    ok = ok && TestStaleTempFiles(before, after);
+    ok = ok && TestCrashes(before, after, steps);
+    ok = ok && TestFailures(before, after, steps);
+    ok = ok && TestConcurrentWriters();
+
+    RemoveTempFiles();
+    unlink(g_path.c_str());
+    rmdir(directory);
+    return ok ? 0 : 1;
+}
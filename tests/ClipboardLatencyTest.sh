@@ -0,0 +1,92 @@
+#!/bin/sh
+# End-to-end capture latency on a virtual X server: copies text with xclip
+# and measures how long the manager takes to list it through clipboard_ctl.
+# Then restores an entry and copies again right away: the restore must not
+# be captured as a new entry, and the copy after it must be.
+#
+#     ClipboardLatencyTest.sh <ClipboardManager> <clipboard_ctl> [copies]
+#
+# Prints the best, median and worst latency in ms. Needs Xvfb and xclip;
+# exits with 77 (skipped) without them.
+
+manager=$1
+ctl=$2
+copies=${3:-20}
+TIMEOUT_MS=5000
+
+if ! command -v Xvfb >/dev/null 2>&1 || ! command -v xclip >/dev/null 2>&1; then
+    echo "Xvfb or xclip not found, skipping"
+    exit 77
+fi
+
+now_ms() {
+    echo $(($(date +%s%N) / 1000000))
+}
+
+fail() {
+    echo "FAIL: $*" >&2
+    exit 1
+}
+
+# Waits until clipboard_ctl lists the text as the newest entry
+wait_for_entry() {
+    start=$(now_ms)
+    while ! "$ctl" list 1 2>/dev/null | grep -qF "$1"; do
+        if [ $(($(now_ms) - start)) -gt $TIMEOUT_MS ]; then
+            return 1
+        fi
+    done
+}
+
+# History, settings and control socket of a manager of our own
+work=$(mktemp -d)
+mkdir -m 700 "$work/run"
+export HOME="$work"
+export XDG_RUNTIME_DIR="$work/run"
+cd "$work" || exit 1
+
+Xvfb -displayfd 3 -nolisten tcp 3>"$work/display" 2>/dev/null &
+xvfb=$!
+trap 'kill $manager_pid $xvfb 2>/dev/null; wait 2>/dev/null; rm -rf "$work"' EXIT
+start=$(now_ms)
+until [ -s "$work/display" ]; do
+    [ $(($(now_ms) - start)) -gt $TIMEOUT_MS ] && fail "Xvfb did not start"
+    sleep 0.05
+done
+export DISPLAY=":$(cat "$work/display")"
+
+"$manager" >/dev/null 2>&1 &
+manager_pid=$!
+start=$(now_ms)
+until "$ctl" list 1 >/dev/null 2>&1; do
+    [ $(($(now_ms) - start)) -gt $TIMEOUT_MS ] && fail "the manager did not start"
+    sleep 0.05
+done
+
+latencies=""
+i=1
+while [ $i -le "$copies" ]; do
+    text="latency test $i $$"
+    start=$(now_ms)
+    printf '%s' "$text" | xclip -selection clipboard
+    wait_for_entry "$text" || fail "copy $i was not captured"
+    latencies="$latencies $(($(now_ms) - start))"
+    i=$((i + 1))
+done
+set -- $(printf '%s\n' $latencies | sort -n)
+median=$(eval echo \${$((($# + 1) / 2))})
+eval worst=\${$#}
+echo "capture latency over $# copies: best $1 ms, median $median ms, worst $worst ms"
+
+count=$("$ctl" list 1000 | wc -l)
+id=$("$ctl" list "$copies" | tail -n 1 | cut -d'|' -f1)
+"$ctl" restore "$id" >/dev/null || fail "restore $id failed"
+start=$(now_ms)
+until [ "$(xclip -o -selection clipboard 2>/dev/null)" = "latency test 1 $$" ]; do
+    [ $(($(now_ms) - start)) -gt $TIMEOUT_MS ] && fail "entry $id was not restored"
+done
+text="latency test after restore $$"
+printf '%s' "$text" | xclip -selection clipboard
+wait_for_entry "$text" || fail "the copy right after a restore was not captured"
+[ "$("$ctl" list 1000 | wc -l)" -eq $((count + 1)) ] || fail "the restore was captured as a new entry"
+echo "restore not captured, copy after it captured"
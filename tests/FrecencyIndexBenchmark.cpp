@@ -0,0 +1,169 @@
+// Frecency ranking of the quick-paste picker: 100k entries, each capture or
+// restore one RecordUse, and the picker reading the top entries.
+//
+//     frecency_index_benchmark [--repeat <n>]
+//
+// Prints the time per update (random entries used at increasing times, as
+// captures and restores arrive) and per GetTop of the picker's 10 and of
+// 100 entries. Checks the ranking against scores summed directly (decayed
+// to a common time) and GetTop against a full sort, including after
+// SetScore and Remove. Exits with 1 on a wrong ranking, or if reading the
+// top entries takes more than the picker's 16 ms frame budget.
+
+#include "FrecencyIndex.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    const size_t ENTRY_COUNT = 100000;
+    const size_t UPDATE_COUNT = 100000;
+    const size_t PICKER_COUNT = 10;          // Default of QuickPaste/Count
+    const double PICKER_BUDGET_MS = 16.0;    // Opens slower than this are logged by the manager
+    const int64_t START_TIME = 1772000000;   // 2026-02-25
+
+    // Deterministic, so runs are comparable
+    uint32_t NextRandom(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    bool Fail(const char* message) {
+        fprintf(stderr, "FAIL: %s\n", message);
+        return false;
+    }
+
+    struct Use {
+        size_t id;
+        int64_t time;
+    };
+
+    // Recent entries are used more often, as in a real history
+    std::vector<Use> MakeUses(size_t count, size_t entries, uint32_t seed) {
+        uint32_t state = seed;
+        std::vector<Use> uses;
+        int64_t time = START_TIME;
+        for (size_t i = 0; i < count; ++i) {
+            time += NextRandom(state) % 600;
+            uint32_t pick = NextRandom(state);
+            size_t id = pick % 4 == 0 ? pick / 4 % entries : entries - 1 - pick / 4 % (entries / 100 + 1);
+            uses.push_back(Use{ id + 1, time });
+        }
+        return uses;
+    }
+
+    // The top entries by a full sort: higher score first, then the newer id
+    std::vector<size_t> SortedTop(const FrecencyIndex& index, const std::vector<size_t>& ids, size_t count) {
+        std::vector<size_t> sorted = ids;
+        std::sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) {
+            double scoreA = index.GetScore(a);
+            double scoreB = index.GetScore(b);
+            return scoreA != scoreB ? scoreA > scoreB : a > b;
+        });
+        sorted.resize(std::min(count, sorted.size()));
+        return sorted;
+    }
+
+    // Sums of 2^((time - now) / half-life) must rank the entries like the index
+    bool CheckRanking() {
+        std::vector<Use> uses = MakeUses(20000, 500, 11);
+        FrecencyIndex index;
+        std::vector<double> sums(501, 0.0);
+        int64_t now = uses.back().time;
+        for (const Use& use : uses) {
+            index.RecordUse(use.id, use.time);
+            sums[use.id] += std::exp2((double)(use.time - now) / FrecencyIndex::HALF_LIFE_SECONDS);
+        }
+        std::vector<size_t> ids;
+        for (size_t id = 1; id < sums.size(); ++id) {
+            if (index.Contains(id)) {
+                ids.push_back(id);
+            }
+        }
+        std::vector<size_t> top = index.GetTop(ids.size());
+        if (top != SortedTop(index, ids, ids.size())) {
+            return Fail("GetTop differs from a full sort");
+        }
+        for (size_t i = 1; i < top.size(); ++i) {
+            // Only sums that differ by more than rounding must keep their order
+            if (sums[top[i]] > sums[top[i - 1]] * (1 + 1e-6)) {
+                return Fail("an entry with less frecency ranks higher");
+            }
+        }
+
+        index.SetScore(top.back(), index.GetScore(top.front()) + 1);
+        index.Remove(top[1]);
+        ids.erase(std::find(ids.begin(), ids.end(), top[1]));
+        if (index.GetTop(1).front() != top.back() || index.Contains(top[1]) ||
+            index.GetTop(ids.size()) != SortedTop(index, ids, ids.size())) {
+            return Fail("SetScore or Remove left the ranking wrong");
+        }
+        printf("ranking of %lu entries: matches decayed sums\n", (unsigned long)ids.size());
+        return true;
+    }
+
+    template <typename Function>
+    double BestMs(int repeat, Function function) {
+        double best = 1e30;
+        for (int i = 0; i < repeat; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            function();
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv) {
+    int repeat = 5;
+    if (argc == 3 && strcmp(argv[1], "--repeat") == 0) {
+        repeat = std::max(atoi(argv[2]), 1);
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: frecency_index_benchmark [--repeat <n>]\n");
+        return 2;
+    }
+
+    if (!CheckRanking()) {
+        return 1;
+    }
+
+    // Every entry used once, then the updates measured on the full index
+    FrecencyIndex index;
+    for (size_t id = 1; id <= ENTRY_COUNT; ++id) {
+        index.RecordUse(id, START_TIME - (int64_t)(ENTRY_COUNT - id) * 60);
+    }
+    std::vector<Use> uses = MakeUses(UPDATE_COUNT, ENTRY_COUNT, 12345);
+    double updateMs = BestMs(repeat, [&]() {
+        for (const Use& use : uses) {
+            index.RecordUse(use.id, use.time);
+        }
+    });
+
+    const size_t READS = 1000;
+    size_t checksum = 0;
+    double pickerMs = BestMs(repeat, [&]() {
+        for (size_t i = 0; i < READS; ++i) {
+            checksum += index.GetTop(PICKER_COUNT).front();
+        }
+    }) / READS;
+    double hundredMs = BestMs(repeat, [&]() {
+        for (size_t i = 0; i < READS; ++i) {
+            checksum += index.GetTop(100).back();
+        }
+    }) / READS;
+
+    printf("%lu entries: %.2f us per update, GetTop(%lu) %.2f us, GetTop(100) %.2f us (%.1f MB, checksum %lu)\n",
+           (unsigned long)index.GetSize(), updateMs * 1000 / UPDATE_COUNT, (unsigned long)PICKER_COUNT,
+           pickerMs * 1000, hundredMs * 1000, index.GetMemoryBytes() / 1048576.0, (unsigned long)checksum);
+    if (pickerMs > PICKER_BUDGET_MS) {
+        fprintf(stderr, "FAIL: reading the picker's entries takes %.2f ms, over %.0f ms\n", pickerMs, PICKER_BUDGET_MS);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+// Fuzzy search over a 100k-entry history: the time from Search to the
+// final results on one worker thread and on the default pool, the cost of
+// adding the entries, and the prefilter alone (a query no entry can match).
+//
+//     fuzzy_search_benchmark [--repeat <n>]
+//
+// Checks the streamed results of every query against ScoreQuery run over
+// all entries, that a new query or Cancel stops the old one before its
+// final results, and the ordering rules of Score. Exits with 1 on a wrong
+// result or ordering.
+
+#include "FuzzySearch.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+    const size_t ENTRY_COUNT = 100000;
+    const size_t MAX_RESULTS = 50;
+
+    const char* QUERIES[] = {
+        "manager",          // Common word
+        "hist clip",        // Two terms
+        "wxLogMessage",     // Smart case
+        "fch api pg",       // Scattered characters
+        "\xc2\xa7",         // Not in any entry: only the prefilter runs
+    };
+
+    // Deterministic, so runs are comparable
+    uint32_t NextRandom(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    bool Fail(const char* message) {
+        fprintf(stderr, "FAIL: %s\n", message);
+        return false;
+    }
+
+    // Short lines of prose, code and commands, as copied text is
+    std::vector<std::string> MakeEntries() {
+        static const char* WORDS[] = {
+            "the", "clipboard", "manager", "keeps", "a", "history", "of", "everything", "you", "copy",
+            "meeting", "notes", "from", "Tuesday", "review", "draft", "before", "Friday", "shipped", "entries",
+            "wxLogMessage(wxT(\"Loaded\"));", "std::string", "size_t", "return", "for", "(int", "i", "=", "0;",
+            "git", "push", "origin", "docker", "run", "-it", "SELECT", "FROM", "users", "WHERE", "fetch(`/api/v1/items?page=",
+        };
+        uint32_t state = 97531;
+        std::vector<std::string> entries;
+        for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+            std::string text;
+            size_t words = 4 + NextRandom(state) % 60;
+            for (size_t w = 0; w < words; ++w) {
+                text += WORDS[NextRandom(state) % (sizeof(WORDS) / sizeof(WORDS[0]))];
+                text += NextRandom(state) % 10 == 0 ? "\n" : " ";
+            }
+            entries.push_back(text);
+        }
+        return entries;
+    }
+
+    // Waits for the final results of one generation and records whether
+    // any other generation reported final results
+    class Collector {
+    public:
+        FuzzySearch::ResultCallback GetCallback() {
+            return [this](uint64_t generation, const std::vector<FuzzySearch::Result>& results, bool done) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!done) {
+                    return;
+                }
+                m_finished.push_back(generation);
+                m_results = results;
+                m_changed.notify_all();
+            };
+        }
+
+        bool WaitFor(uint64_t generation, int timeoutMs) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            return m_changed.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&] {
+                return std::find(m_finished.begin(), m_finished.end(), generation) != m_finished.end();
+            });
+        }
+
+        bool Finished(uint64_t generation) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return std::find(m_finished.begin(), m_finished.end(), generation) != m_finished.end();
+        }
+
+        std::vector<FuzzySearch::Result> GetResults() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_results;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::vector<uint64_t> m_finished;
+        std::vector<FuzzySearch::Result> m_results;
+    };
+
+    // Best first, then the entry added last, as the search ranks them
+    std::vector<FuzzySearch::Result> ScoreAll(const std::vector<std::string>& entries, const std::string& query) {
+        std::vector<FuzzySearch::Result> results;
+        for (size_t i = entries.size(); i-- > 0;) {
+            int score = FuzzySearch::ScoreQuery(query, entries[i]);
+            if (score >= 0) {
+                results.push_back(FuzzySearch::Result{ i, score });
+            }
+        }
+        std::stable_sort(results.begin(), results.end(),
+                         [](const FuzzySearch::Result& a, const FuzzySearch::Result& b) { return a.score > b.score; });
+        results.resize(std::min(results.size(), MAX_RESULTS));
+        return results;
+    }
+
+    bool SameResults(const std::vector<FuzzySearch::Result>& a, const std::vector<FuzzySearch::Result>& b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (a[i].id != b[i].id || a[i].score != b[i].score) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool TestScoreOrdering() {
+        struct Better {
+            const char* query;
+            const char* better;
+            const char* worse;
+            const char* rule;
+        };
+        const Better ORDERINGS[] = {
+            { "clip", "clipboard", "cxlxixp", "consecutive characters score higher" },
+            { "board", "clip board", "clipboard", "a match at a word start scores higher" },
+            { "cb", "ClipBoard", "clipboard", "a camel case hump scores higher" },
+            { "ab", "a.....ab", "a......b", "the shortest match is scored" },
+        };
+        for (const Better& ordering : ORDERINGS) {
+            if (FuzzySearch::Score(ordering.query, ordering.better, false) <=
+                FuzzySearch::Score(ordering.query, ordering.worse, false)) {
+                return Fail(ordering.rule);
+            }
+        }
+        if (FuzzySearch::Score("clpx", "clipboard", false) != -1 || FuzzySearch::Score("pilc", "clipboard", false) != -1) {
+            return Fail("characters missing or out of order matched");
+        }
+        if (FuzzySearch::ScoreQuery("Clip", "clipboard") != -1 || FuzzySearch::ScoreQuery("clip", "CLIPBOARD") < 0) {
+            return Fail("smart case is wrong");
+        }
+        if (FuzzySearch::ScoreQuery("clip mgr", "clipboard manager") !=
+                FuzzySearch::Score("clip", "clipboard manager", false) + FuzzySearch::Score("mgr", "clipboard manager", false) ||
+            FuzzySearch::ScoreQuery("clip xyz", "clipboard manager") != -1) {
+            return Fail("terms are not scored each");
+        }
+        if ((FuzzySearch::QueryMask("Clip 42") & ~FuzzySearch::CharacterMask("clipboard 4 2")) != 0 ||
+            (FuzzySearch::QueryMask("clip 42") & ~FuzzySearch::CharacterMask("clipboard")) == 0) {
+            return Fail("the character masks are wrong");
+        }
+        printf("score ordering: ok\n");
+        return true;
+    }
+
+    // A new query or Cancel must stop the running one before its final results
+    bool TestCancellation(FuzzySearch& search) {
+        Collector collector;
+        uint64_t first = search.Search("e", MAX_RESULTS, collector.GetCallback());
+        uint64_t second = search.Search("manager", MAX_RESULTS, collector.GetCallback());
+        if (!collector.WaitFor(second, 10000)) {
+            return Fail("the second query did not finish");
+        }
+        uint64_t third = search.Search("e", MAX_RESULTS, collector.GetCallback());
+        search.Cancel();
+        // Longer than the query would take
+        collector.WaitFor(third, 1000);
+        if (collector.Finished(first) || collector.Finished(third)) {
+            return Fail("a replaced or cancelled query reported final results");
+        }
+        printf("replaced and cancelled queries: stopped\n");
+        return true;
+    }
+
+    template <typename Function>
+    double BestMs(int repeat, Function function) {
+        double best = 1e30;
+        for (int i = 0; i < repeat; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            function();
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv) {
+    int repeat = 5;
+    if (argc == 3 && strcmp(argv[1], "--repeat") == 0) {
+        repeat = std::max(atoi(argv[2]), 1);
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: fuzzy_search_benchmark [--repeat <n>]\n");
+        return 2;
+    }
+    if (!TestScoreOrdering()) {
+        return 1;
+    }
+
+    std::vector<std::string> entries = MakeEntries();
+    FuzzySearch oneThread(1);
+    FuzzySearch pool;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        oneThread.Add(i, entries[i]);
+    }
+    double addMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        pool.Add(i, entries[i]);
+    }
+    printf("%lu entries added in %.0f ms (%.1f MB)\n", (unsigned long)entries.size(), addMs,
+           oneThread.GetMemoryBytes() / 1048576.0);
+
+    printf("%-16s %8s %10s %10s\n", "query", "results", "1 thread", "pool");
+    for (const char* query : QUERIES) {
+        std::vector<FuzzySearch::Result> expected = ScoreAll(entries, query);
+        double ms[2];
+        FuzzySearch* searches[2] = { &oneThread, &pool };
+        for (int s = 0; s < 2; ++s) {
+            Collector collector;
+            bool finished = true;
+            ms[s] = BestMs(repeat, [&]() {
+                finished = collector.WaitFor(searches[s]->Search(query, MAX_RESULTS, collector.GetCallback()), 10000) && finished;
+            });
+            if (!finished || !SameResults(collector.GetResults(), expected)) {
+                fprintf(stderr, "FAIL: results of \"%s\" differ from scoring every entry\n", query);
+                return 1;
+            }
+        }
+        printf("%-16s %8lu %7.2f ms %7.2f ms\n", strcmp(query, QUERIES[4]) == 0 ? "(prefilter only)" : query,
+               (unsigned long)expected.size(), ms[0], ms[1]);
+    }
+    return TestCancellation(oneThread) ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+// Scan throughput of SensitiveFilter on 1 MB of prose, base64 and source
+// code, with the default keywords. The target is below 1 ms per MB.
+//
+//     sensitive_filter_benchmark [--repeat <n>]
+//
+// Prints the best and median time per MB for each input and the number of
+// matches; prose must not produce any. Exits with 1 if it does, or if the
+// best time of an input is above the target, which holds for an optimized
+// build (the default build type is Release).
+
+#include "SensitiveFilter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+    const size_t INPUT_BYTES = 1 << 20;
+    const double TARGET_MS_PER_MB = 1.0;
+
+    // Deterministic, so runs are comparable
+    uint32_t NextRandom(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // Sentences from a fixed vocabulary, including words that are keywords
+    // on their own ("password", "secret") as they appear in ordinary text
+    std::string MakeProse() {
+        static const char* WORDS[] = {
+            "the", "clipboard", "manager", "keeps", "a", "history", "of", "everything", "you", "copy",
+            "and", "lets", "restore", "it", "later", "change", "your", "password", "every", "few",
+            "months", "secret", "to", "good", "writing", "is", "rewriting", "meeting", "notes", "from",
+            "Tuesday", "were", "shared", "with", "team", "please", "review", "draft", "before", "Friday",
+            "API", "documentation", "explains", "how", "tokens", "are", "issued", "secretary", "passwords",
+            "differ", "between", "accounts", "in", "2024", "we", "shipped", "version", "3.2", "on", "time"
+        };
+        const size_t count = sizeof(WORDS) / sizeof(WORDS[0]);
+        uint32_t state = 12345;
+        std::string text;
+        size_t sentence = 0;
+        while (text.size() < INPUT_BYTES) {
+            const char* word = WORDS[NextRandom(state) % count];
+            if (sentence == 0 && !text.empty()) {
+                text += ' ';
+            }
+            text += word;
+            if (++sentence >= 8 + NextRandom(state) % 10) {
+                text += NextRandom(state) % 5 == 0 ? ".\n" : ".";
+                sentence = 0;
+            } else {
+                text += NextRandom(state) % 9 == 0 ? ", " : " ";
+            }
+        }
+        text.resize(INPUT_BYTES);
+        return text;
+    }
+
+    // MIME-style base64 lines of 76 characters
+    std::string MakeBase64() {
+        static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        uint32_t state = 67890;
+        std::string text;
+        while (text.size() < INPUT_BYTES) {
+            for (int i = 0; i < 76; ++i) {
+                text += ALPHABET[NextRandom(state) % 64];
+            }
+            text += "\r\n";
+        }
+        text.resize(INPUT_BYTES);
+        return text;
+    }
+
+    std::string MakeSource() {
+        static const char* LINES[] = {
+            "    for (size_t i = 0; i < entries.size(); ++i) {\n",
+            "        if (entries[i].id == id) {\n",
+            "            return (int)i;\n",
+            "        }\n",
+            "    }\n",
+            "    wxLogMessage(wxT(\"Loaded %lu entries\"), (unsigned long)m_entries.size());\n",
+            "    std::string line = FormatHistoryRecord(record);\n",
+            "    // The secret is the value following the keyword\n",
+            "    config.Read(wxT(\"/Storage/Encryption\"), &m_settings.encryption, wxT(\"none\"));\n",
+        };
+        const size_t count = sizeof(LINES) / sizeof(LINES[0]);
+        uint32_t state = 24680;
+        std::string text;
+        while (text.size() < INPUT_BYTES) {
+            text += LINES[NextRandom(state) % count];
+        }
+        text.resize(INPUT_BYTES);
+        return text;
+    }
+
+    // Returns the best time per MB
+    double Run(const SensitiveFilter& filter, const char* name, const std::string& text, int repeat, size_t& matches) {
+        std::vector<double> times;
+        for (int i = 0; i < repeat; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            matches = filter.Scan(text).size();
+            times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(times.begin(), times.end());
+        double perMb = (double)(1 << 20) / text.size();
+        printf("%-8s best %.3f ms/MB, median %.3f ms/MB, %lu matches\n", name, times.front() * perMb,
+               times[times.size() / 2] * perMb, (unsigned long)matches);
+        return times.front() * perMb;
+    }
+}
+
+int main(int argc, char** argv) {
+    int repeat = 50;
+    if (argc == 3 && strcmp(argv[1], "--repeat") == 0) {
+        repeat = std::max(atoi(argv[2]), 1);
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: sensitive_filter_benchmark [--repeat <n>]\n");
+        return 2;
+    }
+
+    SensitiveFilter filter;
+    const char* names[] = { "prose", "base64", "source" };
+    std::string inputs[] = { MakeProse(), MakeBase64(), MakeSource() };
+    int result = 0;
+    for (int i = 0; i < 3; ++i) {
+        size_t matches = 0;
+        double best = Run(filter, names[i], inputs[i], repeat, matches);
+        if (i == 0 && matches != 0) {
+            fprintf(stderr, "prose produced %lu matches, expected none\n", (unsigned long)matches);
+            result = 1;
+        }
+        if (best > TARGET_MS_PER_MB) {
+            fprintf(stderr, "%s took %.3f ms/MB, the target is %.1f\n", names[i], best, TARGET_MS_PER_MB);
+            result = 1;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,194 @@
+// History encryption: what sealing adds to a save. Seals records of typical
+// sizes (a short clip, a paragraph, a source file, a large paste) and a
+// history of 1000 mixed entries the way WriteSnapshot does (each formatted
+// record sealed with its time and type as associated data), then writes it
+// with WriteFileAtomically, and compares that with the plaintext save.
+//
+//     storage_cipher_benchmark [--repeat <n>]
+//
+// Prints the seal time and throughput per record size, then the save time
+// plaintext and sealed and the difference. The file is written without
+// fsync, so the difference is not hidden behind the disk. Works in a new
+// directory below the current one and removes it at the end. Exits with 1
+// if a sealed record does not open to the plaintext one.
+
+#include "AtomicFile.h"
+#include "HistoryRecord.h"
+#include "StorageCipher.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    const size_t ENTRY_COUNT = 1000;
+    const size_t SEALS_PER_SIZE = 4 * 1048576;   // Bytes sealed per record size and run
+
+    struct RecordSize {
+        const char* name;
+        size_t bytes;
+    };
+    const RecordSize RECORD_SIZES[] = {
+        { "clip", 80 }, { "paragraph", 1024 }, { "source", 16384 }, { "paste", 262144 },
+    };
+
+    // Deterministic, so runs are comparable
+    uint32_t NextRandom(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    std::string MakeText(uint32_t& state, size_t bytes) {
+        static const char* WORDS[] = {
+            "the", "clipboard", "manager", "keeps", "history", "of", "copy", "restore", "return", "entries",
+            "size_t", "std::string", "if", "for", "(", ")", "{", "}", ";", "\n",
+        };
+        std::string text;
+        while (text.size() < bytes) {
+            text += WORDS[NextRandom(state) % (sizeof(WORDS) / sizeof(WORDS[0]))];
+            text += ' ';
+        }
+        text.resize(bytes);
+        return text;
+    }
+
+    // Mostly clips and paragraphs, some source files, a rare large paste
+    std::vector<HistoryRecord> MakeHistory() {
+        uint32_t state = 86420;
+        std::vector<HistoryRecord> records;
+        for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+            uint32_t kind = NextRandom(state) % 100;
+            size_t bytes = kind < 50 ? 20 + NextRandom(state) % 200
+                         : kind < 85 ? 200 + NextRandom(state) % 2000
+                         : kind < 99 ? 2000 + NextRandom(state) % 30000
+                         : 100000 + NextRandom(state) % 200000;
+            HistoryRecord record;
+            char timestamp[32];
+            snprintf(timestamp, sizeof(timestamp), "2026-03-01 %02u:%02u:%02u", (unsigned)(i / 3600 % 24),
+                     (unsigned)(i / 60 % 60), (unsigned)(i % 60));
+            record.timestamp = timestamp;
+            record.type = "Text";
+            record.content = MakeText(state, bytes);
+            records.push_back(record);
+        }
+        return records;
+    }
+
+    // The history file as WriteSnapshot builds it
+    std::string FormatHistory(const std::vector<HistoryRecord>& records, const StorageCipher* cipher) {
+        std::string data;
+        for (const HistoryRecord& record : records) {
+            if (cipher) {
+                data += FormatHistoryRecord(MakeSealedRecord(record, cipher->Seal(FormatHistoryRecord(record),
+                                                                                  GetSealedRecordAssociatedData(record))));
+            } else {
+                data += FormatHistoryRecord(record);
+            }
+            data += '\n';
+        }
+        return data;
+    }
+
+    // Every line must open to the plaintext record
+    bool OpensToPlaintext(const std::string& data, const std::vector<HistoryRecord>& records, const StorageCipher& cipher) {
+        size_t start = 0;
+        for (const HistoryRecord& record : records) {
+            size_t end = data.find('\n', start);
+            HistoryRecord sealed;
+            std::string line;
+            HistoryRecord opened;
+            if (end == std::string::npos || !ParseHistoryRecord(data.substr(start, end - start), sealed) ||
+                !cipher.Open(sealed.content, GetSealedRecordAssociatedData(sealed), line) ||
+                !ParseOpenedRecord(sealed, line, opened) || opened.content != record.content) {
+                return false;
+            }
+            start = end + 1;
+        }
+        return true;
+    }
+
+    template <typename Function>
+    double BestMs(int repeat, Function function) {
+        double best = 1e30;
+        for (int i = 0; i < repeat; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            function();
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv) {
+    int repeat = 10;
+    if (argc == 3 && strcmp(argv[1], "--repeat") == 0) {
+        repeat = std::max(atoi(argv[2]), 1);
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: storage_cipher_benchmark [--repeat <n>]\n");
+        return 2;
+    }
+
+    StorageCipher cipher;
+    if (!cipher.UseEphemeralKey()) {
+        fprintf(stderr, "no random key\n");
+        return 1;
+    }
+    printf("ChaCha20: %s\n", StorageCipher::GetImplementation());
+
+    uint32_t state = 97531;
+    printf("%-10s %8s %10s %8s\n", "record", "bytes", "us/seal", "MB/s");
+    for (const RecordSize& size : RECORD_SIZES) {
+        std::string text = MakeText(state, size.bytes);
+        size_t seals = std::max<size_t>(SEALS_PER_SIZE / size.bytes, 1);
+        double ms = BestMs(repeat, [&]() {
+            for (size_t i = 0; i < seals; ++i) {
+                cipher.Seal(text, "2026-03-01 10:00:00|Text");
+            }
+        });
+        printf("%-10s %8lu %10.2f %8.0f\n", size.name, (unsigned long)size.bytes, ms * 1000 / seals,
+               size.bytes * seals / 1048576.0 / ms * 1000);
+    }
+
+    std::vector<HistoryRecord> records = MakeHistory();
+    if (!OpensToPlaintext(FormatHistory(records, &cipher), records, cipher)) {
+        fprintf(stderr, "a sealed record does not open to its plaintext\n");
+        return 1;
+    }
+
+    char directory[] = "storage_cipher_benchmark.XXXXXX";
+    if (!mkdtemp(directory)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string path = std::string(directory) + "/history.txt";
+    size_t plainBytes = 0;
+    size_t sealedBytes = 0;
+    bool written = true;
+    double plainMs = BestMs(repeat, [&]() {
+        std::string data = FormatHistory(records, NULL);
+        plainBytes = data.size();
+        written = WriteFileAtomically(path, data, false) && written;
+    });
+    double sealedMs = BestMs(repeat, [&]() {
+        std::string data = FormatHistory(records, &cipher);
+        sealedBytes = data.size();
+        written = WriteFileAtomically(path, data, false) && written;
+    });
+    remove(path.c_str());
+    rmdir(directory);
+    if (!written) {
+        fprintf(stderr, "the history file could not be written\n");
+        return 1;
+    }
+    printf("save of %lu entries: plaintext %.2f ms (%lu bytes), sealed %.2f ms (%lu bytes), +%.2f ms (+%.0f%%)\n",
+           (unsigned long)records.size(), plainMs, (unsigned long)plainBytes, sealedMs, (unsigned long)sealedBytes,
+           sealedMs - plainMs, 100.0 * (sealedMs - plainMs) / plainMs);
+    return 0;
+}
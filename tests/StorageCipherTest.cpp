@@ -0,0 +1,260 @@
+// StorageCipher against published vectors and against itself:
+//   - ChaCha20-Poly1305 sealing and opening of the RFC 8439 section 2.8.2
+//     example
+//   - HMAC-SHA256 (RFC 4231) and PBKDF2-HMAC-SHA256 (RFC 7914 and the
+//     common "password"/"salt" vectors)
+//   - the SSE2 key stream (four blocks at a time) against the one-block
+//     code, for every length up to 1100 bytes
+//   - Open rejecting every modified byte, truncated data, other associated
+//     data and another key, and a passphrase key file reopening
+//
+//     storage_cipher_test
+//
+// Built a second time with STORAGE_CIPHER_PORTABLE as
+// storage_cipher_portable_test, so the portable code passes the same
+// vectors. Works in a new directory below the current one and removes it at
+// the end. Exits with 1 on the first failure.
+
+// The internals live in an anonymous namespace
+#include "StorageCipher.cpp"
+#include <cstdlib>
+#include <sys/stat.h>
+
+namespace {
+    const size_t MAX_AGREEMENT_BYTES = 1100;   // Four SSE2 rounds plus every tail length
+
+    bool Fail(const char* message) {
+        fprintf(stderr, "FAIL: %s\n", message);
+        return false;
+    }
+
+    std::string FromHex(const char* hex) {
+        std::string bytes;
+        for (; hex[0] && hex[1]; hex += 2) {
+            char pair[3] = { hex[0], hex[1], 0 };
+            bytes += (char)strtoul(pair, NULL, 16);
+        }
+        return bytes;
+    }
+
+    std::string ToHex(const unsigned char* data, size_t size) {
+        static const char DIGITS[] = "0123456789abcdef";
+        std::string hex;
+        for (size_t i = 0; i < size; ++i) {
+            hex += DIGITS[data[i] >> 4];
+            hex += DIGITS[data[i] & 15];
+        }
+        return hex;
+    }
+
+    // Deterministic, so runs are comparable
+    uint32_t NextRandom(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    bool TestAeadVector() {
+        std::string key = FromHex("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f");
+        std::string nonce = FromHex("070000004041424344454647");
+        std::string associated = FromHex("50515253c0c1c2c3c4c5c6c7");
+        std::string plaintext = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for "
+                                "the future, sunscreen would be it.";
+        std::string expected = nonce + FromHex(
+            "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d63dbea45e8ca9671282fafb69da92728b"
+            "1a71de0a9e060b2905d6a5b67ecd3b3692ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+            "3ff4def08e4b7a9de576d26586cec64b6116") + FromHex("1ae10b594f09e26a7e902ecbd0600691");
+
+        std::string sealed;
+        SealWithNonce((const unsigned char*)key.data(), (const unsigned char*)nonce.data(), plaintext, associated, sealed);
+        if (sealed != expected) {
+            return Fail("the RFC 8439 2.8.2 example does not seal to its ciphertext and tag");
+        }
+        std::string opened;
+        if (!OpenWithKey((const unsigned char*)key.data(), expected, associated, opened) || opened != plaintext) {
+            return Fail("the RFC 8439 2.8.2 example does not open");
+        }
+        printf("RFC 8439 2.8.2 AEAD: ok\n");
+        return true;
+    }
+
+    bool TestHashVectors() {
+        struct HmacVector {
+            std::string key;
+            const char* data;
+            const char* mac;
+        };
+        // RFC 4231 test cases 2 and 6 (key longer than a block)
+        const HmacVector HMACS[] = {
+            { "Jefe", "what do ya want for nothing?",
+              "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843" },
+            { std::string(131, '\xaa'), "Test Using Larger Than Block-Size Key - Hash Key First",
+              "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54" },
+        };
+        for (const HmacVector& vector : HMACS) {
+            unsigned char mac[32];
+            HmacSha256(vector.key).Compute((const unsigned char*)vector.data, strlen(vector.data), mac);
+            if (ToHex(mac, sizeof(mac)) != vector.mac) {
+                return Fail("HMAC-SHA256 does not match RFC 4231");
+            }
+        }
+
+        struct Pbkdf2Vector {
+            const char* passphrase;
+            const char* salt;
+            uint32_t iterations;
+            const char* key;    // First 32 bytes of the derived key
+        };
+        const Pbkdf2Vector PBKDF2S[] = {
+            { "password", "salt", 1, "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b" },
+            { "password", "salt", 2, "ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43" },
+            { "password", "salt", 4096, "c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a" },
+            { "passwd", "salt", 1, "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc" },
+        };
+        for (const Pbkdf2Vector& vector : PBKDF2S) {
+            unsigned char key[32];
+            Pbkdf2Sha256(vector.passphrase, (const unsigned char*)vector.salt, strlen(vector.salt), vector.iterations, key);
+            if (ToHex(key, sizeof(key)) != vector.key) {
+                return Fail("PBKDF2-HMAC-SHA256 does not match its vector");
+            }
+        }
+        printf("HMAC-SHA256 and PBKDF2-HMAC-SHA256: ok\n");
+        return true;
+    }
+
+    // ChaChaXor (SSE2 for every 256 bytes) must give the key stream of one
+    // ChaChaBlock per 64 bytes, for any length and starting block
+    bool TestKeyStreamAgreement() {
+        uint32_t random = 24680;
+        unsigned char key[32];
+        unsigned char nonce[12];
+        for (unsigned char& byte : key) {
+            byte = (unsigned char)NextRandom(random);
+        }
+        for (unsigned char& byte : nonce) {
+            byte = (unsigned char)NextRandom(random);
+        }
+        std::vector<unsigned char> input(MAX_AGREEMENT_BYTES);
+        for (unsigned char& byte : input) {
+            byte = (unsigned char)NextRandom(random);
+        }
+        std::vector<unsigned char> fast(MAX_AGREEMENT_BYTES);
+        std::vector<unsigned char> reference(MAX_AGREEMENT_BYTES);
+        for (uint32_t counter : { 0u, 1u, 0xfffffffdu }) {
+            for (size_t size = 0; size <= MAX_AGREEMENT_BYTES; ++size) {
+                ChaChaState state;
+                ChaChaInit(state, key, counter, nonce);
+                ChaChaXor(state, input.data(), fast.data(), size);
+
+                ChaChaState one;
+                ChaChaInit(one, key, counter, nonce);
+                for (size_t done = 0; done < size; done += 64) {
+                    unsigned char block[64];
+                    ChaChaBlock(one, block);
+                    one.words[12]++;
+                    for (size_t i = done; i < size && i < done + 64; ++i) {
+                        reference[i] = input[i] ^ block[i - done];
+                    }
+                }
+                if (memcmp(fast.data(), reference.data(), size) != 0 || state.words[12] != one.words[12]) {
+                    return Fail("the key stream differs from the one-block code");
+                }
+            }
+        }
+        printf("%s key stream agrees with the one-block code\n", StorageCipher::GetImplementation());
+        return true;
+    }
+
+    bool TestRejection() {
+        StorageCipher cipher;
+        StorageCipher other;
+        if (!cipher.UseEphemeralKey() || !other.UseEphemeralKey()) {
+            return Fail("no random key");
+        }
+        uint32_t random = 97531;
+        for (size_t size : { (size_t)0, (size_t)1, (size_t)63, (size_t)64, (size_t)300, (size_t)1000 }) {
+            std::string plaintext;
+            for (size_t i = 0; i < size; ++i) {
+                plaintext += (char)NextRandom(random);
+            }
+            const std::string associated = "2026-03-01 10:00:00|Text";
+            std::string sealed = cipher.Seal(plaintext, associated);
+            std::string opened;
+            if (sealed.size() != plaintext.size() + StorageCipher::OVERHEAD ||
+                !cipher.Open(sealed, associated, opened) || opened != plaintext) {
+                return Fail("a sealed record does not open");
+            }
+            if (cipher.Seal(plaintext, associated).compare(0, StorageCipher::NONCE_BYTES, sealed, 0,
+                                                           StorageCipher::NONCE_BYTES) == 0) {
+                return Fail("two seals used the same nonce");
+            }
+            for (size_t i = 0; i < sealed.size(); ++i) {
+                std::string tampered = sealed;
+                tampered[i] ^= (char)(1 << (i % 8));
+                if (cipher.Open(tampered, associated, opened)) {
+                    return Fail("a modified byte was not detected");
+                }
+            }
+            if (cipher.Open(sealed.substr(0, sealed.size() - 1), associated, opened) ||
+                cipher.Open(sealed + '\0', associated, opened) ||
+                cipher.Open(sealed.substr(0, StorageCipher::OVERHEAD - 1), associated, opened)) {
+                return Fail("data of the wrong length opened");
+            }
+            if (cipher.Open(sealed, "2026-03-01 10:00:01|Text", opened) || cipher.Open(sealed, "", opened)) {
+                return Fail("other associated data opened");
+            }
+            if (other.Open(sealed, associated, opened)) {
+                return Fail("another key opened the data");
+            }
+        }
+        printf("modified data, wrong associated data and wrong keys: rejected\n");
+        return true;
+    }
+
+    bool TestPassphraseKeyFile(const std::string& directory) {
+        std::string keyPath = directory + "/history.key";
+        std::string passphrase = "correct horse battery staple";
+        StorageCipher::PassphraseCallback ask = [&](bool, std::string& answer) {
+            answer = passphrase;
+            return true;
+        };
+        std::string error;
+        StorageCipher created;
+        if (!created.Unlock(keyPath, StorageCipher::PROTECTION_PASSPHRASE, ask, error)) {
+            return Fail(("no key file: " + error).c_str());
+        }
+        std::string sealed = created.Seal("copied text", "associated");
+
+        StorageCipher reopened;
+        std::string opened;
+        if (!reopened.Unlock(keyPath, StorageCipher::PROTECTION_PASSPHRASE, ask, error) ||
+            !reopened.Open(sealed, "associated", opened) || opened != "copied text") {
+            return Fail("the key file does not reopen with its passphrase");
+        }
+        passphrase = "wrong horse battery staple";
+        StorageCipher refused;
+        bool unlocked = refused.Unlock(keyPath, StorageCipher::PROTECTION_PASSPHRASE, ask, error);
+        remove(keyPath.c_str());
+        if (unlocked || error != "wrong passphrase") {
+            return Fail("a wrong passphrase unlocked the key file");
+        }
+        printf("passphrase key file: reopens, wrong passphrase refused\n");
+        return true;
+    }
+}
+
+int main() {
+    char directory[] = "storage_cipher_test.XXXXXX";
+    if (!mkdtemp(directory)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    bool ok = TestAeadVector();
+    ok = ok && TestHashVectors();
+    ok = ok && TestKeyStreamAgreement();
+    ok = ok && TestRejection();
+    ok = ok && TestPassphraseKeyFile(directory);
+    rmdir(directory);
+    return ok ? 0 : 1;
+}
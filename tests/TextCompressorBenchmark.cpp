@@ -0,0 +1,285 @@
+// History compression: file size and load time of 1000 entries of source
+// code, logs, JSON, prose and short clips, stored raw and stored the way the
+// manager stores them (lz= for text of at least 128 bytes that shrinks).
+//
+//     text_compressor_benchmark [--repeat <n>]
+//
+// Load time is parsing every line plus, for compressed entries, decoding the
+// 512-byte preview, as LoadFromFile does. Also prints the compression ratio
+// per kind of content and the compression and full decoding throughput.
+// Exits with 1 if an entry does not decode to its original text.
+
+#include "HistoryRecord.h"
+#include "TextCompressor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+    const size_t ENTRY_COUNT = 1000;
+    const size_t MIN_COMPRESSED_BYTES = 128;    // Default of CompressionMinBytes
+    const size_t PREVIEW_BYTES = 512;
+
+    enum Kind { KIND_SOURCE, KIND_LOG, KIND_JSON, KIND_PROSE, KIND_SHORT, KIND_COUNT };
+    const char* KIND_NAMES[KIND_COUNT] = { "source", "log", "json", "prose", "short" };
+
+    struct Entry {
+        Kind kind;
+        std::string text;
+    };
+
+    // Deterministic, so runs are comparable
+    uint32_t NextRandom(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    std::string MakeSource(uint32_t& state) {
+        static const char* LINES[] = {
+            "    for (size_t i = 0; i < entries.size(); ++i) {\n",
+            "        if (entries[i].id == id) {\n",
+            "            return (int)i;\n",
+            "        }\n",
+            "    }\n",
+            "    wxLogMessage(wxT(\"Loaded %lu entries\"), (unsigned long)m_entries.size());\n",
+            "    std::string line = FormatHistoryRecord(record);\n",
+            "    // Only the preview is decoded while loading\n",
+            "    config.Read(wxT(\"/Storage/Encryption\"), &m_settings.encryption, wxT(\"none\"));\n",
+            "def parse_args(argv):\n",
+            "    parser = argparse.ArgumentParser(description=\"Convert the export\")\n",
+            "    return parser.parse_args(argv)\n",
+            "const result = await fetch(`${baseUrl}/api/v1/items?page=${page}`);\n",
+        };
+        std::string text;
+        size_t lines = 40 + NextRandom(state) % 160;
+        for (size_t i = 0; i < lines; ++i) {
+            text += LINES[NextRandom(state) % (sizeof(LINES) / sizeof(LINES[0]))];
+        }
+        return text;
+    }
+
+    std::string MakeLog(uint32_t& state) {
+        static const char* LEVELS[] = { "INFO", "DEBUG", "WARN", "ERROR" };
+        static const char* MESSAGES[] = {
+            "connection established to db-primary:5432",
+            "request completed status=200 duration_ms=",
+            "cache miss for key user:session:",
+            "retrying upstream call attempt=",
+            "worker started pid=",
+        };
+        std::string text;
+        size_t lines = 30 + NextRandom(state) % 120;
+        for (size_t i = 0; i < lines; ++i) {
+            char line[160];
+            snprintf(line, sizeof(line), "2026-03-%02u 10:%02u:%02u.%03u [%s] %s%u\n", 1 + NextRandom(state) % 28,
+                     NextRandom(state) % 60, NextRandom(state) % 60, NextRandom(state) % 1000,
+                     LEVELS[NextRandom(state) % 4], MESSAGES[NextRandom(state) % 5], NextRandom(state) % 100000);
+            text += line;
+        }
+        return text;
+    }
+
+    std::string MakeJson(uint32_t& state) {
+        std::string text = "{\n  \"items\": [\n";
+        size_t items = 10 + NextRandom(state) % 60;
+        for (size_t i = 0; i < items; ++i) {
+            char item[200];
+            snprintf(item, sizeof(item),
+                     "    {\"id\": %u, \"name\": \"item-%u\", \"enabled\": %s, \"tags\": [\"a\", \"b\"], \"score\": %u.%u}%s\n",
+                     NextRandom(state) % 100000, NextRandom(state) % 1000, NextRandom(state) % 2 ? "true" : "false",
+                     NextRandom(state) % 100, NextRandom(state) % 100, i + 1 < items ? "," : "");
+            text += item;
+        }
+        text += "  ],\n  \"total\": " + std::to_string(items) + "\n}\n";
+        return text;
+    }
+
+    std::string MakeProse(uint32_t& state, size_t words) {
+        static const char* WORDS[] = {
+            "the", "clipboard", "manager", "keeps", "a", "history", "of", "everything", "you", "copy",
+            "and", "lets", "restore", "it", "later", "meeting", "notes", "from", "Tuesday", "were",
+            "shared", "with", "team", "please", "review", "draft", "before", "Friday", "we", "shipped",
+        };
+        std::string text;
+        for (size_t i = 0; i < words; ++i) {
+            text += WORDS[NextRandom(state) % (sizeof(WORDS) / sizeof(WORDS[0]))];
+            text += (i + 1) % 12 == 0 ? ". " : " ";
+        }
+        return text;
+    }
+
+    std::string MakeShort(uint32_t& state) {
+        static const char* CLIPS[] = {
+            "https://github.com/example/project/pull/",
+            "docker run -it --rm -v $(pwd):/work ubuntu:24.04 bash # ",
+            "git log --oneline --graph --decorate -n ",
+            "SELECT id, name FROM users WHERE created_at > NOW() - INTERVAL '7 days' LIMIT ",
+        };
+        std::string text = CLIPS[NextRandom(state) % 4] + std::to_string(NextRandom(state) % 10000);
+        if (NextRandom(state) % 2) {
+            text += " " + MakeProse(state, 10 + NextRandom(state) % 30);
+        }
+        return text;
+    }
+
+    std::vector<Entry> MakeEntries() {
+        uint32_t state = 13579;
+        std::vector<Entry> entries;
+        for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+            Entry entry;
+            entry.kind = (Kind)(NextRandom(state) % KIND_COUNT);
+            switch (entry.kind) {
+                case KIND_SOURCE: entry.text = MakeSource(state); break;
+                case KIND_LOG: entry.text = MakeLog(state); break;
+                case KIND_JSON: entry.text = MakeJson(state); break;
+                case KIND_PROSE: entry.text = MakeProse(state, 50 + NextRandom(state) % 250); break;
+                default: entry.text = MakeShort(state); break;
+            }
+            entries.push_back(entry);
+        }
+        return entries;
+    }
+
+    HistoryRecord MakeRecord(const Entry& entry, size_t index) {
+        HistoryRecord record;
+        char timestamp[32];
+        snprintf(timestamp, sizeof(timestamp), "2026-03-01 %02u:%02u:%02u", (unsigned)(index / 3600 % 24),
+                 (unsigned)(index / 60 % 60), (unsigned)(index % 60));
+        record.timestamp = timestamp;
+        record.type = "Text";
+        record.content = entry.text;
+        return record;
+    }
+
+    // Parses every line; compressed content is decoded up to the preview
+    bool Load(const std::string& file, size_t& decodedBytes) {
+        decodedBytes = 0;
+        size_t start = 0;
+        while (start < file.size()) {
+            size_t end = file.find('\n', start);
+            if (end == std::string::npos) {
+                end = file.size();
+            }
+            HistoryRecord record;
+            if (!ParseHistoryRecord(file.substr(start, end - start), record)) {
+                return false;
+            }
+            if (const std::string* compression = record.FindAttribute("lz")) {
+                CompressedText compressed;
+                compressed.data = record.content;
+                compressed.dictionary = atoi(compression->c_str());
+                size_t separator = compression->find(':');
+                compressed.size = separator != std::string::npos ? strtoul(compression->c_str() + separator + 1, NULL, 10) : 0;
+                std::string preview;
+                if (!TextCompressor::Decompress(compressed, preview, PREVIEW_BYTES + 4)) {
+                    return false;
+                }
+                decodedBytes += preview.size();
+            } else {
+                decodedBytes += record.content.size();
+            }
+            start = end + 1;
+        }
+        return true;
+    }
+
+    template <typename Function>
+    double BestMs(int repeat, Function function) {
+        double best = 1e30;
+        for (int i = 0; i < repeat; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            function();
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv) {
+    int repeat = 20;
+    if (argc == 3 && strcmp(argv[1], "--repeat") == 0) {
+        repeat = std::max(atoi(argv[2]), 1);
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: text_compressor_benchmark [--repeat <n>]\n");
+        return 2;
+    }
+
+    std::vector<Entry> entries = MakeEntries();
+    std::vector<CompressedText> compressed(entries.size());
+    std::vector<bool> isCompressed(entries.size());
+    size_t kindRaw[KIND_COUNT] = {0};
+    size_t kindStored[KIND_COUNT] = {0};
+    size_t textBytes = 0;
+    size_t compressedTextBytes = 0;
+    std::string rawFile;
+    std::string compressedFile;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const Entry& entry = entries[i];
+        HistoryRecord record = MakeRecord(entry, i);
+        rawFile += FormatHistoryRecord(record) + "\n";
+        isCompressed[i] = entry.text.size() >= MIN_COMPRESSED_BYTES && TextCompressor::Compress(entry.text, compressed[i]);
+        if (isCompressed[i]) {
+            record.content = compressed[i].data;
+            record.AddAttribute("lz", std::to_string(compressed[i].dictionary) + ":" + std::to_string(compressed[i].size));
+        }
+        compressedFile += FormatHistoryRecord(record) + "\n";
+        kindRaw[entry.kind] += entry.text.size();
+        kindStored[entry.kind] += isCompressed[i] ? compressed[i].data.size() : entry.text.size();
+        textBytes += entry.text.size();
+        compressedTextBytes += isCompressed[i] ? entry.text.size() : 0;
+    }
+
+    // Every compressed entry must decode to its text, in full and as a preview
+    for (size_t i = 0; i < entries.size(); ++i) {
+        std::string text;
+        std::string preview;
+        if (isCompressed[i] && (!TextCompressor::Decompress(compressed[i], text) || text != entries[i].text ||
+                                !TextCompressor::Decompress(compressed[i], preview, PREVIEW_BYTES) ||
+                                entries[i].text.compare(0, preview.size(), preview) != 0)) {
+            fprintf(stderr, "entry %lu does not decode to its text\n", (unsigned long)i);
+            return 1;
+        }
+    }
+
+    printf("%-8s %10s %10s %7s\n", "content", "bytes", "stored", "ratio");
+    for (int kind = 0; kind < KIND_COUNT; ++kind) {
+        printf("%-8s %10lu %10lu %6.1f%%\n", KIND_NAMES[kind], (unsigned long)kindRaw[kind],
+               (unsigned long)kindStored[kind], 100.0 * kindStored[kind] / std::max<size_t>(kindRaw[kind], 1));
+    }
+    printf("file     %10lu %10lu %6.1f%%\n", (unsigned long)rawFile.size(), (unsigned long)compressedFile.size(),
+           100.0 * compressedFile.size() / rawFile.size());
+
+    size_t decodedBytes = 0;
+    bool loaded = true;
+    double rawLoadMs = BestMs(repeat, [&]() { loaded = Load(rawFile, decodedBytes) && loaded; });
+    double compressedLoadMs = BestMs(repeat, [&]() { loaded = Load(compressedFile, decodedBytes) && loaded; });
+    if (!loaded) {
+        fprintf(stderr, "a history line does not load\n");
+        return 1;
+    }
+    printf("load     raw %.2f ms, compressed %.2f ms\n", rawLoadMs, compressedLoadMs);
+
+    double compressMs = BestMs(repeat, [&]() {
+        for (const Entry& entry : entries) {
+            CompressedText result;
+            TextCompressor::Compress(entry.text, result);
+        }
+    });
+    double decompressMs = BestMs(repeat, [&]() {
+        for (size_t i = 0; i < entries.size(); ++i) {
+            std::string text;
+            if (isCompressed[i]) {
+                TextCompressor::Decompress(compressed[i], text);
+            }
+        }
+    });
+    printf("compress %.0f MB/s, decompress %.0f MB/s (full text)\n", textBytes / 1048576.0 / compressMs * 1000,
+           compressedTextBytes / 1048576.0 / decompressMs * 1000);
+    return 0;
+}